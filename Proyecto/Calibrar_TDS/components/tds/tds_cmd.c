@@ -0,0 +1,104 @@
+#include "tds_cmd.h"
+#include "tds.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int cmd_cal_a(int argc, char **argv, char *reply, size_t len)
+{
+    float raw = tds_read_raw();
+    tds_set_calibration_point_A(raw);
+    snprintf(reply, len, "CAL_A raw=%.2f offset=%.6f (RAM)", raw, tds_get_offset());
+    return 0;
+}
+
+static int cmd_cal_b(int argc, char **argv, char *reply, size_t len)
+{
+    float raw = tds_read_raw();
+    tds_set_calibration_point_B(raw);
+    snprintf(reply, len, "CAL_B raw=%.2f gain=%.9f (RAM)", raw, tds_get_gain());
+    return 0;
+}
+
+static int cmd_cal_point(int argc, char **argv, char *reply, size_t len)
+{
+    if (argc < 2) {
+        snprintf(reply, len, "usage: calp <ppm>");
+        return -1;
+    }
+    float ppm = strtof(argv[1], NULL);
+    float raw = tds_read_raw();
+    int n = tds_curve_add(raw, ppm);
+    if (n <= 0) {
+        snprintf(reply, len, "curve point rejected (out of range or curve full)");
+        return -1;
+    }
+    snprintf(reply, len, "curve point %d: raw=%.0f ppm=%.0f (RAM)", n, raw, ppm);
+    return 0;
+}
+
+static int cmd_curve(int argc, char **argv, char *reply, size_t len)
+{
+    const tds_curve_t *c = tds_get_curve();
+    size_t n = (size_t)snprintf(reply, len, "curve: %u points, coef=%.4f/C, temp=%.1f C%s",
+                                c->count, c->temp_coef_e4 / 10000.0f, tds_get_water_temp(),
+                                c->count < 2 ? " (using offset/gain)" : "");
+    for (int i = 0; i < c->count && n < len; i++) {
+        n += (size_t)snprintf(reply + n, len - n, " | %u:%u", c->points[i].raw, c->points[i].ppm);
+    }
+    return 0;
+}
+
+static int cmd_clear(int argc, char **argv, char *reply, size_t len)
+{
+    tds_curve_clear();
+    snprintf(reply, len, "curve cleared in RAM (run save to persist)");
+    return 0;
+}
+
+static int cmd_temp(int argc, char **argv, char *reply, size_t len)
+{
+    if (argc >= 2) {
+        tds_set_water_temp(strtof(argv[1], NULL));
+    }
+    snprintf(reply, len, "water temp %.1f C", tds_get_water_temp());
+    return 0;
+}
+
+static int cmd_save(int argc, char **argv, char *reply, size_t len)
+{
+    esp_err_t r = tds_save_calibration();
+    snprintf(reply, len, "SAVE %s offset=%.6f gain=%.9f", r == ESP_OK ? "OK" : "ERR",
+             tds_get_offset(), tds_get_gain());
+    return r == ESP_OK ? 0 : -1;
+}
+
+static int cmd_load(int argc, char **argv, char *reply, size_t len)
+{
+    esp_err_t r = tds_load_calibration();
+    snprintf(reply, len, "LOAD %s offset=%.6f gain=%.9f", r == ESP_OK ? "OK" : "DEF",
+             tds_get_offset(), tds_get_gain());
+    return 0;
+}
+
+static int cmd_show(int argc, char **argv, char *reply, size_t len)
+{
+    const tds_curve_t *c = tds_get_curve();
+    snprintf(reply, len, "offset=%.6f gain=%.9f | curve %u points%s | temp=%.1f C",
+             tds_get_offset(), tds_get_gain(), c->count,
+             c->count < 2 ? " (using offset/gain)" : "", tds_get_water_temp());
+    return 0;
+}
+
+const cmd_def_t tds_cmd_table[] = {
+    { "calA",  "calibrate point A (offset) with the current reading", cmd_cal_a },
+    { "calB",  "calibrate point B (gain) with the current reading",   cmd_cal_b },
+    { "calp",  "calp <ppm>: add a curve point in a reference solution", cmd_cal_point },
+    { "curve", "list the calibration curve",                          cmd_curve },
+    { "clear", "clear the calibration curve (RAM)",                   cmd_clear },
+    { "temp",  "temp [C]: show/set the water temperature",            cmd_temp },
+    { "save",  "persist the calibration in NVS",                      cmd_save },
+    { "load",  "reload the calibration from NVS",                     cmd_load },
+    { "show",  "show offset, gain and curve",                         cmd_show },
+};
+const size_t tds_cmd_table_len = sizeof(tds_cmd_table) / sizeof(tds_cmd_table[0]);
@@ -0,0 +1,15 @@
+#pragma once
+#include <stddef.h>
+#include "cmd_bus.h"
+
+/*
+ * TDS calibration commands for the command bus, shared by every project
+ * that uses this component:
+ *   calA, calB       two-point calibration with the current reading
+ *   calp <ppm>       add a curve point (probe in a reference solution)
+ *   curve, clear     list / drop the curve points (RAM)
+ *   temp <C>         water temperature used for compensation
+ *   save, load, show persist / reload / print the calibration
+ */
+extern const cmd_def_t tds_cmd_table[];
+extern const size_t tds_cmd_table_len;
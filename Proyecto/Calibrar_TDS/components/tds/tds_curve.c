@@ -0,0 +1,107 @@
+#include "tds_curve.h"
+
+#include <string.h>
+
+#define TDS_LUT_STEP (1u << TDS_LUT_SHIFT)
+
+void tds_curve_init(tds_curve_t *curve)
+{
+    memset(curve, 0, sizeof(*curve));
+    curve->version = TDS_CURVE_VERSION;
+    curve->temp_coef_e4 = TDS_TEMP_COEF_DEFAULT_E4;
+}
+
+int tds_curve_add_point(tds_curve_t *curve, uint16_t raw, uint16_t ppm)
+{
+    int i = 0;
+    while (i < curve->count && curve->points[i].raw < raw) {
+        i++;
+    }
+    if (i < curve->count && curve->points[i].raw == raw) {
+        curve->points[i].ppm = ppm;
+        return curve->count;
+    }
+    if (curve->count >= TDS_CURVE_MAX_POINTS) {
+        return -1;
+    }
+    memmove(&curve->points[i + 1], &curve->points[i],
+            (size_t)(curve->count - i) * sizeof(tds_cal_point_t));
+    curve->points[i].raw = raw;
+    curve->points[i].ppm = ppm;
+    curve->count++;
+    return curve->count;
+}
+
+int tds_curve_is_valid(const tds_curve_t *curve)
+{
+    return curve->version == TDS_CURVE_VERSION &&
+           curve->count >= 2 && curve->count <= TDS_CURVE_MAX_POINTS;
+}
+
+// Line through a and b evaluated at x, clamped at 0
+static uint32_t lerp_points(const tds_cal_point_t *a, const tds_cal_point_t *b, uint32_t x)
+{
+    int64_t dx = (int64_t)b->raw - a->raw;
+    if (dx == 0) {
+        return a->ppm;
+    }
+    int64_t y = a->ppm + ((int64_t)x - a->raw) * ((int64_t)b->ppm - a->ppm) / dx;
+    return y < 0 ? 0 : (uint32_t)y;
+}
+
+uint32_t tds_curve_eval(const tds_curve_t *curve, uint32_t raw)
+{
+    if (curve->count == 0) {
+        return 0;
+    }
+    if (curve->count == 1) {
+        const tds_cal_point_t origin = { 0, 0 };
+        return lerp_points(&origin, &curve->points[0], raw);
+    }
+
+    // Segment containing raw; the end segments extrapolate
+    int seg = 0;
+    while (seg < curve->count - 2 && raw > curve->points[seg + 1].raw) {
+        seg++;
+    }
+    return lerp_points(&curve->points[seg], &curve->points[seg + 1], raw);
+}
+
+void tds_temp_table_build(uint16_t temp_coef_e4, uint32_t table_q16[TDS_TEMP_TABLE_SIZE])
+{
+    for (int i = 0; i < TDS_TEMP_TABLE_SIZE; i++) {
+        int32_t dt = (TDS_TEMP_MIN_C + i) - TDS_TEMP_REF_C;
+        int32_t denom_e4 = 10000 + (int32_t)temp_coef_e4 * dt;
+        if (denom_e4 < 1000) denom_e4 = 1000;   // keep the factor bounded (<= 10x)
+        table_q16[i] = (uint32_t)(((uint64_t)10000 << 16) / (uint32_t)denom_e4);
+    }
+}
+
+uint32_t tds_temp_lookup_q16(const uint32_t table_q16[TDS_TEMP_TABLE_SIZE], float temp_c)
+{
+    int t = (int)(temp_c + (temp_c >= 0 ? 0.5f : -0.5f));
+    if (t < TDS_TEMP_MIN_C) t = TDS_TEMP_MIN_C;
+    if (t > TDS_TEMP_MAX_C) t = TDS_TEMP_MAX_C;
+    return table_q16[t - TDS_TEMP_MIN_C];
+}
+
+void tds_lut_build(const tds_curve_t *curve, uint32_t comp_q16, tds_lut_t *lut)
+{
+    for (uint32_t i = 0; i < TDS_LUT_SIZE; i++) {
+        uint64_t ppm = tds_curve_eval(curve, i * TDS_LUT_STEP);
+        lut->ppm[i] = (uint32_t)((ppm * comp_q16 + 0x8000) >> 16);
+    }
+}
+
+uint32_t tds_lut_lookup(const tds_lut_t *lut, uint32_t raw)
+{
+    if (raw > TDS_ADC_MAX_RAW) raw = TDS_ADC_MAX_RAW;
+    uint32_t idx = raw >> TDS_LUT_SHIFT;
+    uint32_t frac = raw & (TDS_LUT_STEP - 1);
+    uint32_t y0 = lut->ppm[idx];
+    uint32_t y1 = lut->ppm[idx + 1];
+    if (y1 >= y0) {
+        return y0 + (uint32_t)(((uint64_t)(y1 - y0) * frac) >> TDS_LUT_SHIFT);
+    }
+    return y0 - (uint32_t)(((uint64_t)(y0 - y1) * frac) >> TDS_LUT_SHIFT);
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -7,6 +8,8 @@
 #include "adc_driver.h"
 #include "tds.h"
 #include "storage.h"
+#include "cmd_bus.h"
+#include "tds_cmd.h"
 
 static const char *TAG = "main";
 
@@ -20,35 +23,24 @@ static void tds_task(void *arg)
     }
 }
 
+static void console_reply(uint32_t tag, int status, const char *reply, void *ctx)
+{
+    printf("%s%s\n", status == 0 ? "" : "ERR ", reply);
+}
+
 static void console_task(void *arg)
 {
-    // Simple stdin console. Typing commands followed by Enter.
+    // Simple stdin console. Typing commands followed by Enter; parsing and
+    // execution happen in the command bus worker (see tds_cmd.h, "help").
     char line[64];
     while (1) {
         if (fgets(line, sizeof(line), stdin) == NULL) {
             vTaskDelay(pdMS_TO_TICKS(200));
             continue;
         }
-        // strip newline
-        char *nl = strchr(line, '\n'); if (nl) *nl = '\0';
-
-        if (strcmp(line, "calA") == 0) {
-            float raw = tds_read_raw();
-            tds_set_calibration_point_A(raw);
-            printf("Calibration A saved in RAM: %f\n", raw);
-        } else if (strcmp(line, "calB") == 0) {
-            float raw = tds_read_raw();
-            tds_set_calibration_point_B(raw);
-            printf("Calibration B set in RAM: %f\n", raw);
-        } else if (strcmp(line, "save") == 0) {
-            if (tds_save_calibration() == ESP_OK) printf("Calibration persisted\n");
-            else printf("Failed to save calibration\n");
-        } else if (strcmp(line, "show") == 0) {
-            printf("offset=%f gain=%f\n", tds_get_offset(), tds_get_gain());
-        } else if (strlen(line) == 0) {
-            // ignore empty
-        } else {
-            printf("Commands: calA, calB, save, show\n");
+        size_t len = strlen(line);
+        if (cmd_bus_post(CMD_SRC_CONSOLE, 0, line, len) == ESP_ERR_TIMEOUT) {
+            printf("busy\n");
         }
     }
 }
@@ -71,6 +63,11 @@ void app_main(void)
     // Init TDS
     tds_init();
 
+    // Command bus: TDS calibration commands from the console
+    cmd_bus_register(tds_cmd_table, tds_cmd_table_len);
+    cmd_bus_set_reply(CMD_SRC_CONSOLE, console_reply, NULL);
+    cmd_bus_start(5);
+
     // Create tasks
     xTaskCreate(tds_task, "tds_task", 4096, NULL, 5, NULL);
     xTaskCreate(console_task, "console_task", 4096, NULL, 5, NULL);
@@ -0,0 +1,117 @@
+#include "cbor_writer.h"
+
+#include <string.h>
+
+// Tipos mayores de CBOR (3 bits altos del byte inicial)
+#define CBOR_MAJOR_UINT   0
+#define CBOR_MAJOR_NINT   1
+#define CBOR_MAJOR_TEXT   3
+#define CBOR_MAJOR_ARRAY  4
+#define CBOR_MAJOR_MAP    5
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_FALSE   0xF4
+#define CBOR_TRUE    0xF5
+#define CBOR_FLOAT32 0xFA
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t cap)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = false;
+}
+
+static bool reserve(cbor_writer_t *w, size_t n)
+{
+    if (w->overflow || w->cap - w->len < n) {
+        w->overflow = true;
+        return false;
+    }
+    return true;
+}
+
+// Cabecera: tipo mayor + argumento con la codificación más corta
+static void put_head(cbor_writer_t *w, uint8_t major, uint64_t arg)
+{
+    uint8_t ib = (uint8_t)(major << 5);
+    if (arg < 24) {
+        if (!reserve(w, 1)) return;
+        w->buf[w->len++] = ib | (uint8_t)arg;
+    } else if (arg <= 0xFF) {
+        if (!reserve(w, 2)) return;
+        w->buf[w->len++] = ib | 24;
+        w->buf[w->len++] = (uint8_t)arg;
+    } else if (arg <= 0xFFFF) {
+        if (!reserve(w, 3)) return;
+        w->buf[w->len++] = ib | 25;
+        w->buf[w->len++] = (uint8_t)(arg >> 8);
+        w->buf[w->len++] = (uint8_t)arg;
+    } else if (arg <= 0xFFFFFFFFu) {
+        if (!reserve(w, 5)) return;
+        w->buf[w->len++] = ib | 26;
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            w->buf[w->len++] = (uint8_t)(arg >> shift);
+        }
+    } else {
+        if (!reserve(w, 9)) return;
+        w->buf[w->len++] = ib | 27;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            w->buf[w->len++] = (uint8_t)(arg >> shift);
+        }
+    }
+}
+
+void cbor_put_uint(cbor_writer_t *w, uint64_t value)
+{
+    put_head(w, CBOR_MAJOR_UINT, value);
+}
+
+void cbor_put_int(cbor_writer_t *w, int64_t value)
+{
+    if (value >= 0) {
+        put_head(w, CBOR_MAJOR_UINT, (uint64_t)value);
+    } else {
+        put_head(w, CBOR_MAJOR_NINT, (uint64_t)(-1 - value));
+    }
+}
+
+void cbor_put_float(cbor_writer_t *w, float value)
+{
+    if (!reserve(w, 5)) return;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    w->buf[w->len++] = CBOR_FLOAT32;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        w->buf[w->len++] = (uint8_t)(bits >> shift);
+    }
+}
+
+void cbor_put_bool(cbor_writer_t *w, bool value)
+{
+    if (!reserve(w, 1)) return;
+    w->buf[w->len++] = value ? CBOR_TRUE : CBOR_FALSE;
+}
+
+void cbor_put_text(cbor_writer_t *w, const char *text, size_t len)
+{
+    put_head(w, CBOR_MAJOR_TEXT, len);
+    if (!reserve(w, len)) return;
+    memcpy(&w->buf[w->len], text, len);
+    w->len += len;
+}
+
+void cbor_put_map(cbor_writer_t *w, size_t pairs)
+{
+    put_head(w, CBOR_MAJOR_MAP, pairs);
+}
+
+void cbor_put_array(cbor_writer_t *w, size_t items)
+{
+    put_head(w, CBOR_MAJOR_ARRAY, items);
+}
+
+int cbor_writer_finish(const cbor_writer_t *w)
+{
+    return w->overflow ? -1 : (int)w->len;
+}
@@ -0,0 +1,39 @@
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Escritor CBOR mínimo (RFC 8949) sobre un buffer del llamador.
+ *
+ * Sin memoria dinámica: si el buffer se llena, el escritor queda en estado
+ * de overflow, las escrituras siguientes se ignoran y cbor_writer_finish()
+ * devuelve -1. Solo cubre lo que usa la telemetría: enteros, float32,
+ * booleanos, texto y cabeceras de map/array.
+ */
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} cbor_writer_t;
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t cap);
+
+void cbor_put_uint(cbor_writer_t *w, uint64_t value);
+void cbor_put_int(cbor_writer_t *w, int64_t value);
+void cbor_put_float(cbor_writer_t *w, float value);
+void cbor_put_bool(cbor_writer_t *w, bool value);
+void cbor_put_text(cbor_writer_t *w, const char *text, size_t len);
+void cbor_put_map(cbor_writer_t *w, size_t pairs);
+void cbor_put_array(cbor_writer_t *w, size_t items);
+
+/**
+ * @brief Longitud codificada, o -1 si el buffer no alcanzó
+ */
+int cbor_writer_finish(const cbor_writer_t *w);
+
+#endif // CBOR_WRITER_H
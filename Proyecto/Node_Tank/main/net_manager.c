@@ -1,6 +1,7 @@
 #include "net_manager.h"
 
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "esp_wifi.h"
@@ -9,6 +10,8 @@
 #include "esp_netif_net_stack.h"
 #include "esp_netif.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "lwip/inet.h"
 #include "lwip/netdb.h"
 #include "lwip/sockets.h"
@@ -56,8 +59,176 @@ static const char *TAG_STA = "WiFi Sta";
 typedef struct {
     net_manager_context_t *ctx;
     int retry_count;
+    bool fast_attempt;      // connecting straight to the cached BSSID/channel
 } wifi_handler_ctx_t;
 
+/*
+ * Fast reconnect: BSSID, channel and DHCP lease of the last good upstream
+ * connection are kept in NVS. On boot the STA joins that AP directly
+ * (no all-channel scan). With CONFIG_NODE_TANK_WIFI_FAST_STATIC_IP the lease
+ * is also reused as a static address; once associated the DHCP client is
+ * restarted to revalidate it, and a different address drops the cache.
+ * The first failure drops the cache and falls back to the full scan + DHCP
+ * path.
+ */
+#define FAST_NVS_NAMESPACE "net_fast"
+#define FAST_NVS_KEY       "sta"
+#define FAST_CACHE_VERSION 1
+
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[33];
+    esp_netif_ip_info_t ip;
+    esp_ip4_addr_t dns;
+} net_fast_cache_t;
+
+static wifi_config_t s_sta_full_config;
+static int64_t s_connected_at_us;
+static bool s_connected_fast;
+static esp_timer_handle_t s_retry_timer;
+static bool s_mqtt_started;
+#if CONFIG_NODE_TANK_WIFI_FAST_STATIC_IP
+static esp_ip4_addr_t s_static_ip;      // reused address, not yet revalidated
+static esp_ip4_addr_t s_dhcp_check_ip;  // address the renewed lease must match
+#endif
+
+static bool fast_cache_load(net_fast_cache_t *cache)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*cache);
+    esp_err_t err = nvs_get_blob(nvs, FAST_NVS_KEY, cache, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(*cache) && cache->version == FAST_CACHE_VERSION &&
+           cache->channel != 0 && strncmp(cache->ssid, EXAMPLE_ESP_WIFI_STA_SSID, sizeof(cache->ssid)) == 0;
+}
+
+static void fast_cache_erase(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, FAST_NVS_KEY);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+static void fast_cache_update(net_manager_context_t *ctx, const esp_netif_ip_info_t *ip_info)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    net_fast_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.version = FAST_CACHE_VERSION;
+    cache.channel = ap.primary;
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    strncpy(cache.ssid, EXAMPLE_ESP_WIFI_STA_SSID, sizeof(cache.ssid) - 1);
+    cache.ip = *ip_info;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(ctx->netif_sta, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        cache.dns = dns.ip.u_addr.ip4;
+    }
+
+    // Skip the flash write when nothing changed (the common case)
+    net_fast_cache_t old;
+    if (fast_cache_load(&old) && memcmp(&old, &cache, sizeof(old)) == 0) {
+        return;
+    }
+    nvs_handle_t nvs;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (nvs_set_blob(nvs, FAST_NVS_KEY, &cache, sizeof(cache)) == ESP_OK) {
+            nvs_commit(nvs);
+            ESP_LOGI(TAG_STA, "Fast reconnect cache updated (channel %d)", cache.channel);
+        }
+        nvs_close(nvs);
+    }
+}
+
+static bool fast_path_setup(net_manager_context_t *ctx)
+{
+    net_fast_cache_t cache;
+    if (!fast_cache_load(&cache)) {
+        return false;
+    }
+    wifi_config_t cfg = s_sta_full_config;
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, cache.bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = cache.channel;
+    cfg.sta.scan_method = WIFI_FAST_SCAN;
+    cfg.sta.failure_retry_cnt = 1;
+    if (esp_wifi_set_config(WIFI_IF_STA, &cfg) != ESP_OK) {
+        return false;
+    }
+#if CONFIG_NODE_TANK_WIFI_FAST_STATIC_IP
+    esp_netif_dhcpc_stop(ctx->netif_sta);
+    if (esp_netif_set_ip_info(ctx->netif_sta, &cache.ip) != ESP_OK) {
+        esp_netif_dhcpc_start(ctx->netif_sta);
+    } else {
+        s_static_ip = cache.ip.ip;
+        if (cache.dns.addr != 0) {
+            esp_netif_dns_info_t dns = { 0 };
+            dns.ip.type = ESP_IPADDR_TYPE_V4;
+            dns.ip.u_addr.ip4 = cache.dns;
+            esp_netif_set_dns_info(ctx->netif_sta, ESP_NETIF_DNS_MAIN, &dns);
+        }
+    }
+#else
+    (void)ctx;
+#endif
+    ESP_LOGI(TAG_STA, "Fast reconnect: channel %d, BSSID " MACSTR ", IP " IPSTR,
+             cache.channel, MAC2STR(cache.bssid), IP2STR(&cache.ip.ip));
+    return true;
+}
+
+static void fast_path_fallback(net_manager_context_t *ctx)
+{
+    ESP_LOGW(TAG_STA, "Fast reconnect failed, falling back to full scan + DHCP");
+#if CONFIG_NODE_TANK_WIFI_FAST_STATIC_IP
+    s_static_ip.addr = 0;
+#endif
+    fast_cache_erase();
+    esp_wifi_set_config(WIFI_IF_STA, &s_sta_full_config);
+    esp_netif_dhcpc_start(ctx->netif_sta);
+    esp_wifi_connect();
+}
+
+/*
+ * Decides whether a GOT_IP may refresh the cache. The first GOT_IP on a
+ * reused static address restarts the DHCP client (which raises a second
+ * GOT_IP with the renewed lease); if that lease differs, the cache goes.
+ */
+static bool fast_cache_accept(net_manager_context_t *ctx, const esp_netif_ip_info_t *ip_info)
+{
+#if CONFIG_NODE_TANK_WIFI_FAST_STATIC_IP
+    if (s_static_ip.addr != 0) {
+        s_dhcp_check_ip = s_static_ip;
+        s_static_ip.addr = 0;
+        ESP_LOGI(TAG_STA, "Revalidating reused address over DHCP");
+        esp_netif_dhcpc_start(ctx->netif_sta);
+        return false;
+    }
+    if (s_dhcp_check_ip.addr != 0) {
+        bool same = ip_info->ip.addr == s_dhcp_check_ip.addr;
+        s_dhcp_check_ip.addr = 0;
+        if (!same) {
+            ESP_LOGW(TAG_STA, "DHCP handed out a different address, dropping fast reconnect cache");
+            fast_cache_erase();
+            return false;
+        }
+    }
+#else
+    (void)ctx;
+    (void)ip_info;
+#endif
+    return true;
+}
+
 static void softap_set_dns_addr(net_manager_context_t *ctx)
 {
     esp_netif_dns_info_t dns;
@@ -69,6 +240,36 @@ static void softap_set_dns_addr(net_manager_context_t *ctx)
     ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_dhcps_start(ctx->netif_ap));
 }
 
+/* Runs on the first upstream IP and after every reconnect */
+static void uplink_up(net_manager_context_t *ctx)
+{
+    softap_set_dns_addr(ctx);
+    esp_netif_set_default_netif(ctx->netif_sta);
+
+    if (s_mqtt_started) {
+        return;  // the client reconnects on its own
+    }
+#if IP_NAPT
+    if (esp_netif_napt_enable(ctx->netif_ap) != ESP_OK) {
+        ESP_LOGE(TAG_STA, "NAPT not enabled on the netif: %p", ctx->netif_ap);
+    }
+#else
+    ESP_LOGW(TAG_STA, "IP_NAPT disabled, skipping NAPT setup");
+#endif
+    if (ctx->mqtt_client && esp_mqtt_client_start(ctx->mqtt_client) == ESP_OK) {
+        s_mqtt_started = true;
+    }
+}
+
+static void retry_timer_cb(void *arg)
+{
+    wifi_handler_ctx_t *hctx = (wifi_handler_ctx_t *)arg;
+    ESP_LOGI(TAG_STA, "Retrying upstream AP");
+    hctx->retry_count = 0;
+    xEventGroupClearBits(hctx->ctx->wifi_event_group, WIFI_FAIL_BIT);
+    esp_wifi_connect();
+}
+
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data)
 {
@@ -84,12 +285,22 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(TAG_AP, "Station " MACSTR " left, AID=%d, reason:%d",
                  MAC2STR(event->mac), event->aid, event->reason);
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        ESP_LOGW(TAG_STA, "Disconnected from upstream AP, retrying...");
+        if (hctx->fast_attempt) {
+            hctx->fast_attempt = false;
+            fast_path_fallback(ctx);
+            return;
+        }
+        xEventGroupClearBits(ctx->wifi_event_group, WIFI_CONNECTED_BIT);
         if (hctx->retry_count < EXAMPLE_ESP_MAXIMUM_RETRY) {
+            ESP_LOGW(TAG_STA, "Disconnected from upstream AP, retrying...");
             esp_wifi_connect();
             hctx->retry_count++;
         } else {
+            // Sensing and the SoftAP keep running; try again later
+            ESP_LOGW(TAG_STA, "Failed to connect to SSID:%s, retrying in %d s",
+                     EXAMPLE_ESP_WIFI_STA_SSID, CONFIG_NODE_TANK_STA_RETRY_PAUSE_S);
             xEventGroupSetBits(ctx->wifi_event_group, WIFI_FAIL_BIT);
+            esp_timer_start_once(s_retry_timer, (uint64_t)CONFIG_NODE_TANK_STA_RETRY_PAUSE_S * 1000000);
         }
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
@@ -97,8 +308,20 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
         ESP_LOGI(TAG_STA, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
+        if (s_connected_at_us == 0) {
+            s_connected_at_us = esp_timer_get_time();
+            s_connected_fast = hctx->fast_attempt;
+            ESP_LOGI(TAG_STA, "IP %" PRId64 " ms after boot (%s)", s_connected_at_us / 1000,
+                     s_connected_fast ? "fast reconnect" : "full scan");
+        }
+        hctx->fast_attempt = false;
         hctx->retry_count = 0;
+        if (fast_cache_accept(ctx, &event->ip_info)) {
+            fast_cache_update(ctx, &event->ip_info);
+        }
+        xEventGroupClearBits(ctx->wifi_event_group, WIFI_FAIL_BIT);
         xEventGroupSetBits(ctx->wifi_event_group, WIFI_CONNECTED_BIT);
+        uplink_up(ctx);
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_ASSIGNED_IP_TO_CLIENT) {
         const ip_event_assigned_ip_to_client_t *e = (const ip_event_assigned_ip_to_client_t *)event_data;
         ESP_LOGI(TAG_AP, "Assigned IP to client: " IPSTR ", MAC=" MACSTR ", hostname='%s'",
@@ -152,19 +375,27 @@ static esp_netif_t *wifi_init_sta(void)
     };
 
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_sta_config) );
+    s_sta_full_config = wifi_sta_config;
 
     ESP_LOGI(TAG_STA, "wifi_init_sta finished.");
 
     return esp_netif_sta;
 }
 
-static esp_err_t wifi_start_and_wait(net_manager_context_t *ctx, wifi_handler_ctx_t *handler_ctx)
+static esp_err_t wifi_start(net_manager_context_t *ctx, wifi_handler_ctx_t *handler_ctx)
 {
     ctx->wifi_event_group = xEventGroupCreate();
     if (!ctx->wifi_event_group) {
         return ESP_ERR_NO_MEM;
     }
 
+    const esp_timer_create_args_t retry_args = {
+        .callback = retry_timer_cb,
+        .arg = handler_ctx,
+        .name = "sta_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_retry_timer));
+
     handler_ctx->ctx = ctx;
     handler_ctx->retry_count = 0;
 
@@ -193,38 +424,9 @@ static esp_err_t wifi_start_and_wait(net_manager_context_t *ctx, wifi_handler_ct
 
     ESP_LOGI(TAG_STA, "ESP_WIFI_MODE_STA");
     ctx->netif_sta = wifi_init_sta();
+    handler_ctx->fast_attempt = fast_path_setup(ctx);
 
     ESP_ERROR_CHECK(esp_wifi_start() );
-
-    EventBits_t bits = xEventGroupWaitBits(ctx->wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG_STA, "connected to ap SSID:%s password:%s",
-                 EXAMPLE_ESP_WIFI_STA_SSID, EXAMPLE_ESP_WIFI_STA_PASSWD);
-        softap_set_dns_addr(ctx);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG_STA, "Failed to connect to SSID:%s, password:%s",
-                 EXAMPLE_ESP_WIFI_STA_SSID, EXAMPLE_ESP_WIFI_STA_PASSWD);
-        return ESP_FAIL;
-    } else {
-        ESP_LOGE(TAG_STA, "UNEXPECTED EVENT");
-        return ESP_FAIL;
-    }
-
-    esp_netif_set_default_netif(ctx->netif_sta);
-
-#if IP_NAPT
-    if (esp_netif_napt_enable(ctx->netif_ap) != ESP_OK) {
-        ESP_LOGE(TAG_STA, "NAPT not enabled on the netif: %p", ctx->netif_ap);
-    }
-#else
-    ESP_LOGW(TAG_STA, "IP_NAPT disabled, skipping NAPT setup");
-#endif
-
     return ESP_OK;
 }
 
@@ -233,16 +435,12 @@ esp_err_t net_manager_start(net_manager_context_t *ctx, esp_event_handler_t mqtt
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
-    wifi_handler_ctx_t wifi_ctx = {
-        .ctx = ctx,
-        .retry_count = 0,
-    };
-
-    esp_err_t err = wifi_start_and_wait(ctx, &wifi_ctx);
-    if (err != ESP_OK) {
-        return err;
-    }
+    // Event handlers keep this pointer after we return
+    static wifi_handler_ctx_t wifi_ctx;
+    wifi_ctx.ctx = ctx;
+    wifi_ctx.retry_count = 0;
 
+    // Created before Wi-Fi starts so the first GOT_IP can start it
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = "mqtt://10.42.0.1:1883",
     };
@@ -253,6 +451,14 @@ esp_err_t net_manager_start(net_manager_context_t *ctx, esp_event_handler_t mqtt
     if (mqtt_handler) {
         ESP_ERROR_CHECK(esp_mqtt_client_register_event(ctx->mqtt_client, ESP_EVENT_ANY_ID, mqtt_handler, handler_ctx));
     }
-    ESP_ERROR_CHECK(esp_mqtt_client_start(ctx->mqtt_client));
-    return ESP_OK;
+
+    return wifi_start(ctx, &wifi_ctx);
+}
+
+int64_t net_manager_connected_at_us(bool *fast_path)
+{
+    if (fast_path) {
+        *fast_path = s_connected_fast;
+    }
+    return s_connected_at_us;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 #include "esp_event.h"
 #include "freertos/event_groups.h"
@@ -13,7 +15,15 @@ typedef struct {
     esp_mqtt_client_handle_t mqtt_client;
 } net_manager_context_t;
 
-/* Init Wi-Fi (AP+STA) and start MQTT broker connection.
+/* Init Wi-Fi (AP+STA) and create the MQTT client. Returns without waiting
+ * for the uplink: the client is started on the first upstream IP, and the
+ * STA keeps retrying in the background (a pause of
+ * CONFIG_NODE_TANK_STA_RETRY_PAUSE_S after each burst of failed attempts).
  * NVS must be initialized before calling.
  */
 esp_err_t net_manager_start(net_manager_context_t *ctx, esp_event_handler_t mqtt_handler, void *handler_ctx);
+
+/* esp_timer time of the first upstream IP (0 before that); *fast_path tells
+ * whether the cached BSSID/channel/lease was used.
+ */
+int64_t net_manager_connected_at_us(bool *fast_path);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_pm.h"
+
+/*
+ * Power management: dynamic frequency scaling, automatic light sleep and
+ * esp_pm locks with hold-time accounting.
+ *
+ * Drivers hold a lock only while they measure (ADC burst, ultrasonic echo);
+ * the rest of the time the CPU drops to min_mhz and, when enabled, the chip
+ * light-sleeps whenever FreeRTOS is idle (tickless idle). power_report()
+ * logs the share of time each lock was held, i.e. the time the node could
+ * not sleep because of it.
+ *
+ * Without CONFIG_PM_ENABLE the esp_pm locks are not created but accounting
+ * still works, so the report can estimate the savings before enabling PM.
+ */
+
+#define POWER_MAX_LOCKS 8
+
+typedef struct {
+    int max_mhz;        // frequency while a CPU_FREQ_MAX lock is held
+    int min_mhz;        // idle frequency (e.g. 40 = XTAL)
+    bool light_sleep;   // automatic light sleep when idle
+} power_config_t;
+
+typedef struct power_lock *power_lock_t;
+
+typedef struct {
+    const char *name;
+    uint32_t acquisitions;   // free -> held transitions
+    uint64_t held_us;        // total held time since boot
+    uint64_t window_held_us; // held since the last power_report()
+    uint64_t window_us;      // length of the report window
+} power_lock_stats_t;
+
+/** Configure DFS and automatic light sleep. ESP_ERR_NOT_SUPPORTED without CONFIG_PM_ENABLE. */
+esp_err_t power_init(const power_config_t *cfg);
+
+/** Create a named lock (ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX or ESP_PM_NO_LIGHT_SLEEP). */
+esp_err_t power_lock_create(esp_pm_lock_type_t type, const char *name, power_lock_t *out);
+
+/** Take the lock. Nestable, safe from several tasks (not from ISRs), NULL is a no-op. */
+void power_lock_acquire(power_lock_t lock);
+
+/** Release one power_lock_acquire(). */
+void power_lock_release(power_lock_t lock);
+
+/** Copy the statistics of one lock. */
+void power_lock_get_stats(power_lock_t lock, power_lock_stats_t *stats);
+
+/** Log the duty cycle of every lock and start a new window. */
+void power_report(void);
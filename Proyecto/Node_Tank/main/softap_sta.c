@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <strings.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -20,11 +21,21 @@
 #include "mqtt_client.h"
 #include "esp_adc/adc_oneshot.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "sdkconfig.h"
 
 #include "pump_driver.h"
 #include "ultrasonic_driver.h"
 #include "tds_driver.h"
 #include "net_manager.h"
+#include "telemetry.h"
+#include "power.h"
+#include "mqtt_router.h"
+#include "cmd_bus.h"
+#include "diag.h"
+#include "lat_hist.h"
+#include "sample_sched.h"
 
 /* Peripheral pins */
 #define PUMP_GPIO_PIN GPIO_NUM_12
@@ -32,58 +43,94 @@
 #define ULTRASONIC_ECHO_GPIO GPIO_NUM_18
 #define TDS_ADC_CHANNEL ADC_CHANNEL_6
 
-#define PUMP_QUEUE_LEN 4
-#define TELEMETRY_QUEUE_LEN 8
-#define TDS_CMD_QUEUE_LEN 4
+#define TELEMETRY_QUEUE_LEN 32   /* also the offline buffer until MQTT connects */
 
 static const char *TAG_APP = "Cisterna";
 
 /* MQTT topics */
 static const char *TOPIC_PUMP_CMD = "cisterna/bomba/set";
 static const char *TOPIC_PUMP_STATE = "cisterna/bomba/state";
+static const char *TOPIC_PUMP_ACK = "cisterna/bomba/ack";   /* JSON ack of "ON #<id>" commands */
 static const char *TOPIC_ULTRASONIC = "cisterna/ultrasonido";
 static const char *TOPIC_TDS = "cisterna/tds";
 static const char *TOPIC_TDS_CAL_CMD = "cisterna/tds/cal";
 static const char *TOPIC_TDS_CAL_ACK = "cisterna/tds/cal/ack";
+static const char *TOPIC_DIAG_BOOT = "cisterna/diag/boot";
+static const char *TOPIC_DIAG = "cisterna/diag";
+
+#define MQTT_CONNECTED_BIT BIT0
+
+/*
+ * Boot stages. Sensing starts before the network; each stage records the
+ * esp_timer time it was first reached and the set is published (retained)
+ * on TOPIC_DIAG_BOOT at the first MQTT connection.
+ */
+typedef enum {
+    BOOT_NVS,
+    BOOT_DRIVERS,
+    BOOT_FIRST_SAMPLE,
+    BOOT_WIFI,
+    BOOT_MQTT,
+    BOOT_STAGE_COUNT,
+} boot_stage_t;
+
+static const char *const boot_stage_names[BOOT_STAGE_COUNT] = {
+    "nvs", "drivers", "first_sample", "wifi", "mqtt",
+};
+static int64_t s_boot_us[BOOT_STAGE_COUNT];
+
+static void boot_mark(boot_stage_t stage)
+{
+    if (s_boot_us[stage] == 0) {
+        s_boot_us[stage] = esp_timer_get_time();
+        ESP_LOGI("boot", "%-12s at %" PRId64 " ms", boot_stage_names[stage], s_boot_us[stage] / 1000);
+    }
+}
 
 typedef struct {
     esp_mqtt_client_handle_t mqtt;
-    QueueHandle_t pump_cmd_queue;
     QueueHandle_t telemetry_queue;
-    QueueHandle_t tds_cmd_queue;
+    EventGroupHandle_t mqtt_events;
 } app_context_t;
 
-typedef struct {
-    bool turn_on;
-} pump_cmd_msg_t;
-
 typedef struct {
     char topic[48];
     float value;
+    uint8_t payload[TELEMETRY_CBOR_MAX_LEN];  /* binary payload, used when payload_len > 0 */
+    uint8_t payload_len;
 } telemetry_msg_t;
 
-typedef enum {
-    TDS_CMD_CAL_A,
-    TDS_CMD_CAL_B,
-    TDS_CMD_SAVE,
-    TDS_CMD_LOAD,
-} tds_cmd_type_t;
-
-typedef struct {
-    tds_cmd_type_t type;
-} tds_cmd_msg_t;
+/* Reply tags for commands that arrive over MQTT */
+#define CMD_TAG_PUMP 0      /* answer with the retained pump state */
+#define CMD_TAG_TDS_CAL 1   /* answer with the reply text on TOPIC_TDS_CAL_ACK */
 
 static void pump_publish_state(app_context_t *app);
 
+/* Latency histograms (us): one sensor cycle, one publish call, pump command -> relay */
+static lat_hist_t s_read_hist = LAT_HIST_INIT("read");
+static lat_hist_t s_publish_hist = LAT_HIST_INIT("pub");
+static lat_hist_t s_relay_hist = LAT_HIST_INIT("cmd_relay");
+
+/* Notified on pump commands so the next sample does not wait out a long period */
+static TaskHandle_t s_sensor_task;
+
 static void telemetry_publish_task(void *pvParameters)
 {
     app_context_t *app = (app_context_t *)pvParameters;
     telemetry_msg_t msg;
     char payload[32];
     while (true) {
+        /* Samples stay queued (oldest dropped when full) until the broker is up */
+        xEventGroupWaitBits(app->mqtt_events, MQTT_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
         if (xQueueReceive(app->telemetry_queue, &msg, portMAX_DELAY) == pdTRUE && app->mqtt) {
-            snprintf(payload, sizeof(payload), "%.2f", msg.value);
-            esp_mqtt_client_publish(app->mqtt, msg.topic, payload, 0, 1, 0);
+            int64_t start_us = esp_timer_get_time();
+            if (msg.payload_len > 0) {
+                esp_mqtt_client_publish(app->mqtt, msg.topic, (const char *)msg.payload, msg.payload_len, 1, 0);
+            } else {
+                snprintf(payload, sizeof(payload), "%.2f", msg.value);
+                esp_mqtt_client_publish(app->mqtt, msg.topic, payload, 0, 1, 0);
+            }
+            lat_hist_record(&s_publish_hist, (uint32_t)(esp_timer_get_time() - start_us));
         }
     }
 }
@@ -96,6 +143,14 @@ static void pump_publish_state(app_context_t *app)
     esp_mqtt_client_publish(app->mqtt, TOPIC_PUMP_STATE,
                             pump_driver_get_state() ? "ON" : "OFF",
                             0, 1, 1);
+#if CONFIG_NODE_TANK_TELEMETRY_CBOR
+    uint8_t bin[TELEMETRY_CBOR_MAX_LEN];
+    int len = telemetry_encode_pump_cbor(pump_driver_get_state(),
+                                         (uint32_t)(esp_timer_get_time() / 1000000), bin, sizeof(bin));
+    if (len > 0) {
+        esp_mqtt_client_publish(app->mqtt, CONFIG_NODE_TANK_TELEMETRY_TOPIC, (const char *)bin, len, 1, 0);
+    }
+#endif
 }
 
 static void tds_cal_ack(app_context_t *app, const char *msg)
@@ -105,75 +160,111 @@ static void tds_cal_ack(app_context_t *app, const char *msg)
     }
 }
 
-static void tds_cal_task(void *pvParameters)
+/* Command handlers, run by the command bus worker (one at a time) */
+static int cmd_cal_point(int argc, char **argv, char *reply, size_t reply_len)
 {
-    app_context_t *app = (app_context_t *)pvParameters;
-    tds_cmd_msg_t cmd;
-    char ack[96];
-    while (true) {
-        if (xQueueReceive(app->tds_cmd_queue, &cmd, portMAX_DELAY) != pdTRUE) {
-            continue;
-        }
+    bool point_a = strcasecmp(argv[0], "calA") == 0;
+    float raw = tds_driver_read_raw();
+    if (raw < 0) {
+        snprintf(reply, reply_len, "CAL_%c failed", point_a ? 'A' : 'B');
+        ESP_LOGW(TAG_APP, "TDS CAL_%c failed", point_a ? 'A' : 'B');
+        return -1;
+    }
+    if (point_a) {
+        tds_set_calibration_point_A(raw);
+        snprintf(reply, reply_len, "CAL_A raw=%.2f", raw);
+    } else {
+        tds_set_calibration_point_B(raw);
+        snprintf(reply, reply_len, "CAL_B raw=%.2f gain=%.4f", raw, tds_get_gain());
+    }
+    ESP_LOGI(TAG_APP, "TDS CAL_%c raw=%.2f offset=%.2f gain=%.4f", point_a ? 'A' : 'B',
+             raw, tds_get_offset(), tds_get_gain());
+    return 0;
+}
 
-        switch (cmd.type) {
-        case TDS_CMD_CAL_A: {
-            float raw = tds_driver_read_raw();
-            if (raw >= 0) {
-                tds_set_calibration_point_A(raw);
-                snprintf(ack, sizeof(ack), "CAL_A raw=%.2f", raw);
-                ESP_LOGI(TAG_APP, "TDS CAL_A raw=%.2f offset=%.2f gain=%.4f", raw, tds_get_offset(), tds_get_gain());
-            } else {
-                snprintf(ack, sizeof(ack), "CAL_A failed");
-                ESP_LOGW(TAG_APP, "TDS CAL_A failed");
-            }
-            tds_cal_ack(app, ack);
-            break;
-        }
-        case TDS_CMD_CAL_B: {
-            float raw = tds_driver_read_raw();
-            if (raw >= 0) {
-                tds_set_calibration_point_B(raw);
-                snprintf(ack, sizeof(ack), "CAL_B raw=%.2f gain=%.4f", raw, tds_get_gain());
-                ESP_LOGI(TAG_APP, "TDS CAL_B raw=%.2f offset=%.2f gain=%.4f", raw, tds_get_offset(), tds_get_gain());
-            } else {
-                snprintf(ack, sizeof(ack), "CAL_B failed");
-                ESP_LOGW(TAG_APP, "TDS CAL_B failed");
-            }
-            tds_cal_ack(app, ack);
-            break;
-        }
-        case TDS_CMD_SAVE: {
-            esp_err_t r = tds_save_calibration();
-            snprintf(ack, sizeof(ack), "SAVE %s", r == ESP_OK ? "OK" : "ERR");
-            ESP_LOGI(TAG_APP, "TDS SAVE %s offset=%.2f gain=%.4f", r == ESP_OK ? "OK" : "ERR", tds_get_offset(), tds_get_gain());
-            tds_cal_ack(app, ack);
-            break;
-        }
-        case TDS_CMD_LOAD: {
-            esp_err_t r = tds_load_calibration();
-            snprintf(ack, sizeof(ack), "LOAD %s offset=%.2f gain=%.4f",
-                     r == ESP_OK ? "OK" : "DEF", tds_get_offset(), tds_get_gain());
-            ESP_LOGI(TAG_APP, "TDS LOAD %s offset=%.2f gain=%.4f",
-                     r == ESP_OK ? "OK" : "DEF", tds_get_offset(), tds_get_gain());
-            tds_cal_ack(app, ack);
-            break;
-        }
-        default:
-            break;
-        }
+static int cmd_cal_save(int argc, char **argv, char *reply, size_t reply_len)
+{
+    esp_err_t r = tds_save_calibration();
+    snprintf(reply, reply_len, "SAVE %s", r == ESP_OK ? "OK" : "ERR");
+    ESP_LOGI(TAG_APP, "TDS SAVE %s offset=%.2f gain=%.4f", r == ESP_OK ? "OK" : "ERR", tds_get_offset(), tds_get_gain());
+    return r == ESP_OK ? 0 : -1;
+}
+
+static int cmd_cal_load(int argc, char **argv, char *reply, size_t reply_len)
+{
+    esp_err_t r = tds_load_calibration();
+    snprintf(reply, reply_len, "LOAD %s offset=%.2f gain=%.4f",
+             r == ESP_OK ? "OK" : "DEF", tds_get_offset(), tds_get_gain());
+    ESP_LOGI(TAG_APP, "%s", reply);
+    return 0;
+}
+
+static int cmd_pump(int argc, char **argv, char *reply, size_t reply_len)
+{
+    /* Same rule as before: "on"/"1" turns the pump on, anything else off */
+    bool turn_on = argc >= 2 && (strncasecmp(argv[1], "on", 2) == 0 || argv[1][0] == '1');
+    pump_driver_set_state(turn_on);
+    lat_hist_record(&s_relay_hist, (uint32_t)(esp_timer_get_time() - cmd_bus_current_posted_us()));
+    if (s_sensor_task) {
+        xTaskNotifyGive(s_sensor_task);
     }
+    ESP_LOGI(TAG_APP, "Pump command -> %s", turn_on ? "ON" : "OFF");
+    snprintf(reply, reply_len, "%s", pump_driver_get_state() ? "ON" : "OFF");
+    return 0;
 }
 
-static void pump_cmd_task(void *pvParameters)
+static int cmd_lat(int argc, char **argv, char *reply, size_t reply_len)
 {
-    app_context_t *app = (app_context_t *)pvParameters;
-    pump_cmd_msg_t cmd;
-    while (true) {
-        if (xQueueReceive(app->pump_cmd_queue, &cmd, portMAX_DELAY) == pdTRUE) {
-            pump_driver_set_state(cmd.turn_on);
-            pump_publish_state(app);
-            ESP_LOGI(TAG_APP, "Pump command -> %s", cmd.turn_on ? "ON" : "OFF");
+    bool reset = argc >= 2 && strcasecmp(argv[1], "reset") == 0;
+    if (lat_hist_format_text(reply, reply_len, reset) < 0) {
+        snprintf(reply, reply_len, "lat: reply too long");
+        return -1;
+    }
+    return 0;
+}
+
+static const cmd_def_t app_cmd_table[] = {
+    {"calA", "calA: TDS calibration point A from the current reading", cmd_cal_point},
+    {"calB", "calB: TDS calibration point B from the current reading", cmd_cal_point},
+    {"save", "save: store the TDS calibration in NVS", cmd_cal_save},
+    {"load", "load: reload the TDS calibration from NVS", cmd_cal_load},
+    {"pump", "pump on|off: drive the relay", cmd_pump},
+    {"lat", "lat [reset]: latency p50/p90/p99/max in us", cmd_lat},
+};
+
+static void mqtt_cmd_reply(uint32_t tag, int status, const char *reply, void *ctx)
+{
+    app_context_t *app = (app_context_t *)ctx;
+    /* With a correlation ID the ack is JSON carrying receive/actuate timestamps */
+    char ack[CMD_BUS_MAX_REPLY + 128];
+    int ack_len = cmd_bus_current_id()[0] ? cmd_bus_format_ack(ack, sizeof(ack), status, reply) : -1;
+    if (tag == CMD_TAG_PUMP) {
+        pump_publish_state(app);
+        if (ack_len > 0 && app && app->mqtt) {
+            esp_mqtt_client_publish(app->mqtt, TOPIC_PUMP_ACK, ack, ack_len, 1, 0);
         }
+    } else {
+        tds_cal_ack(app, ack_len > 0 ? ack : reply);
+    }
+}
+
+static void commands_init(app_context_t *app)
+{
+    lat_hist_register(&s_read_hist);
+    lat_hist_register(&s_publish_hist);
+    lat_hist_register(&s_relay_hist);
+    cmd_bus_register(app_cmd_table, sizeof(app_cmd_table) / sizeof(app_cmd_table[0]));
+    cmd_bus_set_reply(CMD_SRC_MQTT, mqtt_cmd_reply, app);
+    ESP_ERROR_CHECK(cmd_bus_start(5));
+}
+
+/* Queue a message; while offline the queue is full of old samples, so make room */
+static void telemetry_queue_push(app_context_t *app, const telemetry_msg_t *msg)
+{
+    if (xQueueSend(app->telemetry_queue, msg, 0) != pdTRUE) {
+        telemetry_msg_t oldest;
+        xQueueReceive(app->telemetry_queue, &oldest, 0);
+        xQueueSend(app->telemetry_queue, msg, 0);
     }
 }
 
@@ -185,26 +276,143 @@ static void enqueue_telemetry(app_context_t *app, const char *topic, float value
     telemetry_msg_t msg = {0};
     strncpy(msg.topic, topic, sizeof(msg.topic) - 1);
     msg.value = value;
-    xQueueSend(app->telemetry_queue, &msg, 0);
+    telemetry_queue_push(app, &msg);
+}
+
+#if CONFIG_NODE_TANK_TELEMETRY_CBOR
+/* One versioned CBOR document per sample instead of one text publish per reading */
+static void enqueue_sample_cbor(app_context_t *app, uint32_t seq, float distance, float tds)
+{
+    if (!app || !app->telemetry_queue) {
+        return;
+    }
+    telemetry_sample_t sample = {
+        .seq = seq,
+        .timestamp_s = (uint32_t)(esp_timer_get_time() / 1000000),
+        .water_level_cm = distance > 0 ? distance : -1.0f,
+        .tds_ppm = tds,
+        .water_state = TELEMETRY_WATER_STATE_COUNT,  /* not classified on this node */
+        .pump_on = pump_driver_get_state(),
+    };
+    telemetry_msg_t msg = {0};
+    strncpy(msg.topic, CONFIG_NODE_TANK_TELEMETRY_TOPIC, sizeof(msg.topic) - 1);
+    int len = telemetry_encode_cbor(&sample, msg.payload, sizeof(msg.payload));
+    if (len > 0) {
+        msg.payload_len = (uint8_t)len;
+        telemetry_queue_push(app, &msg);
+    }
 }
+#endif
 
 static void sensor_task(void *pvParameters)
 {
     app_context_t *app = (app_context_t *)pvParameters;
+#if CONFIG_NODE_TANK_TELEMETRY_CBOR
+    uint32_t seq = 0;
+#endif
+    int64_t last_report_us = esp_timer_get_time();
+#if CONFIG_NODE_TANK_SAMPLE_ADAPTIVE
+    /* Fast while the pump runs or the level moves, backing off when quiet */
+    const sample_sched_config_t sched_cfg = {
+        .min_ms = CONFIG_NODE_TANK_SAMPLE_MIN_MS,
+        .max_ms = CONFIG_NODE_TANK_SAMPLE_MAX_MS,
+        .hold_ms = CONFIG_NODE_TANK_SAMPLE_HOLD_S * 1000u,
+        .grow_pct = CONFIG_NODE_TANK_SAMPLE_GROW_PCT,
+        .step_cm = CONFIG_NODE_TANK_SAMPLE_STEP_MM / 10.0f,
+    };
+    sample_sched_t sched;
+    sample_sched_init(&sched, &sched_cfg, (uint32_t)(last_report_us / 1000));
+#endif
     while (true) {
+        int64_t start_us = esp_timer_get_time();
         float distance = ultrasonic_driver_read_cm();
         if (distance > 0) {
-            enqueue_telemetry(app, TOPIC_ULTRASONIC, distance);
             ESP_LOGI(TAG_APP, "Ultrasonic distance: %.2f cm", distance);
         } else {
             ESP_LOGW(TAG_APP, "Ultrasonic read timeout");
         }
 
         float tds = tds_driver_read_ppm();
-        enqueue_telemetry(app, TOPIC_TDS, tds);
+        lat_hist_record(&s_read_hist, (uint32_t)(esp_timer_get_time() - start_us));
         ESP_LOGI(TAG_APP, "TDS reading: %.2f", tds);
+        boot_mark(BOOT_FIRST_SAMPLE);
+
+#if CONFIG_NODE_TANK_TELEMETRY_CBOR
+        enqueue_sample_cbor(app, ++seq, distance, tds);
+#else
+        if (distance > 0) {
+            enqueue_telemetry(app, TOPIC_ULTRASONIC, distance);
+        }
+        enqueue_telemetry(app, TOPIC_TDS, tds);
+#endif
+
+        if (esp_timer_get_time() - last_report_us >= 60 * 1000000LL) {
+            last_report_us = esp_timer_get_time();
+            power_report();
+        }
+
+#if CONFIG_NODE_TANK_SAMPLE_ADAPTIVE
+        /* Distance serves as well as level here: only the size of the rate counts */
+        sample_sched_input_t in = {
+            .pump_on = pump_driver_get_state(),
+            .level_cm = distance > 0 ? distance : -1.0f,
+        };
+        uint32_t period_ms = sample_sched_update(&sched, &in, (uint32_t)(esp_timer_get_time() / 1000));
+        uint32_t spent_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(period_ms > spent_ms ? period_ms - spent_ms : 0)) > 0) {
+            sample_sched_wake(&sched, (uint32_t)(esp_timer_get_time() / 1000));
+        }
+#else
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_NODE_TANK_SAMPLE_PERIOD_MS));
+#endif
+    }
+}
 
-        vTaskDelay(pdMS_TO_TICKS(2000));
+/* Incoming topics; handlers get the client's buffers, not copies */
+static mqtt_router_t s_routes;
+
+static void on_pump_cmd(const char *topic, size_t topic_len, const uint8_t *data, size_t len, void *ctx)
+{
+    char line[CMD_BUS_MAX_LINE];
+    int n = snprintf(line, sizeof(line), "pump %.*s", len > 32 ? 32 : (int)len, (const char *)data);
+    if (cmd_bus_post(CMD_SRC_MQTT, CMD_TAG_PUMP, line, (size_t)n) != ESP_OK) {
+        ESP_LOGW(TAG_APP, "Command bus full, pump command dropped");
+    }
+}
+
+/* Payload is a command line ("calA", "save", ...); the reply goes to TOPIC_TDS_CAL_ACK */
+static void on_tds_cal_cmd(const char *topic, size_t topic_len, const uint8_t *data, size_t len, void *ctx)
+{
+    esp_err_t err = cmd_bus_post(CMD_SRC_MQTT, CMD_TAG_TDS_CAL, (const char *)data, len);
+    if (err != ESP_OK) {
+        tds_cal_ack((app_context_t *)ctx, err == ESP_ERR_TIMEOUT ? "busy" : "Unknown cmd");
+    }
+}
+
+static void routes_init(app_context_t *app)
+{
+    mqtt_router_init(&s_routes);
+    mqtt_router_add(&s_routes, TOPIC_PUMP_CMD, on_pump_cmd, app);
+    mqtt_router_add(&s_routes, TOPIC_TDS_CAL_CMD, on_tds_cal_cmd, app);
+}
+
+static void boot_publish(esp_mqtt_client_handle_t client)
+{
+    char buf[192];
+    bool fast = false;
+    int64_t ip_us = net_manager_connected_at_us(&fast);
+    if (s_boot_us[BOOT_WIFI] == 0) {
+        s_boot_us[BOOT_WIFI] = ip_us;
+    }
+    int n = snprintf(buf, sizeof(buf), "{\"reset\":%d,\"wifi\":\"%s\",\"ms\":{",
+                     (int)esp_reset_reason(), fast ? "fast" : "full");
+    for (int i = 0; i < BOOT_STAGE_COUNT && n > 0 && n < (int)sizeof(buf); i++) {
+        n += snprintf(buf + n, sizeof(buf) - n, "%s\"%s\":%" PRId64, i ? "," : "",
+                      boot_stage_names[i], s_boot_us[i] / 1000);
+    }
+    if (n > 0 && n < (int)sizeof(buf) - 2) {
+        n += snprintf(buf + n, sizeof(buf) - n, "}}");
+        esp_mqtt_client_publish(client, TOPIC_DIAG_BOOT, buf, n, 1, 1);
     }
 }
 
@@ -215,51 +423,87 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     switch (event_id) {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG_APP, "Connected to MQTT broker");
-        esp_mqtt_client_subscribe(event->client, TOPIC_PUMP_CMD, 1);
-        if (app && app->pump_cmd_queue) {
-            pump_cmd_msg_t cmd = {.turn_on = false};
-            xQueueSend(app->pump_cmd_queue, &cmd, 0);
+        if (s_boot_us[BOOT_MQTT] == 0) {
+            boot_mark(BOOT_MQTT);
+            boot_publish(event->client);
         }
+        if (app && app->mqtt_events) {
+            xEventGroupSetBits(app->mqtt_events, MQTT_CONNECTED_BIT);
+        }
+        for (uint8_t i = 0; i < s_routes.count; i++) {
+            esp_mqtt_client_subscribe(event->client, s_routes.routes[i].filter, 1);
+        }
+        /* Fail safe on every (re)connect; also republishes the retained state */
+        cmd_bus_post(CMD_SRC_MQTT, CMD_TAG_PUMP, "pump off", 8);
         break;
-    case MQTT_EVENT_DATA: {
-        char topic[64] = {0};
-        char data[16] = {0};
-        size_t topic_len = event->topic_len < (sizeof(topic) - 1) ? event->topic_len : (sizeof(topic) - 1);
-        size_t data_len = event->data_len < (sizeof(data) - 1) ? event->data_len : (sizeof(data) - 1);
-        memcpy(topic, event->topic, topic_len);
-        memcpy(data, event->data, data_len);
-
-        if (strcmp(topic, TOPIC_PUMP_CMD) == 0) {
-            bool turn_on = (strncasecmp(data, "on", 2) == 0) || (data[0] == '1');
-            if (app && app->pump_cmd_queue) {
-                pump_cmd_msg_t cmd = {.turn_on = turn_on};
-                xQueueSend(app->pump_cmd_queue, &cmd, 0);
-            }
-        } else if (strcmp(topic, TOPIC_TDS_CAL_CMD) == 0 && app && app->tds_cmd_queue) {
-            tds_cmd_msg_t cmd;
-            if (strncasecmp(data, "calA", 4) == 0) {
-                cmd.type = TDS_CMD_CAL_A;
-                xQueueSend(app->tds_cmd_queue, &cmd, 0);
-            } else if (strncasecmp(data, "calB", 4) == 0) {
-                cmd.type = TDS_CMD_CAL_B;
-                xQueueSend(app->tds_cmd_queue, &cmd, 0);
-            } else if (strncasecmp(data, "save", 4) == 0) {
-                cmd.type = TDS_CMD_SAVE;
-                xQueueSend(app->tds_cmd_queue, &cmd, 0);
-            } else if (strncasecmp(data, "load", 4) == 0) {
-                cmd.type = TDS_CMD_LOAD;
-                xQueueSend(app->tds_cmd_queue, &cmd, 0);
-            } else {
-                tds_cal_ack(app, "Unknown cmd");
-            }
+    case MQTT_EVENT_DISCONNECTED:
+        if (app && app->mqtt_events) {
+            xEventGroupClearBits(app->mqtt_events, MQTT_CONNECTED_BIT);
+        }
+        break;
+    case MQTT_EVENT_PUBLISHED: {
+        // Boot-to-first-publish (all telemetry is QoS 1, so this is the first PUBACK)
+        static bool first_logged = false;
+        if (!first_logged) {
+            first_logged = true;
+            bool fast = false;
+            int64_t ip_us = net_manager_connected_at_us(&fast);
+            ESP_LOGI(TAG_APP, "First publish acked %" PRId64 " ms after boot (IP at %" PRId64 " ms, %s)",
+                     esp_timer_get_time() / 1000, ip_us / 1000, fast ? "fast reconnect" : "full scan");
         }
         break;
     }
+    case MQTT_EVENT_DATA:
+        mqtt_router_feed(&s_routes, event->topic, event->topic_len, event->data, event->data_len,
+                         event->current_data_offset, event->total_data_len);
+        break;
     default:
         break;
     }
 }
 
+#if CONFIG_NODE_TANK_DIAG_PERIOD_S > 0
+static void diag_cmd_level(uint32_t *used, uint32_t *capacity, void *ctx)
+{
+    cmd_bus_stats_t st;
+    cmd_bus_get_stats(&st);
+    *used = st.queue_depth;
+    *capacity = CMD_BUS_QUEUE_LEN;
+}
+
+/* Latency percentiles per period: each record restarts the histograms */
+static int diag_lat_section(char *buf, size_t len, void *ctx)
+{
+    return lat_hist_encode_json(buf, len, true);
+}
+
+/* Periodic health record; runs in the main task, which has nothing else to do */
+static void diagnostics_loop(app_context_t *app)
+{
+    static const char *const watched[] = {"sensor_task", "tlm_publish", "cmd_bus"};
+    static char json[1024];
+    for (size_t i = 0; i < sizeof(watched) / sizeof(watched[0]); i++) {
+        diag_watch_task(watched[i]);
+    }
+    diag_watch_queue("telemetry", app->telemetry_queue);
+    diag_watch_level("cmd", diag_cmd_level, NULL);
+    diag_add_section("lat", diag_lat_section, NULL);
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_NODE_TANK_DIAG_PERIOD_S * 1000));
+        int len = diag_encode_json(json, sizeof(json));
+        if (len < 0) {
+            ESP_LOGW(TAG_APP, "Diagnostics record too large, skipped");
+            continue;
+        }
+        ESP_LOGD(TAG_APP, "Diag: %s", json);
+        if (app->mqtt && (xEventGroupGetBits(app->mqtt_events) & MQTT_CONNECTED_BIT)) {
+            esp_mqtt_client_publish(app->mqtt, TOPIC_DIAG, json, len, 0, 0);
+        }
+    }
+}
+#endif
+
 void app_main(void)
 {
     net_manager_context_t net_ctx = {0};
@@ -269,35 +513,53 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    boot_mark(BOOT_NVS);
+
+#if CONFIG_NODE_TANK_POWER_SAVE
+    const power_config_t pm_cfg = {
+        .max_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_mhz = CONFIG_NODE_TANK_PM_MIN_MHZ,
+#if CONFIG_NODE_TANK_LIGHT_SLEEP
+        .light_sleep = true,
+#endif
+    };
+    power_init(&pm_cfg);
+#endif
 
     app_context_t *app_ctx = calloc(1, sizeof(app_context_t));
     if (!app_ctx) {
         ESP_LOGE(TAG_APP, "Failed to allocate app context");
         return;
     }
-    app_ctx->pump_cmd_queue = xQueueCreate(PUMP_QUEUE_LEN, sizeof(pump_cmd_msg_t));
     app_ctx->telemetry_queue = xQueueCreate(TELEMETRY_QUEUE_LEN, sizeof(telemetry_msg_t));
-    if (!app_ctx->pump_cmd_queue || !app_ctx->telemetry_queue) {
+    if (!app_ctx->telemetry_queue) {
         ESP_LOGE(TAG_APP, "Failed to create queues");
         return;
     }
-    app_ctx->tds_cmd_queue = xQueueCreate(TDS_CMD_QUEUE_LEN, sizeof(tds_cmd_msg_t));
-    if (!app_ctx->tds_cmd_queue) {
-        ESP_LOGE(TAG_APP, "Failed to create TDS queue");
+    app_ctx->mqtt_events = xEventGroupCreate();
+    if (!app_ctx->mqtt_events) {
+        ESP_LOGE(TAG_APP, "Failed to create MQTT event group");
         return;
     }
 
-    ESP_ERROR_CHECK(net_manager_start(&net_ctx, mqtt_event_handler, app_ctx));
-    app_ctx->mqtt = net_ctx.mqtt_client;
-
+    /* Sensing first: samples queue up while the uplink comes up */
     ESP_ERROR_CHECK(pump_driver_init(PUMP_GPIO_PIN));
     ESP_ERROR_CHECK(ultrasonic_driver_init(ULTRASONIC_TRIG_GPIO, ULTRASONIC_ECHO_GPIO));
     ESP_ERROR_CHECK(tds_driver_init(TDS_ADC_CHANNEL));
+    boot_mark(BOOT_DRIVERS);
+    xTaskCreate(sensor_task, "sensor_task", 4096, app_ctx, 5, &s_sensor_task);
+
+    commands_init(app_ctx);
+    routes_init(app_ctx);
+    /* Returns right away; MQTT starts on the first upstream IP */
+    ESP_ERROR_CHECK(net_manager_start(&net_ctx, mqtt_event_handler, app_ctx));
+    app_ctx->mqtt = net_ctx.mqtt_client;
 
-    xTaskCreate(sensor_task, "sensor_task", 4096, app_ctx, 5, NULL);
-    xTaskCreate(pump_cmd_task, "pump_cmd_task", 3072, app_ctx, 5, NULL);
-    xTaskCreate(telemetry_publish_task, "telemetry_publish_task", 3072, app_ctx, 5, NULL);
-    xTaskCreate(tds_cal_task, "tds_cal_task", 3072, app_ctx, 5, NULL);
+    xTaskCreate(telemetry_publish_task, "tlm_publish", 3072, app_ctx, 5, NULL);
 
+#if CONFIG_NODE_TANK_DIAG_PERIOD_S > 0
+    diagnostics_loop(app_ctx);
+#else
     vTaskDelay(portMAX_DELAY);
+#endif
 }
@@ -4,6 +4,7 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
+#include "power.h"
 #include <math.h>
 #include <string.h>
 
@@ -22,6 +23,9 @@ static bool s_tds_inited = false;
 static float s_tds_offset = 0.0f;
 static float s_tds_gain = 1.0f;
 static float s_last_raw = 0.0f;
+/* Held for the 16-sample burst: ADC needs APB at full speed and must not sleep */
+static power_lock_t s_pm_apb = NULL;
+static power_lock_t s_pm_awake = NULL;
 
 static esp_err_t tds_storage_save_float(const char *key, float value)
 {
@@ -69,6 +73,8 @@ esp_err_t tds_driver_init(adc_channel_t channel)
     };
     esp_err_t cfg_err = adc_oneshot_config_channel(s_adc_handle, s_tds_channel, &chan_cfg);
     if (cfg_err == ESP_OK) {
+        power_lock_create(ESP_PM_APB_FREQ_MAX, "tds_apb", &s_pm_apb);
+        power_lock_create(ESP_PM_NO_LIGHT_SLEEP, "tds_awake", &s_pm_awake);
         s_tds_inited = true;
         tds_load_calibration();
     }
@@ -81,6 +87,8 @@ float tds_driver_read_raw(void)
         return -1.0f;
     }
     uint32_t adc_sum = 0;
+    power_lock_acquire(s_pm_apb);
+    power_lock_acquire(s_pm_awake);
     for (int i = 0; i < TDS_SAMPLES; i++) {
         int raw = 0;
         if (adc_oneshot_read(s_adc_handle, s_tds_channel, &raw) == ESP_OK) {
@@ -88,6 +96,8 @@ float tds_driver_read_raw(void)
         }
         vTaskDelay(pdMS_TO_TICKS(10));
     }
+    power_lock_release(s_pm_awake);
+    power_lock_release(s_pm_apb);
     uint32_t raw = adc_sum / TDS_SAMPLES;
     s_last_raw = (float)raw;
     return s_last_raw;
@@ -0,0 +1,95 @@
+#include "telemetry.h"
+#include "cbor_writer.h"
+
+#include <stdio.h>
+
+const char *const telemetry_water_state_str[TELEMETRY_WATER_STATE_COUNT] = {
+    "LIMPIA", "MEDIA", "SUCIA"
+};
+
+int telemetry_encode_json(const telemetry_sample_t *sample, char *buf, size_t len)
+{
+    uint8_t state = sample->water_state < TELEMETRY_WATER_STATE_COUNT ? sample->water_state : 0;
+
+    int n = snprintf(buf, len,
+                     "{\"seq\":%lu,\"ts\":%lu,\"level\":%.2f,\"tds\":%.1f,\"state\":\"%s\",\"pump\":\"%s\"}",
+                     (unsigned long)sample->seq,
+                     (unsigned long)sample->timestamp_s,
+                     (double)sample->water_level_cm,
+                     (double)sample->tds_ppm,
+                     telemetry_water_state_str[state],
+                     sample->pump_on ? "ON" : "OFF");
+    if (n < 0 || (size_t)n >= len) {
+        return -1;
+    }
+    return n;
+}
+
+// Cabecera común: map de n pares con versión y tipo primero
+static void put_header(cbor_writer_t *w, size_t pairs, telemetry_msg_type_t type)
+{
+    cbor_put_map(w, pairs);
+    cbor_put_uint(w, TELEMETRY_KEY_VERSION);
+    cbor_put_uint(w, TELEMETRY_SCHEMA_VERSION);
+    cbor_put_uint(w, TELEMETRY_KEY_TYPE);
+    cbor_put_uint(w, type);
+}
+
+int telemetry_encode_cbor(const telemetry_sample_t *sample, uint8_t *buf, size_t len)
+{
+    bool has_state = sample->water_state < TELEMETRY_WATER_STATE_COUNT;
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+
+    put_header(&w, has_state ? 8 : 7, TELEMETRY_MSG_SAMPLE);
+    cbor_put_uint(&w, TELEMETRY_KEY_SEQ);
+    cbor_put_uint(&w, sample->seq);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, sample->timestamp_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_LEVEL);
+    cbor_put_float(&w, sample->water_level_cm);
+    cbor_put_uint(&w, TELEMETRY_KEY_TDS);
+    cbor_put_float(&w, sample->tds_ppm);
+    if (has_state) {
+        cbor_put_uint(&w, TELEMETRY_KEY_STATE);
+        cbor_put_uint(&w, sample->water_state);
+    }
+    cbor_put_uint(&w, TELEMETRY_KEY_PUMP);
+    cbor_put_bool(&w, sample->pump_on);
+    return cbor_writer_finish(&w);
+}
+
+int telemetry_encode_pump_cbor(bool pump_on, uint32_t timestamp_s, uint8_t *buf, size_t len)
+{
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+
+    put_header(&w, 4, TELEMETRY_MSG_PUMP);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, timestamp_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_PUMP);
+    cbor_put_bool(&w, pump_on);
+    return cbor_writer_finish(&w);
+}
+
+int telemetry_encode_diag_cbor(const telemetry_diag_t *diag, uint8_t *buf, size_t len)
+{
+    bool has_rssi = diag->rssi_dbm != 0;
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+
+    put_header(&w, has_rssi ? 7 : 6, TELEMETRY_MSG_DIAG);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, diag->uptime_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_HEAP_FREE);
+    cbor_put_uint(&w, diag->heap_free);
+    cbor_put_uint(&w, TELEMETRY_KEY_HEAP_MIN);
+    cbor_put_uint(&w, diag->heap_min_free);
+    if (has_rssi) {
+        cbor_put_uint(&w, TELEMETRY_KEY_RSSI);
+        cbor_put_int(&w, diag->rssi_dbm);
+    }
+    cbor_put_uint(&w, TELEMETRY_KEY_DROPPED);
+    cbor_put_uint(&w, diag->dropped);
+    return cbor_writer_finish(&w);
+}
@@ -0,0 +1,109 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Codificación de la telemetría por muestra: un único documento con todos
+ * los campos, número de secuencia y timestamp, en lugar de un publish por campo.
+ *
+ * Dos codificaciones: JSON compacto (legible en Node-RED sin nodos extra) y
+ * CBOR binario con versión de esquema (ver abajo).
+ *
+ * No depende de ESP-IDF ni reserva memoria: escribe en el buffer del llamador.
+ */
+
+// Nombres del estado del agua usados en los tópicos y en el documento
+#define TELEMETRY_WATER_STATE_COUNT 3
+extern const char *const telemetry_water_state_str[TELEMETRY_WATER_STATE_COUNT];
+
+/**
+ * @brief Muestra a codificar
+ */
+typedef struct {
+    uint32_t seq;            // Número de muestra (tasks_wait_sample)
+    uint32_t timestamp_s;    // Segundos desde el arranque
+    float water_level_cm;    // -1 si la lectura falló
+    float tds_ppm;           // -1 si la lectura falló
+    uint8_t water_state;     // 0 = LIMPIA, 1 = MEDIA, 2 = SUCIA
+    bool pump_on;
+} telemetry_sample_t;
+
+/**
+ * @brief Codifica la muestra como JSON compacto
+ *
+ * Formato: {"seq":12,"ts":34,"level":125.50,"tds":450.2,"state":"LIMPIA","pump":"ON"}
+ *
+ * @return int Longitud escrita (sin el '\0'), o -1 si no cabe en @p len
+ */
+int telemetry_encode_json(const telemetry_sample_t *sample, char *buf, size_t len);
+
+/*
+ * Esquema binario: un map CBOR con claves enteras pequeñas (1 byte cada una).
+ * La clave 0 (versión) va siempre primero, así que el byte de versión queda
+ * en el offset 2 del payload y un consumidor puede rechazar esquemas
+ * desconocidos sin decodificar el resto. Un payload JSON empieza con '{'
+ * (0x7B) y uno CBOR con 0xA0..0xB7, de modo que ambos pueden compartir tópico.
+ *
+ * Cambios compatibles (claves nuevas) no suben la versión; cambiar el
+ * significado o la unidad de una clave existente sí.
+ */
+#define TELEMETRY_SCHEMA_VERSION 1
+
+// Tamaño de buffer suficiente para cualquier mensaje del esquema actual
+#define TELEMETRY_CBOR_MAX_LEN 64
+
+typedef enum {
+    TELEMETRY_MSG_SAMPLE = 1,    // Muestra de sensores
+    TELEMETRY_MSG_PUMP = 2,      // Cambio de estado de la bomba
+    TELEMETRY_MSG_DIAG = 3,      // Diagnóstico del nodo
+} telemetry_msg_type_t;
+
+typedef enum {
+    TELEMETRY_KEY_VERSION = 0,   // uint: TELEMETRY_SCHEMA_VERSION
+    TELEMETRY_KEY_TYPE = 1,      // uint: telemetry_msg_type_t
+    TELEMETRY_KEY_SEQ = 2,       // uint
+    TELEMETRY_KEY_TS = 3,        // uint: segundos desde el arranque
+    TELEMETRY_KEY_LEVEL = 4,     // float32: cm (-1 = lectura fallida)
+    TELEMETRY_KEY_TDS = 5,       // float32: ppm (-1 = lectura fallida)
+    TELEMETRY_KEY_STATE = 6,     // uint: 0 LIMPIA, 1 MEDIA, 2 SUCIA (se omite si no aplica)
+    TELEMETRY_KEY_PUMP = 7,      // bool
+    TELEMETRY_KEY_HEAP_FREE = 8, // uint: bytes
+    TELEMETRY_KEY_HEAP_MIN = 9,  // uint: bytes
+    TELEMETRY_KEY_RSSI = 10,     // int: dBm
+    TELEMETRY_KEY_DROPPED = 11,  // uint: mensajes descartados
+} telemetry_key_t;
+
+/**
+ * @brief Diagnóstico del nodo
+ */
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    int8_t rssi_dbm;             // 0 = desconocido (se omite)
+    uint32_t dropped;
+} telemetry_diag_t;
+
+/**
+ * @brief Codifica una muestra como CBOR (tipo TELEMETRY_MSG_SAMPLE)
+ *
+ * Si water_state >= TELEMETRY_WATER_STATE_COUNT la clave de estado se omite.
+ *
+ * @return int Longitud escrita, o -1 si no cabe en @p len
+ */
+int telemetry_encode_cbor(const telemetry_sample_t *sample, uint8_t *buf, size_t len);
+
+/**
+ * @brief Codifica un cambio de estado de la bomba como CBOR (tipo TELEMETRY_MSG_PUMP)
+ */
+int telemetry_encode_pump_cbor(bool pump_on, uint32_t timestamp_s, uint8_t *buf, size_t len);
+
+/**
+ * @brief Codifica el diagnóstico como CBOR (tipo TELEMETRY_MSG_DIAG)
+ */
+int telemetry_encode_diag_cbor(const telemetry_diag_t *diag, uint8_t *buf, size_t len);
+
+#endif // TELEMETRY_H
@@ -2,10 +2,14 @@
 #include "esp_timer.h"
 #include "rom/ets_sys.h"
 #include "esp_log.h"
+#include "power.h"
 
 static const char *TAG_ULTRA = "ultrasonic";
 static gpio_num_t s_trig_pin = GPIO_NUM_NC;
 static gpio_num_t s_echo_pin = GPIO_NUM_NC;
+/* The echo is timed by busy-waiting: keep the CPU clock fixed and the chip awake */
+static power_lock_t s_pm_cpu = NULL;
+static power_lock_t s_pm_awake = NULL;
 
 esp_err_t ultrasonic_driver_init(gpio_num_t trig_pin, gpio_num_t echo_pin)
 {
@@ -29,14 +33,13 @@ esp_err_t ultrasonic_driver_init(gpio_num_t trig_pin, gpio_num_t echo_pin)
     gpio_set_direction(s_echo_pin, GPIO_MODE_INPUT);
     gpio_set_level(s_trig_pin, 0);
 
+    power_lock_create(ESP_PM_CPU_FREQ_MAX, "ultra_cpu", &s_pm_cpu);
+    power_lock_create(ESP_PM_NO_LIGHT_SLEEP, "ultra_awake", &s_pm_awake);
     return ESP_OK;
 }
 
-float ultrasonic_driver_read_cm(void)
+static float ultrasonic_measure_cm(void)
 {
-    if (s_trig_pin == GPIO_NUM_NC || s_echo_pin == GPIO_NUM_NC) {
-        return -1.0f;
-    }
 
     gpio_set_level(s_trig_pin, 0);
     ets_delay_us(2);
@@ -66,3 +69,17 @@ float ultrasonic_driver_read_cm(void)
 
     return (float)(pulse_width_us * 0.0343f / 2.0f);
 }
+
+float ultrasonic_driver_read_cm(void)
+{
+    if (s_trig_pin == GPIO_NUM_NC || s_echo_pin == GPIO_NUM_NC) {
+        return -1.0f;
+    }
+
+    power_lock_acquire(s_pm_cpu);
+    power_lock_acquire(s_pm_awake);
+    float cm = ultrasonic_measure_cm();
+    power_lock_release(s_pm_awake);
+    power_lock_release(s_pm_cpu);
+    return cm;
+}
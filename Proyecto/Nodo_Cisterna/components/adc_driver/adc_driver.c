@@ -4,7 +4,13 @@
 #include <stdlib.h>
 
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "adc_ring.h"
 
 static const char *TAG = "adc_driver";
 
@@ -14,9 +20,18 @@ static const char *TAG = "adc_driver";
 #define ADC_ATTEN ADC_ATTEN_DB_11
 #define DEFAULT_VREF 1100
 
+// Continuous mode: bytes per DMA conversion frame and driver pool
+#define ADC_STREAM_FRAME_BYTES (64 * SOC_ADC_DIGI_RESULT_BYTES)
+#define ADC_STREAM_POOL_BYTES  (4 * ADC_STREAM_FRAME_BYTES)
+
 static int g_adc_channel = -1;
 static adc_oneshot_unit_handle_t adc_handle = NULL;
 
+static adc_continuous_handle_t s_stream_handle = NULL;
+static TaskHandle_t s_stream_task = NULL;
+static adc_ring_t s_stream_ring;
+static volatile bool s_streaming = false;
+
 esp_err_t adc_init(int channel)
 {
     esp_err_t ret = ESP_OK;
@@ -47,8 +62,139 @@ esp_err_t adc_init(int channel)
     return ESP_OK;
 }
 
+static bool IRAM_ATTR adc_stream_conv_done_cb(adc_continuous_handle_t handle,
+                                               const adc_continuous_evt_data_t *edata,
+                                               void *user_data)
+{
+    (void)handle; (void)edata; (void)user_data;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_stream_task, &woken);
+    return woken == pdTRUE;
+}
+
+// Drains DMA frames into the averaging ring whenever the driver signals
+static void adc_stream_task(void *arg)
+{
+    (void)arg;
+    static uint8_t frame[ADC_STREAM_FRAME_BYTES];
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t len = 0;
+        while (adc_continuous_read(s_stream_handle, frame, sizeof(frame), &len, 0) == ESP_OK) {
+            for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+                const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&frame[i];
+                if (p->type2.channel == (uint32_t)g_adc_channel) {
+                    adc_ring_push(&s_stream_ring, (uint16_t)p->type2.data);
+                }
+            }
+        }
+    }
+}
+
+static void adc_stream_teardown(void)
+{
+    if (s_stream_task) {
+        vTaskDelete(s_stream_task);
+        s_stream_task = NULL;
+    }
+    adc_continuous_deinit(s_stream_handle);
+    s_stream_handle = NULL;
+}
+
+esp_err_t adc_init_continuous(int channel, uint32_t sample_freq_hz, uint32_t avg_window)
+{
+    if (s_streaming) return ESP_ERR_INVALID_STATE;
+    if (sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW ||
+        sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) {
+        ESP_LOGE(TAG, "sample rate %u Hz out of range", (unsigned)sample_freq_hz);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The unit cannot be shared with oneshot mode
+    if (adc_handle) {
+        adc_oneshot_del_unit(adc_handle);
+        adc_handle = NULL;
+    }
+    g_adc_channel = channel;
+    adc_ring_init(&s_stream_ring, avg_window);
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = ADC_STREAM_POOL_BYTES,
+        .conv_frame_size = ADC_STREAM_FRAME_BYTES,
+    };
+    esp_err_t ret = adc_continuous_new_handle(&handle_cfg, &s_stream_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "adc_continuous_new_handle failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN,
+        .channel = (uint8_t)(channel & 0x7),
+        .unit = ADC_UNIT_ID,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    adc_continuous_config_t dig_cfg = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = sample_freq_hz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+    };
+    ret = adc_continuous_config(s_stream_handle, &dig_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "adc_continuous_config failed: %s", esp_err_to_name(ret));
+        adc_stream_teardown();
+        return ret;
+    }
+
+    if (xTaskCreate(adc_stream_task, "adc_stream", 3072, NULL, 4, &s_stream_task) != pdPASS) {
+        adc_stream_teardown();
+        return ESP_ERR_NO_MEM;
+    }
+
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = adc_stream_conv_done_cb,
+    };
+    ret = adc_continuous_register_event_callbacks(s_stream_handle, &cbs, NULL);
+    if (ret == ESP_OK) ret = adc_continuous_start(s_stream_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "adc_continuous start failed: %s", esp_err_to_name(ret));
+        adc_stream_teardown();
+        return ret;
+    }
+
+    s_streaming = true;
+    ESP_LOGI(TAG, "ADC initialized (continuous, %u Hz, window=%u)",
+             (unsigned)sample_freq_hz, (unsigned)s_stream_ring.window);
+    return ESP_OK;
+}
+
+bool adc_is_continuous(void)
+{
+    return s_streaming;
+}
+
+int adc_read_latest(void)
+{
+    if (!s_streaming || adc_ring_count(&s_stream_ring) == 0) return -1;
+    return (int)adc_ring_latest_avg(&s_stream_ring);
+}
+
+int adc_read_block(uint16_t *out, int n)
+{
+    if (!s_streaming || out == NULL || n <= 0) return 0;
+    return (int)adc_ring_copy_latest(&s_stream_ring, out, (size_t)n);
+}
+
 int adc_read_raw(int samples)
 {
+    // Continuous mode: the stream task already keeps the running average
+    if (s_streaming) {
+        int latest = adc_read_latest();
+        return latest < 0 ? 0 : latest;
+    }
+
     if (samples <= 0) samples = 10;
     long sum = 0;
     for (int i = 0; i < samples; ++i) {
@@ -4,9 +4,31 @@
 #include "esp_err.h"
 
 esp_err_t adc_init(int channel);
+
+/**
+ * Start continuous (DMA) acquisition on channel instead of oneshot mode.
+ * A background task keeps a running average of the last avg_window samples.
+ * sample_freq_hz: conversion rate (SOC_ADC_SAMPLE_FREQ_THRES_LOW..HIGH)
+ */
+esp_err_t adc_init_continuous(int channel, uint32_t sample_freq_hz, uint32_t avg_window);
+
+/** True when continuous acquisition is running. */
+bool adc_is_continuous(void);
+
+/** Latest averaged raw value, lock-free and O(1). -1 if not streaming yet. */
+int adc_read_latest(void);
+
+/**
+ * Copy the newest n raw samples (oldest first) from the continuous ring,
+ * at most ADC_RING_SIZE - 1. Returns the number of samples copied
+ * (0 if not streaming).
+ */
+int adc_read_block(uint16_t *out, int n);
+
 /**
  * Read averaged raw ADC value (0..4095 or hardware-dependent).
- * samples: number of samples to average
+ * samples: number of samples to average (ignored in continuous mode,
+ * which returns adc_read_latest() without blocking)
  */
 int adc_read_raw(int samples);
 
@@ -0,0 +1,78 @@
+#include "adc_ring.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define ADC_RING_MASK (ADC_RING_SIZE - 1)
+#define ADC_RING_COPY_RETRIES 4
+
+void adc_ring_init(adc_ring_t *ring, uint32_t window)
+{
+    if (window == 0) window = 1;
+    if (window > ADC_RING_SIZE) window = ADC_RING_SIZE;
+    memset(ring->samples, 0, sizeof(ring->samples));
+    ring->window = window;
+    ring->sum = 0;
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->filled, 0);
+    atomic_store(&ring->latest_avg, 0);
+}
+
+void adc_ring_push(adc_ring_t *ring, uint16_t sample)
+{
+    uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t filled = (uint32_t)atomic_load_explicit(&ring->filled, memory_order_relaxed);
+
+    // Drop the sample leaving the window before it is overwritten
+    if (filled >= ring->window) {
+        ring->sum -= ring->samples[(head - ring->window) & ADC_RING_MASK];
+    }
+    ring->samples[head & ADC_RING_MASK] = sample;
+    ring->sum += sample;
+    bool grow = filled < ADC_RING_SIZE;
+    if (grow) filled++;
+
+    uint32_t in_window = filled < ring->window ? filled : ring->window;
+    atomic_store_explicit(&ring->latest_avg, ring->sum / in_window, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    // After head: a reader that sees this fill level also sees the sample
+    if (grow) atomic_store_explicit(&ring->filled, filled, memory_order_release);
+}
+
+uint32_t adc_ring_latest_avg(const adc_ring_t *ring)
+{
+    return (uint32_t)atomic_load_explicit(&ring->latest_avg, memory_order_relaxed);
+}
+
+uint32_t adc_ring_count(const adc_ring_t *ring)
+{
+    return (uint32_t)atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+size_t adc_ring_copy_latest(const adc_ring_t *ring, uint16_t *out, size_t n)
+{
+    // The slot after the newest sample is the next one the producer writes
+    if (n > ADC_RING_SIZE - 1) n = ADC_RING_SIZE - 1;
+
+    for (int attempt = 0; attempt < ADC_RING_COPY_RETRIES; ++attempt) {
+        // Fill level first: every sample it counts is published by then
+        uint32_t filled = (uint32_t)atomic_load_explicit(&ring->filled, memory_order_acquire);
+        uint32_t head = adc_ring_count(ring);
+        size_t count = filled < n ? filled : n;
+        uint32_t first = head - (uint32_t)count;
+
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = ring->samples[(first + i) & ADC_RING_MASK];
+        }
+
+        // Valid only if the producer did not lap the copied range meanwhile.
+        // Sample `after` may be mid-write (head is bumped after the store),
+        // so it must not fall on a copied slot either.
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t after = adc_ring_count(ring);
+        if (after - first < ADC_RING_SIZE) {
+            return count;
+        }
+    }
+    return 0;
+}
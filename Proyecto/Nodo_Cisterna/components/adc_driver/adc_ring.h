@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Sample history ring with an O(1) running-window average.
+ *
+ * Single producer (the ADC stream task, or a host test feeding synthetic
+ * samples), any number of lock-free readers. No ESP-IDF dependencies.
+ */
+
+/** History capacity in samples (power of two). */
+#define ADC_RING_SIZE 512
+
+typedef struct {
+    uint16_t samples[ADC_RING_SIZE];
+    atomic_uint_fast32_t head;       // total samples written (wraps)
+    atomic_uint_fast32_t filled;     // valid history samples, saturates at ADC_RING_SIZE
+    atomic_uint_fast32_t latest_avg; // mean of the last `window` samples
+    uint32_t window;                 // averaging window, 1..ADC_RING_SIZE
+    uint32_t sum;                    // running sum of the window (producer only)
+} adc_ring_t;
+
+/** Reset the ring. window is clamped to 1..ADC_RING_SIZE. */
+void adc_ring_init(adc_ring_t *ring, uint32_t window);
+
+/** Producer: append one sample and update the running average. */
+void adc_ring_push(adc_ring_t *ring, uint16_t sample);
+
+/** Reader: latest averaged value (partial window until the ring fills). */
+uint32_t adc_ring_latest_avg(const adc_ring_t *ring);
+
+/** Reader: total samples pushed since init (wraps at 2^32). */
+uint32_t adc_ring_count(const adc_ring_t *ring);
+
+/**
+ * Reader: copy the newest n samples (oldest first) into out, at most
+ * ADC_RING_SIZE - 1 (the remaining slot is the one the producer writes next).
+ * Retries if the producer overwrote the range mid-copy.
+ * Returns the number of samples copied (less than n while the ring fills,
+ * 0 if a consistent copy could not be taken).
+ */
+size_t adc_ring_copy_latest(const adc_ring_t *ring, uint16_t *out, size_t n);
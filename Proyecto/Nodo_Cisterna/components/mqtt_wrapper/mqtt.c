@@ -1,12 +1,17 @@
 #include <string.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <inttypes.h>
 #include "esp_log.h"
 #include "esp_system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
 
 #include "mqtt.h"
+#include "lat_hist.h"
 
 static const char *TAG = "MQTT_STUB";
 
@@ -16,6 +21,68 @@ static const char *TAG = "MQTT_STUB";
  */
 static esp_mqtt_client_handle_t global_client = NULL;
 static bool mqtt_connected = false;
+static int64_t first_publish_us = 0;     // Primer publish entregado desde el arranque
+
+// Duración de mqtt_publish_class() para mensajes aceptados (µs), espera por lugar incluida
+static lat_hist_t publish_hist = LAT_HIST_INIT("pub");
+
+/*
+ * Contrapresión: el outbox de esp-mqtt guarda en heap cada mensaje QoS>0
+ * hasta su confirmación. La telemetría se admite solo mientras el outbox
+ * esté bajo OUTBOX_CAP_BYTES; el cliente recibe además un límite duro
+ * algo mayor, de modo que los mensajes de estado siempre tengan lugar.
+ * Lo más viejo sale por antigüedad (CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS,
+ * evento MQTT_EVENT_DELETED): esp-mqtt no permite quitar un mensaje puntual.
+ */
+#ifdef CONFIG_CISTERNA_MQTT_OUTBOX_CAP_KB
+#define OUTBOX_CAP_BYTES (CONFIG_CISTERNA_MQTT_OUTBOX_CAP_KB * 1024)
+#else
+#define OUTBOX_CAP_BYTES (16 * 1024)
+#endif
+#define OUTBOX_STATE_RESERVE 2048   // Lugar extra para mensajes de estado
+
+#if CONFIG_CISTERNA_MQTT_BP_BLOCK
+static mqtt_backpressure_t bp_policy = MQTT_BP_BLOCK;
+static uint32_t bp_timeout_ms = CONFIG_CISTERNA_MQTT_BP_TIMEOUT_MS;
+#else
+static mqtt_backpressure_t bp_policy = MQTT_BP_DROP;
+static uint32_t bp_timeout_ms = 200;
+#endif
+
+#define OUTBOX_SPACE_BIT BIT0   // Se liberó lugar (confirmación o expiración)
+
+static EventGroupHandle_t outbox_events = NULL;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_outbox_stats_t stats;
+
+static void stats_add(uint32_t *counter)
+{
+    portENTER_CRITICAL(&stats_mux);
+    (*counter)++;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/* Un mensaje QoS>0 dejó el outbox */
+static void outbox_released(uint32_t *counter)
+{
+    portENTER_CRITICAL(&stats_mux);
+    (*counter)++;
+    if (stats.depth > 0) {
+        stats.depth--;
+    }
+    portEXIT_CRITICAL(&stats_mux);
+    if (outbox_events) {
+        xEventGroupSetBits(outbox_events, OUTBOX_SPACE_BIT);
+    }
+}
+
+static void note_first_publish(void)
+{
+    if (first_publish_us == 0) {
+        first_publish_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "✓ Primer publish a los %" PRId64 " ms del arranque", first_publish_us / 1000);
+    }
+}
 
 static void internal_mqtt_event_handler(void *handler_args,
                                         esp_event_base_t base,
@@ -36,6 +103,17 @@ static void internal_mqtt_event_handler(void *handler_args,
             ESP_LOGW(TAG, "✗ Desconectado del broker MQTT");
             break;
 
+        case MQTT_EVENT_PUBLISHED:
+            note_first_publish();
+            outbox_released(&stats.acked);
+            break;
+
+        case MQTT_EVENT_DELETED:
+            // Expiró sin confirmación (msg_id en event->msg_id)
+            outbox_released(&stats.expired);
+            ESP_LOGW(TAG, "⚠ Mensaje %d descartado del outbox por antigüedad", event->msg_id);
+            break;
+
         case MQTT_EVENT_DATA:
             ESP_LOGI(TAG, "→ Mensaje recibido en %.*s: %.*s",
                      event->topic_len, event->topic,
@@ -55,14 +133,20 @@ void* mqtt_init(const mqtt_config_t *config,
                 esp_event_handler_t user_handler)
 {
     if (!config) return NULL;
+    lat_hist_register(&publish_hist);
 
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = config->broker_uri,
         .credentials.client_id = config->client_id,
         .credentials.username = config->username,
         .credentials.authentication.password = config->password,
+        .outbox.limit = OUTBOX_CAP_BYTES + OUTBOX_STATE_RESERVE,
     };
 
+    if (!outbox_events) {
+        outbox_events = xEventGroupCreate();
+    }
+
     global_client = esp_mqtt_client_init(&mqtt_cfg);
     if (!global_client) {
         ESP_LOGE(TAG, "✗ Error al inicializar MQTT");
@@ -104,7 +188,88 @@ esp_err_t mqtt_disconnect(void *client)
 int mqtt_publish(void *client, const char *topic,
                  const char *data, int data_len, int qos, bool retain)
 {
-    return esp_mqtt_client_publish(client, topic, data, data_len, qos, retain);
+    return mqtt_publish_class(client, topic, data, data_len, qos, retain, MQTT_MSG_TELEMETRY);
+}
+
+/* Espera lugar bajo el tope; true si lo hay */
+static bool outbox_wait_space(void *client, uint32_t timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (esp_mqtt_client_get_outbox_size(client) >= OUTBOX_CAP_BYTES) {
+        int64_t left_us = deadline - esp_timer_get_time();
+        if (left_us <= 0 || !outbox_events) {
+            return false;
+        }
+        xEventGroupWaitBits(outbox_events, OUTBOX_SPACE_BIT, pdTRUE, pdFALSE,
+                            pdMS_TO_TICKS(left_us / 1000) + 1);
+    }
+    return true;
+}
+
+/**
+ * @brief Publica aplicando el tope del outbox según la clase del mensaje
+ */
+int mqtt_publish_class(void *client, const char *topic, const char *data, int data_len,
+                       int qos, bool retain, mqtt_msg_class_t cls)
+{
+    int64_t start_us = esp_timer_get_time();
+    bool waited = false;
+
+    // QoS 0 no pasa por el outbox
+    if (cls == MQTT_MSG_TELEMETRY && qos > 0 &&
+        esp_mqtt_client_get_outbox_size(client) >= OUTBOX_CAP_BYTES) {
+        if (bp_policy != MQTT_BP_BLOCK || !outbox_wait_space(client, bp_timeout_ms)) {
+            stats_add(&stats.dropped);
+            return -2;
+        }
+        waited = true;
+    }
+
+    int msg_id = esp_mqtt_client_publish(client, topic, data, data_len, qos, retain);
+    if (msg_id < 0) {
+        // -2: límite duro del outbox; -1: error del cliente
+        stats_add(&stats.dropped);
+        return msg_id;
+    }
+
+    portENTER_CRITICAL(&stats_mux);
+    stats.accepted++;
+    if (waited) {
+        stats.retried++;
+    }
+    if (qos > 0) {
+        stats.depth++;
+    }
+    portEXIT_CRITICAL(&stats_mux);
+    lat_hist_record(&publish_hist, (uint32_t)(esp_timer_get_time() - start_us));
+
+    // QoS 0 no tiene confirmación: cuenta como entregado al salir por el socket
+    if (qos == 0 && mqtt_connected) {
+        note_first_publish();
+    }
+    return msg_id;
+}
+
+/**
+ * @brief Cambia la política de contrapresión
+ */
+void mqtt_set_backpressure(mqtt_backpressure_t policy, uint32_t timeout_ms)
+{
+    bp_policy = policy;
+    bp_timeout_ms = timeout_ms;
+}
+
+/**
+ * @brief Estado del outbox y contadores
+ */
+void mqtt_get_outbox_stats(mqtt_outbox_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_mux);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_mux);
+    int bytes = global_client ? esp_mqtt_client_get_outbox_size(global_client) : 0;
+    out->bytes = bytes > 0 ? (uint32_t)bytes : 0;
+    out->cap_bytes = OUTBOX_CAP_BYTES;
 }
 /**
  * @brief Se suscribe a un topic MQTT
@@ -127,4 +292,10 @@ void* mqtt_get_client(void)
 {
     return global_client;
 }
-
+/**
+ * @brief Momento del primer publish entregado
+ */
+int64_t mqtt_first_publish_us(void)
+{
+    return first_publish_us;
+}
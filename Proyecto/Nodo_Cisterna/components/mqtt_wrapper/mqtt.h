@@ -4,6 +4,7 @@
 #include "esp_err.h"
 #include "mqtt_client.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * @brief Estructura para configuración MQTT
@@ -15,6 +16,40 @@ typedef struct {
     char password[32];           // Contraseña (opcional)
 } mqtt_config_t;
 
+/**
+ * @brief Clase de mensaje para el control de contrapresión
+ *
+ * La telemetría se puede descartar o hacer esperar cuando el outbox supera
+ * el tope; los mensajes de estado (bomba, diagnóstico) entran siempre
+ * mientras quede lugar bajo el límite duro del cliente.
+ */
+typedef enum {
+    MQTT_MSG_TELEMETRY = 0,
+    MQTT_MSG_STATE,
+} mqtt_msg_class_t;
+
+/**
+ * @brief Qué hacer con la telemetría cuando el outbox está lleno
+ */
+typedef enum {
+    MQTT_BP_DROP = 0,   // Descartar el mensaje nuevo (lo viejo expira por edad)
+    MQTT_BP_BLOCK,      // Esperar hasta timeout_ms a que el broker confirme; si no, descartar
+} mqtt_backpressure_t;
+
+/**
+ * @brief Estado del outbox y contadores de contrapresión
+ */
+typedef struct {
+    uint32_t depth;         // Mensajes QoS>0 aceptados y aún sin confirmar
+    uint32_t bytes;         // Bytes ocupados en el outbox del cliente
+    uint32_t cap_bytes;     // Tope para telemetría
+    uint32_t accepted;      // Publicaciones aceptadas por el cliente
+    uint32_t acked;         // Confirmadas por el broker (PUBACK/PUBCOMP)
+    uint32_t dropped;       // Rechazadas por tope, límite duro o error
+    uint32_t retried;       // Aceptadas tras esperar lugar (MQTT_BP_BLOCK)
+    uint32_t expired;       // Descartadas del outbox por antigüedad
+} mqtt_outbox_stats_t;
+
 void* mqtt_init(const mqtt_config_t *config,
                 esp_event_handler_t event_handler);
 
@@ -24,12 +59,43 @@ esp_err_t mqtt_disconnect(void *client);
 int mqtt_publish(void *client, const char *topic,
                  const char *data, int data_len, int qos, bool retain);
 
+/**
+ * @brief Publica aplicando el tope del outbox según la clase del mensaje
+ *
+ * Con MQTT_BP_BLOCK la telemetría puede bloquear la tarea que llama: no
+ * usar desde el handler de eventos MQTT (las confirmaciones se procesan
+ * en esa misma tarea).
+ *
+ * @return int msg_id (>= 0), -1 si el cliente falló, -2 si se descartó por tope
+ */
+int mqtt_publish_class(void *client, const char *topic, const char *data, int data_len,
+                       int qos, bool retain, mqtt_msg_class_t cls);
+
+/**
+ * @brief Cambia la política de contrapresión en tiempo de ejecución
+ */
+void mqtt_set_backpressure(mqtt_backpressure_t policy, uint32_t timeout_ms);
+
+/**
+ * @brief Copia el estado actual del outbox y los contadores
+ */
+void mqtt_get_outbox_stats(mqtt_outbox_stats_t *stats);
+
 int mqtt_subscribe(void *client, const char *topic, int qos);
 
 bool mqtt_is_connected(void *client);
 
 void* mqtt_get_client(void);
 
+/**
+ * @brief Tiempo desde el arranque hasta el primer publish entregado
+ *
+ * QoS 1/2: al recibir la confirmación del broker; QoS 0: al enviarlo.
+ *
+ * @return int64_t Microsegundos de esp_timer, o 0 si aún no hubo ninguno
+ */
+int64_t mqtt_first_publish_us(void);
+
 #endif
 
 
@@ -0,0 +1,160 @@
+#include "power.h"
+
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "POWER";
+
+struct power_lock {
+    const char *name;
+    esp_pm_lock_handle_t handle;   // NULL sin CONFIG_PM_ENABLE
+    uint32_t depth;
+    int64_t since_us;              // Inicio de la retención en curso
+    uint32_t acquisitions;
+    uint64_t held_us;
+    uint64_t window_held_us;
+};
+
+static struct power_lock s_locks[POWER_MAX_LOCKS];
+static int s_lock_count = 0;
+static int64_t s_window_start_us = 0;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t power_init(const power_config_t *cfg)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_cfg = {
+        .max_freq_mhz = cfg->max_mhz,
+        .min_freq_mhz = cfg->min_mhz,
+        .light_sleep_enable = cfg->light_sleep,
+    };
+    esp_err_t ret = esp_pm_configure(&pm_cfg);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "✓ PM: %d-%d MHz, light sleep %s",
+                 cfg->min_mhz, cfg->max_mhz, cfg->light_sleep ? "activo" : "inactivo");
+    } else {
+        ESP_LOGE(TAG, "✗ esp_pm_configure: %s", esp_err_to_name(ret));
+    }
+    return ret;
+#else
+    (void)cfg;
+    ESP_LOGW(TAG, "⚠ Compilado sin CONFIG_PM_ENABLE: solo contabilidad de locks");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t power_lock_create(esp_pm_lock_type_t type, const char *name, power_lock_t *out)
+{
+    portENTER_CRITICAL(&s_mux);
+    if (s_lock_count >= POWER_MAX_LOCKS) {
+        portEXIT_CRITICAL(&s_mux);
+        return ESP_ERR_NO_MEM;
+    }
+    struct power_lock *lock = &s_locks[s_lock_count++];
+    if (s_window_start_us == 0) {
+        s_window_start_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&s_mux);
+
+    lock->name = name;
+    lock->handle = NULL;
+#if CONFIG_PM_ENABLE
+    esp_err_t ret = esp_pm_lock_create(type, 0, name, &lock->handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "✗ esp_pm_lock_create(%s): %s", name, esp_err_to_name(ret));
+        return ret;
+    }
+#else
+    (void)type;
+#endif
+    *out = lock;
+    return ESP_OK;
+}
+
+void power_lock_acquire(power_lock_t lock)
+{
+    if (lock == NULL) {
+        return;
+    }
+    // Tomar el lock de esp_pm antes de medir: la CPU ya sube de frecuencia
+    if (lock->handle) {
+        esp_pm_lock_acquire(lock->handle);
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_mux);
+    if (lock->depth++ == 0) {
+        lock->since_us = now;
+        lock->acquisitions++;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void power_lock_release(power_lock_t lock)
+{
+    if (lock == NULL) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_mux);
+    if (lock->depth > 0 && --lock->depth == 0) {
+        uint64_t held = (uint64_t)(now - lock->since_us);
+        lock->held_us += held;
+        lock->window_held_us += held;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (lock->handle) {
+        esp_pm_lock_release(lock->handle);
+    }
+}
+
+// Copia consistente; cuenta como retenido el tramo en curso
+static void snapshot_stats(const struct power_lock *lock, int64_t now, power_lock_stats_t *stats)
+{
+    uint64_t running = lock->depth > 0 ? (uint64_t)(now - lock->since_us) : 0;
+    stats->name = lock->name;
+    stats->acquisitions = lock->acquisitions;
+    stats->held_us = lock->held_us + running;
+    stats->window_held_us = lock->window_held_us + running;
+    stats->window_us = (uint64_t)(now - s_window_start_us);
+}
+
+void power_lock_get_stats(power_lock_t lock, power_lock_stats_t *stats)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_mux);
+    snapshot_stats(lock, now, stats);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void power_report(void)
+{
+    power_lock_stats_t stats[POWER_MAX_LOCKS];
+    int count;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_mux);
+    count = s_lock_count;
+    for (int i = 0; i < count; i++) {
+        struct power_lock *lock = &s_locks[i];
+        snapshot_stats(lock, now, &stats[i]);
+        lock->window_held_us = 0;
+        if (lock->depth > 0) {
+            // El tramo en curso ya se contó en esta ventana
+            lock->held_us += (uint64_t)(now - lock->since_us);
+            lock->since_us = now;
+        }
+    }
+    s_window_start_us = now;
+    portEXIT_CRITICAL(&s_mux);
+
+    for (int i = 0; i < count; i++) {
+        const power_lock_stats_t *s = &stats[i];
+        uint32_t duty_permille = s->window_us ? (uint32_t)(s->window_held_us * 1000 / s->window_us) : 0;
+        uint32_t avg_ms = s->acquisitions ? (uint32_t)(s->held_us / 1000 / s->acquisitions) : 0;
+        ESP_LOGI(TAG, "  Lock %-12s retenido %3" PRIu32 ".%" PRIu32 " %% | %" PRIu32 " veces | media %" PRIu32 " ms",
+                 s->name, duty_permille / 10, duty_permille % 10, s->acquisitions, avg_ms);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_pm.h"
+
+/*
+ * Gestión de energía: frecuencia dinámica, light sleep automático y locks
+ * de esp_pm con contabilidad del tiempo retenido.
+ *
+ * Los drivers retienen un lock solo mientras miden (ADC, eco ultrasónico);
+ * el resto del tiempo el sistema baja la CPU a min_mhz y, si está
+ * habilitado, entra en light sleep cuando FreeRTOS queda ocioso (tickless
+ * idle). power_report() muestra qué fracción del tiempo estuvo retenido
+ * cada lock: es la fracción en la que el nodo no pudo dormir por él.
+ *
+ * Sin CONFIG_PM_ENABLE los locks no existen en esp_pm pero la contabilidad
+ * funciona igual, así que el reporte sirve para estimar el ahorro antes de
+ * activarlo.
+ */
+
+// Locks registrables (los muestra power_report)
+#define POWER_MAX_LOCKS 8
+
+typedef struct {
+    int max_mhz;             // Frecuencia con algún lock CPU_FREQ_MAX retenido
+    int min_mhz;             // Frecuencia en reposo (p. ej. 40 = XTAL)
+    bool light_sleep;        // Light sleep automático en idle
+} power_config_t;
+
+typedef struct power_lock *power_lock_t;
+
+/**
+ * @brief Estadística de un lock
+ */
+typedef struct {
+    const char *name;
+    uint32_t acquisitions;   // Veces que pasó de libre a retenido
+    uint64_t held_us;        // Tiempo total retenido desde el arranque
+    uint64_t window_held_us; // Retenido desde el último power_report()
+    uint64_t window_us;      // Duración de la ventana del reporte
+} power_lock_stats_t;
+
+/**
+ * @brief Configura DFS y light sleep automático
+ *
+ * @return ESP_ERR_NOT_SUPPORTED si el firmware se compiló sin CONFIG_PM_ENABLE
+ */
+esp_err_t power_init(const power_config_t *cfg);
+
+/**
+ * @brief Crea un lock con nombre (aparece en el reporte)
+ *
+ * @param type ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX o ESP_PM_NO_LIGHT_SLEEP
+ */
+esp_err_t power_lock_create(esp_pm_lock_type_t type, const char *name, power_lock_t *out);
+
+/**
+ * @brief Retiene el lock (anidable; seguro desde varias tareas, no desde ISR)
+ */
+void power_lock_acquire(power_lock_t lock);
+
+/**
+ * @brief Libera una retención de power_lock_acquire()
+ */
+void power_lock_release(power_lock_t lock);
+
+/**
+ * @brief Copia la estadística de un lock
+ */
+void power_lock_get_stats(power_lock_t lock, power_lock_stats_t *stats);
+
+/**
+ * @brief Registra en el log el ciclo de trabajo de cada lock y abre una ventana nueva
+ */
+void power_report(void);
+
+#endif // POWER_H
@@ -0,0 +1,75 @@
+#include "upload_sched.h"
+
+#include <math.h>
+#include <string.h>
+
+void upload_sched_init(upload_sched_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->ref_level_cm = -1.0f;
+}
+
+upload_reason_t upload_sched_on_sample(upload_sched_t *s, const upload_policy_t *p,
+                                       uint32_t buffered, float level_cm, uint8_t water_state)
+{
+    // En espera tras un fallo: seguir acumulando (el buffer descarta lo más viejo)
+    if (s->retry_in > 0) {
+        s->retry_in--;
+        return UPLOAD_NONE;
+    }
+
+    if (!s->have_ref && s->fail_streak == 0) {
+        return UPLOAD_FIRST;
+    }
+    if (s->have_ref) {
+        if (p->level_delta_cm > 0.0f && level_cm >= 0.0f && s->ref_level_cm >= 0.0f &&
+            fabsf(level_cm - s->ref_level_cm) >= p->level_delta_cm) {
+            return UPLOAD_THRESHOLD;
+        }
+        if (water_state != s->ref_state) {
+            return UPLOAD_STATE;
+        }
+    }
+    if (p->capacity > 0 && buffered >= p->capacity) {
+        return UPLOAD_FULL;
+    }
+    if (buffered >= (p->every_n ? p->every_n : 1)) {
+        return UPLOAD_COUNT;
+    }
+    return UPLOAD_NONE;
+}
+
+void upload_sched_done(upload_sched_t *s, const upload_policy_t *p, bool ok,
+                       float level_cm, uint8_t water_state)
+{
+    if (ok) {
+        s->have_ref = true;
+        // Una lectura fallida no reemplaza la referencia de nivel
+        if (level_cm >= 0.0f) {
+            s->ref_level_cm = level_cm;
+        }
+        s->ref_state = water_state;
+        s->fail_streak = 0;
+        s->retry_in = 0;
+        return;
+    }
+
+    if (s->fail_streak < UINT16_MAX) {
+        s->fail_streak++;
+    }
+    uint32_t wait = 1u << (s->fail_streak - 1 < 15 ? s->fail_streak - 1 : 15);
+    uint16_t cap = p->max_backoff ? p->max_backoff : 1;
+    s->retry_in = (uint16_t)(wait < cap ? wait : cap);
+}
+
+const char *upload_reason_str(upload_reason_t reason)
+{
+    switch (reason) {
+        case UPLOAD_FIRST:     return "primer arranque";
+        case UPLOAD_THRESHOLD: return "cambio de nivel";
+        case UPLOAD_STATE:     return "cambio de estado";
+        case UPLOAD_COUNT:     return "lote completo";
+        case UPLOAD_FULL:      return "buffer lleno";
+        default:               return "ninguno";
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef UPLOAD_SCHED_H
+#define UPLOAD_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Planificador de subidas del modo deep sleep: en cada despertar se toma una
+ * muestra y se decide si vale la pena encender Wi-Fi + MQTT (lo más caro del
+ * ciclo) para subir todo el buffer de una vez.
+ *
+ * Se sube cuando:
+ * - es la primera muestra tras un arranque en frío (valida la conexión),
+ * - el nivel se apartó al menos level_delta_cm del último nivel subido,
+ * - cambió la clasificación del agua respecto de la última subida,
+ * - el buffer llegó a every_n muestras o a su capacidad.
+ *
+ * Tras una subida fallida se espera 1, 2, 4... muestras (hasta
+ * max_backoff) antes de reintentar, para no gastar la batería intentando
+ * conectar en cada despertar mientras la red no está.
+ *
+ * El estado cabe en memoria RTC y no depende de ESP-IDF.
+ */
+
+typedef enum {
+    UPLOAD_NONE = 0,
+    UPLOAD_FIRST,            // Primera muestra desde el arranque en frío
+    UPLOAD_THRESHOLD,        // El nivel cruzó la banda alrededor del último valor subido
+    UPLOAD_STATE,            // Cambió el estado del agua
+    UPLOAD_COUNT,            // Se juntaron every_n muestras
+    UPLOAD_FULL,             // El buffer RTC está lleno
+} upload_reason_t;
+
+typedef struct {
+    uint16_t every_n;        // Subir cada N muestras
+    uint16_t capacity;       // Muestras que caben en el buffer
+    float level_delta_cm;    // Banda de nivel (0 = sin disparo por nivel)
+    uint16_t max_backoff;    // Máximo de muestras entre reintentos
+} upload_policy_t;
+
+typedef struct {
+    bool have_ref;           // Hubo al menos una subida exitosa
+    float ref_level_cm;      // Nivel de la última muestra subida (-1 si era inválido)
+    uint8_t ref_state;       // Estado del agua de la última muestra subida
+    uint16_t fail_streak;    // Subidas fallidas seguidas
+    uint16_t retry_in;       // Muestras a esperar antes de reintentar
+} upload_sched_t;
+
+/**
+ * @brief Estado inicial (arranque en frío)
+ */
+void upload_sched_init(upload_sched_t *s);
+
+/**
+ * @brief Decide si subir tras guardar una muestra
+ *
+ * @param buffered Muestras en el buffer, incluida la recién guardada
+ * @param level_cm Nivel de la muestra (-1 si la lectura falló)
+ * @param water_state Estado del agua de la muestra
+ * @return upload_reason_t UPLOAD_NONE para volver a dormir sin conectar
+ */
+upload_reason_t upload_sched_on_sample(upload_sched_t *s, const upload_policy_t *p,
+                                       uint32_t buffered, float level_cm, uint8_t water_state);
+
+/**
+ * @brief Informa el resultado de la subida
+ *
+ * Con @p ok la muestra pasada se vuelve la referencia para el disparo por
+ * nivel y estado; sin él se programa el siguiente reintento.
+ */
+void upload_sched_done(upload_sched_t *s, const upload_policy_t *p, bool ok,
+                       float level_cm, uint8_t water_state);
+
+/**
+ * @brief Nombre del motivo para el log
+ */
+const char *upload_reason_str(upload_reason_t reason);
+
+#endif // UPLOAD_SCHED_H
@@ -0,0 +1,150 @@
+#include "level_kalman.h"
+
+#include <string.h>
+
+// Incertidumbre inicial de la velocidad: del orden del caudal de la bomba
+#define LEVEL_KALMAN_INIT_RATE_SD 1.0f   // cm/s
+
+void level_kalman_init(level_kalman_t *kf, const level_kalman_config_t *cfg)
+{
+    memset(kf, 0, sizeof(*kf));
+    kf->cfg = *cfg;
+    kf->r = cfg->meas_sd_cm * cfg->meas_sd_cm;
+    kf->q = cfg->accel_noise * cfg->accel_noise;
+    kf->gate2 = cfg->gate_sigma * cfg->gate_sigma;
+}
+
+static void reset_to(level_kalman_t *kf, float level_cm, float rate, bool tracking)
+{
+    kf->valid = true;
+    kf->tracking = tracking;
+    kf->level = level_cm;
+    kf->rate = rate;
+    kf->p00 = kf->r;
+    kf->p01 = 0.0f;
+    kf->p11 = LEVEL_KALMAN_INIT_RATE_SD * LEVEL_KALMAN_INIT_RATE_SD;
+    kf->gap_s = 0.0f;
+    kf->rejects = 0;
+}
+
+// x = F x, P = F P F' + Q con F = [1 dt; 0 1] y aceleración blanca
+static void predict(level_kalman_t *kf, float dt)
+{
+    float qdt = kf->q * dt;
+    kf->level += kf->rate * dt;
+    kf->p00 += dt * (2.0f * kf->p01 + dt * kf->p11) + qdt * dt * dt * (1.0f / 3.0f);
+    kf->p01 += dt * kf->p11 + qdt * dt * 0.5f;
+    kf->p11 += qdt;
+}
+
+static void output(const level_kalman_t *kf, bool measured, level_kalman_out_t *out)
+{
+    // Con una sola lectura todavía no hay velocidad: no se publica
+    out->valid = kf->valid && kf->tracking;
+    out->measured = measured;
+    out->eta_min = -1.0f;
+    if (!out->valid) {
+        out->level_cm = -1.0f;
+        out->rate_cm_min = 0.0f;
+        return;
+    }
+
+    float rate_min = kf->rate * 60.0f;
+    out->level_cm = kf->level;
+    out->rate_cm_min = rate_min;
+
+    // Tiempo estimado solo con una tendencia clara: por encima del umbral y
+    // de dos desvíos de la propia estimación de velocidad
+    float stable = kf->cfg.stable_cm_min;
+    if (rate_min * rate_min > stable * stable && kf->rate * kf->rate > 4.0f * kf->p11) {
+        // Nivel, no distancia: lleno en full_cm, vacío en 0
+        float left = rate_min > 0.0f ? kf->cfg.full_cm - kf->level : -kf->level;
+        float eta = left / rate_min;
+        out->eta_min = eta > 0.0f ? eta : 0.0f;
+    }
+}
+
+// Sigue las lecturas rechazadas como una recta candidata: solo cuentan como
+// cambio real si son coherentes entre sí (ecos espurios sueltos no lo son).
+// Retorna true cuando la candidata junta max_rejects lecturas.
+static bool track_reject(level_kalman_t *kf, float level_cm)
+{
+    bool extend = false;
+    if (kf->rejects == 1) {
+        extend = kf->cand_age_s > 0.0f;
+    } else if (kf->rejects >= 2 && kf->cand_age_s > 0.0f) {
+        float e = level_cm - (kf->cand_level + kf->cand_rate * kf->cand_age_s);
+        extend = e * e <= kf->gate2 * 2.0f * kf->r;
+    }
+
+    if (extend) {
+        kf->cand_span_s += kf->cand_age_s;
+        kf->cand_rate = (level_cm - kf->cand_first) / kf->cand_span_s;
+        kf->rejects++;
+    } else {
+        kf->cand_first = level_cm;
+        kf->cand_span_s = 0.0f;
+        kf->cand_rate = 0.0f;
+        kf->rejects = 1;
+    }
+    kf->cand_level = level_cm;
+    kf->cand_age_s = 0.0f;
+    return kf->rejects >= kf->cfg.max_rejects;
+}
+
+void level_kalman_update(level_kalman_t *kf, float level_cm, float dt_s, level_kalman_out_t *out)
+{
+    if (kf->valid && dt_s > 0.0f) {
+        predict(kf, dt_s);
+        kf->gap_s += dt_s;
+        kf->cand_age_s += dt_s;
+        if (kf->gap_s > kf->cfg.max_gap_s) {
+            kf->valid = false;
+            kf->resets++;
+        }
+    }
+
+    if (level_cm < 0.0f) {
+        output(kf, false, out);
+        return;
+    }
+
+    if (!kf->valid) {
+        reset_to(kf, level_cm, 0.0f, false);
+        output(kf, true, out);
+        return;
+    }
+
+    float y = level_cm - kf->level;
+    float s = kf->p00 + kf->r;
+    if (kf->gate2 > 0.0f && y * y > kf->gate2 * s) {
+        if (track_reject(kf, level_cm)) {
+            reset_to(kf, level_cm, kf->cand_rate, true);
+            kf->resets++;
+            output(kf, true, out);
+        } else {
+            output(kf, false, out);
+        }
+        return;
+    }
+
+    float inv_s = 1.0f / s;
+    float k0 = kf->p00 * inv_s;
+    float k1 = kf->p01 * inv_s;
+    kf->level += k0 * y;
+    kf->rate += k1 * y;
+    kf->p11 -= k1 * kf->p01;
+    kf->p01 -= k0 * kf->p01;
+    kf->p00 -= k0 * kf->p00;
+    kf->gap_s = 0.0f;
+    kf->rejects = 0;
+    kf->tracking = true;
+    output(kf, true, out);
+}
+
+void level_kalman_maneuver(level_kalman_t *kf)
+{
+    if (kf->valid) {
+        kf->p11 += LEVEL_KALMAN_INIT_RATE_SD * LEVEL_KALMAN_INIT_RATE_SD;
+    }
+}
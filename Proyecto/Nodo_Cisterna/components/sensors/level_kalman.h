@@ -0,0 +1,93 @@
+#ifndef LEVEL_KALMAN_H
+#define LEVEL_KALMAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Estimación del nivel y de su velocidad de llenado/vaciado con un filtro de
+ * Kalman de dos estados (nivel, velocidad) y modelo de velocidad constante.
+ *
+ * La aceleración del nivel se modela como ruido blanco: accel_noise fija
+ * cuánto puede cambiar la velocidad entre muestras (arranque o parada de la
+ * bomba, consumo). Más alto sigue antes los cambios y deja pasar más ruido.
+ *
+ * Una lectura fallida (nivel negativo) solo predice: el estimado sigue la
+ * última velocidad y su incertidumbre crece. Tras max_gap_s sin mediciones
+ * el estimado se invalida y la siguiente lectura lo reinicia. Una lectura
+ * a más de gate_sigma desvíos de la predicción se descarta como outlier;
+ * max_rejects descartes seguidos y alineados entre sí se toman como un
+ * cambio real (un salto o un arranque de bomba que la predicción no siguió)
+ * y reinician el filtro en la última lectura con la velocidad entre ellas.
+ *
+ * La medición es un nivel que sube al llenar (full_cm es lleno y 0 vacío),
+ * no la distancia del sensor a la superficie: por eso el filtro de
+ * sensor.c requiere CISTERNA_TANK_HEIGHT_CM.
+ *
+ * Precisión simple, tamaño fijo (covarianza 2x2 simétrica en tres floats),
+ * sin memoria dinámica ni raíces. No es thread-safe ni depende de ESP-IDF
+ * (se mide en el host, ver tools/level_kalman).
+ */
+
+typedef struct {
+    float meas_sd_cm;        // Desvío del ruido de medición
+    float accel_noise;       // Ruido de proceso: raíz de la densidad espectral de la aceleración (cm/s^1.5)
+    float gate_sigma;        // Rechazo de outliers en desvíos de la innovación (0 = sin rechazo)
+    uint8_t max_rejects;     // Outliers seguidos que reinician el filtro
+    float max_gap_s;         // Sin mediciones más que esto: estimado inválido
+    float full_cm;           // Nivel de cisterna llena (tiempo hasta lleno)
+    float stable_cm_min;     // Por debajo de esta velocidad no se estima tiempo
+} level_kalman_config_t;
+
+typedef struct {
+    bool valid;              // Hay estimado (false hasta la segunda lectura y tras un hueco largo)
+    bool measured;           // Esta muestra corrigió el estimado (false = solo predicción)
+    float level_cm;          // Nivel filtrado
+    float rate_cm_min;       // Velocidad: positiva llenando, negativa vaciando
+    float eta_min;           // Minutos hasta lleno (llenando) o vacío (vaciando); -1 = estable
+} level_kalman_out_t;
+
+typedef struct {
+    level_kalman_config_t cfg;
+    float r;                 // meas_sd_cm^2
+    float q;                 // accel_noise^2
+    float gate2;             // gate_sigma^2
+    bool valid;              // Hay estado (desde la primera lectura)
+    bool tracking;           // La velocidad ya se corrigió con una lectura
+    float level;             // cm
+    float rate;              // cm/s
+    float p00, p01, p11;     // Covarianza
+    float gap_s;             // Tiempo desde la última medición aceptada
+    uint8_t rejects;         // Outliers seguidos y coherentes entre sí
+    float cand_first;        // Primera lectura rechazada de la racha
+    float cand_level;        // Última lectura rechazada
+    float cand_rate;         // Velocidad de la primera a la última (cm/s)
+    float cand_span_s;       // Tiempo de la primera a la última
+    float cand_age_s;        // Tiempo desde la última lectura rechazada
+    uint32_t resets;         // Reinicios por hueco largo o salto
+} level_kalman_t;
+
+/**
+ * @brief Inicializa el filtro sin estimado
+ */
+void level_kalman_init(level_kalman_t *kf, const level_kalman_config_t *cfg);
+
+/**
+ * @brief Procesa una muestra
+ *
+ * @param level_cm Nivel medido; negativo = lectura fallida
+ * @param dt_s Tiempo desde la muestra anterior (ignorado en la primera)
+ * @param out Estimado tras la muestra
+ */
+void level_kalman_update(level_kalman_t *kf, float level_cm, float dt_s, level_kalman_out_t *out);
+
+/**
+ * @brief Avisa un cambio de caudal conocido (arranque o parada de la bomba)
+ *
+ * La velocidad vuelve a la incertidumbre inicial: las lecturas siguientes
+ * corrigen la velocidad de inmediato en lugar de rechazarse como outliers.
+ * Llamar antes del update de la muestra siguiente.
+ */
+void level_kalman_maneuver(level_kalman_t *kf);
+
+#endif // LEVEL_KALMAN_H
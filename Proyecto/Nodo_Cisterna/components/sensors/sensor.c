@@ -5,12 +5,19 @@
 #include "driver/gpio.h"
 #include "driver/uart.h"
 #include "esp_timer.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "tds.h"
 #include "adc_driver.h"
 #include "storage.h"
-#include "esp_console.h"
 
 #include "sensor.h"
+#include "ultrasonic_echo.h"
+#include "ultrasonic_filter.h"
+#include "level_kalman.h"
+#include "power.h"
+#include "lat_hist.h"
 
 static const char *TAG = "SENSOR";
 
@@ -22,14 +29,68 @@ static int g_echo_pin = -1;
 // Canal ADC para TDS
 static int g_tds_adc_channel = -1;
 
+// Locks de energía retenidos solo mientras sensor_read_all() mide:
+// la ISR de flancos y los esp_timer de la ráfaga no funcionan en light
+// sleep, y la CPU a frecuencia máxima acorta la ventana de medición
+static power_lock_t g_pm_no_sleep = NULL;
+static power_lock_t g_pm_cpu = NULL;
+
+// Duración de sensor_read_all() (µs), en el diagnóstico y el comando "lat"
+static lat_hist_t g_read_hist = LAT_HIST_INIT("read");
+
 // Constantes para sensor ultrasónico
 #define ULTRASONIC_PULSE_DURATION_US 10
 
-// --- Consola: comandos para calibración TDS ---
-static int cmd_calA(int argc, char **argv);
-static int cmd_calB(int argc, char **argv);
-static int cmd_save(int argc, char **argv);
-static int cmd_show(int argc, char **argv);
+// Captura asíncrona del ECHO (ISR de flancos + esp_timer para timeouts)
+static echo_capture_t g_echo_cap = { .state = ECHO_STATE_IDLE };
+static portMUX_TYPE g_echo_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t g_echo_timer = NULL;
+static TaskHandle_t g_echo_waiter = NULL;
+static sensor_echo_cb_t g_echo_cb = NULL;
+static void *g_echo_cb_ctx = NULL;
+
+// Ráfaga de pings: el HC-SR04 necesita ~60 ms entre disparos para que se
+// apaguen los ecos del anterior
+#define ULTRASONIC_RECOVERY_US 60000
+
+static struct {
+    sensor_burst_config_t cfg;
+    ultrasonic_filter_cfg_t filter;
+    uint32_t widths[ULTRASONIC_BURST_MAX];
+    uint8_t fired;
+    int64_t last_ping_us;
+    volatile bool active;
+    sensor_echo_cb_t cb;
+    void *ctx;
+    TaskHandle_t waiter;
+    esp_err_t result;
+    float distance;
+    esp_timer_handle_t timer;
+} g_burst = {
+    .cfg = {
+        .pings = CONFIG_CISTERNA_ULTRASONIC_BURST_PINGS,
+        .outlier_mm = CONFIG_CISTERNA_ULTRASONIC_OUTLIER_MM,
+        .trim = CONFIG_CISTERNA_ULTRASONIC_TRIM,
+        .min_valid = CONFIG_CISTERNA_ULTRASONIC_MIN_VALID,
+    },
+};
+
+#if CONFIG_CISTERNA_LEVEL_FILTER
+#if CONFIG_CISTERNA_TANK_HEIGHT_CM <= 0 || CONFIG_CISTERNA_LEVEL_FULL_CM > CONFIG_CISTERNA_TANK_HEIGHT_CM
+#error "Filtro de nivel: requiere CISTERNA_TANK_HEIGHT_CM >= CISTERNA_LEVEL_FULL_CM"
+#endif
+// Rechazos seguidos y alineados que se toman como cambio real de nivel
+#define LEVEL_KF_MAX_REJECTS 3
+
+// Filtro de Kalman del nivel: solo lo toca sensor_read_all() (tarea de muestreo)
+static level_kalman_t g_level_kf;
+static int64_t g_level_kf_last_us = 0;
+// Conmutación de la bomba pendiente de aplicar en la próxima lectura
+static volatile bool g_level_kf_maneuver = false;
+#endif
+
+static esp_err_t ultrasonic_capture_init(void);
+static void burst_timer_cb(void *arg);
 
 
 /**
@@ -39,6 +100,7 @@ esp_err_t sensor_init(int ultrasonic_trig_pin, int ultrasonic_echo_pin,
                       int tds_adc_pin)
 {
     ESP_LOGI(TAG, "→ Inicializando sensores...");
+    lat_hist_register(&g_read_hist);
 
         // Almacenar pines
         g_trig_pin = ultrasonic_trig_pin;
@@ -61,7 +123,8 @@ esp_err_t sensor_init(int ultrasonic_trig_pin, int ultrasonic_echo_pin,
         return ret;
     }
 
-    // Configurar ECHO como entrada
+    // Configurar ECHO como entrada con interrupción en ambos flancos
+    io_conf.intr_type = GPIO_INTR_ANYEDGE;
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pin_bit_mask = (1ULL << g_echo_pin);
     io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
@@ -73,49 +136,46 @@ esp_err_t sensor_init(int ultrasonic_trig_pin, int ultrasonic_echo_pin,
         return ret;
     }
 
+    ret = ultrasonic_capture_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "✗ Error configurando captura de ECHO: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
     // ========== Configurar sensor TDS (ADC) ==========
+#if CONFIG_CISTERNA_TDS_ADC_CONTINUOUS
+    // Muestreo continuo por DMA: tds_read_raw() pasa a ser O(1)
+    ret = adc_init_continuous(g_tds_adc_channel,
+                              CONFIG_CISTERNA_TDS_ADC_SAMPLE_HZ,
+                              CONFIG_CISTERNA_TDS_ADC_AVG_WINDOW);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "⚠ ADC continuo no disponible (%s), usando oneshot", esp_err_to_name(ret));
+        adc_init(g_tds_adc_channel);
+    }
+#else
     adc_init(g_tds_adc_channel);
+#endif
 
     tds_init();
     tds_load_calibration();
 
-    // Registrar comandos de consola para calibración TDS:
-    // calA  -> tomar lectura actual y guardarla como punto A (offset)
-    // calB  -> tomar lectura actual y usarla como punto B (gain)
-    // save  -> guardar calibración en NVS
-    // show  -> mostrar offset/gain actuales
-    {
-        static const esp_console_cmd_t calA_cmd_struct = {
-            .command = "calA",
-            .help = "Calibrar punto A (offset) con lectura actual",
-            .hint = NULL,
-            .func = &cmd_calA,
-        };
-        esp_console_cmd_register(&calA_cmd_struct);
-
-        static const esp_console_cmd_t calB_cmd_struct = {
-            .command = "calB",
-            .help = "Calibrar punto B (gain) con lectura actual",
-            .hint = NULL,
-            .func = &cmd_calB,
-        };
-        esp_console_cmd_register(&calB_cmd_struct);
-
-        static const esp_console_cmd_t save_cmd_struct = {
-            .command = "save",
-            .help = "Guardar calibración TDS en memoria NVS",
-            .hint = NULL,
-            .func = &cmd_save,
-        };
-        esp_console_cmd_register(&save_cmd_struct);
+#if CONFIG_CISTERNA_LEVEL_FILTER
+    const level_kalman_config_t kf_cfg = {
+        .meas_sd_cm = CONFIG_CISTERNA_LEVEL_KF_MEAS_SD_MM / 10.0f,
+        .accel_noise = CONFIG_CISTERNA_LEVEL_KF_ACCEL_NOISE / 1000.0f,
+        .gate_sigma = (float)CONFIG_CISTERNA_LEVEL_KF_GATE,
+        .max_rejects = LEVEL_KF_MAX_REJECTS,
+        .max_gap_s = (float)CONFIG_CISTERNA_LEVEL_KF_MAX_GAP_S,
+        .full_cm = (float)CONFIG_CISTERNA_LEVEL_FULL_CM,
+        .stable_cm_min = CONFIG_CISTERNA_LEVEL_KF_STABLE_MM_MIN / 10.0f,
+    };
+    level_kalman_init(&g_level_kf, &kf_cfg);
+    g_level_kf_last_us = 0;
+#endif
 
-        static const esp_console_cmd_t show_cmd_struct = {
-            .command = "show",
-            .help = "Mostrar offset y gain actuales de TDS",
-            .hint = NULL,
-            .func = &cmd_show,
-        };
-        esp_console_cmd_register(&show_cmd_struct);
+    if (power_lock_create(ESP_PM_NO_LIGHT_SLEEP, "sensor_awake", &g_pm_no_sleep) != ESP_OK ||
+        power_lock_create(ESP_PM_CPU_FREQ_MAX, "sensor_cpu", &g_pm_cpu) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠ Locks de energía no disponibles");
     }
 
     ESP_LOGI(TAG, "✓ Calibración TDS cargada: offset=%.3f gain=%.3f",
@@ -126,138 +186,371 @@ esp_err_t sensor_init(int ultrasonic_trig_pin, int ultrasonic_echo_pin,
 }
 
 /**
- * @brief Lee el nivel de agua mediante sensor ultrasónico
- * 
- * Calcula la distancia basada en:
- * - Envía pulso de 10µs al pin TRIG
- * - Mide tiempo del pulso ECHO
- * - Distancia = (tiempo_echo * velocidad_sonido) / 2
+ * @brief Resultado de una medición terminada, tomado bajo g_echo_mux
  */
-esp_err_t sensor_read_ultrasonic(float *distance)
+typedef struct {
+    sensor_echo_cb_t cb;
+    void *ctx;
+    TaskHandle_t waiter;
+    esp_err_t result;
+    float distance;
+} echo_delivery_t;
+
+static void IRAM_ATTR ultrasonic_take_result_locked(echo_delivery_t *out)
 {
-    if (distance == NULL) {
-        return ESP_ERR_INVALID_ARG;
+    out->cb = g_echo_cb;
+    out->ctx = g_echo_cb_ctx;
+    out->waiter = g_echo_waiter;
+    out->result = (g_echo_cap.state == ECHO_STATE_DONE) ? ESP_OK : ESP_ERR_TIMEOUT;
+    out->distance = (out->result == ESP_OK) ? echo_width_to_cm(g_echo_cap.width_us) : 0.0f;
+}
+
+/**
+ * @brief ISR de flancos del pin ECHO: solo toma la marca de tiempo
+ */
+static void IRAM_ATTR echo_isr_handler(void *arg)
+{
+    (void)arg;
+    int64_t now = esp_timer_get_time();
+    int level = gpio_get_level(g_echo_pin);
+    echo_delivery_t d;
+    bool finished;
+
+    portENTER_CRITICAL_ISR(&g_echo_mux);
+    finished = echo_capture_on_edge(&g_echo_cap, level, now);
+    if (finished) {
+        ultrasonic_take_result_locked(&d);
+    }
+    portEXIT_CRITICAL_ISR(&g_echo_mux);
+
+    if (!finished) {
+        return;
     }
+    esp_timer_stop(g_echo_timer);
 
-    if (g_trig_pin < 0 || g_echo_pin < 0) {
+    BaseType_t woken = pdFALSE;
+    if (d.cb) {
+        d.cb(d.result, d.distance, d.ctx);
+    } else if (d.waiter) {
+        vTaskNotifyGiveFromISR(d.waiter, &woken);
+    }
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief Timer de guardia: declara timeout o se re-arma hasta el siguiente límite
+ */
+static void echo_timeout_cb(void *arg)
+{
+    (void)arg;
+    int64_t now = esp_timer_get_time();
+    int64_t rearm_us = 0;
+    echo_delivery_t d;
+    bool finished;
+
+    portENTER_CRITICAL(&g_echo_mux);
+    finished = echo_capture_check_timeout(&g_echo_cap, now);
+    if (finished) {
+        ultrasonic_take_result_locked(&d);
+    } else if (g_echo_cap.state == ECHO_STATE_MEASURING) {
+        rearm_us = g_echo_cap.rise_at_us + ECHO_PULSE_TIMEOUT_US - now + 1;
+    } else if (g_echo_cap.state == ECHO_STATE_ARMED) {
+        rearm_us = g_echo_cap.armed_at_us + ECHO_RISE_TIMEOUT_US - now + 1;
+    }
+    portEXIT_CRITICAL(&g_echo_mux);
+
+    if (finished) {
+        if (d.cb) {
+            d.cb(d.result, d.distance, d.ctx);
+        } else if (d.waiter) {
+            xTaskNotifyGive(d.waiter);
+        }
+    } else if (rearm_us > 0) {
+        esp_timer_start_once(g_echo_timer, (uint64_t)rearm_us);
+    }
+}
+
+static esp_err_t ultrasonic_capture_init(void)
+{
+    if (g_echo_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = &echo_timeout_cb,
+            .name = "echo_timeout",
+        };
+        esp_err_t ret = esp_timer_create(&timer_args, &g_echo_timer);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    if (g_burst.timer == NULL) {
+        const esp_timer_create_args_t burst_args = {
+            .callback = &burst_timer_cb,
+            .name = "echo_burst",
+        };
+        esp_err_t ret = esp_timer_create(&burst_args, &g_burst.timer);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        sensor_ultrasonic_set_burst_config(&g_burst.cfg);
+    }
+
+    // El servicio de ISR puede estar ya instalado por otro componente
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        return ret;
+    }
+    return gpio_isr_handler_add(g_echo_pin, echo_isr_handler, NULL);
+}
+
+/**
+ * @brief Dispara un ping y retorna de inmediato
+ */
+esp_err_t sensor_ultrasonic_trigger(sensor_echo_cb_t cb, void *ctx)
+{
+    if (g_trig_pin < 0 || g_echo_pin < 0 || g_echo_timer == NULL) {
         ESP_LOGE(TAG, "✗ Sensor ultrasónico no inicializado");
         return ESP_ERR_INVALID_STATE;
     }
 
+    portENTER_CRITICAL(&g_echo_mux);
+    if (g_echo_cap.state == ECHO_STATE_ARMED || g_echo_cap.state == ECHO_STATE_MEASURING) {
+        portEXIT_CRITICAL(&g_echo_mux);
+        return ESP_ERR_INVALID_STATE;
+    }
+    g_echo_cb = cb;
+    g_echo_cb_ctx = ctx;
+    g_echo_waiter = cb ? NULL : xTaskGetCurrentTaskHandle();
+    portEXIT_CRITICAL(&g_echo_mux);
+
+    if (!cb) {
+        // Descartar una notificación pendiente de una medición abandonada
+        ulTaskNotifyTake(pdTRUE, 0);
+    }
+
     // Enviar pulso de 10µs
     gpio_set_level(g_trig_pin, 0);
     esp_rom_delay_us(2);
     gpio_set_level(g_trig_pin, 1);
     esp_rom_delay_us(ULTRASONIC_PULSE_DURATION_US);
+
+    portENTER_CRITICAL(&g_echo_mux);
+    echo_capture_arm(&g_echo_cap, esp_timer_get_time());
+    portEXIT_CRITICAL(&g_echo_mux);
     gpio_set_level(g_trig_pin, 0);
 
-    // Esperar a que ECHO se ponga en alto
-    // Aumentamos el timeout inicial a 30000 µs (30 ms) para evitar falsos timeouts
-    uint32_t timeout = 30000;  // 30ms timeout
-    uint32_t start_time = esp_timer_get_time();
-    while (gpio_get_level(g_echo_pin) == 0) {
-        if ((esp_timer_get_time() - start_time) > timeout) {
-            ESP_LOGW(TAG, "✗ Timeout esperando ECHO alto");
-            *distance = 0.0f;
-            return ESP_ERR_TIMEOUT;
-        }
+    esp_timer_start_once(g_echo_timer, ECHO_RISE_TIMEOUT_US);
+    return ESP_OK;
+}
+
+/**
+ * @brief Espera (sin consumir CPU) el resultado de un ping disparado sin callback
+ */
+esp_err_t sensor_ultrasonic_wait(float *distance, uint32_t timeout_ms)
+{
+    if (distance == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Medir duración del pulso ECHO
-    uint32_t echo_start = esp_timer_get_time();
-    timeout = 100000;  // 100ms timeout (máximo ~17 metros)
-    while (gpio_get_level(g_echo_pin) == 1) {
-        if ((esp_timer_get_time() - echo_start) > timeout) {
-            ESP_LOGW(TAG, "✗ Timeout esperando ECHO bajo");
-            *distance = 0.0f;
-            return ESP_ERR_TIMEOUT;
-        }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+
+    esp_err_t ret;
+    bool rose;
+    portENTER_CRITICAL(&g_echo_mux);
+    rose = g_echo_cap.rise_at_us != 0;
+    if (g_echo_cap.state == ECHO_STATE_DONE) {
+        *distance = echo_width_to_cm(g_echo_cap.width_us);
+        ret = ESP_OK;
+    } else {
+        // Timeout del timer de guardia, o el llamador se cansó de esperar antes
+        g_echo_cap.state = ECHO_STATE_TIMEOUT;
+        *distance = 0.0f;
+        ret = ESP_ERR_TIMEOUT;
     }
-    uint32_t echo_duration = esp_timer_get_time() - echo_start;
+    g_echo_waiter = NULL;
+    portEXIT_CRITICAL(&g_echo_mux);
 
-    // Calcular distancia: distancia = (tiempo * velocidad_sonido) / 2
-    // Velocidad del sonido = 343 m/s = 0.0343 cm/µs
-    // Dividimos por 2 porque el sonido viaja ida y vuelta
-    *distance = (echo_duration * 0.0343f) / 2.0f;
+    if (ret != ESP_OK) {
+        esp_timer_stop(g_echo_timer);
+        ESP_LOGW(TAG, "✗ Timeout esperando ECHO %s", rose ? "bajo" : "alto");
+    }
+    return ret;
+}
 
-    return ESP_OK;
+/**
+ * @brief Lee el nivel de agua mediante sensor ultrasónico
+ * 
+ * Calcula la distancia basada en:
+ * - Envía pulso de 10µs al pin TRIG
+ * - Mide el pulso ECHO por interrupciones (la tarea duerme mientras tanto)
+ * - Distancia = (tiempo_echo * velocidad_sonido) / 2
+ */
+esp_err_t sensor_read_ultrasonic(float *distance)
+{
+    if (distance == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = sensor_ultrasonic_trigger(NULL, NULL);
+    if (ret != ESP_OK) {
+        *distance = 0.0f;
+        return ret;
+    }
+
+    // Margen sobre el peor caso del timer de guardia (30 ms + 100 ms)
+    return sensor_ultrasonic_wait(distance, (ECHO_RISE_TIMEOUT_US + ECHO_PULSE_TIMEOUT_US) / 1000 + 20);
 }
 
-// --- Implementación de comandos de consola para calibración TDS ---
-static int cmd_calA(int argc, char **argv)
+/**
+ * @brief Ajusta la ráfaga de pings y el rechazo de outliers
+ */
+void sensor_ultrasonic_set_burst_config(const sensor_burst_config_t *cfg)
 {
-    (void)argc; (void)argv;
-    float raw = tds_read_raw();
-    tds_set_calibration_point_A(raw);
-    ESP_LOGI(TAG, "calA: raw=%.3f -> offset set", raw);
-    ESP_LOGI(TAG, "Calibration A saved in RAM: raw=%.3f | offset=%.6f", raw, tds_get_offset());
-    return 0;
+    if (cfg == NULL || g_burst.active) {
+        return;
+    }
+    g_burst.cfg = *cfg;
+    if (g_burst.cfg.pings == 0) g_burst.cfg.pings = 1;
+    if (g_burst.cfg.pings > ULTRASONIC_BURST_MAX) g_burst.cfg.pings = ULTRASONIC_BURST_MAX;
+    if (g_burst.cfg.min_valid == 0) g_burst.cfg.min_valid = 1;
+
+    g_burst.filter.max_dev_us = ultrasonic_filter_mm_to_us(g_burst.cfg.outlier_mm);
+    g_burst.filter.trim = g_burst.cfg.trim;
+    g_burst.filter.min_valid = g_burst.cfg.min_valid;
 }
 
-static int cmd_calB(int argc, char **argv)
+void sensor_ultrasonic_get_burst_config(sensor_burst_config_t *cfg)
 {
-    (void)argc; (void)argv;
-    float raw = tds_read_raw();
-    tds_set_calibration_point_B(raw);
-    ESP_LOGI(TAG, "calB: raw=%.3f -> gain set", raw);
-    ESP_LOGI(TAG, "Calibration B saved in RAM: raw=%.3f | gain=%.9f", raw, tds_get_gain());
-    return 0;
+    if (cfg) {
+        *cfg = g_burst.cfg;
+    }
 }
 
-static int cmd_save(int argc, char **argv)
+// Fin de cada ping de la ráfaga (ISR o tarea esp_timer): guarda el ancho y
+// agenda el siguiente disparo tras el tiempo de recuperación
+static void IRAM_ATTR burst_echo_cb(esp_err_t result, float distance_cm, void *ctx)
 {
-    (void)argc; (void)argv;
-    esp_err_t r = tds_save_calibration();
-    if (r == ESP_OK) ESP_LOGI(TAG, "save: calibración guardada");
-    else ESP_LOGE(TAG, "save: error guardando calibración (%s)", esp_err_to_name(r));
-    if (r == ESP_OK) {
-        ESP_LOGI(TAG, "Calibration saved to NVS: offset=%.6f gain=%.9f", tds_get_offset(), tds_get_gain());
+    (void)distance_cm; (void)ctx;
+    g_burst.widths[g_burst.fired - 1] = (result == ESP_OK) ? g_echo_cap.width_us : 0;
+
+    int64_t wait_us = 1;
+    if (g_burst.fired < g_burst.cfg.pings) {
+        wait_us = g_burst.last_ping_us + ULTRASONIC_RECOVERY_US - esp_timer_get_time();
+        if (wait_us < 1) wait_us = 1;
+    }
+    esp_timer_start_once(g_burst.timer, (uint64_t)wait_us);
+}
+
+// Reduce la ráfaga y entrega el resultado (tarea esp_timer)
+static void burst_finish(void)
+{
+    uint32_t width_us = 0;
+    size_t used = ultrasonic_filter_reduce(g_burst.widths, g_burst.fired, &g_burst.filter, &width_us);
+    if (used >= g_burst.filter.min_valid) {
+        g_burst.result = ESP_OK;
+        g_burst.distance = echo_width_to_cm(width_us);
     } else {
-        ESP_LOGW(TAG, "Calibration not saved to NVS");
+        g_burst.result = ESP_ERR_TIMEOUT;
+        g_burst.distance = 0.0f;
+    }
+
+    sensor_echo_cb_t cb = g_burst.cb;
+    void *ctx = g_burst.ctx;
+    TaskHandle_t waiter = g_burst.waiter;
+    g_burst.active = false;
+
+    if (cb) {
+        cb(g_burst.result, g_burst.distance, ctx);
+    } else if (waiter) {
+        xTaskNotifyGive(waiter);
     }
-    return 0;
 }
 
-static int cmd_show(int argc, char **argv)
+static void burst_timer_cb(void *arg)
 {
-    (void)argc; (void)argv;
-    float off = tds_get_offset();
-    float gain = tds_get_gain();
-    ESP_LOGI(TAG, "show: offset=%.6f gain=%.6f", off, gain);
-    ESP_LOGI(TAG, "Calibration values: offset=%.6f | gain=%.9f", off, gain);
-    return 0;
+    (void)arg;
+    if (g_burst.fired >= g_burst.cfg.pings) {
+        burst_finish();
+        return;
+    }
+
+    g_burst.fired++;
+    g_burst.last_ping_us = esp_timer_get_time();
+    if (sensor_ultrasonic_trigger(burst_echo_cb, NULL) != ESP_OK) {
+        // Sensor ocupado por una lectura suelta: cuenta como ping perdido
+        burst_echo_cb(ESP_ERR_INVALID_STATE, 0.0f, NULL);
+    }
 }
 
-/* Public wrappers for minimal UART command handler */
-void sensor_do_calA(void)
+/**
+ * @brief Inicia una ráfaga de pings sin bloquear
+ */
+esp_err_t sensor_ultrasonic_burst_start(sensor_echo_cb_t cb, void *ctx)
 {
-    float raw = tds_read_raw();
-    tds_set_calibration_point_A(raw);
-    ESP_LOGI(TAG, "(cmd) calA: raw=%.3f -> offset set | offset=%.6f", raw, tds_get_offset());
+    if (g_burst.timer == NULL) {
+        ESP_LOGE(TAG, "✗ Sensor ultrasónico no inicializado");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (g_burst.active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    g_burst.cb = cb;
+    g_burst.ctx = ctx;
+    g_burst.waiter = cb ? NULL : xTaskGetCurrentTaskHandle();
+    g_burst.fired = 0;
+    g_burst.active = true;
+    if (!cb) {
+        ulTaskNotifyTake(pdTRUE, 0);
+    }
+
+    // Primer ping inmediato; los siguientes los agenda el timer
+    burst_timer_cb(NULL);
+    return ESP_OK;
 }
 
-void sensor_do_calB(void)
+/**
+ * @brief Espera (sin consumir CPU) el resultado de una ráfaga iniciada sin callback
+ */
+esp_err_t sensor_ultrasonic_burst_wait(float *distance, uint32_t timeout_ms)
 {
-    float raw = tds_read_raw();
-    tds_set_calibration_point_B(raw);
-    ESP_LOGI(TAG, "(cmd) calB: raw=%.3f -> gain set | gain=%.9f", raw, tds_get_gain());
+    if (distance == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms)) == 0 || g_burst.active) {
+        // La ráfaga sigue en curso: terminará sola, pero sin avisar a nadie
+        g_burst.waiter = NULL;
+        *distance = 0.0f;
+        ESP_LOGW(TAG, "✗ Timeout esperando ráfaga ultrasónica");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    *distance = g_burst.distance;
+    if (g_burst.result != ESP_OK) {
+        ESP_LOGW(TAG, "✗ Ráfaga sin suficientes ecos válidos (%u pings)", g_burst.fired);
+    }
+    return g_burst.result;
 }
 
-void sensor_do_save(void)
+/**
+ * @brief Lee el nivel con una ráfaga de pings filtrada
+ */
+esp_err_t sensor_read_ultrasonic_burst(float *distance)
 {
-    esp_err_t r = tds_save_calibration();
-    if (r == ESP_OK) {
-        ESP_LOGI(TAG, "(cmd) save: Calibration saved to NVS: offset=%.6f gain=%.9f", tds_get_offset(), tds_get_gain());
-    } else {
-        ESP_LOGE(TAG, "(cmd) save: Error saving calibration: %s", esp_err_to_name(r));
+    esp_err_t ret = sensor_ultrasonic_burst_start(NULL, NULL);
+    if (ret != ESP_OK) {
+        return ret;
     }
+    return sensor_ultrasonic_burst_wait(distance, sensor_ultrasonic_burst_timeout_ms());
 }
 
-void sensor_do_show(void)
+uint32_t sensor_ultrasonic_burst_timeout_ms(void)
 {
-    float off = tds_get_offset();
-    float gain = tds_get_gain();
-    ESP_LOGI(TAG, "(cmd) show: offset=%.6f gain=%.9f", off, gain);
+    // Peor caso por ping: 30 ms sin flanco + 100 ms de pulso
+    return g_burst.cfg.pings * ((ECHO_RISE_TIMEOUT_US + ECHO_PULSE_TIMEOUT_US) / 1000) + 50;
 }
 
 /**
@@ -300,6 +593,57 @@ water_state_t sensor_classify_water_quality(float tds_value)
     }
 }
 
+void sensor_level_filter_maneuver(void)
+{
+#if CONFIG_CISTERNA_LEVEL_FILTER
+    g_level_kf_maneuver = true;
+#endif
+}
+
+/**
+ * @brief Distancia del sensor a la superficie -> nivel sobre el fondo
+ *
+ * Con CISTERNA_TANK_HEIGHT_CM = 0 deja la distancia cruda (convención
+ * histórica de water_level, ver sensor.h).
+ */
+static float distance_to_level(float distance_cm)
+{
+#if CONFIG_CISTERNA_TANK_HEIGHT_CM > 0
+    float level = (float)CONFIG_CISTERNA_TANK_HEIGHT_CM - distance_cm;
+    return level > 0.0f ? level : 0.0f;
+#else
+    return distance_cm;
+#endif
+}
+
+/**
+ * @brief Pasa la lectura de nivel por el filtro y completa los campos level_*
+ */
+static void level_filter_update(sensor_data_t *data, int64_t now_us)
+{
+#if CONFIG_CISTERNA_LEVEL_FILTER
+    level_kalman_out_t out;
+    float dt_s = g_level_kf_last_us ? (float)(now_us - g_level_kf_last_us) / 1e6f : 0.0f;
+    g_level_kf_last_us = now_us;
+    if (g_level_kf_maneuver) {
+        g_level_kf_maneuver = false;
+        level_kalman_maneuver(&g_level_kf);
+    }
+    level_kalman_update(&g_level_kf, data->water_level, dt_s, &out);
+    if (out.valid) {
+        data->level_filtered = out.level_cm;
+        data->level_rate = out.rate_cm_min;
+        data->level_eta = out.eta_min;
+        return;
+    }
+#else
+    (void)now_us;
+#endif
+    data->level_filtered = -1.0f;
+    data->level_rate = 0.0f;
+    data->level_eta = -1.0f;
+}
+
 /**
  * @brief Lee ambos sensores y devuelve estructura completa de datos
  */
@@ -313,21 +657,39 @@ esp_err_t sensor_read_all(sensor_data_t *data)
     memset(data, 0, sizeof(sensor_data_t));
 
     // Obtener timestamp
-    data->timestamp = (uint32_t)(esp_timer_get_time() / 1000000);
+    int64_t start_us = esp_timer_get_time();
+    data->timestamp = (uint32_t)(start_us / 1000000);
 
-        // Leer sensor ultrasónico (use heap buffer)
-        esp_err_t ret = sensor_read_ultrasonic(&data->water_level);
-        if (ret != ESP_OK) {
-            ESP_LOGW(TAG, "✗ Error leyendo sensor ultrasónico");
-            data->water_level = -1.0f;
-        }
+    power_lock_acquire(g_pm_no_sleep);
+    power_lock_acquire(g_pm_cpu);
+
+        // Disparar la ráfaga ultrasónica; corre en segundo plano mientras se lee el TDS
+        bool burst = g_burst.cfg.pings > 1;
+        esp_err_t us_ret = burst ? sensor_ultrasonic_burst_start(NULL, NULL) : ESP_OK;
 
         // Leer sensor TDS
-        ret = sensor_read_tds(&data->tds_value);
+        esp_err_t ret = sensor_read_tds(&data->tds_value);
         if (ret != ESP_OK) {
             ESP_LOGW(TAG, "✗ Error leyendo sensor TDS");
             data->tds_value = -1.0f;
         }
+
+        // Recoger el nivel (un solo ping si la ráfaga está desactivada)
+        if (burst && us_ret == ESP_OK) {
+            us_ret = sensor_ultrasonic_burst_wait(&data->water_level, sensor_ultrasonic_burst_timeout_ms());
+        } else if (!burst) {
+            us_ret = sensor_read_ultrasonic(&data->water_level);
+        }
+        if (us_ret != ESP_OK) {
+            ESP_LOGW(TAG, "✗ Error leyendo sensor ultrasónico");
+            data->water_level = -1.0f;
+        } else {
+            data->water_level = distance_to_level(data->water_level);
+        }
+        level_filter_update(data, start_us);
+
+    power_lock_release(g_pm_cpu);
+    power_lock_release(g_pm_no_sleep);
     
     // Clasificar calidad del agua
     if (data->tds_value >= 0.0f) {
@@ -336,5 +698,6 @@ esp_err_t sensor_read_all(sensor_data_t *data)
         data->water_state = WATER_STATE_CLEAN;
     }
 
+    lat_hist_record(&g_read_hist, (uint32_t)(esp_timer_get_time() - start_us));
     return ESP_OK;
 }
@@ -1,6 +1,7 @@
 #ifndef SENSOR_H
 #define SENSOR_H
 
+#include <stdint.h>
 #include "esp_err.h"
 
 /**
@@ -16,10 +17,13 @@ typedef enum {
  * @brief Estructura para almacenar datos de sensores
  */
 typedef struct {
-    float water_level;           // Nivel de agua en cm
+    float water_level;           // Nivel de agua en cm (con CISTERNA_TANK_HEIGHT_CM = 0, distancia del sensor a la superficie); -1 = lectura fallida
     float tds_value;             // Valor de TDS en ppm
     water_state_t water_state;   // Estado del agua (limpia, media, sucia)
     uint32_t timestamp;          // Timestamp de la lectura
+    float level_filtered;        // Nivel filtrado (Kalman) en cm; -1 = sin estimado
+    float level_rate;            // Velocidad del nivel en cm/min (+ llenando, - vaciando)
+    float level_eta;             // Minutos hasta lleno (llenando) o vacío (vaciando); -1 = estable o sin estimado
 } sensor_data_t;
 
 /**
@@ -44,6 +48,91 @@ esp_err_t sensor_init(int ultrasonic_trig_pin, int ultrasonic_echo_pin, int tds_
  */
 esp_err_t sensor_read_ultrasonic(float *distance);
 
+/**
+ * @brief Callback de fin de medición ultrasónica asíncrona
+ *
+ * Se invoca desde la ISR de GPIO (pulso completo) o desde la tarea de
+ * esp_timer (timeout): debe ser breve y usar solo APIs *FromISR de FreeRTOS.
+ *
+ * @param result ESP_OK o ESP_ERR_TIMEOUT
+ * @param distance_cm Distancia medida (0 si hubo timeout)
+ * @param ctx Contexto pasado a sensor_ultrasonic_trigger()
+ */
+typedef void (*sensor_echo_cb_t)(esp_err_t result, float distance_cm, void *ctx);
+
+/**
+ * @brief Dispara un ping ultrasónico y retorna de inmediato
+ *
+ * El pulso ECHO se mide por interrupciones de flanco con marcas de esp_timer,
+ * sin espera activa. El resultado se entrega:
+ * - a @p cb si no es NULL, o
+ * - por notificación a la tarea que llamó, que debe recogerlo con
+ *   sensor_ultrasonic_wait().
+ *
+ * @param cb Callback de fin de medición (NULL para usar notificación de tarea)
+ * @param ctx Contexto opaco para el callback
+ * @return esp_err_t ESP_OK, o ESP_ERR_INVALID_STATE si hay una medición en curso
+ */
+esp_err_t sensor_ultrasonic_trigger(sensor_echo_cb_t cb, void *ctx);
+
+/**
+ * @brief Bloquea la tarea (sin consumir CPU) hasta el fin del ping disparado sin callback
+ *
+ * @param distance Puntero para almacenar la distancia en cm
+ * @param timeout_ms Espera máxima; al vencer se aborta la medición
+ * @return esp_err_t ESP_OK o ESP_ERR_TIMEOUT
+ */
+esp_err_t sensor_ultrasonic_wait(float *distance, uint32_t timeout_ms);
+
+/**
+ * @brief Configuración de la ráfaga de pings y del rechazo de outliers
+ */
+typedef struct {
+    uint8_t pings;         // Pings por lectura (1 = sin ráfaga, máx. 15)
+    uint32_t outlier_mm;   // Descartar ecos a más de esta distancia de la mediana (0 = no descartar)
+    uint8_t trim;          // Ecos a recortar en cada extremo antes de promediar
+    uint8_t min_valid;     // Mínimo de ecos aceptados para publicar un valor
+} sensor_burst_config_t;
+
+/**
+ * @brief Ajusta la ráfaga (ignorado si hay una ráfaga en curso)
+ */
+void sensor_ultrasonic_set_burst_config(const sensor_burst_config_t *cfg);
+
+/**
+ * @brief Obtiene la configuración de ráfaga vigente
+ */
+void sensor_ultrasonic_get_burst_config(sensor_burst_config_t *cfg);
+
+/**
+ * @brief Inicia una ráfaga de pings separados por el tiempo de recuperación del sensor
+ *
+ * Retorna de inmediato; los pings los agenda un esp_timer. Al terminar, los
+ * anchos de pulso se reducen con mediana + media recortada (enteros, sin
+ * memoria dinámica) y el resultado se entrega a @p cb (desde la tarea
+ * esp_timer) o por notificación a la tarea que llamó (sensor_ultrasonic_burst_wait()).
+ *
+ * @return esp_err_t ESP_OK, o ESP_ERR_INVALID_STATE si ya hay una ráfaga en curso
+ */
+esp_err_t sensor_ultrasonic_burst_start(sensor_echo_cb_t cb, void *ctx);
+
+/**
+ * @brief Espera (sin consumir CPU) el resultado de una ráfaga iniciada sin callback
+ *
+ * @return esp_err_t ESP_OK, o ESP_ERR_TIMEOUT si no hubo suficientes ecos válidos
+ */
+esp_err_t sensor_ultrasonic_burst_wait(float *distance, uint32_t timeout_ms);
+
+/**
+ * @brief Peor caso de duración de una ráfaga con la configuración actual
+ */
+uint32_t sensor_ultrasonic_burst_timeout_ms(void);
+
+/**
+ * @brief Lee el nivel con una ráfaga filtrada (inicia y espera)
+ */
+esp_err_t sensor_read_ultrasonic_burst(float *distance);
+
 /**
  * @brief Lee el valor TDS mediante sensor analógico
  * 
@@ -67,17 +156,21 @@ water_state_t sensor_classify_water_quality(float tds_value);
 
 /**
  * @brief Lee ambos sensores y devuelve estructura completa de datos
+ *
+ * Con CONFIG_CISTERNA_LEVEL_FILTER cada lectura pasa además por el filtro de
+ * Kalman del nivel (level_kalman.h): una lectura fallida solo predice y los
+ * campos level_* quedan en -1 hasta tener dos lecturas.
  * 
  * @param data Puntero a estructura para almacenar los datos leídos
  * @return esp_err_t ESP_OK si es exitoso
  */
 esp_err_t sensor_read_all(sensor_data_t *data);
 
-/* Simple programmatic command API so external tasks (UART handler) can invoke
-    calibration without using esp_console/argtable which has caused instability. */
-void sensor_do_calA(void);
-void sensor_do_calB(void);
-void sensor_do_save(void);
-void sensor_do_show(void);
+/**
+ * @brief Avisa al filtro de nivel que la bomba conmutó (el caudal cambia de golpe)
+ *
+ * Se aplica en la próxima sensor_read_all(). Sin efecto si el filtro está desactivado.
+ */
+void sensor_level_filter_maneuver(void);
 
 #endif // SENSOR_H
@@ -0,0 +1,58 @@
+#include "ultrasonic_echo.h"
+
+void echo_capture_arm(echo_capture_t *cap, int64_t now_us)
+{
+    cap->armed_at_us = now_us;
+    cap->rise_at_us = 0;
+    cap->width_us = 0;
+    cap->state = ECHO_STATE_ARMED;
+}
+
+bool echo_capture_on_edge(echo_capture_t *cap, int level, int64_t now_us)
+{
+    switch (cap->state) {
+        case ECHO_STATE_ARMED:
+            if (level) {
+                cap->rise_at_us = now_us;
+                cap->state = ECHO_STATE_MEASURING;
+            }
+            return false;
+
+        case ECHO_STATE_MEASURING:
+            if (!level) {
+                cap->width_us = (uint32_t)(now_us - cap->rise_at_us);
+                cap->state = ECHO_STATE_DONE;
+                return true;
+            }
+            return false;
+
+        default:
+            // Flanco sin medición activa (ruido o eco tardío): se ignora
+            return false;
+    }
+}
+
+bool echo_capture_check_timeout(echo_capture_t *cap, int64_t now_us)
+{
+    if (cap->state == ECHO_STATE_ARMED &&
+        (now_us - cap->armed_at_us) > ECHO_RISE_TIMEOUT_US) {
+        cap->state = ECHO_STATE_TIMEOUT;
+        return true;
+    }
+    if (cap->state == ECHO_STATE_MEASURING &&
+        (now_us - cap->rise_at_us) > ECHO_PULSE_TIMEOUT_US) {
+        cap->state = ECHO_STATE_TIMEOUT;
+        return true;
+    }
+    return false;
+}
+
+bool echo_capture_finished(const echo_capture_t *cap)
+{
+    return cap->state == ECHO_STATE_DONE || cap->state == ECHO_STATE_TIMEOUT;
+}
+
+float echo_width_to_cm(uint32_t width_us)
+{
+    return (width_us * 0.0343f) / 2.0f;
+}
@@ -0,0 +1,75 @@
+#ifndef ULTRASONIC_ECHO_H
+#define ULTRASONIC_ECHO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Máquina de estados para capturar el pulso ECHO del HC-SR04 por flancos.
+ *
+ * No depende de ESP-IDF: recibe niveles y marcas de tiempo (µs) desde quien
+ * la alimente. En el firmware la alimenta la ISR de GPIO con esp_timer;
+ * en el host puede alimentarse con flancos sintéticos para probarla sin placa.
+ */
+
+// Timeouts equivalentes a los del antiguo lazo de espera activa
+#define ECHO_RISE_TIMEOUT_US   30000   // Espera máxima de ECHO alto tras el disparo
+#define ECHO_PULSE_TIMEOUT_US  100000  // Ancho máximo de pulso (~17 m)
+
+/**
+ * @brief Estados de una medición
+ */
+typedef enum {
+    ECHO_STATE_IDLE = 0,     // Sin medición en curso
+    ECHO_STATE_ARMED,        // Disparo enviado, esperando flanco de subida
+    ECHO_STATE_MEASURING,    // ECHO en alto, esperando flanco de bajada
+    ECHO_STATE_DONE,         // Pulso completo, width_us válido
+    ECHO_STATE_TIMEOUT       // No llegó el flanco esperado a tiempo
+} echo_state_t;
+
+/**
+ * @brief Contexto de captura de una medición
+ */
+typedef struct {
+    volatile echo_state_t state;
+    int64_t armed_at_us;     // Instante del disparo
+    int64_t rise_at_us;      // Instante del flanco de subida
+    uint32_t width_us;       // Ancho del pulso (válido en ECHO_STATE_DONE)
+} echo_capture_t;
+
+/**
+ * @brief Prepara el contexto para una nueva medición (llamar justo antes del disparo)
+ */
+void echo_capture_arm(echo_capture_t *cap, int64_t now_us);
+
+/**
+ * @brief Procesa un flanco de ECHO
+ *
+ * Seguro para llamar desde ISR. Flancos fuera de secuencia se ignoran.
+ *
+ * @param level Nivel de ECHO tras el flanco (1 = subida, 0 = bajada)
+ * @param now_us Marca de tiempo del flanco
+ * @return true si la medición terminó con este flanco (ECHO_STATE_DONE)
+ */
+bool echo_capture_on_edge(echo_capture_t *cap, int level, int64_t now_us);
+
+/**
+ * @brief Comprueba si la medición en curso excedió su timeout
+ *
+ * @return true si la medición pasó a ECHO_STATE_TIMEOUT en esta llamada
+ */
+bool echo_capture_check_timeout(echo_capture_t *cap, int64_t now_us);
+
+/**
+ * @brief Indica si la medición terminó (con pulso o por timeout)
+ */
+bool echo_capture_finished(const echo_capture_t *cap);
+
+/**
+ * @brief Convierte el ancho de pulso a distancia en cm
+ *
+ * Velocidad del sonido = 343 m/s = 0.0343 cm/µs, dividido entre 2 por ida y vuelta.
+ */
+float echo_width_to_cm(uint32_t width_us);
+
+#endif // ULTRASONIC_ECHO_H
@@ -0,0 +1,71 @@
+#include "ultrasonic_filter.h"
+
+// Inserción: n <= ULTRASONIC_BURST_MAX, más barata que qsort y sin llamadas
+static void sort_u32(uint32_t *v, size_t n)
+{
+    for (size_t i = 1; i < n; ++i) {
+        uint32_t x = v[i];
+        size_t j = i;
+        while (j > 0 && v[j - 1] > x) {
+            v[j] = v[j - 1];
+            --j;
+        }
+        v[j] = x;
+    }
+}
+
+size_t ultrasonic_filter_reduce(const uint32_t *samples, size_t n,
+                                const ultrasonic_filter_cfg_t *cfg, uint32_t *out_us)
+{
+    uint32_t v[ULTRASONIC_BURST_MAX];
+    size_t count = 0;
+
+    if (n > ULTRASONIC_BURST_MAX) n = ULTRASONIC_BURST_MAX;
+    for (size_t i = 0; i < n; ++i) {
+        if (samples[i] != 0) {
+            v[count++] = samples[i];
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    sort_u32(v, count);
+
+    // Mediana entera (promedio de las dos centrales si count es par)
+    uint32_t median = (count & 1) ? v[count / 2]
+                                  : (v[count / 2 - 1] + v[count / 2]) / 2;
+
+    // Ventana [lo, hi) de muestras dentro de la tolerancia; como v está
+    // ordenado, las aceptadas son contiguas
+    size_t lo = 0, hi = count;
+    if (cfg->max_dev_us > 0) {
+        while (lo < hi && v[lo] < median && median - v[lo] > cfg->max_dev_us) ++lo;
+        while (hi > lo && v[hi - 1] > median && v[hi - 1] - median > cfg->max_dev_us) --hi;
+    }
+
+    // Media recortada solo si tras recortar quedan min_valid muestras: el
+    // recorte afina el promedio, no debe volver fallida una ráfaga válida
+    size_t keep = cfg->min_valid > 0 ? cfg->min_valid : 1;
+    if (hi - lo >= 2u * cfg->trim + keep) {
+        lo += cfg->trim;
+        hi -= cfg->trim;
+    }
+
+    uint64_t sum = 0;
+    for (size_t i = lo; i < hi; ++i) {
+        sum += v[i];
+    }
+    size_t used = hi - lo;
+    if (used == 0) {
+        // Ráfaga de dos grupos separados: ninguna muestra cerca de la mediana
+        return 0;
+    }
+    *out_us = (uint32_t)((sum + used / 2) / used);
+    return used;
+}
+
+uint32_t ultrasonic_filter_mm_to_us(uint32_t mm)
+{
+    // ida y vuelta: 2 * mm / 0.343 mm/µs ≈ mm * 5.831
+    return (mm * 5831u + 500u) / 1000u;
+}
@@ -0,0 +1,47 @@
+#ifndef ULTRASONIC_FILTER_H
+#define ULTRASONIC_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Reducción de una ráfaga de pings ultrasónicos a un único ancho de pulso.
+ *
+ * Solo aritmética entera y sin memoria dinámica: trabaja sobre una copia
+ * local de a lo sumo ULTRASONIC_BURST_MAX muestras. No depende de ESP-IDF.
+ */
+
+#define ULTRASONIC_BURST_MAX 15
+
+/**
+ * @brief Parámetros de rechazo de outliers
+ */
+typedef struct {
+    uint32_t max_dev_us;   // Descartar muestras a más de esta distancia de la mediana (0 = sin límite)
+    uint8_t trim;          // Muestras a recortar en cada extremo tras el rechazo (media recortada)
+    uint8_t min_valid;     // Mínimo de muestras aceptadas para dar un resultado
+} ultrasonic_filter_cfg_t;
+
+/**
+ * @brief Reduce n anchos de pulso (µs) con mediana + media recortada
+ *
+ * 1. Ignora muestras 0 (ping sin eco) y ordena el resto.
+ * 2. Descarta las que se alejan de la mediana más de max_dev_us.
+ * 3. Recorta @c trim muestras de cada extremo (solo si quedan al menos
+ *    @c min_valid) y promedia.
+ *
+ * @param samples Anchos de pulso en µs (0 = ping fallido)
+ * @param n Número de muestras (se usan como máximo ULTRASONIC_BURST_MAX)
+ * @param cfg Parámetros de rechazo
+ * @param out_us Resultado en µs (solo válido si retorna >= cfg->min_valid)
+ * @return Número de muestras que entraron en el promedio
+ */
+size_t ultrasonic_filter_reduce(const uint32_t *samples, size_t n,
+                                const ultrasonic_filter_cfg_t *cfg, uint32_t *out_us);
+
+/**
+ * @brief Convierte una tolerancia en mm a µs de ida y vuelta (sonido a 343 m/s)
+ */
+uint32_t ultrasonic_filter_mm_to_us(uint32_t mm);
+
+#endif // ULTRASONIC_FILTER_H
@@ -0,0 +1,307 @@
+#include "flash_ring.h"
+
+#include <string.h>
+
+#define SECTOR_MAGIC   0x524D4C54u  // "TLMR"
+#define RECORD_MAGIC   0x5AA5u
+#define SECTOR_HDR     8u
+#define RECORD_HDR     8u
+#define STATE_PENDING  0xFFFFFFFFu
+#define STATE_DONE     0x00000000u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} sector_hdr_t;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t len;
+    uint32_t crc;
+} record_hdr_t;
+
+typedef enum {
+    REC_OK = 0,   // valid record
+    REC_END,      // erased space: no more records in this sector
+    REC_BAD,      // torn or corrupt: rest of the sector is unusable
+} rec_status_t;
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, uint32_t n)
+{
+    crc = ~crc;
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t record_crc(const uint8_t *payload, uint16_t len)
+{
+    uint8_t l[2] = { (uint8_t)len, (uint8_t)(len >> 8) };
+    return crc32_update(crc32_update(0, l, 2), payload, len);
+}
+
+uint32_t flash_ring_record_size(uint16_t len)
+{
+    return RECORD_HDR + (((uint32_t)len + 3u) & ~3u) + 4u;
+}
+
+uint32_t flash_ring_capacity(const flash_ring_t *r, uint16_t len)
+{
+    // One sector is always the next to be recycled
+    return (r->io.sector_size - SECTOR_HDR) / flash_ring_record_size(len) * (r->sectors - 1);
+}
+
+static uint32_t addr_of(const flash_ring_t *r, flash_ring_pos_t p)
+{
+    return p.sector * r->io.sector_size + p.offset;
+}
+
+static uint32_t next_sector(const flash_ring_t *r, uint32_t s)
+{
+    return (s + 1 == r->sectors) ? 0 : s + 1;
+}
+
+/* Validate the record at p. On REC_OK fills len/state and, if buf is given,
+ * copies min(len, cap) payload bytes. */
+static int read_record(const flash_ring_t *r, flash_ring_pos_t p,
+                       uint16_t *len, uint32_t *state, void *buf, uint16_t cap)
+{
+    uint8_t payload[FLASH_RING_MAX_PAYLOAD];
+    record_hdr_t h;
+
+    if (p.offset + RECORD_HDR + 4u > r->io.sector_size) return REC_END;
+    if (r->io.read(r->io.ctx, addr_of(r, p), &h, sizeof(h)) != 0) return -1;
+    if (h.magic == 0xFFFFu && h.len == 0xFFFFu && h.crc == 0xFFFFFFFFu) return REC_END;
+    if (h.magic != RECORD_MAGIC || h.len == 0 || h.len > FLASH_RING_MAX_PAYLOAD ||
+        p.offset + flash_ring_record_size(h.len) > r->io.sector_size) {
+        return REC_BAD;
+    }
+
+    uint32_t a = addr_of(r, p) + RECORD_HDR;
+    if (r->io.read(r->io.ctx, a, payload, h.len) != 0) return -1;
+    if (record_crc(payload, h.len) != h.crc) return REC_BAD;
+    if (r->io.read(r->io.ctx, a + (((uint32_t)h.len + 3u) & ~3u), state, 4) != 0) return -1;
+
+    *len = h.len;
+    if (buf) memcpy(buf, payload, h.len < cap ? h.len : cap);
+    return REC_OK;
+}
+
+/* Move p to the next readable record position, crossing into later sectors
+ * until the head is reached. */
+static void normalize(const flash_ring_t *r, flash_ring_pos_t *p)
+{
+    uint16_t len;
+    uint32_t state;
+
+    while (!(p->sector == r->head.sector && p->offset >= r->head.offset)) {
+        if (p->sector == r->head.sector) return;  // before head in the head sector
+        int st = read_record(r, *p, &len, &state, NULL, 0);
+        if (st == REC_OK || st < 0) return;
+        p->sector = next_sector(r, p->sector);
+        p->offset = SECTOR_HDR;
+    }
+}
+
+/* The sequence is programmed before the magic: a header torn by power loss
+ * never carries a valid magic with a half-written (huge) sequence, which
+ * would make that sector the newest forever. */
+static int open_sector(flash_ring_t *r, uint32_t s, uint32_t seq)
+{
+    sector_hdr_t h = { SECTOR_MAGIC, seq };
+    uint32_t a = s * r->io.sector_size;
+    if (r->io.erase_sector(r->io.ctx, a) != 0) return -1;
+    if (r->io.write(r->io.ctx, a + sizeof(h.magic), &h.seq, sizeof(h.seq)) != 0) return -1;
+    if (r->io.write(r->io.ctx, a, &h.magic, sizeof(h.magic)) != 0) return -1;
+    r->head.sector = s;
+    r->head.offset = SECTOR_HDR;
+    r->head_seq = seq;
+    return 0;
+}
+
+int flash_ring_format(flash_ring_t *r)
+{
+    for (uint32_t s = 1; s < r->sectors; ++s) {
+        if (r->io.erase_sector(r->io.ctx, s * r->io.sector_size) != 0) return -1;
+    }
+    if (open_sector(r, 0, 1) != 0) return -1;
+    r->tail = r->head;
+    r->pending = 0;
+    return 0;
+}
+
+int flash_ring_mount(flash_ring_t *r, const flash_ring_io_t *io)
+{
+    memset(r, 0, sizeof(*r));
+    r->io = *io;
+    if (io->sector_size < 64 || io->size % io->sector_size) return -1;
+    r->sectors = io->size / io->sector_size;
+    if (r->sectors < 2) return -1;
+
+    // Newest sector by sequence becomes the head
+    bool found = false;
+    for (uint32_t s = 0; s < r->sectors; ++s) {
+        sector_hdr_t h;
+        if (io->read(io->ctx, s * io->sector_size, &h, sizeof(h)) != 0) return -1;
+        if (h.magic != SECTOR_MAGIC) continue;
+        if (!found || h.seq > r->head_seq) {
+            r->head_seq = h.seq;
+            r->head.sector = s;
+            found = true;
+        }
+    }
+    if (!found) return flash_ring_format(r);
+
+    // Walk sectors oldest to newest (index order after the head), counting
+    // pending records and locating the first one
+    bool have_tail = false;
+    uint32_t s = r->head.sector;
+    for (uint32_t i = 0; i < r->sectors; ++i) {
+        s = next_sector(r, s);
+        sector_hdr_t h;
+        if (io->read(io->ctx, s * io->sector_size, &h, sizeof(h)) != 0) return -1;
+        if (h.magic != SECTOR_MAGIC) continue;
+
+        flash_ring_pos_t p = { s, SECTOR_HDR };
+        for (;;) {
+            uint16_t len;
+            uint32_t state;
+            int st = read_record(r, p, &len, &state, NULL, 0);
+            if (st < 0) return -1;
+            if (st == REC_BAD) {
+                r->corrupt++;
+                p.offset = io->sector_size;  // close the sector
+                break;
+            }
+            if (st == REC_END) break;
+            // A partially cleared state word means delivery already happened
+            if (state == STATE_PENDING) {
+                if (!have_tail) {
+                    r->tail = p;
+                    have_tail = true;
+                }
+                r->pending++;
+            }
+            p.offset += flash_ring_record_size(len);
+        }
+        if (s == r->head.sector) r->head.offset = p.offset;
+    }
+    if (!have_tail) r->tail = r->head;
+    return 0;
+}
+
+/* Recycle the sector after the head, dropping whatever is still pending in it. */
+static int advance_head(flash_ring_t *r)
+{
+    uint32_t victim = next_sector(r, r->head.sector);
+
+    if (r->pending && r->tail.sector == victim) {
+        flash_ring_pos_t p = r->tail;
+        for (;;) {
+            uint16_t len;
+            uint32_t state;
+            int st = read_record(r, p, &len, &state, NULL, 0);
+            if (st < 0) return -1;
+            if (st != REC_OK) break;
+            if (state == STATE_PENDING && r->pending) {
+                r->pending--;
+                r->dropped++;
+            }
+            p.offset += flash_ring_record_size(len);
+        }
+        r->tail.sector = next_sector(r, victim);
+        r->tail.offset = SECTOR_HDR;
+    }
+
+    if (open_sector(r, victim, r->head_seq + 1) != 0) return -1;
+    if (r->pending == 0) {
+        r->tail = r->head;
+    } else {
+        normalize(r, &r->tail);
+    }
+    return 0;
+}
+
+int flash_ring_append(flash_ring_t *r, const void *data, uint16_t len)
+{
+    uint8_t rec[RECORD_HDR + FLASH_RING_MAX_PAYLOAD + 4];
+    if (len == 0 || len > FLASH_RING_MAX_PAYLOAD) return -1;
+
+    uint32_t size = flash_ring_record_size(len);
+    if (r->head.offset + size > r->io.sector_size) {
+        if (advance_head(r) != 0) return -1;
+    }
+    if (r->pending == 0) r->tail = r->head;
+
+    // Header, payload and padding in a single program; the state word stays erased
+    record_hdr_t h = { RECORD_MAGIC, len, record_crc(data, len) };
+    memcpy(rec, &h, sizeof(h));
+    memcpy(rec + RECORD_HDR, data, len);
+    memset(rec + RECORD_HDR + len, 0xFF, size - 4u - RECORD_HDR - len);
+    if (r->io.write(r->io.ctx, addr_of(r, r->head), rec, size - 4u) != 0) {
+        // Whatever landed is unreadable; skip to a fresh sector next time
+        r->head.offset = r->io.sector_size;
+        return -1;
+    }
+    r->head.offset += size;
+    r->pending++;
+    r->appended++;
+    return 0;
+}
+
+flash_ring_pos_t flash_ring_begin(const flash_ring_t *r)
+{
+    return r->pending ? r->tail : r->head;
+}
+
+int flash_ring_next(const flash_ring_t *r, flash_ring_pos_t *it,
+                    void *buf, uint16_t cap, uint16_t *len)
+{
+    for (;;) {
+        if (it->sector == r->head.sector && it->offset >= r->head.offset) return 0;
+
+        uint32_t state;
+        int st = read_record(r, *it, len, &state, buf, cap);
+        if (st < 0) return -1;
+        if (st != REC_OK) {
+            if (it->sector == r->head.sector) return 0;
+            it->sector = next_sector(r, it->sector);
+            it->offset = SECTOR_HDR;
+            continue;
+        }
+        it->offset += flash_ring_record_size(*len);
+        if (state == STATE_PENDING) return 1;
+    }
+}
+
+int flash_ring_consume(flash_ring_t *r, uint32_t n)
+{
+    static const uint32_t done = STATE_DONE;
+
+    while (n-- && r->pending) {
+        flash_ring_pos_t it = r->tail;
+        uint16_t len;
+        int got = flash_ring_next(r, &it, NULL, 0, &len);
+        if (got <= 0) {
+            r->pending = 0;
+            r->tail = r->head;
+            return got;
+        }
+        // flash_ring_next skipped to the record it returned; its start is it - size
+        flash_ring_pos_t at = { it.sector, it.offset - flash_ring_record_size(len) };
+        uint32_t state_addr = addr_of(r, at) + RECORD_HDR + (((uint32_t)len + 3u) & ~3u);
+        if (r->io.write(r->io.ctx, state_addr, &done, sizeof(done)) != 0) return -1;
+        r->pending--;
+        r->tail = it;
+        if (r->pending == 0) {
+            r->tail = r->head;
+        } else {
+            normalize(r, &r->tail);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Append-only record ring over raw NOR flash (store-and-forward buffer).
+ *
+ * The region is split into erase sectors used round-robin, so every sector
+ * is erased equally often. Each sector starts with a header carrying a
+ * monotonically increasing sequence number; mount finds the newest sector by
+ * sequence, not by a separate index that would need rewriting.
+ *
+ * Record framing (4-byte aligned):
+ *
+ *   u16 magic | u16 len | u32 crc32(len, payload) | payload (padded) | u32 state
+ *
+ * Header and payload are programmed in one write; a record that lost power
+ * mid-write fails its CRC and closes its sector on mount. The state word is
+ * left erased (pending) and cleared to zero once the record was delivered,
+ * so a crash between publish and consume replays the record again
+ * (at-least-once). When the ring is full the oldest sector is recycled and
+ * its pending records are counted as dropped.
+ *
+ * Flash access goes through flash_ring_io_t, so the same code runs on the
+ * ESP partition API and on a file-backed emulator on the host.
+ */
+
+#define FLASH_RING_MAX_PAYLOAD 240
+
+typedef struct {
+    int (*read)(void *ctx, uint32_t addr, void *dst, uint32_t len);
+    int (*write)(void *ctx, uint32_t addr, const void *src, uint32_t len);
+    int (*erase_sector)(void *ctx, uint32_t addr);
+    void *ctx;
+    uint32_t size;        // region size, multiple of sector_size
+    uint32_t sector_size; // erase unit
+} flash_ring_io_t;
+
+typedef struct {
+    uint32_t sector;
+    uint32_t offset;
+} flash_ring_pos_t;
+
+typedef struct {
+    flash_ring_io_t io;
+    uint32_t sectors;
+    uint32_t head_seq;       // sequence of the sector being written
+    flash_ring_pos_t head;   // next write position
+    flash_ring_pos_t tail;   // oldest pending record (== head when empty)
+    uint32_t pending;        // records written but not consumed
+    uint32_t appended;       // records written since mount
+    uint32_t dropped;        // pending records lost to sector recycling
+    uint32_t corrupt;        // torn or corrupt records skipped on mount
+} flash_ring_t;
+
+/**
+ * Scan the region and rebuild head/tail/pending. An unformatted region is
+ * formatted. Returns 0 on success, negative on I/O error or bad geometry
+ * (fewer than two sectors).
+ */
+int flash_ring_mount(flash_ring_t *r, const flash_ring_io_t *io);
+
+/** Erase every sector and start an empty ring. */
+int flash_ring_format(flash_ring_t *r);
+
+/** Append one record (1..FLASH_RING_MAX_PAYLOAD bytes). Returns 0 or negative. */
+int flash_ring_append(flash_ring_t *r, const void *data, uint16_t len);
+
+/** Iterator positioned on the oldest pending record. */
+flash_ring_pos_t flash_ring_begin(const flash_ring_t *r);
+
+/**
+ * Read the pending record at *it and advance the iterator.
+ * Copies at most cap bytes; *len receives the stored length.
+ * Returns 1 if a record was read, 0 at the end, negative on I/O error.
+ */
+int flash_ring_next(const flash_ring_t *r, flash_ring_pos_t *it,
+                    void *buf, uint16_t cap, uint16_t *len);
+
+/** Mark the n oldest pending records as delivered. Returns 0 or negative. */
+int flash_ring_consume(flash_ring_t *r, uint32_t n);
+
+/** Bytes a record of len payload bytes occupies in flash. */
+uint32_t flash_ring_record_size(uint16_t len);
+
+/** Records of len bytes the ring keeps before it starts dropping the oldest. */
+uint32_t flash_ring_capacity(const flash_ring_t *r, uint16_t len);
@@ -55,3 +55,33 @@ esp_err_t storage_load_float(const char *key, float *value)
     nvs_close(handle);
     return ret;
 }
+
+esp_err_t storage_save_blob(const char *key, const void *data, size_t len)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+    ret = nvs_open("tds_storage", NVS_READWRITE, &handle);
+    if (ret != ESP_OK) return ret;
+    ret = nvs_set_blob(handle, key, data, len);
+    if (ret == ESP_OK) ret = nvs_commit(handle);
+    nvs_close(handle);
+    if (ret == ESP_OK) ESP_LOGI(TAG, "Saved [%s] (%u bytes)", key, (unsigned)len);
+    else ESP_LOGE(TAG, "Failed to save [%s]: %s", key, esp_err_to_name(ret));
+    return ret;
+}
+
+esp_err_t storage_load_blob(const char *key, void *data, size_t *len)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+    ret = nvs_open("tds_storage", NVS_READONLY, &handle);
+    if (ret != ESP_OK) return ret;
+    ret = nvs_get_blob(handle, key, data, len);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Loaded [%s] (%u bytes)", key, (unsigned)*len);
+    } else {
+        ESP_LOGW(TAG, "Key [%s] not found: %s", key, esp_err_to_name(ret));
+    }
+    nvs_close(handle);
+    return ret;
+}
@@ -1,6 +1,10 @@
 #pragma once
+#include <stddef.h>
 #include "esp_err.h"
 
 esp_err_t storage_init(void);
 esp_err_t storage_save_float(const char *key, float value);
 esp_err_t storage_load_float(const char *key, float *value);
+/** Store an opaque binary record. *len is in/out on load (buffer size / bytes read). */
+esp_err_t storage_save_blob(const char *key, const void *data, size_t len);
+esp_err_t storage_load_blob(const char *key, void *data, size_t *len);
@@ -0,0 +1,121 @@
+#include "storage_ring.h"
+#include "flash_ring.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "storage_ring";
+
+static flash_ring_t s_ring;
+static SemaphoreHandle_t s_lock;
+static bool s_mounted;
+static uint32_t s_last_len = 32;
+
+static int part_read(void *ctx, uint32_t addr, void *dst, uint32_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, addr, dst, len) == ESP_OK ? 0 : -1;
+}
+
+static int part_write(void *ctx, uint32_t addr, const void *src, uint32_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, addr, src, len) == ESP_OK ? 0 : -1;
+}
+
+static int part_erase(void *ctx, uint32_t addr)
+{
+    const esp_partition_t *p = ctx;
+    return esp_partition_erase_range(p, addr, p->erase_size) == ESP_OK ? 0 : -1;
+}
+
+esp_err_t storage_ring_init(const char *partition_label)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_ANY,
+                                                           partition_label);
+    if (part == NULL) {
+        ESP_LOGE(TAG, "Partition '%s' not found", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutex();
+        if (s_lock == NULL) return ESP_ERR_NO_MEM;
+    }
+
+    flash_ring_io_t io = {
+        .read = part_read,
+        .write = part_write,
+        .erase_sector = part_erase,
+        .ctx = (void *)part,
+        .size = part->size - part->size % part->erase_size,
+        .sector_size = part->erase_size,
+    };
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int rc = flash_ring_mount(&s_ring, &io);
+    s_mounted = (rc == 0);
+    xSemaphoreGive(s_lock);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Mount failed on '%s'", partition_label);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Mounted '%s': %u sectors, %u pending, %u corrupt",
+             partition_label, (unsigned)s_ring.sectors,
+             (unsigned)s_ring.pending, (unsigned)s_ring.corrupt);
+    return ESP_OK;
+}
+
+esp_err_t storage_ring_append(const void *data, size_t len)
+{
+    if (!s_mounted) return ESP_ERR_INVALID_STATE;
+    if (len == 0 || len > FLASH_RING_MAX_PAYLOAD) return ESP_ERR_INVALID_SIZE;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int rc = flash_ring_append(&s_ring, data, (uint16_t)len);
+    s_last_len = len;
+    xSemaphoreGive(s_lock);
+    return rc == 0 ? ESP_OK : ESP_FAIL;
+}
+
+int storage_ring_peek(void *recs, size_t rec_size, int max)
+{
+    if (!s_mounted || rec_size > UINT16_MAX) return 0;
+    uint8_t *out = recs;
+    int n = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    flash_ring_pos_t it = flash_ring_begin(&s_ring);
+    while (n < max) {
+        uint16_t len;
+        if (flash_ring_next(&s_ring, &it, out + (size_t)n * rec_size, (uint16_t)rec_size, &len) != 1) break;
+        n++;
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+esp_err_t storage_ring_consume(int n)
+{
+    if (!s_mounted) return ESP_ERR_INVALID_STATE;
+    if (n <= 0) return ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int rc = flash_ring_consume(&s_ring, (uint32_t)n);
+    xSemaphoreGive(s_lock);
+    return rc == 0 ? ESP_OK : ESP_FAIL;
+}
+
+uint32_t storage_ring_pending(void)
+{
+    return s_mounted ? s_ring.pending : 0;
+}
+
+void storage_ring_get_stats(storage_ring_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!s_mounted) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    stats->pending = s_ring.pending;
+    stats->appended = s_ring.appended;
+    stats->dropped = s_ring.dropped;
+    stats->corrupt = s_ring.corrupt;
+    stats->capacity = flash_ring_capacity(&s_ring, (uint16_t)s_last_len);
+    xSemaphoreGive(s_lock);
+}
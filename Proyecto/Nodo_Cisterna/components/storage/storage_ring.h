@@ -0,0 +1,38 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Store-and-forward buffer on a raw data partition (see flash_ring.h).
+ * Thread-safe: producers append while a replay task peeks and consumes.
+ */
+
+typedef struct {
+    uint32_t pending;    // records waiting for replay
+    uint32_t appended;   // records stored since boot
+    uint32_t dropped;    // records overwritten before replay (ring full)
+    uint32_t corrupt;    // torn records skipped at mount
+    uint32_t capacity;   // approximate records that fit for the last record size
+} storage_ring_stats_t;
+
+/** Mount the ring on the data partition with the given label. */
+esp_err_t storage_ring_init(const char *partition_label);
+
+/** Append one record (1..240 bytes). */
+esp_err_t storage_ring_append(const void *data, size_t len);
+
+/**
+ * Copy up to max of the oldest pending records into recs, each slot rec_size
+ * bytes (longer records are truncated). Records stay pending until consumed.
+ * Returns the number of records copied.
+ */
+int storage_ring_peek(void *recs, size_t rec_size, int max);
+
+/** Mark the n oldest pending records as delivered. */
+esp_err_t storage_ring_consume(int n);
+
+/** Records waiting for replay (0 if the ring is not mounted). */
+uint32_t storage_ring_pending(void);
+
+void storage_ring_get_stats(storage_ring_stats_t *stats);
@@ -0,0 +1,116 @@
+#include "pump_ctrl.h"
+
+#include <string.h>
+
+void pump_ctrl_init(pump_ctrl_t *ctrl, const pump_ctrl_config_t *cfg, bool on, uint32_t now_ms)
+{
+    memset(ctrl, 0, sizeof(*ctrl));
+    ctrl->cfg = *cfg;
+    ctrl->on = on;
+    // Al arrancar no se conoce el último cambio: cuenta como recién conmutada
+    ctrl->since_ms = now_ms;
+}
+
+pump_ctrl_decision_t pump_ctrl_update(pump_ctrl_t *ctrl, float level_cm, bool dirty, uint32_t now_ms)
+{
+    pump_ctrl_decision_t d = { .action = PUMP_CTRL_KEEP, .on = ctrl->on };
+
+    if (level_cm < 0.0f) {
+        if (ctrl->missed < UINT8_MAX) {
+            ctrl->missed++;
+        }
+    } else {
+        ctrl->missed = 0;
+    }
+
+    if (ctrl->manual) {
+        if (ctrl->cfg.override_ms == 0 || now_ms - ctrl->manual_at_ms < ctrl->cfg.override_ms) {
+            return d;
+        }
+        // Vencido el comando manual: se reporta y se evalúa desde la próxima muestra
+        ctrl->manual = false;
+        d.action = PUMP_CTRL_RESUME;
+        return d;
+    }
+
+    bool want = ctrl->on;
+    bool safety = false;
+    if (ctrl->on && dirty) {
+        want = false;
+        safety = true;
+        d.reason = PUMP_CTRL_REASON_DIRTY;
+    } else if (ctrl->on && ctrl->cfg.max_missed && ctrl->missed >= ctrl->cfg.max_missed) {
+        want = false;
+        safety = true;
+        d.reason = PUMP_CTRL_REASON_NO_ECHO;
+    } else if (level_cm >= 0.0f) {
+        if (!ctrl->on && !dirty && level_cm < ctrl->cfg.low_cm) {
+            want = true;
+            d.reason = PUMP_CTRL_REASON_LOW;
+        } else if (ctrl->on && level_cm > ctrl->cfg.high_cm) {
+            want = false;
+            d.reason = PUMP_CTRL_REASON_HIGH;
+        }
+    }
+
+    if (want == ctrl->on) {
+        // Un eco perdido no cancela la espera ya reportada
+        if (level_cm >= 0.0f) {
+            ctrl->holding = false;
+        }
+        return d;
+    }
+
+    d.on = want;
+    uint32_t min_ms = want ? ctrl->cfg.min_off_ms : ctrl->cfg.min_on_ms;
+    uint32_t elapsed = now_ms - ctrl->since_ms;
+    if (!safety && elapsed < min_ms) {
+        if (!ctrl->holding) {
+            ctrl->holding = true;
+            d.action = PUMP_CTRL_HOLD;
+            d.wait_ms = min_ms - elapsed;
+        }
+        return d;
+    }
+
+    ctrl->on = want;
+    ctrl->since_ms = now_ms;
+    ctrl->holding = false;
+    ctrl->switches++;
+    d.action = PUMP_CTRL_SWITCH;
+    return d;
+}
+
+pump_ctrl_decision_t pump_ctrl_override(pump_ctrl_t *ctrl, bool on, uint32_t now_ms)
+{
+    if (on != ctrl->on) {
+        ctrl->on = on;
+        ctrl->since_ms = now_ms;
+    }
+    ctrl->manual = true;
+    ctrl->manual_at_ms = now_ms;
+    ctrl->holding = false;
+    return (pump_ctrl_decision_t){ .action = PUMP_CTRL_OVERRIDE, .on = on, .reason = PUMP_CTRL_REASON_MANUAL };
+}
+
+pump_ctrl_decision_t pump_ctrl_resume(pump_ctrl_t *ctrl)
+{
+    pump_ctrl_decision_t d = { .action = PUMP_CTRL_KEEP, .on = ctrl->on };
+    if (ctrl->manual) {
+        ctrl->manual = false;
+        d.action = PUMP_CTRL_RESUME;
+    }
+    return d;
+}
+
+const char *pump_ctrl_action_name(pump_ctrl_action_t action)
+{
+    static const char *const names[] = { "keep", "switch", "hold", "override", "resume" };
+    return (unsigned)action < sizeof(names) / sizeof(names[0]) ? names[action] : "?";
+}
+
+const char *pump_ctrl_reason_name(pump_ctrl_reason_t reason)
+{
+    static const char *const names[] = { "", "low", "high", "dirty", "no_echo", "manual" };
+    return (unsigned)reason < sizeof(names) / sizeof(names[0]) ? names[reason] : "?";
+}
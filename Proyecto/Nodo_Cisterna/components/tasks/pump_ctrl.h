@@ -0,0 +1,99 @@
+#ifndef PUMP_CTRL_H
+#define PUMP_CTRL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Control local de la bomba por histéresis.
+ *
+ * Se evalúa con cada muestra: enciende si el nivel baja de low_cm y apaga si
+ * supera high_cm (la misma regla que el flujo de Node-RED). El nivel es la
+ * altura del agua sobre el fondo, que sube al llenar; la distancia cruda del
+ * sensor invertiría la regla (por eso CISTERNA_PUMP_LOCAL_CONTROL depende de
+ * CISTERNA_TANK_HEIGHT_CM). Entre ambos
+ * umbrales conserva el estado. Los tiempos mínimos evitan ciclos cortos del
+ * motor: un arranque espera min_off_ms desde el último apagado y un apagado
+ * por nivel alto espera min_on_ms desde el encendido. Los apagados de
+ * seguridad (agua sucia, max_missed ecos perdidos seguidos) no esperan.
+ *
+ * Un comando explícito (Node-RED, UART) manda sobre el control: lo suspende
+ * override_ms (0 = hasta pump_ctrl_resume()) y no respeta tiempos mínimos.
+ *
+ * Solo decide: quien llama conmuta el relé ante PUMP_CTRL_SWITCH y reporta
+ * las demás acciones. No es thread-safe ni depende de ESP-IDF (se simula en
+ * el host, ver tools/pump_ctrl_sim). Tiempos en ms de un reloj monotónico de
+ * 32 bits; las diferencias toleran el desborde.
+ */
+
+typedef struct {
+    float low_cm;            // Encender por debajo de este nivel
+    float high_cm;           // Apagar por encima de este nivel
+    uint32_t min_on_ms;      // Encendida al menos este tiempo antes de apagar por nivel
+    uint32_t min_off_ms;     // Apagada al menos este tiempo antes de volver a encender
+    uint32_t override_ms;    // Duración de un comando manual (0 = hasta reanudar)
+    uint8_t max_missed;      // Ecos perdidos seguidos que apagan la bomba
+} pump_ctrl_config_t;
+
+typedef enum {
+    PUMP_CTRL_KEEP = 0,      // Nada que hacer ni reportar
+    PUMP_CTRL_SWITCH,        // Conmutar el relé a decision.on
+    PUMP_CTRL_HOLD,          // Corresponde conmutar pero un tiempo mínimo lo retiene (una vez)
+    PUMP_CTRL_OVERRIDE,      // Un comando manual tomó el control
+    PUMP_CTRL_RESUME,        // El control local retoma (vencido el manual o pedido)
+} pump_ctrl_action_t;
+
+typedef enum {
+    PUMP_CTRL_REASON_NONE = 0,
+    PUMP_CTRL_REASON_LOW,
+    PUMP_CTRL_REASON_HIGH,
+    PUMP_CTRL_REASON_DIRTY,
+    PUMP_CTRL_REASON_NO_ECHO,
+    PUMP_CTRL_REASON_MANUAL,
+} pump_ctrl_reason_t;
+
+typedef struct {
+    pump_ctrl_action_t action;
+    bool on;                 // Estado del relé pedido (o vigente)
+    pump_ctrl_reason_t reason;
+    uint32_t wait_ms;        // HOLD: tiempo que falta para poder conmutar
+} pump_ctrl_decision_t;
+
+typedef struct {
+    pump_ctrl_config_t cfg;
+    bool on;                 // Estado del relé según el control
+    uint32_t since_ms;       // Desde cuándo está en ese estado
+    bool manual;             // Suspendido por un comando manual
+    uint32_t manual_at_ms;
+    bool holding;            // Ya se reportó HOLD para el cambio pendiente
+    uint8_t missed;          // Ecos perdidos seguidos
+    uint32_t switches;       // Conmutaciones hechas por el control
+} pump_ctrl_t;
+
+/**
+ * @brief Inicializa el control con el estado actual del relé
+ */
+void pump_ctrl_init(pump_ctrl_t *ctrl, const pump_ctrl_config_t *cfg, bool on, uint32_t now_ms);
+
+/**
+ * @brief Evalúa una muestra nueva
+ *
+ * @param level_cm Nivel medido; negativo = eco perdido
+ * @param dirty Agua sucia según TDS: no arranca y apaga si está encendida
+ */
+pump_ctrl_decision_t pump_ctrl_update(pump_ctrl_t *ctrl, float level_cm, bool dirty, uint32_t now_ms);
+
+/**
+ * @brief Registra un comando manual: el relé ya quedó en @p on y el control se suspende
+ */
+pump_ctrl_decision_t pump_ctrl_override(pump_ctrl_t *ctrl, bool on, uint32_t now_ms);
+
+/**
+ * @brief Termina el comando manual en curso (KEEP si no había ninguno)
+ */
+pump_ctrl_decision_t pump_ctrl_resume(pump_ctrl_t *ctrl);
+
+const char *pump_ctrl_action_name(pump_ctrl_action_t action);
+const char *pump_ctrl_reason_name(pump_ctrl_reason_t reason);
+
+#endif // PUMP_CTRL_H
@@ -0,0 +1,79 @@
+#include "snapshot.h"
+
+#include <string.h>
+
+void snapshot_init(snapshot_t *snap, size_t size)
+{
+    if (size > sizeof(uint32_t) * SNAPSHOT_MAX_WORDS) {
+        size = sizeof(uint32_t) * SNAPSHOT_MAX_WORDS;
+    }
+    snap->size = size;
+    for (int s = 0; s < 2; s++) {
+        atomic_init(&snap->slot[s].seq, 0);
+        atomic_init(&snap->slot[s].sample, 0);
+        for (int w = 0; w < SNAPSHOT_MAX_WORDS; w++) {
+            atomic_init(&snap->slot[s].words[w], 0);
+        }
+    }
+    atomic_init(&snap->published, 0);
+}
+
+uint32_t snapshot_publish(snapshot_t *snap, const void *data)
+{
+    uint32_t words[SNAPSHOT_MAX_WORDS] = {0};
+    memcpy(words, data, snap->size);
+    size_t n = (snap->size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    uint32_t sample = (uint32_t)atomic_load_explicit(&snap->published, memory_order_relaxed) + 1;
+    snapshot_slot_t *slot = &snap->slot[sample & 1];
+
+    // Marcar el slot inactivo como "en escritura" antes de tocar los datos
+    uint32_t seq = (uint32_t)atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->sample, sample, memory_order_relaxed);
+    for (size_t w = 0; w < n; w++) {
+        atomic_store_explicit(&slot->words[w], words[w], memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&snap->published, sample, memory_order_release);
+    return sample;
+}
+
+uint32_t snapshot_read(const snapshot_t *snap, void *out)
+{
+    uint32_t words[SNAPSHOT_MAX_WORDS];
+    size_t n = (snap->size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    for (;;) {
+        uint32_t published = (uint32_t)atomic_load_explicit(&snap->published, memory_order_acquire);
+        if (published == 0) {
+            return 0;
+        }
+        const snapshot_slot_t *slot = &snap->slot[published & 1];
+
+        uint32_t seq1 = (uint32_t)atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq1 & 1) {
+            // El escritor dio la vuelta y está reescribiendo este slot: el otro ya está publicado
+            continue;
+        }
+        uint32_t sample = (uint32_t)atomic_load_explicit(&slot->sample, memory_order_relaxed);
+        for (size_t w = 0; w < n; w++) {
+            words[w] = (uint32_t)atomic_load_explicit(&slot->words[w], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t seq2 = (uint32_t)atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+        if (seq1 == seq2) {
+            memcpy(out, words, snap->size);
+            return sample;
+        }
+    }
+}
+
+uint32_t snapshot_latest(const snapshot_t *snap)
+{
+    return (uint32_t)atomic_load_explicit(&snap->published, memory_order_acquire);
+}
@@ -0,0 +1,60 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Publicación sin bloqueo de una muestra pequeña (doble buffer + secuencia).
+ *
+ * Un único escritor publica sin esperar nunca; cualquier número de lectores
+ * obtiene una copia consistente sin tomar locks. El escritor siempre escribe
+ * en el slot que NO está publicado, así que un lector que interrumpe al
+ * escritor (p.ej. de mayor prioridad en un solo núcleo) lee el slot publicado
+ * sin conflicto y no queda girando. Solo reintenta si el escritor completó
+ * dos publicaciones mientras el lector copiaba.
+ *
+ * No depende de ESP-IDF: se puede probar en el host con hilos.
+ */
+
+// Tamaño máximo del dato publicado (en palabras de 32 bits)
+#define SNAPSHOT_MAX_WORDS 8
+
+typedef struct {
+    atomic_uint_fast32_t seq;                        // Impar = escritura en curso
+    atomic_uint_fast32_t sample;                     // Número de muestra guardada en el slot
+    atomic_uint_fast32_t words[SNAPSHOT_MAX_WORDS];
+} snapshot_slot_t;
+
+typedef struct {
+    atomic_uint_fast32_t published;   // Muestras publicadas; el slot vigente es published & 1
+    size_t size;                      // Tamaño del dato en bytes
+    snapshot_slot_t slot[2];
+} snapshot_t;
+
+/**
+ * @brief Inicializa el snapshot para datos de @p size bytes (<= 4 * SNAPSHOT_MAX_WORDS)
+ */
+void snapshot_init(snapshot_t *snap, size_t size);
+
+/**
+ * @brief Publica un dato nuevo (solo un escritor). Nunca bloquea.
+ *
+ * @return Número de muestra asignado (1, 2, 3, ...)
+ */
+uint32_t snapshot_publish(snapshot_t *snap, const void *data);
+
+/**
+ * @brief Copia el último dato publicado. Sin locks ni timeouts.
+ *
+ * @return Número de muestra copiada, o 0 si todavía no se publicó ninguna
+ */
+uint32_t snapshot_read(const snapshot_t *snap, void *out);
+
+/**
+ * @brief Número de la última muestra publicada (0 = ninguna)
+ */
+uint32_t snapshot_latest(const snapshot_t *snap);
+
+#endif // SNAPSHOT_H
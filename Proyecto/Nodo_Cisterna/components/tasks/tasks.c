@@ -1,13 +1,16 @@
 #include <string.h>
 #include <inttypes.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
 
 #include "tasks.h"
 #include "../sensors/sensor.h"
+#include "sample_sched.h"
 
 static const char *TAG = "TASKS";
 
@@ -16,15 +19,51 @@ static void task_sensor_read_loop(void *pvParameters);
 // (button support removed) 
 
 // Variables globales
-static shared_sensor_data_t g_sensor_data = {
-    .sensor_data = {0},
-    .mutex = NULL
-};
+static shared_sensor_data_t g_sensor_data;
+
+// Suscriptores de muestras nuevas: un bit del event group por suscriptor
+static EventGroupHandle_t g_sample_events = NULL;
+static EventBits_t g_sample_sub_mask = 0;
+static portMUX_TYPE g_sample_sub_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Bit siguiente a los suscriptores: despierta a la tarea de muestreo antes de tiempo
+#define SAMPLE_WAKE_BIT ((EventBits_t)1 << TASKS_MAX_SAMPLE_SUBSCRIBERS)
+// Y el siguiente: hay eventos de bomba en cola para el suscriptor que los entrega
+#define PUMP_EVENT_BIT ((EventBits_t)1 << (TASKS_MAX_SAMPLE_SUBSCRIBERS + 1))
+
+_Static_assert(TASKS_MAX_SAMPLE_SUBSCRIBERS < 23, "event group limitado a 24 bits");
+_Static_assert(sizeof(sensor_data_t) <= sizeof(uint32_t) * SNAPSHOT_MAX_WORDS,
+               "sensor_data_t no cabe en el snapshot");
 
 static int g_pump_relay_pin = -1;
 static bool g_pump_relay_state = false;
 static pump_state_cb_t g_pump_cb = NULL;
 
+// Relé y control local: los tocan la tarea de muestreo y la de comandos
+static portMUX_TYPE g_pump_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool g_pump_ctrl_enabled = false;
+static pump_ctrl_t g_pump_ctrl;
+static pump_ctrl_cb_t g_pump_ctrl_cb = NULL;
+
+// Cambios del relé y decisiones del control: los callbacks publican en la
+// red, así que no se llaman desde quien conmuta sino desde el suscriptor
+// asignado con tasks_set_pump_event_subscriber()
+typedef struct {
+    bool relay;                      // true: cambio del relé (on); false: decisión del control
+    bool on;
+    pump_ctrl_decision_t decision;
+    float level_cm;
+} pump_event_t;
+
+static QueueHandle_t g_pump_events = NULL;
+static int g_pump_event_sub = -1;
+static uint32_t g_pump_events_dropped = 0;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
 /**
  * @brief Inicializa el sistema de tareas FreeRTOS
  */
@@ -37,13 +76,16 @@ esp_err_t tasks_init(const task_config_t *config)
 
     ESP_LOGI(TAG, "→ Inicializando sistema de tareas...");
 
-    // ========== Crear semáforo mutex ==========
-    g_sensor_data.mutex = xSemaphoreCreateMutex();
-    if (g_sensor_data.mutex == NULL) {
-        ESP_LOGE(TAG, "✗ Error creando mutex");
-        return ESP_FAIL;
+    // ========== Inicializar snapshot compartido ==========
+    snapshot_init(&g_sensor_data.snapshot, sizeof(sensor_data_t));
+    ESP_LOGD(TAG, "  ✓ Snapshot de sensores inicializado");
+
+    g_sample_events = xEventGroupCreate();
+    g_pump_events = xQueueCreate(TASKS_PUMP_EVENT_QUEUE_LEN, sizeof(pump_event_t));
+    if (g_sample_events == NULL || g_pump_events == NULL) {
+        ESP_LOGE(TAG, "✗ Error creando event group de muestras o cola de eventos de bomba");
+        return ESP_ERR_NO_MEM;
     }
-    ESP_LOGD(TAG, "  ✓ Mutex creado");
 
     // ========== Inicializar sensores ==========
     esp_err_t ret = sensor_init(config->ultrasonic_trig_pin,
@@ -76,6 +118,14 @@ esp_err_t tasks_init(const task_config_t *config)
     g_pump_relay_state = false;
     ESP_LOGD(TAG, "  ✓ Pin del relé configurado (pin %d)", g_pump_relay_pin);
 
+    if (config->pump_ctrl_enable) {
+        pump_ctrl_init(&g_pump_ctrl, &config->pump_ctrl, false, now_ms());
+        g_pump_ctrl_enabled = true;
+        ESP_LOGI(TAG, "✓ Control local de bomba: ON < %.1f cm, OFF > %.1f cm (mín. %" PRIu32 "/%" PRIu32 " s)",
+                 config->pump_ctrl.low_cm, config->pump_ctrl.high_cm,
+                 config->pump_ctrl.min_on_ms / 1000, config->pump_ctrl.min_off_ms / 1000);
+    }
+
     // Button support disabled: control is via MQTT only
 
     // ========== Crear tarea de lectura de sensores ==========
@@ -92,20 +142,137 @@ esp_err_t tasks_init(const task_config_t *config)
 
 /* Button task removed: hardware button is disabled to ensure Node-RED is sole controller */
 
+// Con g_pump_mux tomado; true si el relé cambió
+static bool pump_relay_apply(bool enable)
+{
+    if (g_pump_relay_state == enable) {
+        return false;
+    }
+    gpio_set_level(g_pump_relay_pin, enable ? 1 : 0);
+    g_pump_relay_state = enable;
+    return true;
+}
+
+/* Encola un evento para los callbacks sin esperar: con la cola llena se descarta */
+static void pump_event_post(const pump_event_t *ev)
+{
+    if (g_pump_events == NULL) {
+        return;
+    }
+    if (xQueueSend(g_pump_events, ev, 0) != pdTRUE) {
+        g_pump_events_dropped++;
+        ESP_LOGW(TAG, "⚠ Cola de eventos de bomba llena (%" PRIu32 " descartados)", g_pump_events_dropped);
+        return;
+    }
+    xEventGroupSetBits(g_sample_events, PUMP_EVENT_BIT);
+}
+
+static void pump_ctrl_report(const pump_ctrl_decision_t *d, float level_cm)
+{
+    if (d->action != PUMP_CTRL_KEEP && g_pump_ctrl_cb) {
+        pump_event_t ev = { .relay = false, .on = d->on, .decision = *d, .level_cm = level_cm };
+        pump_event_post(&ev);
+    }
+}
+
+/* Llama a los callbacks con los eventos en cola, en orden (tarea del suscriptor asignado) */
+static void pump_events_dispatch(void)
+{
+    pump_event_t ev;
+    while (xQueueReceive(g_pump_events, &ev, 0) == pdTRUE) {
+        if (ev.relay && g_pump_cb) {
+            g_pump_cb(ev.on);
+        } else if (!ev.relay && g_pump_ctrl_cb) {
+            g_pump_ctrl_cb(&ev.decision, ev.level_cm);
+        }
+    }
+}
+
+// Fuera de la sección crítica: log y aviso del cambio de relé
+static void pump_relay_changed(bool enable)
+{
+    ESP_LOGI(TAG, "→ Relé de bomba: %s", enable ? "ENCENDIDO" : "APAGADO");
+    // El caudal cambia de golpe: el filtro de nivel lo sigue sin rechazar lecturas
+    sensor_level_filter_maneuver();
+    // y el muestreo adaptativo vuelve al período mínimo sin esperar el actual
+    if (g_sample_events != NULL) {
+        xEventGroupSetBits(g_sample_events, SAMPLE_WAKE_BIT);
+    }
+    if (g_pump_cb) {
+        pump_event_t ev = { .relay = true, .on = enable };
+        pump_event_post(&ev);
+    }
+}
+
+/**
+ * @brief Control local: evalúa la muestra y conmuta el relé si corresponde
+ */
+static void pump_ctrl_step(const sensor_data_t *sample)
+{
+    bool changed = false;
+    taskENTER_CRITICAL(&g_pump_mux);
+    pump_ctrl_decision_t d = pump_ctrl_update(&g_pump_ctrl, sample->water_level,
+                                              sample->water_state == WATER_STATE_DIRTY, now_ms());
+    if (d.action == PUMP_CTRL_SWITCH) {
+        changed = pump_relay_apply(d.on);
+    }
+    taskEXIT_CRITICAL(&g_pump_mux);
+
+    if (changed) {
+        pump_relay_changed(d.on);
+    }
+    pump_ctrl_report(&d, sample->water_level);
+}
+
+/**
+ * @brief Período hasta la próxima muestra según la bomba y el nivel
+ *
+ * @param sample Muestra recién tomada, o NULL si la lectura falló
+ */
+static uint32_t sample_period_step(sample_sched_t *sched, const sensor_data_t *sample)
+{
+    sample_sched_input_t in = {
+        .pump_on = tasks_get_pump_relay_state(),
+        .level_cm = -1.0f,
+    };
+    if (sample != NULL) {
+        in.level_cm = sample->water_level;
+        // Con el filtro de nivel la velocidad ya viene estimada
+        in.has_rate = sample->level_filtered >= 0.0f;
+        in.rate_cm_min = sample->level_rate;
+    }
+
+    sample_sched_mode_t prev = sched->mode;
+    uint32_t period_ms = sample_sched_update(sched, &in, now_ms());
+    if (sched->mode != prev) {
+        ESP_LOGD(TAG, "  Muestreo %s: %" PRIu32 " ms", sample_sched_mode_name(sched->mode), period_ms);
+    }
+    return period_ms;
+}
+
 /**
  * @brief Tarea FreeRTOS para lectura periódica de sensores
  * 
- * Esta tarea realiza lecturas cada 1 segundo y actualiza la estructura
- * compartida de forma sincronizada usando un semáforo mutex
+ * Esta tarea realiza lecturas a intervalo fijo o adaptativo (rápido con la
+ * bomba en marcha o el nivel moviéndose, espaciado en reposo), publica cada
+ * muestra en el snapshot compartido (nunca bloquea a la espera de los
+ * lectores) y despierta a los suscriptores
  */
 static void task_sensor_read_loop(void *pvParameters)
 {
     const task_config_t *config = (const task_config_t *)pvParameters;
     
     ESP_LOGI(TAG, "→ Tarea de lectura de sensores iniciada");
-    ESP_LOGI(TAG, "  Intervalo: %" PRIu32 " ms", config->sampling_interval_ms);
+    if (config->adaptive_sampling) {
+        ESP_LOGI(TAG, "  Intervalo adaptativo: %" PRIu32 "..%" PRIu32 " ms",
+                 config->sampling.min_ms, config->sampling.max_ms);
+    } else {
+        ESP_LOGI(TAG, "  Intervalo: %" PRIu32 " ms", config->sampling_interval_ms);
+    }
 
     sensor_data_t local_data;
+    sample_sched_t sched;
+    sample_sched_init(&sched, &config->sampling, now_ms());
     TickType_t xLastWakeTime = xTaskGetTickCount();
 
     while (1) {
@@ -113,20 +280,41 @@ static void task_sensor_read_loop(void *pvParameters)
         esp_err_t err = sensor_read_all(&local_data);
 
         if (err == ESP_OK) {
-            // Actualizar estructura compartida de forma segura
-            if (xSemaphoreTake(g_sensor_data.mutex, pdMS_TO_TICKS(100))) {
-                memcpy(&g_sensor_data.sensor_data, &local_data, 
-                       sizeof(sensor_data_t));
-                xSemaphoreGive(g_sensor_data.mutex);
-            } else {
-                ESP_LOGW(TAG, "⚠ Timeout adquiriendo mutex");
+            // Publicar la muestra (sin bloqueo) y despertar a los suscriptores
+            snapshot_publish(&g_sensor_data.snapshot, &local_data);
+
+            taskENTER_CRITICAL(&g_sample_sub_mux);
+            EventBits_t subs = g_sample_sub_mask;
+            taskEXIT_CRITICAL(&g_sample_sub_mux);
+            if (subs) {
+                xEventGroupSetBits(g_sample_events, subs);
+            }
+
+            // Control local sobre la muestra recién tomada, sin pasar por la red
+            if (g_pump_ctrl_enabled) {
+                pump_ctrl_step(&local_data);
             }
         } else {
             ESP_LOGW(TAG, "⚠ Error leyendo sensores");
         }
 
         // Esperar al siguiente ciclo
-        vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(config->sampling_interval_ms));
+        if (!config->adaptive_sampling) {
+            vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(config->sampling_interval_ms));
+            continue;
+        }
+
+        // Adaptativo: el período cuenta desde el despertar anterior, y un
+        // cambio del relé (comando o control local) adelanta la muestra
+        TickType_t period = pdMS_TO_TICKS(sample_period_step(&sched, err == ESP_OK ? &local_data : NULL));
+        TickType_t elapsed = xTaskGetTickCount() - xLastWakeTime;
+        EventBits_t bits = xEventGroupWaitBits(g_sample_events, SAMPLE_WAKE_BIT, pdTRUE, pdFALSE,
+                                               elapsed < period ? period - elapsed : 0);
+        if (bits & SAMPLE_WAKE_BIT) {
+            sample_sched_wake(&sched, now_ms());
+        }
+        xLastWakeTime = (bits & SAMPLE_WAKE_BIT) || elapsed >= period ? xTaskGetTickCount()
+                                                                      : xLastWakeTime + period;
     }
 }
 
@@ -139,7 +327,7 @@ shared_sensor_data_t* tasks_get_shared_sensor_data(void)
 }
 
 /**
- * @brief Lee datos de sensores de forma segura (con semáforo)
+ * @brief Copia la última muestra publicada; si aún no hay, espera la primera
  */
 esp_err_t tasks_read_sensor_data(sensor_data_t *data, uint32_t timeout_ms)
 {
@@ -147,21 +335,121 @@ esp_err_t tasks_read_sensor_data(sensor_data_t *data, uint32_t timeout_ms)
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (g_sensor_data.mutex == NULL) {
-        ESP_LOGE(TAG, "✗ Mutex no inicializado");
+    if (snapshot_read(&g_sensor_data.snapshot, data) != 0) {
+        return ESP_OK;
+    }
+    if (timeout_ms == 0) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    // Intentar adquirir el mutex
-    if (xSemaphoreTake(g_sensor_data.mutex, pdMS_TO_TICKS(timeout_ms))) {
-        // Copiar datos
-        memcpy(data, &g_sensor_data.sensor_data, sizeof(sensor_data_t));
-        xSemaphoreGive(g_sensor_data.mutex);
-        return ESP_OK;
-    } else {
-        ESP_LOGW(TAG, "⚠ Timeout adquiriendo mutex (timeout=%" PRIu32 " ms)", timeout_ms);
-        return ESP_ERR_TIMEOUT;
+    // Sin muestras todavía: suscripción temporal para esperar la primera
+    int sub_id = tasks_subscribe_samples();
+    if (sub_id < 0) {
+        return ESP_ERR_INVALID_STATE;
     }
+    uint32_t seq = tasks_wait_sample(sub_id, data, 0, timeout_ms);
+    tasks_unsubscribe_samples(sub_id);
+    return seq != 0 ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief Copia la última muestra publicada y su número de secuencia
+ */
+uint32_t tasks_get_sensor_snapshot(sensor_data_t *data)
+{
+    if (data == NULL) {
+        return 0;
+    }
+    return snapshot_read(&g_sensor_data.snapshot, data);
+}
+
+/**
+ * @brief Suscribe a la tarea que llama a la notificación de muestras nuevas
+ */
+int tasks_subscribe_samples(void)
+{
+    if (g_sample_events == NULL) {
+        ESP_LOGE(TAG, "✗ tasks_init() no fue llamado");
+        return -1;
+    }
+
+    int id = -1;
+    taskENTER_CRITICAL(&g_sample_sub_mux);
+    for (int i = 0; i < TASKS_MAX_SAMPLE_SUBSCRIBERS; i++) {
+        if (!(g_sample_sub_mask & (1u << i))) {
+            g_sample_sub_mask |= (1u << i);
+            id = i;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&g_sample_sub_mux);
+
+    if (id < 0) {
+        ESP_LOGW(TAG, "⚠ Sin lugar para más suscriptores de muestras");
+        return -1;
+    }
+    xEventGroupClearBits(g_sample_events, 1u << id);
+    return id;
+}
+
+/**
+ * @brief Cancela una suscripción a muestras nuevas
+ */
+void tasks_unsubscribe_samples(int sub_id)
+{
+    if (sub_id < 0 || sub_id >= TASKS_MAX_SAMPLE_SUBSCRIBERS) {
+        return;
+    }
+    taskENTER_CRITICAL(&g_sample_sub_mux);
+    g_sample_sub_mask &= ~(1u << sub_id);
+    taskEXIT_CRITICAL(&g_sample_sub_mux);
+    if (g_pump_event_sub == sub_id) {
+        g_pump_event_sub = -1;
+    }
+}
+
+/**
+ * @brief Espera una muestra más nueva que last_seq
+ */
+uint32_t tasks_wait_sample(int sub_id, sensor_data_t *data, uint32_t last_seq, uint32_t timeout_ms)
+{
+    if (data == NULL || sub_id < 0 || sub_id >= TASKS_MAX_SAMPLE_SUBSCRIBERS ||
+        g_sample_events == NULL) {
+        return 0;
+    }
+    const EventBits_t bit = 1u << sub_id;
+    const EventBits_t events = sub_id == g_pump_event_sub ? PUMP_EVENT_BIT : 0;
+    const TickType_t start = xTaskGetTickCount();
+    const TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+
+    // Limpiar antes de comprobar: una publicación posterior deja el bit levantado
+    xEventGroupClearBits(g_sample_events, bit);
+    while (snapshot_latest(&g_sensor_data.snapshot) == last_seq) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        EventBits_t bits = xEventGroupWaitBits(g_sample_events, bit | events, pdTRUE, pdFALSE,
+                                               elapsed < timeout ? timeout - elapsed : 0);
+        if (bits & events) {
+            // Con el bit ya limpio: un evento encolado después lo vuelve a levantar
+            pump_events_dispatch();
+        } else if (!(bits & bit)) {
+            return 0;
+        }
+    }
+    return snapshot_read(&g_sensor_data.snapshot, data);
+}
+
+/**
+ * @brief Asigna el suscriptor que entrega los eventos de bomba a los callbacks
+ */
+esp_err_t tasks_set_pump_event_subscriber(int sub_id)
+{
+    if (sub_id < 0 || sub_id >= TASKS_MAX_SAMPLE_SUBSCRIBERS || g_sample_events == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    g_pump_event_sub = sub_id;
+    // Los eventos encolados antes de asignarlo se entregan en la próxima espera
+    xEventGroupSetBits(g_sample_events, PUMP_EVENT_BIT);
+    return ESP_OK;
 }
 
 /**
@@ -175,19 +463,79 @@ esp_err_t tasks_set_pump_relay(bool enable)
     }
 
     // Evitar cambios innecesarios
-    if (g_pump_relay_state != enable) {
-        gpio_set_level(g_pump_relay_pin, enable ? 1 : 0);
-        g_pump_relay_state = enable;
-        
-        ESP_LOGI(TAG, "→ Relé de bomba: %s", enable ? "ENCENDIDO" : "APAGADO");
-        if (g_pump_cb) {
-            g_pump_cb(g_pump_relay_state);
-        }
+    taskENTER_CRITICAL(&g_pump_mux);
+    bool changed = pump_relay_apply(enable);
+    taskEXIT_CRITICAL(&g_pump_mux);
+    if (changed) {
+        pump_relay_changed(enable);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Comando manual de la bomba: conmuta y suspende el control local
+ */
+esp_err_t tasks_pump_command(bool enable)
+{
+    if (g_pump_relay_pin < 0) {
+        ESP_LOGE(TAG, "✗ Pin del relé no configurado");
+        return ESP_ERR_INVALID_STATE;
     }
 
+    pump_ctrl_decision_t d = { .action = PUMP_CTRL_KEEP };
+    taskENTER_CRITICAL(&g_pump_mux);
+    bool changed = pump_relay_apply(enable);
+    if (g_pump_ctrl_enabled) {
+        d = pump_ctrl_override(&g_pump_ctrl, enable, now_ms());
+    }
+    taskEXIT_CRITICAL(&g_pump_mux);
+
+    if (changed) {
+        pump_relay_changed(enable);
+    }
+    if (d.action != PUMP_CTRL_KEEP) {
+        sensor_data_t last = { .water_level = -1.0f };
+        tasks_get_sensor_snapshot(&last);
+        pump_ctrl_report(&d, last.water_level);
+    }
     return ESP_OK;
 }
 
+/**
+ * @brief Devuelve la bomba al control local
+ */
+esp_err_t tasks_pump_resume(void)
+{
+    if (!g_pump_ctrl_enabled) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    taskENTER_CRITICAL(&g_pump_mux);
+    pump_ctrl_decision_t d = pump_ctrl_resume(&g_pump_ctrl);
+    taskEXIT_CRITICAL(&g_pump_mux);
+
+    if (d.action != PUMP_CTRL_KEEP) {
+        sensor_data_t last = { .water_level = -1.0f };
+        tasks_get_sensor_snapshot(&last);
+        pump_ctrl_report(&d, last.water_level);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Copia el estado del control local
+ */
+bool tasks_get_pump_ctrl(pump_ctrl_t *out)
+{
+    if (!g_pump_ctrl_enabled || out == NULL) {
+        return false;
+    }
+    taskENTER_CRITICAL(&g_pump_mux);
+    *out = g_pump_ctrl;
+    taskEXIT_CRITICAL(&g_pump_mux);
+    return true;
+}
+
 bool tasks_is_button_pressed(void)
 {
     // Button disabled: always return false
@@ -198,6 +546,11 @@ void tasks_register_pump_state_cb(pump_state_cb_t cb)
 {
     g_pump_cb = cb;
 }
+
+void tasks_register_pump_ctrl_cb(pump_ctrl_cb_t cb)
+{
+    g_pump_ctrl_cb = cb;
+}
 /* Button support removed: tasks_register_button_cb omitted */
 
 /**
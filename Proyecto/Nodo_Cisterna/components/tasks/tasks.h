@@ -3,28 +3,35 @@
 
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
 #include "../sensors/sensor.h"
+#include "snapshot.h"
+#include "pump_ctrl.h"
+#include "sample_sched.h"
 
 /**
- * @brief Estructura para compartir datos entre tareas de forma sincronizada
+ * @brief Estructura para compartir datos entre tareas sin bloqueo
+ *
+ * La tarea de muestreo publica con snapshot_publish() sin esperar nunca;
+ * los lectores copian con snapshot_read() sin locks (ver snapshot.h).
  */
 typedef struct {
-    sensor_data_t sensor_data;
-    SemaphoreHandle_t mutex;     // Semáforo para sincronizar acceso
+    snapshot_t snapshot;         // Última muestra de sensor_data_t (doble buffer + secuencia)
 } shared_sensor_data_t;
 
 /**
  * @brief Estructura para configuración de tareas
  */
 typedef struct {
-    uint32_t sampling_interval_ms;  // Intervalo de muestreo (1000ms = 1 segundo)
+    uint32_t sampling_interval_ms;  // Intervalo fijo de muestreo (sin muestreo adaptativo)
     int ultrasonic_trig_pin;        // Pin GPIO del sensor ultrasónico TRIG
     int ultrasonic_echo_pin;        // Pin GPIO del sensor ultrasónico ECHO
     int tds_adc_pin;                // Pin ADC del sensor TDS
     int pump_relay_pin;             // Pin GPIO del relé que controla la bomba
     /* pump_button_pin removed: button is disabled in firmware; control via MQTT only */
-    /* Note: automatic thresholds removed; control is performed externally via MQTT ON/OFF */
+    bool pump_ctrl_enable;          // Control local por histéresis en cada muestra (ver pump_ctrl.h)
+    pump_ctrl_config_t pump_ctrl;   // Umbrales y tiempos del control local
+    bool adaptive_sampling;         // Período según bomba y nivel (ver sample_sched.h)
+    sample_sched_config_t sampling; // Límites del período adaptativo
 } task_config_t;
 
 /**
@@ -43,22 +50,117 @@ esp_err_t tasks_init(const task_config_t *config);
 shared_sensor_data_t* tasks_get_shared_sensor_data(void);
 
 /**
- * @brief Lee datos de sensores de forma segura (con semáforo)
+ * @brief Copia la última muestra publicada
  * 
+ * Si ya hay una muestra la copia sin bloquear; si todavía no se publicó
+ * ninguna, espera la primera hasta @p timeout_ms.
+ *
  * @param data Puntero para almacenar los datos leídos
- * @param timeout_ms Timeout en ms para adquirir el semáforo
- * @return esp_err_t ESP_OK si es exitoso, ESP_ERR_TIMEOUT si agota tiempo
+ * @param timeout_ms Espera máxima por la primera muestra (0 = no esperar)
+ * @return esp_err_t ESP_OK; ESP_ERR_TIMEOUT si no llegó ninguna muestra a
+ *         tiempo; ESP_ERR_INVALID_STATE si no hay muestras y no se puede
+ *         esperar (timeout 0, o sin tasks_init() o sin lugar para suscribirse)
  */
 esp_err_t tasks_read_sensor_data(sensor_data_t *data, uint32_t timeout_ms);
 
+/**
+ * @brief Copia la última muestra publicada y su número de secuencia
+ *
+ * @param data Puntero para almacenar los datos leídos
+ * @return uint32_t Número de muestra (1, 2, ...), 0 si aún no hay muestras
+ */
+uint32_t tasks_get_sensor_snapshot(sensor_data_t *data);
+
+// Máximo de tareas suscritas a muestras nuevas (un bit de event group por suscriptor)
+#define TASKS_MAX_SAMPLE_SUBSCRIBERS 8
+// Eventos de bomba (cambios del relé, decisiones del control) pendientes de entregar
+#define TASKS_PUMP_EVENT_QUEUE_LEN 8
+
+/**
+ * @brief Suscribe a la tarea que llama a la notificación de muestras nuevas
+ *
+ * Cada muestra publicada por la tarea de muestreo levanta el bit del
+ * suscriptor en un event group (no usa las notificaciones directas de la
+ * tarea, que quedan libres para sensor_ultrasonic_wait()).
+ * Requiere tasks_init() previo.
+ *
+ * @return int Identificador de suscriptor (>= 0), o -1 si no hay lugar
+ */
+int tasks_subscribe_samples(void);
+
+/**
+ * @brief Cancela una suscripción obtenida con tasks_subscribe_samples()
+ */
+void tasks_unsubscribe_samples(int sub_id);
+
+/**
+ * @brief Espera (sin consumir CPU) una muestra más nueva que @p last_seq
+ *
+ * Retorna de inmediato si ya hay una muestra posterior a @p last_seq.
+ * Si el consumidor se atrasó, entrega la más reciente: la diferencia entre
+ * números de secuencia indica cuántas muestras se perdieron.
+ *
+ * @param sub_id Identificador de tasks_subscribe_samples()
+ * @param data Puntero para almacenar la muestra
+ * @param last_seq Último número de secuencia procesado (0 al comenzar)
+ * Si @p sub_id es el suscriptor de tasks_set_pump_event_subscriber(),
+ * mientras espera entrega además los eventos de bomba a los callbacks.
+ *
+ * @param timeout_ms Espera máxima
+ * @return uint32_t Número de secuencia de la muestra, 0 si venció el timeout
+ */
+uint32_t tasks_wait_sample(int sub_id, sensor_data_t *data, uint32_t last_seq, uint32_t timeout_ms);
+
+/**
+ * @brief Asigna la tarea que llama a los callbacks de bomba
+ *
+ * Los cambios del relé y las decisiones del control local no llaman a los
+ * callbacks desde la tarea que conmuta (la de muestreo no debe esperar a la
+ * red): se encolan sin bloquear y los entrega, en orden, tasks_wait_sample()
+ * de este suscriptor. Hasta asignarlo quedan en cola; con la cola llena
+ * (TASKS_PUMP_EVENT_QUEUE_LEN) se descartan con un aviso.
+ *
+ * @param sub_id Identificador de tasks_subscribe_samples()
+ * @return esp_err_t ESP_OK, o ESP_ERR_INVALID_ARG
+ */
+esp_err_t tasks_set_pump_event_subscriber(int sub_id);
+
 /**
  * @brief Controla el relé de la bomba sumergible
  * 
+ * No pasa por el control local: para comandos de usuario usar
+ * tasks_pump_command().
+ * 
  * @param enable true para encender, false para apagar
  * @return esp_err_t ESP_OK si es exitoso
  */
 esp_err_t tasks_set_pump_relay(bool enable);
 
+/**
+ * @brief Comando manual de la bomba (Node-RED, UART)
+ *
+ * Conmuta el relé de inmediato. Con el control local activo, además lo
+ * suspende durante pump_ctrl.override_ms (ver pump_ctrl_override()).
+ *
+ * @param enable true para encender, false para apagar
+ * @return esp_err_t ESP_OK si es exitoso
+ */
+esp_err_t tasks_pump_command(bool enable);
+
+/**
+ * @brief Devuelve la bomba al control local si un comando manual lo suspendió
+ *
+ * @return esp_err_t ESP_OK, o ESP_ERR_NOT_SUPPORTED si el control local está desactivado
+ */
+esp_err_t tasks_pump_resume(void);
+
+/**
+ * @brief Copia el estado del control local
+ *
+ * @return bool false si el control local está desactivado
+ */
+bool tasks_get_pump_ctrl(pump_ctrl_t *out);
+
 /**
  * @brief Obtiene el estado actual del relé de la bomba
  * 
@@ -70,7 +172,18 @@ bool tasks_get_pump_relay_state(void);
 typedef void (*pump_state_cb_t)(bool state);
 /**
  * @brief Registrar una función callback que será llamada cuando cambie el estado del relé
+ *
+ * Se llama desde la tarea de tasks_set_pump_event_subscriber().
  */
 void tasks_register_pump_state_cb(pump_state_cb_t cb);
 
+/**
+ * @brief Callback de decisiones del control local (conmutación, espera por
+ * tiempo mínimo, comando manual, reanudación), con el último nivel medido.
+ * Se llama desde la tarea de tasks_set_pump_event_subscriber(), en el
+ * mismo orden que los cambios del relé.
+ */
+typedef void (*pump_ctrl_cb_t)(const pump_ctrl_decision_t *decision, float level_cm);
+void tasks_register_pump_ctrl_cb(pump_ctrl_cb_t cb);
+
 #endif // TASKS_H
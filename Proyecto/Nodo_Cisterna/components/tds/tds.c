@@ -1,4 +1,5 @@
 #include "tds.h"
+#include "tds_curve.h"
 #include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
@@ -8,31 +9,62 @@
 
 static const char *TAG = "tds";
 
-// Fixed water temperature for temperature compensation (not used deeply here)
+// Default water temperature for compensation (no temperature probe yet)
 const float WATER_TEMP = 25.0f;
 
 // Calibration storage keys
 static const char *KEY_OFFSET = "tds_offset";
 static const char *KEY_GAIN = "tds_gain";
+static const char *KEY_CURVE = "tds_curve";
 
 static float tds_offset = 0.0f;
 static float tds_gain = 1.0f;
 static float last_raw = 0.0f;
 
+// Multi-point curve (persisted) and the raw -> ppm LUT expanded from it.
+// With fewer than 2 curve points the LUT is built from offset/gain instead.
+static tds_curve_t tds_curve;
+static tds_lut_t tds_lut;
+static uint32_t tds_temp_table[TDS_TEMP_TABLE_SIZE];
+static float water_temp = WATER_TEMP;
+
+static void tds_rebuild_lut(void)
+{
+    uint32_t comp = tds_temp_lookup_q16(tds_temp_table, water_temp);
+
+    if (tds_curve_is_valid(&tds_curve)) {
+        tds_lut_build(&tds_curve, comp, &tds_lut);
+        return;
+    }
+
+    // Legacy two-point formula: ppm = (raw - offset) * gain * 1000
+    for (uint32_t i = 0; i < TDS_LUT_SIZE; i++) {
+        float ppm = ((float)(i << TDS_LUT_SHIFT) - tds_offset) * tds_gain * 1000.0f;
+        ppm = ppm * (float)comp / 65536.0f;
+        if (ppm < 0.0f) ppm = 0.0f;
+        if (ppm > 4.0e9f) ppm = 4.0e9f;
+        tds_lut.ppm[i] = (uint32_t)(ppm + 0.5f);
+    }
+}
+
 void tds_init(void)
 {
     ESP_LOGI(TAG, "Initializing TDS module");
+    tds_curve_init(&tds_curve);
+    tds_temp_table_build(tds_curve.temp_coef_e4, tds_temp_table);
     // Ensure ADC is initialized by caller
     // Load calibration if present
     esp_err_t r = tds_load_calibration();
     if (r != ESP_OK) {
         ESP_LOGI(TAG, "Using default calibration offset=0 gain=1");
+        tds_rebuild_lut();
     }
 }
 
 float tds_read_raw(void)
 {
     // Use ADC driver to read raw and return as float
+    // (in continuous mode this is the latest running average, no blocking)
     int raw = adc_read_raw(20);
     last_raw = (float)raw;
     return last_raw;
@@ -40,17 +72,17 @@ float tds_read_raw(void)
 
 float tds_read_ppm(void)
 {
+    // Curve and temperature compensation are folded into the LUT at load time
     float raw = tds_read_raw();
-    float normalized = (raw - tds_offset) * tds_gain;
-    // Temperature compensation could be applied here based on WATER_TEMP
-    float tds_ppm = normalized * 1000.0f; // arbitrary scaling to ppm-like units
-    return tds_ppm;
+    if (raw < 0.0f) raw = 0.0f;
+    return (float)tds_lut_lookup(&tds_lut, (uint32_t)raw);
 }
 
 void tds_set_calibration_point_A(float raw)
 {
     tds_offset = raw;
     ESP_LOGI(TAG, "Set calibration A (offset) = %f", tds_offset);
+    tds_rebuild_lut();
 }
 
 void tds_set_calibration_point_B(float raw)
@@ -62,6 +94,7 @@ void tds_set_calibration_point_B(float raw)
     }
     tds_gain = 1.0f / (raw - tds_offset);
     ESP_LOGI(TAG, "Set calibration B (gain) = %f (raw=%f)", tds_gain, raw);
+    tds_rebuild_lut();
 }
 
 esp_err_t tds_save_calibration(void)
@@ -69,7 +102,9 @@ esp_err_t tds_save_calibration(void)
     esp_err_t r = storage_save_float(KEY_OFFSET, tds_offset);
     if (r != ESP_OK) return r;
     r = storage_save_float(KEY_GAIN, tds_gain);
-    return r;
+    if (r != ESP_OK) return r;
+    // An empty curve is stored too, so that "clear" + save persists
+    return storage_save_blob(KEY_CURVE, &tds_curve, sizeof(tds_curve));
 }
 
 esp_err_t tds_load_calibration(void)
@@ -80,12 +115,68 @@ esp_err_t tds_load_calibration(void)
     if (r1 == ESP_OK) tds_offset = offset;
     if (r2 == ESP_OK) tds_gain = gain;
 
-    if (r1 == ESP_OK || r2 == ESP_OK) {
+    tds_curve_t curve;
+    size_t len = sizeof(curve);
+    esp_err_t r3 = storage_load_blob(KEY_CURVE, &curve, &len);
+    if (r3 == ESP_OK && len == sizeof(curve) && curve.version == TDS_CURVE_VERSION &&
+        curve.count <= TDS_CURVE_MAX_POINTS) {
+        tds_curve = curve;
+        tds_temp_table_build(tds_curve.temp_coef_e4, tds_temp_table);
+        ESP_LOGI(TAG, "Calibration curve loaded (%u points)", tds_curve.count);
+    } else if (r3 == ESP_OK) {
+        ESP_LOGW(TAG, "Calibration curve ignored (bad version or size)");
+        r3 = ESP_ERR_INVALID_VERSION;
+    }
+    tds_rebuild_lut();
+
+    if (r1 == ESP_OK || r2 == ESP_OK || r3 == ESP_OK) {
         ESP_LOGI(TAG, "Calibration loaded offset=%f gain=%f", tds_offset, tds_gain);
         return ESP_OK;
     }
     return ESP_FAIL;
 }
 
+int tds_curve_add(float raw, float ppm)
+{
+    if (raw < 0.0f || raw > TDS_ADC_MAX_RAW || ppm < 0.0f || ppm > 65535.0f) {
+        ESP_LOGW(TAG, "Curve point out of range raw=%f ppm=%f", raw, ppm);
+        return -1;
+    }
+    int n = tds_curve_add_point(&tds_curve, (uint16_t)(raw + 0.5f), (uint16_t)(ppm + 0.5f));
+    if (n < 0) {
+        ESP_LOGW(TAG, "Curve full (%d points)", TDS_CURVE_MAX_POINTS);
+        return -1;
+    }
+    ESP_LOGI(TAG, "Curve point raw=%.0f ppm=%.0f (%d points)", raw, ppm, n);
+    tds_rebuild_lut();
+    return n;
+}
+
+void tds_curve_clear(void)
+{
+    uint16_t coef = tds_curve.temp_coef_e4;
+    tds_curve_init(&tds_curve);
+    tds_curve.temp_coef_e4 = coef;
+    tds_rebuild_lut();
+}
+
+const tds_curve_t *tds_get_curve(void) { return &tds_curve; }
+
+void tds_set_temp_coefficient(float per_degree)
+{
+    if (per_degree < 0.0f || per_degree > 0.1f) return;
+    tds_curve.temp_coef_e4 = (uint16_t)(per_degree * 10000.0f + 0.5f);
+    tds_temp_table_build(tds_curve.temp_coef_e4, tds_temp_table);
+    tds_rebuild_lut();
+}
+
+void tds_set_water_temp(float celsius)
+{
+    water_temp = celsius;
+    tds_rebuild_lut();
+}
+
+float tds_get_water_temp(void) { return water_temp; }
+
 float tds_get_offset(void) { return tds_offset; }
 float tds_get_gain(void) { return tds_gain; }
@@ -1,6 +1,7 @@
 #pragma once
 #include <stdbool.h>
 #include "esp_err.h"
+#include "tds_curve.h"
 
 void tds_init(void);
 /**
@@ -8,7 +9,10 @@ void tds_init(void);
  */
 float tds_read_raw(void);
 
-/** Return TDS in ppm (relative) using offset/gain calibration. */
+/**
+ * Return TDS in ppm: one lookup in the LUT expanded from the calibration
+ * curve (or from offset/gain when no curve is stored), temperature compensated.
+ */
 float tds_read_ppm(void);
 
 void tds_set_calibration_point_A(float raw);
@@ -18,3 +22,19 @@ esp_err_t tds_load_calibration(void);
 
 float tds_get_offset(void);
 float tds_get_gain(void);
+
+/**
+ * Add a multi-point calibration sample (raw reading in a reference solution
+ * of known ppm at 25 °C). Returns the point count or -1 on error.
+ * The curve replaces offset/gain once it has 2 or more points; it is
+ * persisted by tds_save_calibration() as a single NVS blob.
+ */
+int tds_curve_add(float raw, float ppm);
+void tds_curve_clear(void);
+const tds_curve_t *tds_get_curve(void);
+
+/** Conductivity temperature coefficient (default 0.02 /°C), stored with the curve. */
+void tds_set_temp_coefficient(float per_degree);
+/** Water temperature used for compensation (default WATER_TEMP). Rebuilds the LUT. */
+void tds_set_water_temp(float celsius);
+float tds_get_water_temp(void);
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Multi-point TDS calibration curve expanded into a raw-ADC -> ppm lookup table.
+ *
+ * The curve (up to TDS_CURVE_MAX_POINTS raw/ppm pairs at 25 °C plus the
+ * temperature coefficient) is what gets persisted. At boot it is expanded
+ * into a LUT with one entry every 2^TDS_LUT_SHIFT raw counts, with the
+ * temperature compensation already folded in, so a conversion is one indexed
+ * interpolation. No ESP-IDF dependencies.
+ */
+
+#define TDS_CURVE_MAX_POINTS 8
+#define TDS_CURVE_VERSION    1
+
+#define TDS_ADC_MAX_RAW      4095
+#define TDS_LUT_SHIFT        4
+#define TDS_LUT_SIZE         ((TDS_ADC_MAX_RAW >> TDS_LUT_SHIFT) + 2)
+
+// Temperature compensation table: one entry per °C from 0 to 50 °C
+#define TDS_TEMP_MIN_C       0
+#define TDS_TEMP_MAX_C       50
+#define TDS_TEMP_TABLE_SIZE  (TDS_TEMP_MAX_C - TDS_TEMP_MIN_C + 1)
+#define TDS_TEMP_REF_C       25
+#define TDS_TEMP_COEF_DEFAULT_E4 200   // 0.02 /°C, typical for conductivity
+
+typedef struct {
+    uint16_t raw;   // averaged ADC reading
+    uint16_t ppm;   // reference solution value at 25 °C
+} tds_cal_point_t;
+
+/** Persisted form (single NVS blob). Points are kept sorted by raw. */
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    uint16_t temp_coef_e4;   // compensation coefficient x 10^4 per °C
+    tds_cal_point_t points[TDS_CURVE_MAX_POINTS];
+} tds_curve_t;
+
+typedef struct {
+    uint32_t ppm[TDS_LUT_SIZE];
+} tds_lut_t;
+
+/** Empty curve with the default temperature coefficient. */
+void tds_curve_init(tds_curve_t *curve);
+
+/**
+ * Insert a point keeping raw order. A point with the same raw replaces the
+ * old one. Returns the new point count, or -1 if the curve is full.
+ */
+int tds_curve_add_point(tds_curve_t *curve, uint16_t raw, uint16_t ppm);
+
+/** True if the blob has a known version and a usable (>= 2) point count. */
+int tds_curve_is_valid(const tds_curve_t *curve);
+
+/**
+ * Evaluate the piecewise-linear curve at raw (linear extrapolation past the
+ * end points, clamped at 0). One point means ppm proportional to raw.
+ */
+uint32_t tds_curve_eval(const tds_curve_t *curve, uint32_t raw);
+
+/** Fill table_q16[t - TDS_TEMP_MIN_C] = 1 / (1 + coef * (t - 25)) in Q16. */
+void tds_temp_table_build(uint16_t temp_coef_e4, uint32_t table_q16[TDS_TEMP_TABLE_SIZE]);
+
+/** Compensation factor for temp_c (clamped to the table range), Q16. */
+uint32_t tds_temp_lookup_q16(const uint32_t table_q16[TDS_TEMP_TABLE_SIZE], float temp_c);
+
+/** Expand the curve into lut, scaling every entry by comp_q16. */
+void tds_lut_build(const tds_curve_t *curve, uint32_t comp_q16, tds_lut_t *lut);
+
+/** Convert a raw reading: one table index plus a linear interpolation. */
+uint32_t tds_lut_lookup(const tds_lut_t *lut, uint32_t raw);
@@ -0,0 +1,109 @@
+#include "aggregate.h"
+
+#include <math.h>
+
+void welford_reset(welford_t *w)
+{
+    w->count = 0;
+    w->min = 0.0f;
+    w->max = 0.0f;
+    w->mean = 0.0f;
+    w->m2 = 0.0f;
+}
+
+void welford_add(welford_t *w, float x)
+{
+    w->count++;
+    if (w->count == 1) {
+        w->min = x;
+        w->max = x;
+    } else {
+        if (x < w->min) w->min = x;
+        if (x > w->max) w->max = x;
+    }
+    float delta = x - w->mean;
+    w->mean += delta / (float)w->count;
+    w->m2 += delta * (x - w->mean);
+}
+
+void welford_get(const welford_t *w, telemetry_stats_t *out)
+{
+    out->count = w->count;
+    out->min = w->min;
+    out->max = w->max;
+    out->mean = w->mean;
+    out->stddev = (w->count > 1 && w->m2 > 0.0f) ? sqrtf(w->m2 / (float)w->count) : 0.0f;
+}
+
+void aggregate_init(aggregate_t *agg, uint32_t window_s)
+{
+    agg->window_s = window_s ? window_s : 1;
+    agg->started = false;
+    agg->window = 0;
+    agg->start_s = 0;
+    agg->samples = 0;
+    welford_reset(&agg->level);
+    welford_reset(&agg->tds);
+    agg->water_state = 0;
+    agg->pump_on = false;
+}
+
+// Emite el resumen de la ventana en curso y vacía los acumuladores
+static bool close_window(aggregate_t *agg, telemetry_summary_t *closed)
+{
+    if (agg->samples == 0) {
+        return false;
+    }
+    closed->window = agg->window;
+    closed->start_s = agg->start_s;
+    closed->duration_s = agg->window_s;
+    closed->samples = agg->samples;
+    welford_get(&agg->level, &closed->level);
+    welford_get(&agg->tds, &closed->tds);
+    closed->water_state = agg->water_state;
+    closed->pump_on = agg->pump_on;
+
+    agg->samples = 0;
+    welford_reset(&agg->level);
+    welford_reset(&agg->tds);
+    return true;
+}
+
+bool aggregate_flush(aggregate_t *agg, telemetry_summary_t *closed)
+{
+    if (!agg->started) {
+        return false;
+    }
+    bool had_samples = close_window(agg, closed);
+    agg->started = false;
+    agg->window++;
+    return had_samples;
+}
+
+bool aggregate_add(aggregate_t *agg, const telemetry_sample_t *sample, uint32_t now_s,
+                   telemetry_summary_t *closed)
+{
+    bool did_close = false;
+
+    if (!agg->started) {
+        agg->started = true;
+        agg->start_s = now_s;
+    } else if (now_s - agg->start_s >= agg->window_s) {
+        did_close = close_window(agg, closed);
+        // Saltar ventanas vacías manteniendo la alineación
+        uint32_t elapsed = (now_s - agg->start_s) / agg->window_s;
+        agg->window += elapsed;
+        agg->start_s += elapsed * agg->window_s;
+    }
+
+    agg->samples++;
+    if (sample->water_level_cm >= 0.0f) {
+        welford_add(&agg->level, sample->water_level_cm);
+    }
+    if (sample->tds_ppm >= 0.0f) {
+        welford_add(&agg->tds, sample->tds_ppm);
+    }
+    agg->water_state = sample->water_state;
+    agg->pump_on = sample->pump_on;
+    return did_close;
+}
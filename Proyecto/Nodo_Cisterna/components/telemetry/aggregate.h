@@ -0,0 +1,76 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "telemetry.h"
+
+/*
+ * Agregación por ventanas de tiempo: mínimo, máximo, media y desviación
+ * estándar de nivel y TDS con memoria O(1) (algoritmo de Welford, estable
+ * numéricamente sin guardar las muestras).
+ *
+ * Las ventanas se alinean al tiempo de la primera muestra y duran
+ * window_s segundos; una ventana se cierra cuando llega la primera muestra
+ * fuera de ella, y las ventanas sin muestras (nodo detenido) se saltan.
+ * Las lecturas fallidas (-1) cuentan como muestra pero no entran en las
+ * estadísticas del campo.
+ *
+ * Sin dependencias de ESP-IDF.
+ */
+
+/**
+ * @brief Acumulador de Welford para un campo
+ */
+typedef struct {
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    float m2;                // Suma de cuadrados de las desviaciones a la media
+} welford_t;
+
+void welford_reset(welford_t *w);
+void welford_add(welford_t *w, float x);
+void welford_get(const welford_t *w, telemetry_stats_t *out);
+
+typedef struct {
+    uint32_t window_s;
+    bool started;            // Hay una ventana en curso (alineación fijada)
+    uint32_t window;         // Número de la ventana en curso
+    uint32_t start_s;
+    uint32_t samples;
+    welford_t level;
+    welford_t tds;
+    uint8_t water_state;
+    bool pump_on;
+} aggregate_t;
+
+/**
+ * @brief Inicializa el agregador (window_s = 0 se trata como 1)
+ */
+void aggregate_init(aggregate_t *agg, uint32_t window_s);
+
+/**
+ * @brief Incorpora una muestra
+ *
+ * Si la muestra cae fuera de la ventana en curso, primero la cierra y
+ * escribe su resumen en @p closed; la muestra abre la ventana siguiente.
+ *
+ * @param now_s Tiempo de la muestra en segundos (creciente)
+ * @return true si se cerró una ventana (resumen válido en @p closed)
+ */
+bool aggregate_add(aggregate_t *agg, const telemetry_sample_t *sample, uint32_t now_s,
+                   telemetry_summary_t *closed);
+
+/**
+ * @brief Cierra la ventana en curso aunque no haya terminado (p. ej. antes de dormir)
+ *
+ * La siguiente muestra abre una ventana nueva alineada a ella.
+ *
+ * @return true si había muestras (resumen válido en @p closed)
+ */
+bool aggregate_flush(aggregate_t *agg, telemetry_summary_t *closed);
+
+#endif // AGGREGATE_H
@@ -0,0 +1,89 @@
+#include "deadband.h"
+
+#include <math.h>
+
+void deadband_init(deadband_t *db, const deadband_config_t *cfg)
+{
+    db->cfg = *cfg;
+    db->has_last = false;
+    db->last_sent_s = 0;
+    db->sent = 0;
+    db->suppressed = 0;
+}
+
+void deadband_reset(deadband_t *db)
+{
+    db->has_last = false;
+}
+
+// true si value se alejó de ref más que alguna de las bandas configuradas
+static bool outside_band(float value, float ref, float abs_band, float rel_pct)
+{
+    // Lectura fallida (-1) <-> válida: siempre es un cambio
+    if ((value < 0.0f) != (ref < 0.0f)) {
+        return true;
+    }
+    float diff = fabsf(value - ref);
+    if (abs_band <= 0.0f && rel_pct <= 0.0f) {
+        return diff > 0.0f;
+    }
+    if (abs_band > 0.0f && diff >= abs_band) {
+        return true;
+    }
+    if (rel_pct > 0.0f && diff >= fabsf(ref) * rel_pct / 100.0f) {
+        return true;
+    }
+    return false;
+}
+
+static deadband_reason_t evaluate(const deadband_t *db, const telemetry_sample_t *s, uint32_t now_s)
+{
+    if (!db->has_last) {
+        return DEADBAND_FIRST;
+    }
+    const telemetry_sample_t *ref = &db->last;
+    if (s->water_state != ref->water_state) {
+        return DEADBAND_WATER_STATE;
+    }
+    if (s->pump_on != ref->pump_on) {
+        return DEADBAND_PUMP;
+    }
+    if (outside_band(s->water_level_cm, ref->water_level_cm, db->cfg.level_abs_cm, db->cfg.level_rel_pct)) {
+        return DEADBAND_LEVEL;
+    }
+    if (outside_band(s->tds_ppm, ref->tds_ppm, db->cfg.tds_abs_ppm, db->cfg.tds_rel_pct)) {
+        return DEADBAND_TDS;
+    }
+    if (db->cfg.heartbeat_s > 0 && now_s - db->last_sent_s >= db->cfg.heartbeat_s) {
+        return DEADBAND_HEARTBEAT;
+    }
+    return DEADBAND_SUPPRESS;
+}
+
+deadband_reason_t deadband_check(deadband_t *db, const telemetry_sample_t *sample, uint32_t now_s)
+{
+    deadband_reason_t reason = evaluate(db, sample, now_s);
+    if (reason == DEADBAND_SUPPRESS) {
+        db->suppressed++;
+    } else {
+        db->sent++;
+        db->last = *sample;
+        db->last_sent_s = now_s;
+        db->has_last = true;
+    }
+    return reason;
+}
+
+const char *deadband_reason_str(deadband_reason_t reason)
+{
+    switch (reason) {
+        case DEADBAND_SUPPRESS:     return "suppress";
+        case DEADBAND_FIRST:        return "first";
+        case DEADBAND_LEVEL:        return "level";
+        case DEADBAND_TDS:          return "tds";
+        case DEADBAND_WATER_STATE:  return "water_state";
+        case DEADBAND_PUMP:         return "pump";
+        case DEADBAND_HEARTBEAT:    return "heartbeat";
+        default:                    return "?";
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "telemetry.h"
+
+/*
+ * Publicación por excepción: decide si una muestra merece publicarse o se
+ * suprime por no diferir lo suficiente de la última enviada.
+ *
+ * Se publica si:
+ * - es la primera muestra (o la primera tras deadband_reset()),
+ * - el nivel o el TDS superan su banda muerta respecto al último enviado
+ *   (absoluta o relativa, la que se cumpla primero),
+ * - una lectura pasa de fallida (-1) a válida o al revés,
+ * - cambia el estado del agua o de la bomba,
+ * - pasaron heartbeat_s segundos desde el último envío.
+ *
+ * Sin dependencias de ESP-IDF.
+ */
+
+typedef struct {
+    float level_abs_cm;      // Banda absoluta de nivel (0 = no usar)
+    float level_rel_pct;     // Banda relativa de nivel en % del último enviado (0 = no usar)
+    float tds_abs_ppm;       // Banda absoluta de TDS (0 = no usar)
+    float tds_rel_pct;       // Banda relativa de TDS en % (0 = no usar)
+    uint32_t heartbeat_s;    // Envío forzado cada N segundos (0 = sin heartbeat)
+} deadband_config_t;
+
+/**
+ * @brief Motivo de la decisión (DEADBAND_SUPPRESS = no publicar)
+ */
+typedef enum {
+    DEADBAND_SUPPRESS = 0,
+    DEADBAND_FIRST,
+    DEADBAND_LEVEL,
+    DEADBAND_TDS,
+    DEADBAND_WATER_STATE,
+    DEADBAND_PUMP,
+    DEADBAND_HEARTBEAT,
+} deadband_reason_t;
+
+typedef struct {
+    deadband_config_t cfg;
+    bool has_last;
+    telemetry_sample_t last;   // Última muestra enviada
+    uint32_t last_sent_s;
+    uint32_t sent;             // Muestras publicadas
+    uint32_t suppressed;       // Muestras suprimidas por banda muerta
+} deadband_t;
+
+void deadband_init(deadband_t *db, const deadband_config_t *cfg);
+
+/**
+ * @brief Olvida la última muestra enviada (la siguiente se publica). Conserva los contadores.
+ */
+void deadband_reset(deadband_t *db);
+
+/**
+ * @brief Evalúa una muestra y actualiza contadores y referencia
+ *
+ * @param now_s Tiempo actual en segundos (misma base que el heartbeat)
+ * @return deadband_reason_t Motivo de envío, o DEADBAND_SUPPRESS
+ */
+deadband_reason_t deadband_check(deadband_t *db, const telemetry_sample_t *sample, uint32_t now_s);
+
+/**
+ * @brief Nombre corto del motivo (para logs)
+ */
+const char *deadband_reason_str(deadband_reason_t reason);
+
+#endif // DEADBAND_H
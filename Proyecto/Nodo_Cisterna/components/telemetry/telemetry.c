@@ -0,0 +1,236 @@
+#include "telemetry.h"
+#include "cbor_writer.h"
+
+#include <stdio.h>
+
+const char *const telemetry_water_state_str[TELEMETRY_WATER_STATE_COUNT] = {
+    "LIMPIA", "MEDIA", "SUCIA"
+};
+
+int telemetry_encode_json(const telemetry_sample_t *sample, char *buf, size_t len)
+{
+    uint8_t state = sample->water_state < TELEMETRY_WATER_STATE_COUNT ? sample->water_state : 0;
+
+    int n = snprintf(buf, len,
+                     "{\"seq\":%lu,\"ts\":%lu,\"level\":%.2f,\"tds\":%.1f,\"state\":\"%s\",\"pump\":\"%s\"",
+                     (unsigned long)sample->seq,
+                     (unsigned long)sample->timestamp_s,
+                     (double)sample->water_level_cm,
+                     (double)sample->tds_ppm,
+                     telemetry_water_state_str[state],
+                     sample->pump_on ? "ON" : "OFF");
+    if (n < 0 || (size_t)n >= len) {
+        return -1;
+    }
+
+    int w;
+    if (sample->has_trend) {
+        w = snprintf(buf + n, len - n, ",\"level_f\":%.2f,\"rate\":%.2f",
+                     (double)sample->level_filt_cm, (double)sample->rate_cm_min);
+        if (w < 0 || (size_t)(n += w) >= len) return -1;
+        if (sample->eta_min >= 0.0f) {
+            w = snprintf(buf + n, len - n, ",\"eta\":%.1f", (double)sample->eta_min);
+            if (w < 0 || (size_t)(n += w) >= len) return -1;
+        }
+    }
+    w = snprintf(buf + n, len - n, "}");
+    if (w < 0 || (size_t)(n += w) >= len) return -1;
+    return n;
+}
+
+int telemetry_encode_json_batch(const telemetry_sample_t *samples, size_t count,
+                                char *buf, size_t len)
+{
+    size_t n = 0;
+
+    if (len < 3) {
+        return -1;
+    }
+    buf[n++] = '[';
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            if (n + 1 >= len) return -1;
+            buf[n++] = ',';
+        }
+        // Reservar el ']' final
+        int w = telemetry_encode_json(&samples[i], buf + n, len - n - 1);
+        if (w < 0) return -1;
+        n += (size_t)w;
+    }
+    buf[n++] = ']';
+    buf[n] = '\0';
+    return (int)n;
+}
+
+static int put_stats_json(char *buf, size_t len, const char *name, const telemetry_stats_t *st)
+{
+    if (st->count == 0) {
+        return snprintf(buf, len, ",\"%s\":{\"n\":0}", name);
+    }
+    return snprintf(buf, len, ",\"%s\":{\"n\":%lu,\"min\":%.2f,\"max\":%.2f,\"mean\":%.2f,\"sd\":%.2f}",
+                    name, (unsigned long)st->count, (double)st->min, (double)st->max,
+                    (double)st->mean, (double)st->stddev);
+}
+
+int telemetry_encode_summary_json(const telemetry_summary_t *summary, char *buf, size_t len)
+{
+    uint8_t state = summary->water_state < TELEMETRY_WATER_STATE_COUNT ? summary->water_state : 0;
+    size_t n = 0;
+    int w;
+
+    w = snprintf(buf, len, "{\"win\":%lu,\"ts\":%lu,\"dur\":%lu,\"n\":%lu",
+                 (unsigned long)summary->window, (unsigned long)summary->start_s,
+                 (unsigned long)summary->duration_s, (unsigned long)summary->samples);
+    if (w < 0 || (n += (size_t)w) >= len) return -1;
+    w = put_stats_json(buf + n, len - n, "level", &summary->level);
+    if (w < 0 || (n += (size_t)w) >= len) return -1;
+    w = put_stats_json(buf + n, len - n, "tds", &summary->tds);
+    if (w < 0 || (n += (size_t)w) >= len) return -1;
+    w = snprintf(buf + n, len - n, ",\"state\":\"%s\",\"pump\":\"%s\"}",
+                 telemetry_water_state_str[state], summary->pump_on ? "ON" : "OFF");
+    if (w < 0 || (n += (size_t)w) >= len) return -1;
+    return (int)n;
+}
+
+// Cabecera común: map de n pares con versión y tipo primero
+static void put_header(cbor_writer_t *w, size_t pairs, telemetry_msg_type_t type)
+{
+    cbor_put_map(w, pairs);
+    cbor_put_uint(w, TELEMETRY_KEY_VERSION);
+    cbor_put_uint(w, TELEMETRY_SCHEMA_VERSION);
+    cbor_put_uint(w, TELEMETRY_KEY_TYPE);
+    cbor_put_uint(w, type);
+}
+
+int telemetry_encode_cbor(const telemetry_sample_t *sample, uint8_t *buf, size_t len)
+{
+    bool has_state = sample->water_state < TELEMETRY_WATER_STATE_COUNT;
+    bool has_eta = sample->has_trend && sample->eta_min >= 0.0f;
+    size_t pairs = 7 + (has_state ? 1 : 0) + (sample->has_trend ? 2 : 0) + (has_eta ? 1 : 0);
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+
+    put_header(&w, pairs, TELEMETRY_MSG_SAMPLE);
+    cbor_put_uint(&w, TELEMETRY_KEY_SEQ);
+    cbor_put_uint(&w, sample->seq);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, sample->timestamp_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_LEVEL);
+    cbor_put_float(&w, sample->water_level_cm);
+    cbor_put_uint(&w, TELEMETRY_KEY_TDS);
+    cbor_put_float(&w, sample->tds_ppm);
+    if (has_state) {
+        cbor_put_uint(&w, TELEMETRY_KEY_STATE);
+        cbor_put_uint(&w, sample->water_state);
+    }
+    cbor_put_uint(&w, TELEMETRY_KEY_PUMP);
+    cbor_put_bool(&w, sample->pump_on);
+    if (sample->has_trend) {
+        cbor_put_uint(&w, TELEMETRY_KEY_LEVEL_FILT);
+        cbor_put_float(&w, sample->level_filt_cm);
+        cbor_put_uint(&w, TELEMETRY_KEY_RATE);
+        cbor_put_float(&w, sample->rate_cm_min);
+    }
+    if (has_eta) {
+        cbor_put_uint(&w, TELEMETRY_KEY_ETA);
+        cbor_put_float(&w, sample->eta_min);
+    }
+    return cbor_writer_finish(&w);
+}
+
+int telemetry_encode_cbor_batch(const telemetry_sample_t *samples, size_t count,
+                                uint8_t *buf, size_t len)
+{
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+    cbor_put_array(&w, count);
+    int n = cbor_writer_finish(&w);
+    if (n < 0) {
+        return -1;
+    }
+
+    size_t used = (size_t)n;
+    for (size_t i = 0; i < count; i++) {
+        int m = telemetry_encode_cbor(&samples[i], buf + used, len - used);
+        if (m < 0) return -1;
+        used += (size_t)m;
+    }
+    return (int)used;
+}
+
+static void put_stats_cbor(cbor_writer_t *w, telemetry_key_t key, const telemetry_stats_t *st)
+{
+    cbor_put_uint(w, key);
+    cbor_put_array(w, 5);
+    cbor_put_uint(w, st->count);
+    cbor_put_float(w, st->min);
+    cbor_put_float(w, st->max);
+    cbor_put_float(w, st->mean);
+    cbor_put_float(w, st->stddev);
+}
+
+int telemetry_encode_summary_cbor(const telemetry_summary_t *summary, uint8_t *buf, size_t len)
+{
+    bool has_state = summary->water_state < TELEMETRY_WATER_STATE_COUNT;
+    size_t pairs = 7 + (has_state ? 1 : 0) + (summary->level.count ? 1 : 0) + (summary->tds.count ? 1 : 0);
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+
+    put_header(&w, pairs, TELEMETRY_MSG_SUMMARY);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, summary->start_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_WINDOW);
+    cbor_put_uint(&w, summary->window);
+    cbor_put_uint(&w, TELEMETRY_KEY_DURATION);
+    cbor_put_uint(&w, summary->duration_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_COUNT);
+    cbor_put_uint(&w, summary->samples);
+    if (summary->level.count) {
+        put_stats_cbor(&w, TELEMETRY_KEY_LEVEL_STATS, &summary->level);
+    }
+    if (summary->tds.count) {
+        put_stats_cbor(&w, TELEMETRY_KEY_TDS_STATS, &summary->tds);
+    }
+    if (has_state) {
+        cbor_put_uint(&w, TELEMETRY_KEY_STATE);
+        cbor_put_uint(&w, summary->water_state);
+    }
+    cbor_put_uint(&w, TELEMETRY_KEY_PUMP);
+    cbor_put_bool(&w, summary->pump_on);
+    return cbor_writer_finish(&w);
+}
+
+int telemetry_encode_pump_cbor(bool pump_on, uint32_t timestamp_s, uint8_t *buf, size_t len)
+{
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+
+    put_header(&w, 4, TELEMETRY_MSG_PUMP);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, timestamp_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_PUMP);
+    cbor_put_bool(&w, pump_on);
+    return cbor_writer_finish(&w);
+}
+
+int telemetry_encode_diag_cbor(const telemetry_diag_t *diag, uint8_t *buf, size_t len)
+{
+    bool has_rssi = diag->rssi_dbm != 0;
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, len);
+
+    put_header(&w, has_rssi ? 7 : 6, TELEMETRY_MSG_DIAG);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, diag->uptime_s);
+    cbor_put_uint(&w, TELEMETRY_KEY_HEAP_FREE);
+    cbor_put_uint(&w, diag->heap_free);
+    cbor_put_uint(&w, TELEMETRY_KEY_HEAP_MIN);
+    cbor_put_uint(&w, diag->heap_min_free);
+    if (has_rssi) {
+        cbor_put_uint(&w, TELEMETRY_KEY_RSSI);
+        cbor_put_int(&w, diag->rssi_dbm);
+    }
+    cbor_put_uint(&w, TELEMETRY_KEY_DROPPED);
+    cbor_put_uint(&w, diag->dropped);
+    return cbor_writer_finish(&w);
+}
@@ -0,0 +1,195 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Codificación de la telemetría por muestra: un único documento con todos
+ * los campos, número de secuencia y timestamp, en lugar de un publish por campo.
+ *
+ * Dos codificaciones: JSON compacto (legible en Node-RED sin nodos extra) y
+ * CBOR binario con versión de esquema (ver abajo).
+ *
+ * No depende de ESP-IDF ni reserva memoria: escribe en el buffer del llamador.
+ */
+
+// Nombres del estado del agua usados en los tópicos y en el documento
+#define TELEMETRY_WATER_STATE_COUNT 3
+extern const char *const telemetry_water_state_str[TELEMETRY_WATER_STATE_COUNT];
+
+/**
+ * @brief Muestra a codificar
+ */
+typedef struct {
+    uint32_t seq;            // Número de muestra (tasks_wait_sample)
+    uint32_t timestamp_s;    // Segundos desde el arranque
+    float water_level_cm;    // -1 si la lectura falló
+    float tds_ppm;           // -1 si la lectura falló
+    uint8_t water_state;     // 0 = LIMPIA, 1 = MEDIA, 2 = SUCIA
+    bool pump_on;
+    float level_filt_cm;     // Nivel filtrado (Kalman)
+    float rate_cm_min;       // Velocidad del nivel: + llenando, - vaciando
+    float eta_min;           // Minutos hasta lleno/vacío; -1 = estable (se omite)
+    bool has_trend;          // Los tres campos anteriores aplican
+} telemetry_sample_t;
+
+/**
+ * @brief Estadística de un campo en una ventana (lecturas válidas solamente)
+ */
+typedef struct {
+    uint32_t count;          // Lecturas válidas; si es 0 el resto no aplica
+    float min;
+    float max;
+    float mean;
+    float stddev;            // Desviación estándar poblacional
+} telemetry_stats_t;
+
+/**
+ * @brief Resumen de una ventana de agregación (ver aggregate.h)
+ */
+typedef struct {
+    uint32_t window;         // Número de ventana desde el arranque
+    uint32_t start_s;        // Inicio de la ventana (segundos desde el arranque)
+    uint32_t duration_s;     // Duración configurada de la ventana
+    uint32_t samples;        // Muestras recibidas (válidas o no)
+    telemetry_stats_t level; // cm
+    telemetry_stats_t tds;   // ppm
+    uint8_t water_state;     // Estado del agua de la última muestra
+    bool pump_on;            // Estado de la bomba de la última muestra
+} telemetry_summary_t;
+
+// Tamaño de buffer por muestra JSON (para lotes: count * TELEMETRY_JSON_MAX_LEN + 3)
+#define TELEMETRY_JSON_MAX_LEN 160
+
+/**
+ * @brief Codifica la muestra como JSON compacto
+ *
+ * Formato: {"seq":12,"ts":34,"level":125.50,"tds":450.2,"state":"LIMPIA","pump":"ON",
+ *           "level_f":125.31,"rate":22.84,"eta":2.4}
+ * level_f/rate/eta solo con has_trend; eta además solo si no es -1.
+ *
+ * @return int Longitud escrita (sin el '\0'), o -1 si no cabe en @p len
+ */
+int telemetry_encode_json(const telemetry_sample_t *sample, char *buf, size_t len);
+
+/**
+ * @brief Codifica varias muestras como un array JSON de documentos
+ *
+ * Usado al reenviar muestras guardadas sin conexión: un publish por lote.
+ *
+ * @return int Longitud escrita (sin el '\0'), o -1 si no cabe en @p len
+ */
+int telemetry_encode_json_batch(const telemetry_sample_t *samples, size_t count,
+                                char *buf, size_t len);
+
+/**
+ * @brief Codifica el resumen de una ventana como JSON compacto
+ *
+ * Formato: {"win":3,"ts":180,"dur":60,"n":60,
+ *           "level":{"n":60,"min":120.10,"max":125.40,"mean":122.31,"sd":1.52},
+ *           "tds":{...},"state":"LIMPIA","pump":"OFF"}
+ * Un campo sin lecturas válidas se publica como {"n":0}.
+ *
+ * @return int Longitud escrita (sin el '\0'), o -1 si no cabe en @p len
+ */
+int telemetry_encode_summary_json(const telemetry_summary_t *summary, char *buf, size_t len);
+
+/*
+ * Esquema binario: un map CBOR con claves enteras pequeñas (1 byte cada una).
+ * La clave 0 (versión) va siempre primero, así que el byte de versión queda
+ * en el offset 2 del payload y un consumidor puede rechazar esquemas
+ * desconocidos sin decodificar el resto. Un payload JSON empieza con '{'
+ * (0x7B) y uno CBOR con 0xA0..0xB7, de modo que ambos pueden compartir tópico.
+ *
+ * Cambios compatibles (claves nuevas) no suben la versión; cambiar el
+ * significado o la unidad de una clave existente sí.
+ */
+#define TELEMETRY_SCHEMA_VERSION 1
+
+// Tamaño de buffer suficiente para cualquier mensaje del esquema actual
+// salvo el resumen de ventana, que lleva dos arrays de estadísticas
+#define TELEMETRY_CBOR_MAX_LEN 64
+#define TELEMETRY_SUMMARY_CBOR_MAX_LEN 96
+
+typedef enum {
+    TELEMETRY_MSG_SAMPLE = 1,    // Muestra de sensores
+    TELEMETRY_MSG_PUMP = 2,      // Cambio de estado de la bomba
+    TELEMETRY_MSG_DIAG = 3,      // Diagnóstico del nodo
+    TELEMETRY_MSG_SUMMARY = 4,   // Resumen de una ventana de agregación
+} telemetry_msg_type_t;
+
+typedef enum {
+    TELEMETRY_KEY_VERSION = 0,   // uint: TELEMETRY_SCHEMA_VERSION
+    TELEMETRY_KEY_TYPE = 1,      // uint: telemetry_msg_type_t
+    TELEMETRY_KEY_SEQ = 2,       // uint
+    TELEMETRY_KEY_TS = 3,        // uint: segundos desde el arranque
+    TELEMETRY_KEY_LEVEL = 4,     // float32: cm (-1 = lectura fallida)
+    TELEMETRY_KEY_TDS = 5,       // float32: ppm (-1 = lectura fallida)
+    TELEMETRY_KEY_STATE = 6,     // uint: 0 LIMPIA, 1 MEDIA, 2 SUCIA (se omite si no aplica)
+    TELEMETRY_KEY_PUMP = 7,      // bool
+    TELEMETRY_KEY_HEAP_FREE = 8, // uint: bytes
+    TELEMETRY_KEY_HEAP_MIN = 9,  // uint: bytes
+    TELEMETRY_KEY_RSSI = 10,     // int: dBm
+    TELEMETRY_KEY_DROPPED = 11,  // uint: mensajes descartados
+    TELEMETRY_KEY_WINDOW = 12,   // uint: número de ventana
+    TELEMETRY_KEY_DURATION = 13, // uint: segundos
+    TELEMETRY_KEY_COUNT = 14,    // uint: muestras en la ventana
+    TELEMETRY_KEY_LEVEL_STATS = 15, // array [n, min, max, mean, sd] (float32 salvo n; se omite si n = 0)
+    TELEMETRY_KEY_TDS_STATS = 16,   // ídem para TDS
+    TELEMETRY_KEY_LEVEL_FILT = 17,  // float32: cm, nivel filtrado (se omite sin estimado)
+    TELEMETRY_KEY_RATE = 18,        // float32: cm/min, + llenando (ídem)
+    TELEMETRY_KEY_ETA = 19,         // float32: minutos hasta lleno/vacío (se omite si estable)
+} telemetry_key_t;
+
+/**
+ * @brief Diagnóstico del nodo
+ */
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    int8_t rssi_dbm;             // 0 = desconocido (se omite)
+    uint32_t dropped;
+} telemetry_diag_t;
+
+/**
+ * @brief Codifica una muestra como CBOR (tipo TELEMETRY_MSG_SAMPLE)
+ *
+ * Si water_state >= TELEMETRY_WATER_STATE_COUNT la clave de estado se omite.
+ *
+ * @return int Longitud escrita, o -1 si no cabe en @p len
+ */
+int telemetry_encode_cbor(const telemetry_sample_t *sample, uint8_t *buf, size_t len);
+
+/**
+ * @brief Codifica varias muestras como un array CBOR de maps de muestra
+ *
+ * Cada elemento es idéntico a lo que produce telemetry_encode_cbor(); el
+ * payload empieza con 0x80..0x9F en lugar de un map. Basta un buffer de
+ * count * TELEMETRY_CBOR_MAX_LEN + 3 bytes.
+ *
+ * @return int Longitud escrita, o -1 si no cabe en @p len
+ */
+int telemetry_encode_cbor_batch(const telemetry_sample_t *samples, size_t count,
+                                uint8_t *buf, size_t len);
+
+/**
+ * @brief Codifica el resumen de una ventana como CBOR (tipo TELEMETRY_MSG_SUMMARY)
+ *
+ * El timestamp (clave 3) es el inicio de la ventana.
+ */
+int telemetry_encode_summary_cbor(const telemetry_summary_t *summary, uint8_t *buf, size_t len);
+
+/**
+ * @brief Codifica un cambio de estado de la bomba como CBOR (tipo TELEMETRY_MSG_PUMP)
+ */
+int telemetry_encode_pump_cbor(bool pump_on, uint32_t timestamp_s, uint8_t *buf, size_t len);
+
+/**
+ * @brief Codifica el diagnóstico como CBOR (tipo TELEMETRY_MSG_DIAG)
+ */
+int telemetry_encode_diag_cbor(const telemetry_diag_t *diag, uint8_t *buf, size_t len);
+
+#endif // TELEMETRY_H
@@ -1,9 +1,12 @@
 #include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_netif.h"
 #include "esp_event.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "lwip/err.h"
@@ -25,6 +28,186 @@ static int retry_count = 0;
 static const int MAXIMUM_RETRY = 10;
 static char saved_ssid[33] = {0};
 
+/*
+ * Conexión rápida: el BSSID, el canal y la concesión DHCP de la última
+ * conexión buena se guardan en NVS. Al arrancar se conecta directo a ese
+ * AP (sin escaneo de todos los canales) y, con
+ * CONFIG_CISTERNA_WIFI_FAST_STATIC_IP, se reutiliza la IP sin esperar al
+ * DHCP; una vez asociado se rearranca el cliente DHCP para revalidar la
+ * concesión y, si el servidor entrega otra dirección, se descarta la caché.
+ * Si ese intento falla se borra la caché y se vuelve al camino completo
+ * (escaneo + DHCP).
+ */
+#define FAST_NVS_NAMESPACE "wifi_fast"
+#define FAST_NVS_KEY       "ap"
+#define FAST_CACHE_VERSION 1
+
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[33];
+    esp_netif_ip_info_t ip;     // IP, máscara y gateway de la concesión
+    esp_ip4_addr_t dns;
+} wifi_fast_cache_t;
+
+static esp_netif_t *sta_netif = NULL;
+static wifi_config_t full_config;          // Configuración sin BSSID/canal (respaldo)
+static bool fast_attempt = false;          // Intento en curso por la ruta rápida
+static bool fast_used = false;             // La conexión actual vino por la ruta rápida
+static int64_t connected_at_us = 0;        // Primera IP desde el arranque
+#if CONFIG_CISTERNA_WIFI_FAST_STATIC_IP
+static esp_ip4_addr_t static_ip = { 0 };   // IP reutilizada, pendiente de revalidar
+static esp_ip4_addr_t dhcp_check_ip = { 0 }; // IP a comparar con la nueva concesión
+#endif
+
+#if CONFIG_CISTERNA_WIFI_FAST_CONNECT
+static bool fast_cache_load(const char *ssid, wifi_fast_cache_t *cache)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*cache);
+    esp_err_t err = nvs_get_blob(nvs, FAST_NVS_KEY, cache, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(*cache) && cache->version == FAST_CACHE_VERSION &&
+           cache->channel != 0 && strncmp(cache->ssid, ssid, sizeof(cache->ssid)) == 0;
+}
+
+static void fast_cache_store(const wifi_fast_cache_t *cache)
+{
+    // Solo escribir si cambió algo: evita un ciclo de flash en cada arranque
+    wifi_fast_cache_t old;
+    if (fast_cache_load(cache->ssid, &old) && memcmp(&old, cache, sizeof(old)) == 0) {
+        return;
+    }
+    nvs_handle_t nvs;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, FAST_NVS_KEY, cache, sizeof(*cache)) == ESP_OK) {
+        nvs_commit(nvs);
+        ESP_LOGI(TAG, "→ Caché de conexión rápida actualizada (canal %d)", cache->channel);
+    }
+    nvs_close(nvs);
+}
+
+static void fast_cache_erase(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, FAST_NVS_KEY);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+/**
+ * @brief Guarda AP, canal y concesión de la conexión recién establecida
+ */
+static void fast_cache_update(const esp_netif_ip_info_t *ip_info)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    wifi_fast_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.version = FAST_CACHE_VERSION;
+    cache.channel = ap.primary;
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    strncpy(cache.ssid, saved_ssid, sizeof(cache.ssid) - 1);
+    cache.ip = *ip_info;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        cache.dns = dns.ip.u_addr.ip4;
+    }
+    fast_cache_store(&cache);
+}
+
+/**
+ * @brief Configura la ruta rápida a partir de la caché (antes de esp_wifi_start)
+ */
+static bool fast_path_setup(const wifi_fast_cache_t *cache)
+{
+    wifi_config_t cfg = full_config;
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, cache->bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = cache->channel;
+    cfg.sta.scan_method = WIFI_FAST_SCAN;
+    if (esp_wifi_set_config(WIFI_IF_STA, &cfg) != ESP_OK) {
+        return false;
+    }
+#if CONFIG_CISTERNA_WIFI_FAST_STATIC_IP
+    // Reutilizar la concesión: la IP queda lista al asociarse, sin DHCP
+    esp_netif_dhcpc_stop(sta_netif);
+    if (esp_netif_set_ip_info(sta_netif, &cache->ip) != ESP_OK) {
+        esp_netif_dhcpc_start(sta_netif);
+    } else {
+        static_ip = cache->ip.ip;
+        if (cache->dns.addr != 0) {
+            esp_netif_dns_info_t dns = { 0 };
+            dns.ip.type = ESP_IPADDR_TYPE_V4;
+            dns.ip.u_addr.ip4 = cache->dns;
+            esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+        }
+    }
+#endif
+    ESP_LOGI(TAG, "→ Conexión rápida: canal %d, BSSID " MACSTR ", IP " IPSTR,
+             cache->channel, MAC2STR(cache->bssid), IP2STR(&cache->ip.ip));
+    return true;
+}
+
+/**
+ * @brief La ruta rápida falló: borrar la caché y volver a escaneo + DHCP
+ */
+static void fast_path_fallback(void)
+{
+    ESP_LOGW(TAG, "⚠ Conexión rápida fallida, volviendo a escaneo completo y DHCP");
+    fast_attempt = false;
+#if CONFIG_CISTERNA_WIFI_FAST_STATIC_IP
+    static_ip.addr = 0;
+#endif
+    fast_cache_erase();
+    esp_wifi_set_config(WIFI_IF_STA, &full_config);
+    esp_netif_dhcpc_start(sta_netif);
+    xTaskCreate(&delayed_connect_task, "delayed_conn", 2048, NULL, 5, NULL);
+}
+
+#if CONFIG_CISTERNA_WIFI_FAST_STATIC_IP
+/**
+ * @brief Revalida por DHCP la IP reutilizada de la caché
+ *
+ * Con la IP estática el primer GOT_IP llega sin intercambio DHCP: se
+ * rearranca el cliente para renovar la concesión, lo que genera un segundo
+ * GOT_IP. Si esa IP difiere de la reutilizada, la caché se descarta.
+ *
+ * @return true si la caché debe actualizarse con @p ip_info
+ */
+static bool fast_static_revalidate(const esp_netif_ip_info_t *ip_info)
+{
+    if (static_ip.addr != 0) {
+        dhcp_check_ip = static_ip;
+        static_ip.addr = 0;
+        ESP_LOGI(TAG, "→ Revalidando la concesión por DHCP");
+        esp_netif_dhcpc_start(sta_netif);
+        return false;
+    }
+    if (dhcp_check_ip.addr != 0) {
+        bool same = ip_info->ip.addr == dhcp_check_ip.addr;
+        dhcp_check_ip.addr = 0;
+        if (!same) {
+            ESP_LOGW(TAG, "⚠ DHCP asignó otra IP, se descarta la caché de conexión rápida");
+            fast_cache_erase();
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+#endif // CONFIG_CISTERNA_WIFI_FAST_CONNECT
+
 /**
  * @brief Event handler para eventos de Wi-Fi
  */
@@ -33,6 +216,11 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
 {
     if (event_base == WIFI_EVENT) {
         if (event_id == WIFI_EVENT_STA_START) {
+            if (fast_attempt) {
+                // AP conocido: sin escaneo de diagnóstico ni retraso
+                esp_wifi_connect();
+                return;
+            }
             ESP_LOGI(TAG, "→ Iniciando conexión a Wi-Fi...");
             // Ejecutar escaneo de diagnóstico ANTES de intentar conectar (si el SSID objetivo fue guardado)
             if (saved_ssid[0] != '\0') {
@@ -51,6 +239,14 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
             } else {
                 ESP_LOGW(TAG, "X Wi-Fi desconectado (razón desconocida).");
             }
+            xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+
+#if CONFIG_CISTERNA_WIFI_FAST_CONNECT
+            if (fast_attempt) {
+                fast_path_fallback();
+                return;
+            }
+#endif
 
             // Si MAXIMUM_RETRY <= 0 → reintento infinito, si >0 respeta el límite
             if (MAXIMUM_RETRY > 0 && retry_count >= MAXIMUM_RETRY) {
@@ -68,6 +264,20 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
             ESP_LOGI(TAG, "✓ Conectado a Wi-Fi | IP obtenida: " IPSTR,
                      IP2STR(&event->ip_info.ip));
             retry_count = 0;
+            if (connected_at_us == 0) {
+                connected_at_us = esp_timer_get_time();
+                fast_used = fast_attempt;
+                ESP_LOGI(TAG, "✓ IP a los %" PRId64 " ms del arranque (%s)", connected_at_us / 1000,
+                         fast_used ? "conexión rápida" : "escaneo completo");
+            }
+            fast_attempt = false;
+#if CONFIG_CISTERNA_WIFI_FAST_STATIC_IP
+            if (fast_static_revalidate(&event->ip_info)) {
+                fast_cache_update(&event->ip_info);
+            }
+#elif CONFIG_CISTERNA_WIFI_FAST_CONNECT
+            fast_cache_update(&event->ip_info);
+#endif
             xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
         }
     }
@@ -104,8 +314,9 @@ esp_err_t wifi_init(const char *ssid, const char *password)
         return ret;
     }
 
-    if (esp_netif_get_handle_from_ifkey("WIFI_STA_DEF") == NULL) {
-        esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    if (sta_netif == NULL) {
+        sta_netif = esp_netif_create_default_wifi_sta();
     }
 
     // Crear y configurar Wi-Fi
@@ -158,6 +369,15 @@ esp_err_t wifi_init(const char *ssid, const char *password)
         return ret;
     }
 
+#if CONFIG_CISTERNA_WIFI_MODEM_SLEEP
+    // Modem sleep: la radio duerme entre beacons DTIM y permite el light sleep
+    esp_err_t ps_ret = esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    if (ps_ret == ESP_OK) {
+        ESP_LOGI(TAG, "→ Power save modo: MIN_MODEM");
+    } else {
+        ESP_LOGW(TAG, "→ No se pudo activar power save (ret=%s)", esp_err_to_name(ps_ret));
+    }
+#else
     // Desactive el modo de ahorro de energía STA (evita problemas de handshake en algunos APs)
     esp_err_t ps_ret = esp_wifi_set_ps(WIFI_PS_NONE);
     if (ps_ret == ESP_OK) {
@@ -165,12 +385,21 @@ esp_err_t wifi_init(const char *ssid, const char *password)
     } else {
         ESP_LOGW(TAG, "→ No se pudo desactivar power save (ret=%s)", esp_err_to_name(ps_ret));
     }
+#endif
 
     ret = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "✗ Error al configurar credenciales Wi-Fi");
         return ret;
     }
+    full_config = wifi_config;
+
+#if CONFIG_CISTERNA_WIFI_FAST_CONNECT
+    wifi_fast_cache_t cache;
+    if (fast_cache_load(saved_ssid, &cache)) {
+        fast_attempt = fast_path_setup(&cache);
+    }
+#endif
 
     ret = esp_wifi_start();
     if (ret != ESP_OK) {
@@ -179,7 +408,9 @@ esp_err_t wifi_init(const char *ssid, const char *password)
     }
 
     // Hacer un escaneo rápido y reportar si el SSID objetivo está visible (útil para debugging)
-    wifi_scan_and_report((const char *)wifi_config.sta.ssid);
+    if (!fast_attempt) {
+        wifi_scan_and_report((const char *)wifi_config.sta.ssid);
+    }
 
     ESP_LOGI(TAG, "✓ Wi-Fi inicializado correctamente");
     return ESP_OK;
@@ -199,6 +430,42 @@ bool wifi_is_connected(void)
     return (bits & WIFI_CONNECTED_BIT) != 0;
 }
 
+/**
+ * @brief Espera la conexión bloqueando en el event group
+ */
+bool wifi_wait_connected(uint32_t timeout_ms)
+{
+    if (wifi_event_group == NULL) {
+        return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT,
+                                           pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & WIFI_CONNECTED_BIT) != 0;
+}
+
+/**
+ * @brief Reinicia los intentos de conexión tras agotar los reintentos
+ */
+esp_err_t wifi_reconnect(void)
+{
+    if (wifi_is_connected()) {
+        return ESP_OK;
+    }
+    retry_count = 0;
+    return esp_wifi_connect();
+}
+
+/**
+ * @brief Momento de la primera IP y ruta usada
+ */
+int64_t wifi_connected_at_us(bool *fast_path)
+{
+    if (fast_path) {
+        *fast_path = fast_used;
+    }
+    return connected_at_us;
+}
+
 /**
  * @brief Desconecta del Wi-Fi
  */
@@ -3,6 +3,8 @@
 
 #include "esp_wifi.h"
 #include "esp_event.h"
+#include <stdbool.h>
+#include <stdint.h>
 
 /**
  * @brief Inicializa y conecta el ESP32-C6 a la red Wi-Fi
@@ -23,6 +25,30 @@ void wifi_scan_and_report(const char *expected_ssid);
  */
 bool wifi_is_connected(void);
 
+/**
+ * @brief Espera (sin sondeo) a que haya IP
+ *
+ * @param timeout_ms Espera máxima
+ * @return bool true si quedó conectado dentro del plazo
+ */
+bool wifi_wait_connected(uint32_t timeout_ms);
+
+/**
+ * @brief Vuelve a intentar la conexión (con el contador de reintentos en cero)
+ *
+ * wifi.c deja de reintentar tras MAXIMUM_RETRY desconexiones seguidas;
+ * esto lo reactiva. No hace nada si ya hay conexión.
+ */
+esp_err_t wifi_reconnect(void);
+
+/**
+ * @brief Tiempo desde el arranque hasta la primera IP
+ *
+ * @param fast_path Si no es NULL, recibe si se usó la conexión rápida
+ * @return int64_t Microsegundos de esp_timer, o 0 si aún no hubo conexión
+ */
+int64_t wifi_connected_at_us(bool *fast_path);
+
 /**
  * @brief Desconecta del Wi-Fi
  * 
@@ -0,0 +1,88 @@
+#include "boot_timing.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "BOOT";
+
+static const char *const stage_names[BOOT_STAGE_COUNT] = {
+    [BOOT_STAGE_NVS] = "nvs",
+    [BOOT_STAGE_STORAGE] = "storage",
+    [BOOT_STAGE_SENSORS] = "sensors",
+    [BOOT_STAGE_FIRST_SAMPLE] = "first_sample",
+    [BOOT_STAGE_WIFI] = "wifi",
+    [BOOT_STAGE_MQTT] = "mqtt",
+};
+
+// Marcas en µs de esp_timer; 0 = la etapa no terminó todavía
+static int64_t stage_us[BOOT_STAGE_COUNT];
+static int64_t last_us = 0;
+static portMUX_TYPE boot_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_mark(boot_stage_t stage)
+{
+    if (stage >= BOOT_STAGE_COUNT) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t prev;
+
+    portENTER_CRITICAL(&boot_mux);
+    if (stage_us[stage] != 0) {
+        portEXIT_CRITICAL(&boot_mux);
+        return;
+    }
+    stage_us[stage] = now;
+    prev = last_us;
+    last_us = now;
+    portEXIT_CRITICAL(&boot_mux);
+
+    ESP_LOGI(TAG, "→ Arranque: %-12s a los %" PRId64 " ms (+%" PRId64 " ms)",
+             stage_names[stage], now / 1000, (now - prev) / 1000);
+}
+
+int32_t boot_stage_ms(boot_stage_t stage)
+{
+    if (stage >= BOOT_STAGE_COUNT) {
+        return -1;
+    }
+    portENTER_CRITICAL(&boot_mux);
+    int64_t us = stage_us[stage];
+    portEXIT_CRITICAL(&boot_mux);
+    return us ? (int32_t)(us / 1000) : -1;
+}
+
+int boot_timing_encode_json(const char *reset_reason, bool fast_wifi, char *buf, size_t len)
+{
+    size_t pos = 0;
+    int n = snprintf(buf, len, "{\"reset\":\"%s\",\"wifi\":\"%s\",\"ms\":{",
+                     reset_reason, fast_wifi ? "fast" : "full");
+    if (n < 0 || (size_t)n >= len) {
+        return -1;
+    }
+    pos = (size_t)n;
+
+    bool first = true;
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        int32_t ms = boot_stage_ms((boot_stage_t)i);
+        if (ms < 0) {
+            continue;
+        }
+        n = snprintf(buf + pos, len - pos, "%s\"%s\":%" PRId32, first ? "" : ",", stage_names[i], ms);
+        if (n < 0 || (size_t)n >= len - pos) {
+            return -1;
+        }
+        pos += (size_t)n;
+        first = false;
+    }
+
+    n = snprintf(buf + pos, len - pos, "}}");
+    if (n < 0 || (size_t)n >= len - pos) {
+        return -1;
+    }
+    return (int)(pos + (size_t)n);
+}
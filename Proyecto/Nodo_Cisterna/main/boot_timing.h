@@ -0,0 +1,46 @@
+#ifndef BOOT_TIMING_H
+#define BOOT_TIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Etapas del arranque, en el orden en que suelen completarse
+ *
+ * Sensores y tareas arrancan antes que la red, así que FIRST_SAMPLE puede
+ * llegar antes o después de WIFI según cuánto tarde la conexión.
+ */
+typedef enum {
+    BOOT_STAGE_NVS = 0,
+    BOOT_STAGE_STORAGE,          // Anillo sin conexión montado
+    BOOT_STAGE_SENSORS,          // Sensores y tareas FreeRTOS creados
+    BOOT_STAGE_FIRST_SAMPLE,     // Primera muestra disponible
+    BOOT_STAGE_WIFI,             // IP obtenida
+    BOOT_STAGE_MQTT,             // Conectado al broker
+    BOOT_STAGE_COUNT
+} boot_stage_t;
+
+/**
+ * @brief Registra el fin de una etapa (solo la primera vez) y lo muestra en el log
+ */
+void boot_mark(boot_stage_t stage);
+
+/**
+ * @brief Tiempo desde el arranque hasta el fin de la etapa, en ms (-1 si no ocurrió)
+ */
+int32_t boot_stage_ms(boot_stage_t stage);
+
+/**
+ * @brief Codifica las marcas como JSON para el tópico de diagnóstico
+ *
+ * Formato: {"reset":"POWERON","wifi":"fast","ms":{"nvs":12,"storage":40,
+ *           "sensors":180,"first_sample":1190,"wifi":1650,"mqtt":1900}}
+ * Las etapas que aún no ocurrieron se omiten.
+ *
+ * @param fast_wifi true si la IP se obtuvo por la conexión rápida
+ * @return int Longitud escrita (sin el '\0'), o -1 si no cabe en @p len
+ */
+int boot_timing_encode_json(const char *reset_reason, bool fast_wifi, char *buf, size_t len);
+
+#endif // BOOT_TIMING_H
@@ -0,0 +1,242 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "duty_cycle.h"
+#include "wifi.h"
+#include "mqtt.h"
+#include "sensor.h"
+#include "telemetry.h"
+#include "upload_sched.h"
+
+#if CONFIG_CISTERNA_DEEP_SLEEP
+
+static const char *TAG = "DUTY_CYCLE";
+
+#define DS_RTC_MAGIC      0x43495354u   // "CIST"
+#define DS_PUBACK_WAIT_MS 5000
+
+#if CONFIG_CISTERNA_DS_UPLOAD_EVERY > CONFIG_CISTERNA_DS_BUFFER
+#define DS_UPLOAD_EVERY CONFIG_CISTERNA_DS_BUFFER
+#else
+#define DS_UPLOAD_EVERY CONFIG_CISTERNA_DS_UPLOAD_EVERY
+#endif
+
+/*
+ * Estado que sobrevive al deep sleep. Las muestras se guardan en orden
+ * (la más vieja primero) para codificarlas sin copiar; con el buffer lleno
+ * se descarta la más vieja.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t wakes;          // Despertares desde el arranque en frío
+    uint32_t seq;            // Última muestra tomada
+    uint32_t uploads;        // Subidas exitosas
+    uint32_t upload_fails;   // Subidas fallidas (sin Wi-Fi, MQTT o PUBACK)
+    uint32_t dropped;        // Muestras descartadas con el buffer lleno
+    uint16_t count;
+    upload_sched_t sched;
+    telemetry_sample_t samples[CONFIG_CISTERNA_DS_BUFFER];
+} ds_rtc_t;
+
+static RTC_DATA_ATTR ds_rtc_t s_rtc;
+
+static const upload_policy_t s_policy = {
+    .every_n = DS_UPLOAD_EVERY,
+    .capacity = CONFIG_CISTERNA_DS_BUFFER,
+    .level_delta_cm = (float)CONFIG_CISTERNA_DS_LEVEL_DELTA_CM,
+    .max_backoff = DS_UPLOAD_EVERY,
+};
+
+// msg_id del último PUBACK recibido (lo escribe la tarea de MQTT)
+static volatile int s_puback_msg_id = -1;
+
+static void ds_mqtt_event_handler(void *handler_args, esp_event_base_t base,
+                                  int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+    if (event_id == MQTT_EVENT_PUBLISHED) {
+        s_puback_msg_id = event->msg_id;
+    }
+}
+
+static void rtc_state_check(void)
+{
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && s_rtc.magic == DS_RTC_MAGIC) {
+        return;
+    }
+    // Arranque en frío: la memoria RTC no tiene datos válidos
+    memset(&s_rtc, 0, sizeof(s_rtc));
+    s_rtc.magic = DS_RTC_MAGIC;
+    upload_sched_init(&s_rtc.sched);
+    ESP_LOGI(TAG, "→ Arranque en frío: buffer RTC vacío (%d muestras)", CONFIG_CISTERNA_DS_BUFFER);
+}
+
+static void buffer_append(const telemetry_sample_t *sample)
+{
+    if (s_rtc.count == CONFIG_CISTERNA_DS_BUFFER) {
+        memmove(&s_rtc.samples[0], &s_rtc.samples[1],
+                (CONFIG_CISTERNA_DS_BUFFER - 1) * sizeof(s_rtc.samples[0]));
+        s_rtc.count--;
+        s_rtc.dropped++;
+    }
+    s_rtc.samples[s_rtc.count++] = *sample;
+}
+
+static bool wait_until(bool (*ready)(void), uint32_t timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (!ready()) {
+        if (esp_timer_get_time() >= deadline) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+    return true;
+}
+
+static void *s_client = NULL;
+
+static bool mqtt_ready(void)
+{
+    return mqtt_is_connected(s_client);
+}
+
+/**
+ * @brief Conecta, publica el buffer completo y espera el PUBACK
+ */
+static bool upload_buffer(const duty_cycle_config_t *cfg)
+{
+    uint32_t timeout_ms = CONFIG_CISTERNA_DS_CONNECT_TIMEOUT_S * 1000;
+
+    if (wifi_init(cfg->ssid, cfg->password) != ESP_OK || !wait_until(wifi_is_connected, timeout_ms)) {
+        ESP_LOGW(TAG, "✗ Sin Wi-Fi, se reintenta más adelante");
+        return false;
+    }
+
+    mqtt_config_t mqtt_cfg = { 0 };
+    strncpy(mqtt_cfg.broker_uri, cfg->broker_uri, sizeof(mqtt_cfg.broker_uri) - 1);
+    strncpy(mqtt_cfg.client_id, cfg->client_id, sizeof(mqtt_cfg.client_id) - 1);
+    s_client = mqtt_init(&mqtt_cfg, ds_mqtt_event_handler);
+    if (s_client == NULL || mqtt_connect(s_client) != ESP_OK || !wait_until(mqtt_ready, timeout_ms)) {
+        ESP_LOGW(TAG, "✗ Sin broker MQTT, se reintenta más adelante");
+        return false;
+    }
+
+#if CONFIG_CISTERNA_TELEMETRY_CBOR
+    const size_t buf_sz = CONFIG_CISTERNA_DS_BUFFER * TELEMETRY_CBOR_MAX_LEN + 3;
+#else
+    const size_t buf_sz = CONFIG_CISTERNA_DS_BUFFER * TELEMETRY_JSON_MAX_LEN + 3;
+#endif
+    char *payload = (char *)malloc(buf_sz);
+    if (payload == NULL) {
+        ESP_LOGE(TAG, "✗ Sin memoria para el lote");
+        return false;
+    }
+#if CONFIG_CISTERNA_TELEMETRY_CBOR
+    int len = telemetry_encode_cbor_batch(s_rtc.samples, s_rtc.count, (uint8_t *)payload, buf_sz);
+#else
+    int len = telemetry_encode_json_batch(s_rtc.samples, s_rtc.count, payload, buf_sz);
+#endif
+    int msg_id = len > 0 ? mqtt_publish(s_client, CONFIG_CISTERNA_DS_TOPIC, payload, len, 1, false) : -1;
+    free(payload);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "✗ Error publicando el lote");
+        return false;
+    }
+
+    // Sin PUBACK no se borra el buffer: mejor duplicar que perder muestras
+    int64_t deadline = esp_timer_get_time() + (int64_t)DS_PUBACK_WAIT_MS * 1000;
+    while (s_puback_msg_id != msg_id) {
+        if (esp_timer_get_time() >= deadline) {
+            ESP_LOGW(TAG, "✗ Sin PUBACK del lote (msg_id=%d)", msg_id);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    ESP_LOGI(TAG, "✓ Subidas %u muestras (#%" PRIu32 "..#%" PRIu32 ", %d bytes)",
+             (unsigned)s_rtc.count, s_rtc.samples[0].seq, s_rtc.samples[s_rtc.count - 1].seq, len);
+    return true;
+}
+
+static void shutdown_radio(void)
+{
+    if (s_client != NULL) {
+        mqtt_disconnect(s_client);
+    }
+    wifi_disconnect();
+    esp_wifi_stop();
+}
+
+void duty_cycle_run(const duty_cycle_config_t *cfg)
+{
+    rtc_state_check();
+    s_rtc.wakes++;
+
+    // 1. Una lectura
+    sensor_data_t data = { 0 };
+    telemetry_sample_t sample = { 0 };
+    if (sensor_init(cfg->ultrasonic_trig_pin, cfg->ultrasonic_echo_pin, cfg->tds_adc_pin) == ESP_OK &&
+        sensor_read_all(&data) == ESP_OK) {
+        sample.water_level_cm = data.water_level;
+        sample.tds_ppm = data.tds_value;
+        sample.water_state = (uint8_t)data.water_state;
+        // Una lectura por despertar: el filtro de nivel no llega a estimar
+        sample.level_filt_cm = data.level_filtered;
+        sample.rate_cm_min = data.level_rate;
+        sample.eta_min = data.level_eta;
+        sample.has_trend = data.level_filtered >= 0.0f;
+    } else {
+        sample.water_level_cm = -1.0f;
+        sample.tds_ppm = -1.0f;
+    }
+    // El reloj del sistema sigue contando en deep sleep (esp_timer no)
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    sample.seq = ++s_rtc.seq;
+    sample.timestamp_s = (uint32_t)now.tv_sec;
+    buffer_append(&sample);
+
+    // 2. ¿Vale la pena encender la radio?
+    upload_reason_t reason = upload_sched_on_sample(&s_rtc.sched, &s_policy, s_rtc.count,
+                                                    sample.water_level_cm, sample.water_state);
+    ESP_LOGI(TAG, "→ Muestra #%" PRIu32 ": nivel=%.1f cm tds=%.0f ppm | buffer %u/%d | subir: %s",
+             sample.seq, sample.water_level_cm, sample.tds_ppm, (unsigned)s_rtc.count,
+             CONFIG_CISTERNA_DS_BUFFER, upload_reason_str(reason));
+
+    if (reason != UPLOAD_NONE) {
+        bool ok = upload_buffer(cfg);
+        shutdown_radio();
+        upload_sched_done(&s_rtc.sched, &s_policy, ok, sample.water_level_cm, sample.water_state);
+        if (ok) {
+            s_rtc.uploads++;
+            s_rtc.count = 0;
+        } else {
+            s_rtc.upload_fails++;
+        }
+        ESP_LOGI(TAG, "  Subidas=%" PRIu32 " | fallidas=%" PRIu32 " | descartadas=%" PRIu32,
+                 s_rtc.uploads, s_rtc.upload_fails, s_rtc.dropped);
+    }
+
+    // 3. Dormir el resto del período (esp_timer cuenta desde este despertar)
+    int64_t period_us = (int64_t)CONFIG_CISTERNA_DS_PERIOD_S * 1000000;
+    int64_t sleep_us = period_us - esp_timer_get_time();
+    if (sleep_us < 1000000) {
+        sleep_us = 1000000;
+    }
+    ESP_LOGI(TAG, "→ Deep sleep %" PRId64 " ms (despierto %" PRId64 " ms)",
+             sleep_us / 1000, esp_timer_get_time() / 1000);
+    esp_sleep_enable_timer_wakeup((uint64_t)sleep_us);
+    esp_deep_sleep_start();
+}
+
+#endif // CONFIG_CISTERNA_DEEP_SLEEP
@@ -0,0 +1,27 @@
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+/**
+ * @brief Parámetros del modo deep sleep (los mismos que usa app_main)
+ */
+typedef struct {
+    const char *ssid;
+    const char *password;
+    const char *broker_uri;
+    const char *client_id;
+    int ultrasonic_trig_pin;
+    int ultrasonic_echo_pin;
+    int tds_adc_pin;
+} duty_cycle_config_t;
+
+/**
+ * @brief Ejecuta un ciclo del modo deep sleep y duerme; no retorna
+ *
+ * En cada despertar por timer: lee los sensores, agrega la muestra al
+ * buffer en memoria RTC y, si upload_sched lo indica, conecta Wi-Fi + MQTT
+ * y publica todo el buffer en un único mensaje (QoS 1). Luego programa el
+ * siguiente despertar a CONFIG_CISTERNA_DS_PERIOD_S del anterior.
+ */
+void duty_cycle_run(const duty_cycle_config_t *cfg);
+
+#endif // DUTY_CYCLE_H
@@ -10,31 +10,152 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
 
-#include "esp_console.h"
-#include "linenoise/linenoise.h"
-#include "esp_vfs_dev.h"
 #include "driver/uart.h"
 #include <strings.h>
 
 // Componentes locales
 #include "wifi.h"
 #include "mqtt.h"
+#include "mqtt_router.h"
+#include "cmd_bus.h"
+#include "diag.h"
+#include "lat_hist.h"
+#include "tds_cmd.h"
 
 #include "sensor.h"
 #include "tasks.h"
+#include "telemetry.h"
+#include "deadband.h"
+#include "aggregate.h"
+#include "storage_ring.h"
+#include "power.h"
+#include "duty_cycle.h"
+#include "boot_timing.h"
+#include "sdkconfig.h"
 
 #define WIFI_SSID       "RPi-Hotspot"        // Cambiar por el SSID de tu red Wi-Fi RPi-Hotspot
 #define WIFI_PASSWORD   "12345678"    // Cambiar por la contraseña de tu red Wi-Fi
 #define MQTT_BROKER_URI "mqtt://10.42.0.1:1883"  // Cambiar según broker 10.162.31.132  10.42.0.1     10.42.0.111
 static const char *TAG = "CISTERNA_MAIN";
 
+// Telemetría por muestra: documento agrupado y/o tópicos por campo (ver Kconfig)
+#define TOPIC_PUMP_STATE "cistern/pump_state"
+#define TOPIC_DIAG_BOOT  "cistern/diag/boot"
+#define TOPIC_DIAG       "cistern/diag"         // Registro periódico de salud (ver diag.h)
+#define TOPIC_CMD        "cistern/cmd"          // Cualquier comando del bus (ver "help")
+#define TOPIC_CMD_ACK    "cistern/cmd/ack"
+#define TOPIC_PUMP_ACK   "cistern/pump_state/ack"  // Confirmación JSON de comandos con "#<id>"
+#define TOPIC_PUMP_CTRL  "cistern/pump_ctrl"    // Decisiones del control local de bomba
+
+// Etiquetas de respuesta para comandos llegados por MQTT
+#define CMD_TAG_PUMP_STATE 0   // Responder publicando cistern/pump_state (retenido)
+#define CMD_TAG_ACK        1   // Responder el texto en TOPIC_CMD_ACK
+#if defined(CONFIG_CISTERNA_TELEMETRY_MODE_BATCHED) || defined(CONFIG_CISTERNA_TELEMETRY_MODE_BOTH)
+#define TELEMETRY_BATCHED 1
+#endif
+#if defined(CONFIG_CISTERNA_TELEMETRY_MODE_FIELDS) || defined(CONFIG_CISTERNA_TELEMETRY_MODE_BOTH)
+#define TELEMETRY_FIELDS 1
+#endif
+
+// Período más largo entre muestras (el adaptativo lo alcanza en reposo)
+#if CONFIG_CISTERNA_SAMPLE_ADAPTIVE
+#define SAMPLE_PERIOD_MAX_MS CONFIG_CISTERNA_SAMPLE_MAX_MS
+#else
+#define SAMPLE_PERIOD_MAX_MS CONFIG_CISTERNA_SAMPLE_PERIOD_MS
+#endif
+#if CONFIG_CISTERNA_LEVEL_FILTER && SAMPLE_PERIOD_MAX_MS >= CONFIG_CISTERNA_LEVEL_KF_MAX_GAP_S * 1000
+#warning "Período de muestreo máximo >= hueco del filtro de nivel: el filtro se reinicia en cada muestra"
+#endif
+#if CONFIG_CISTERNA_PUMP_LOCAL_CONTROL
+#if CONFIG_CISTERNA_WATER_LEVEL_LOW_THRESHOLD >= CONFIG_CISTERNA_WATER_LEVEL_HIGH_THRESHOLD
+#error "Control local de bomba: el umbral bajo debe ser menor que el alto"
+#endif
+#if CONFIG_CISTERNA_WATER_LEVEL_HIGH_THRESHOLD >= CONFIG_CISTERNA_TANK_HEIGHT_CM
+#error "Control local de bomba: el umbral alto debe ser menor que CISTERNA_TANK_HEIGHT_CM"
+#endif
+#endif
+
+#if CONFIG_CISTERNA_DEADBAND_ENABLE
+// Publicación por excepción: contadores de enviadas/suprimidas en g_deadband
+static deadband_t g_deadband;
+#endif
+
 // Variables globales para configuración
 static void *mqtt_client = NULL;
-// Mode: central control via Node-RED by default
-// Control modes
-// Only MQTT-based control is used now; node-RED sends ON/OFF to control pump
-static bool pump_manual_override = false;  // retained for compatibility (unused)
+
+// Tarea que levanta la red; el handler MQTT la notifica al conectar
+static TaskHandle_t network_task_handle = NULL;
+
+// Tabla de tópicos entrantes (se registra antes de iniciar el cliente)
+static mqtt_router_t mqtt_routes;
+
+// Comando de bomba: llegada (MQTT o UART) -> relé conmutado, en µs
+static lat_hist_t relay_hist = LAT_HIST_INIT("cmd_relay");
+
+#if CONFIG_CISTERNA_STORE_FORWARD
+// Registro del anillo sin conexión. Un registro de otro formato (otra versión
+// o tamaño de telemetry_sample_t, o de un firmware sin cabecera) no se reenvía
+#define SF_RECORD_MAGIC   0x5346u      // "SF"
+#define SF_RECORD_VERSION 1            // Subir al cambiar telemetry_sample_t
+#define SF_PUBACK_WAIT_MS 10000        // Sin PUBACK en este plazo el lote se reenvía
+
+typedef struct {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t size;                      // sizeof(telemetry_sample_t) al guardarlo
+    telemetry_sample_t sample;
+} sf_record_t;
+
+_Static_assert(sizeof(telemetry_sample_t) == 36, "cambió telemetry_sample_t: subir SF_RECORD_VERSION");
+
+// Lote reenviado que espera confirmación y últimos msg_id confirmado y
+// expirado del outbox (los escribe el handler MQTT)
+static TaskHandle_t sf_task_handle = NULL;
+static volatile int sf_wait_msg_id = -1;
+static volatile int sf_acked_msg_id = -1;
+static volatile int sf_expired_msg_id = -1;
+#endif
+
+/**
+ * @brief Comando de bomba desde Node-RED (cistern_control y su alias cistern/pump_cmd)
+ *
+ * Solo encola "pump <payload>" en el bus de comandos; la respuesta vuelve
+ * como publicación de cistern/pump_state (CMD_TAG_PUMP_STATE). Un payload
+ * "ON #17" agrega además la confirmación con ese ID en TOPIC_PUMP_ACK.
+ */
+static void on_pump_command(const char *topic, size_t topic_len,
+                            const uint8_t *data, size_t len, void *ctx)
+{
+    char line[CMD_BUS_MAX_LINE];
+    int n = snprintf(line, sizeof(line), "pump %.*s", len > 32 ? 32 : (int)len, (const char *)data);
+    if (cmd_bus_post(CMD_SRC_MQTT, CMD_TAG_PUMP_STATE, line, (size_t)n) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠ Bus de comandos lleno, comando de bomba descartado");
+    }
+}
+
+/**
+ * @brief Comando genérico (cistern/cmd): la línea completa va al bus, la respuesta a cistern/cmd/ack
+ */
+static void on_bus_command(const char *topic, size_t topic_len,
+                           const uint8_t *data, size_t len, void *ctx)
+{
+    esp_err_t err = cmd_bus_post(CMD_SRC_MQTT, CMD_TAG_ACK, (const char *)data, len);
+    if (err != ESP_OK && mqtt_is_connected(mqtt_client)) {
+        const char *msg = err == ESP_ERR_TIMEOUT ? "busy" : "invalid command line";
+        mqtt_publish_class(mqtt_client, TOPIC_CMD_ACK, msg, strlen(msg), 1, false, MQTT_MSG_STATE);
+    }
+}
+
+static void mqtt_routes_init(void)
+{
+    mqtt_router_init(&mqtt_routes);
+    mqtt_router_add(&mqtt_routes, "cistern_control", on_pump_command, NULL);
+    mqtt_router_add(&mqtt_routes, "cistern/pump_cmd", on_pump_command, NULL);  // alias del flujo de Node-RED
+    mqtt_router_add(&mqtt_routes, TOPIC_CMD, on_bus_command, NULL);
+}
 
 /**
  * @brief Callback para eventos MQTT
@@ -43,65 +164,52 @@ static bool pump_manual_override = false;  // retained for compatibility (unused
  * Particularmente, procesa comandos de control de bomba desde el topic "cistern_control"
  * 
  * Tópicos esperados:
- * - Recibir: cistern_control → mensajes "ON"/"OFF" para control de bomba
+ * - Recibir: cistern_control → mensajes "ON"/"OFF"/"AUTO" para control de bomba
+ *
+ * Los mensajes entrantes se despachan por tabla (mqtt_routes_init), sin
+ * copiar el payload y reensamblando los que llegan fragmentados.
  */
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, 
                                int32_t event_id, void *event_data)
 {
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+
+    if (event_id == MQTT_EVENT_CONNECTED) {
+        boot_mark(BOOT_STAGE_MQTT);
+        // Suscribirse en cada conexión (la sesión no es persistente) a cada filtro registrado
+        for (uint8_t i = 0; i < mqtt_routes.count; i++) {
+            mqtt_subscribe(event->client, mqtt_routes.routes[i].filter, 1);
+            ESP_LOGI(TAG, "-> Suscrito a topico '%s' para recibir comandos desde Node-RED", mqtt_routes.routes[i].filter);
+        }
+        // Estado retenido para que Node-RED conozca el estado actual de la bomba
+        const char *pump_state = tasks_get_pump_relay_state() ? "ON" : "OFF";
+        mqtt_publish_class(event->client, TOPIC_PUMP_STATE, pump_state, strlen(pump_state), CONFIG_CISTERNA_PUMP_STATE_QOS, true, MQTT_MSG_STATE);
+        if (network_task_handle != NULL) {
+            xTaskNotifyGive(network_task_handle);
+        }
+        return;
+    }
+
+#if CONFIG_CISTERNA_STORE_FORWARD
+    if (event_id == MQTT_EVENT_PUBLISHED || event_id == MQTT_EVENT_DELETED) {
+        if (event_id == MQTT_EVENT_PUBLISHED) {
+            sf_acked_msg_id = event->msg_id;
+        } else {
+            sf_expired_msg_id = event->msg_id;
+        }
+        if (event->msg_id == sf_wait_msg_id && sf_task_handle != NULL) {
+            xTaskNotifyGive(sf_task_handle);
+        }
+        return;
+    }
+#endif
     
     if (event_id == MQTT_EVENT_DATA) {
-        // Mostrar topic y payload para diagnostico
+        // Mostrar topic y payload para diagnostico (los fragmentos siguientes no traen topic)
         ESP_LOGI(TAG, "MQTT: topic=%.*s payload=%.*s", event->topic_len, event->topic,
                  event->data_len, event->data);
-        // Procesar mensajes recibidos
-        const char topic_control[] = "cistern_control";
-        const char topic_pump_cmd[] = "cistern/pump_cmd"; // alias used by Node-RED flow
-        bool is_control = false;
-
-        if (event->topic_len == (int)sizeof(topic_control) - 1 &&
-            memcmp(event->topic, topic_control, event->topic_len) == 0) {
-            is_control = true;
-        } else if (event->topic_len == (int)sizeof(topic_pump_cmd) - 1 &&
-                   memcmp(event->topic, topic_pump_cmd, event->topic_len) == 0) {
-            is_control = true;
-        }
-
-        if (is_control) {
-            // Procesar comando de control de bomba (ON/OFF variants)
-            char payload[32] = {0};
-            int len = (event->data_len < (int)sizeof(payload) - 1) ? event->data_len : (int)sizeof(payload) - 1;
-            strncpy(payload, event->data, len);
-            payload[len] = '\0';
-
-            ESP_LOGI(TAG, "-> Comando de bomba recibido: '%s'", payload);
-
-            if (strcasecmp(payload, "ON") == 0 || strcasecmp(payload, "ENCENDER") == 0 || strcasecmp(payload, "1") == 0 || strcasecmp(payload, "TRUE") == 0) {
-                esp_err_t rc = tasks_set_pump_relay(true);
-                if (rc == ESP_OK) {
-                    ESP_LOGI(TAG, "tasks_set_pump_relay(true) -> ESP_OK");
-                } else {
-                    ESP_LOGW(TAG, "tasks_set_pump_relay(true) -> %s", esp_err_to_name(rc));
-                }
-                ESP_LOGI(TAG, "OK Bomba encendida (desde Node-RED)");
-            } else if (strcasecmp(payload, "OFF") == 0 || strcasecmp(payload, "APAGAR") == 0 || strcasecmp(payload, "0") == 0 || strcasecmp(payload, "FALSE") == 0) {
-                esp_err_t rc = tasks_set_pump_relay(false);
-                if (rc == ESP_OK) {
-                    ESP_LOGI(TAG, "tasks_set_pump_relay(false) -> ESP_OK");
-                } else {
-                    ESP_LOGW(TAG, "tasks_set_pump_relay(false) -> %s", esp_err_to_name(rc));
-                }
-                ESP_LOGI(TAG, "OK Bomba apagada (desde Node-RED)");
-            } else {
-                ESP_LOGW(TAG, "Comando desconocido en cistern_control: '%s' (aceptados: ON/OFF)", payload);
-            }
-
-            // Enviar confirmación del estado de la bomba por MQTT
-            if (mqtt_is_connected(mqtt_client)) {
-                const char *pump_state_str = tasks_get_pump_relay_state() ? "ON" : "OFF";
-                mqtt_publish(mqtt_client, "cistern/pump_state", pump_state_str, strlen(pump_state_str), 1, true);
-            }
-        }
+        mqtt_router_feed(&mqtt_routes, event->topic, event->topic_len, event->data, event->data_len,
+                         event->current_data_offset, event->total_data_len);
     }
 }
 
@@ -109,19 +217,30 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
  * @brief Tarea FreeRTOS para lectura de sensores y publicación de datos
  * 
  * Esta tarea:
- * 1. Lee los sensores (nivel de agua y TDS) cada 1 segundo
- * 2. Clasifica la calidad del agua
- * 3. Publica los datos en tópicos MQTT
+ * 1. Espera cada muestra nueva de la tarea de muestreo (suscripción, sin sondeo)
+ * 2. Publica los datos una sola vez por muestra: un documento agrupado
+ *    (seq, ts y todos los campos) y/o los tópicos por campo históricos
+ * 3. Con banda muerta activa, suprime muestras sin cambios relevantes
+ *    (publica igual ante cambios de estado/bomba y cada heartbeat)
+ * 4. Registra si se perdieron muestras (saltos en el número de secuencia)
+ * 5. Sin conexión, guarda en flash las muestras que habría publicado
+ *    (las reenvía telemetry_replay_task)
+ * 6. Agrega nivel y TDS por ventanas y publica un resumen al cerrar cada una
+ *    (el flujo crudo de los puntos 2-5 puede desactivarse en Kconfig)
+ * 7. Mientras espera, publica los cambios del relé y las decisiones del
+ *    control local (pump_state_change_cb, pump_ctrl_report_cb)
  * 
- * Nota: El control de la bomba se realiza únicamente mediante comandos
- * MQTT recibidos en el tópico "cistern_control" (ON/OFF)
+ * Nota: esta tarea no decide sobre la bomba. Los comandos ON/OFF/AUTO
+ * llegan por "cistern_control" (o la UART) y, con
+ * CISTERNA_PUMP_LOCAL_CONTROL, la histéresis corre en la tarea de muestreo
  */
 static void sensor_read_and_publish_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "→ Iniciando tarea de lectura y publicación de sensores");
     
-    const uint32_t publish_interval = 1000;  // 1 segundo
+    const uint32_t sample_timeout_ms = SAMPLE_PERIOD_MAX_MS + 5000;  // Aviso si el muestreo se detiene
     sensor_data_t sensor_data;
+    uint32_t last_seq = 0;
     const size_t json_buf_sz = 512;
     char *json_payload = (char *) malloc(json_buf_sz);
     if (json_payload == NULL) {
@@ -130,39 +249,145 @@ static void sensor_read_and_publish_task(void *pvParameters)
         return;
     }
     
+#if CONFIG_CISTERNA_DEADBAND_ENABLE
+    const deadband_config_t db_cfg = {
+        .level_abs_cm = CONFIG_CISTERNA_DEADBAND_LEVEL_MM / 10.0f,
+        .level_rel_pct = CONFIG_CISTERNA_DEADBAND_LEVEL_PCT,
+        .tds_abs_ppm = CONFIG_CISTERNA_DEADBAND_TDS_PPM,
+        .tds_rel_pct = CONFIG_CISTERNA_DEADBAND_TDS_PCT,
+        .heartbeat_s = CONFIG_CISTERNA_HEARTBEAT_S,
+    };
+    deadband_init(&g_deadband, &db_cfg);
+#endif
+
+#if CONFIG_CISTERNA_DEADBAND_ENABLE
+    bool was_connected = false;
+#endif
+#if CONFIG_CISTERNA_AGGREGATE_ENABLE
+    aggregate_t aggregator;
+    aggregate_init(&aggregator, CONFIG_CISTERNA_AGGREGATE_WINDOW_S);
+#endif
+    int sub_id = tasks_subscribe_samples();
+    if (sub_id < 0) {
+        ESP_LOGE(TAG, "✗ No se pudo suscribir a las muestras de sensores");
+        free(json_payload);
+        vTaskDelete(NULL);
+        return;
+    }
+    // Los eventos de bomba se publican desde aquí, no desde la tarea de muestreo
+    tasks_set_pump_event_subscriber(sub_id);
+
     while (1) {
-        // Leer datos de sensores de forma segura (con semáforo)
-        esp_err_t err = tasks_read_sensor_data(&sensor_data, pdMS_TO_TICKS(500));
+        // Dormir hasta que la tarea de muestreo publique una muestra nueva
+        uint32_t seq = tasks_wait_sample(sub_id, &sensor_data, last_seq, sample_timeout_ms);
         
-        if (err == ESP_OK) {
+        if (seq != 0) {
+            if (last_seq != 0 && seq - last_seq > 1) {
+                ESP_LOGW(TAG, "⚠ %" PRIu32 " muestra(s) sin publicar", seq - last_seq - 1);
+            }
+            last_seq = seq;
+            boot_mark(BOOT_STAGE_FIRST_SAMPLE);
+
             // Preparar datos de sensores
-            const char *water_state_str[] = {"LIMPIA", "MEDIA", "SUCIA"};
+            const char *const *water_state_str = telemetry_water_state_str;
             const char *pump_state_str = tasks_get_pump_relay_state() ? "ON" : "OFF";
+            telemetry_sample_t sample = {
+                .seq = seq,
+                .timestamp_s = sensor_data.timestamp,
+                .water_level_cm = sensor_data.water_level,
+                .tds_ppm = sensor_data.tds_value,
+                .water_state = (uint8_t)sensor_data.water_state,
+                .pump_on = tasks_get_pump_relay_state(),
+                .level_filt_cm = sensor_data.level_filtered,
+                .rate_cm_min = sensor_data.level_rate,
+                .eta_min = sensor_data.level_eta,
+                .has_trend = sensor_data.level_filtered >= 0.0f,
+            };
+
+            bool connected = mqtt_is_connected(mqtt_client);
+            deadband_reason_t reason = DEADBAND_FIRST;
+#if !CONFIG_CISTERNA_RAW_STREAM
+            reason = DEADBAND_SUPPRESS;   // Solo resúmenes: ninguna muestra cruda sale del nodo
+#elif CONFIG_CISTERNA_DEADBAND_ENABLE
+            if (connected != was_connected) {
+                // Al conectar o desconectar, la primera muestra pasa sin comparar
+                deadband_reset(&g_deadband);
+            }
+            was_connected = connected;
+            reason = deadband_check(&g_deadband, &sample, sensor_data.timestamp);
+#endif
             
-            // Publicar en topicos separados si MQTT esta conectado
-            if (mqtt_is_connected(mqtt_client)) {
+            if (connected && reason != DEADBAND_SUPPRESS) {
+#if TELEMETRY_BATCHED
+                // Un único documento por muestra: un publish (y un PUBACK) en lugar de cuatro
+#if CONFIG_CISTERNA_TELEMETRY_CBOR
+                int len = telemetry_encode_cbor(&sample, (uint8_t *)json_payload, json_buf_sz);
+#else
+                int len = telemetry_encode_json(&sample, json_payload, json_buf_sz);
+#endif
+                if (len > 0) {
+                    mqtt_publish(mqtt_client, CONFIG_CISTERNA_TELEMETRY_TOPIC, json_payload, len,
+                                 CONFIG_CISTERNA_TELEMETRY_QOS, false);
+                }
+#endif
+#if TELEMETRY_FIELDS
+                // Compatibilidad: tópicos separados por campo
                 // 1. Publicar nivel de agua (en cm)
                 snprintf(json_payload, json_buf_sz, "%.2f", sensor_data.water_level);
-                mqtt_publish(mqtt_client, "cistern/water_level", json_payload, strlen(json_payload), 1, false);
+                mqtt_publish(mqtt_client, "cistern/water_level", json_payload, strlen(json_payload), CONFIG_CISTERNA_FIELD_TOPICS_QOS, false);
                 
                 // 2. Publicar TDS (en ppm)
                 snprintf(json_payload, json_buf_sz, "%.1f", sensor_data.tds_value);
-                mqtt_publish(mqtt_client, "cistern/tds_value", json_payload, strlen(json_payload), 1, false);
+                mqtt_publish(mqtt_client, "cistern/tds_value", json_payload, strlen(json_payload), CONFIG_CISTERNA_FIELD_TOPICS_QOS, false);
                 
                 // 3. Publicar estado del agua (LIMPIA/MEDIA/SUCIA)
                 snprintf(json_payload, json_buf_sz, "%s", water_state_str[sensor_data.water_state]);
-                mqtt_publish(mqtt_client, "cistern/water_state", json_payload, strlen(json_payload), 1, false);
+                mqtt_publish(mqtt_client, "cistern/water_state", json_payload, strlen(json_payload), CONFIG_CISTERNA_FIELD_TOPICS_QOS, false);
                 
                 // 4. Publicar estado de la bomba (ON/OFF)
                 snprintf(json_payload, json_buf_sz, "%s", pump_state_str);
-                mqtt_publish(mqtt_client, "cistern/pump_state", json_payload, strlen(json_payload), 1, true);
-
-                    ESP_LOGD(TAG, "-> Datos publicados en topicos MQTT");
-
-                    // Control automático interno removido: Node-RED controla la bomba mediante ON/OFF
-            } else {
+                mqtt_publish_class(mqtt_client, TOPIC_PUMP_STATE, json_payload, strlen(json_payload), CONFIG_CISTERNA_PUMP_STATE_QOS, true, MQTT_MSG_STATE);
+#endif
+                ESP_LOGD(TAG, "-> Datos publicados en topicos MQTT (%s)", deadband_reason_str(reason));
+            } else if (!connected && reason != DEADBAND_SUPPRESS) {
+#if CONFIG_CISTERNA_STORE_FORWARD
+                const sf_record_t rec = {
+                    .magic = SF_RECORD_MAGIC,
+                    .version = SF_RECORD_VERSION,
+                    .size = sizeof(telemetry_sample_t),
+                    .sample = sample,
+                };
+                if (storage_ring_append(&rec, sizeof(rec)) == ESP_OK) {
+                    ESP_LOGW(TAG, "X MQTT desconectado, muestra #%" PRIu32 " guardada (%" PRIu32 " pendientes)",
+                             seq, storage_ring_pending());
+                } else {
+                    ESP_LOGW(TAG, "X MQTT desconectado, datos no publicados ni guardados");
+                }
+#else
                 ESP_LOGW(TAG, "X MQTT desconectado, datos no publicados");
+#endif
+            } else {
+                ESP_LOGD(TAG, "-> Muestra #%" PRIu32 " suprimida (sin cambios fuera de banda)", seq);
+            }
+
+#if CONFIG_CISTERNA_AGGREGATE_ENABLE
+            telemetry_summary_t summary;
+            if (aggregate_add(&aggregator, &sample, sensor_data.timestamp, &summary)) {
+#if CONFIG_CISTERNA_TELEMETRY_CBOR
+                int len = telemetry_encode_summary_cbor(&summary, (uint8_t *)json_payload, json_buf_sz);
+#else
+                int len = telemetry_encode_summary_json(&summary, json_payload, json_buf_sz);
+#endif
+                if (connected && len > 0) {
+                    mqtt_publish(mqtt_client, CONFIG_CISTERNA_AGGREGATE_TOPIC, json_payload, len, 1, false);
+                    ESP_LOGI(TAG, "→ Resumen ventana #%" PRIu32 ": nivel %.2f±%.2f cm, TDS %.1f±%.1f ppm (%" PRIu32 " muestras)",
+                             summary.window, summary.level.mean, summary.level.stddev,
+                             summary.tds.mean, summary.tds.stddev, summary.samples);
+                } else if (!connected) {
+                    ESP_LOGW(TAG, "X MQTT desconectado, resumen de ventana #%" PRIu32 " no publicado", summary.window);
+                }
             }
+#endif
             
             // Log de información
             ESP_LOGI(TAG, "Lectura #%" PRIu32 " | Nivel: %.2f cm | TDS: %.1f ppm (%s) | Bomba: %s",
@@ -171,14 +396,224 @@ static void sensor_read_and_publish_task(void *pvParameters)
                      sensor_data.tds_value,
                      water_state_str[sensor_data.water_state],
                      pump_state_str);
+            if (sample.has_trend && sample.eta_min >= 0.0f) {
+                ESP_LOGI(TAG, "  Filtrado: %.2f cm | %+.2f cm/min | %s en %.1f min",
+                         sample.level_filt_cm, sample.rate_cm_min,
+                         sample.rate_cm_min > 0.0f ? "lleno" : "vacío", sample.eta_min);
+            } else if (sample.has_trend) {
+                ESP_LOGI(TAG, "  Filtrado: %.2f cm | %+.2f cm/min | estable",
+                         sample.level_filt_cm, sample.rate_cm_min);
+            }
         } else {
-            ESP_LOGE(TAG, "✗ Error al leer sensores: %s", esp_err_to_name(err));
+            ESP_LOGW(TAG, "⚠ Sin muestras nuevas en %" PRIu32 " ms", sample_timeout_ms);
         }
-        
-        vTaskDelay(pdMS_TO_TICKS(publish_interval));
     }
 }
 
+#if CONFIG_CISTERNA_STORE_FORWARD
+/**
+ * @brief Tarea FreeRTOS que reenvía las muestras guardadas sin conexión
+ *
+ * Con MQTT conectado, lee del anillo en flash lotes de hasta
+ * CONFIG_CISTERNA_SF_BATCH muestras, los publica (QoS 1) como un único array
+ * en CONFIG_CISTERNA_SF_TOPIC y solo al recibir el PUBACK de ese mensaje los
+ * marca como entregados: un reinicio, un corte o la expiración del mensaje
+ * en el outbox antes de la confirmación reenvía el lote (al menos una vez).
+ * Los registros de otro formato se descartan sin reenviar. Entre lotes
+ * espera CONFIG_CISTERNA_SF_INTERVAL_MS para no competir con la telemetría
+ * en vivo.
+ */
+static void telemetry_replay_task(void *pvParameters)
+{
+    static sf_record_t recs[CONFIG_CISTERNA_SF_BATCH];
+    static telemetry_sample_t batch[CONFIG_CISTERNA_SF_BATCH];
+#if CONFIG_CISTERNA_TELEMETRY_CBOR
+    const size_t buf_sz = CONFIG_CISTERNA_SF_BATCH * TELEMETRY_CBOR_MAX_LEN + 3;
+#else
+    const size_t buf_sz = CONFIG_CISTERNA_SF_BATCH * TELEMETRY_JSON_MAX_LEN + 3;
+#endif
+    char *payload = (char *) malloc(buf_sz);
+    if (payload == NULL) {
+        ESP_LOGE(TAG, "✗ No memory for replay buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    sf_task_handle = xTaskGetCurrentTaskHandle();
+
+    while (1) {
+        if (!mqtt_is_connected(mqtt_client) || storage_ring_pending() == 0) {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        // Un registro más largo que sf_record_t llega truncado: su tamaño no coincide
+        memset(recs, 0, sizeof(recs));
+        int count = storage_ring_peek(recs, sizeof(recs[0]), CONFIG_CISTERNA_SF_BATCH);
+        int valid = 0;
+        for (int i = 0; i < count; i++) {
+            if (recs[i].magic == SF_RECORD_MAGIC && recs[i].version == SF_RECORD_VERSION &&
+                recs[i].size == sizeof(telemetry_sample_t)) {
+                batch[valid++] = recs[i].sample;
+            }
+        }
+        if (valid < count) {
+            ESP_LOGW(TAG, "⚠ %d registro(s) guardados con otro formato, descartados", count - valid);
+        }
+        if (valid == 0) {
+            storage_ring_consume(count);
+            continue;
+        }
+
+#if CONFIG_CISTERNA_TELEMETRY_CBOR
+        int len = telemetry_encode_cbor_batch(batch, valid, (uint8_t *)payload, buf_sz);
+#else
+        int len = telemetry_encode_json_batch(batch, valid, payload, buf_sz);
+#endif
+        ulTaskNotifyTake(pdTRUE, 0);
+        int msg_id = len > 0 ? mqtt_publish(mqtt_client, CONFIG_CISTERNA_SF_TOPIC, payload, len, 1, false) : -1;
+        if (msg_id > 0) {
+            // El PUBACK puede llegar antes de anotar el msg_id: sf_acked_msg_id lo cubre
+            sf_wait_msg_id = msg_id;
+            int64_t deadline = esp_timer_get_time() + (int64_t)SF_PUBACK_WAIT_MS * 1000;
+            int64_t left_us;
+            while (sf_acked_msg_id != msg_id && sf_expired_msg_id != msg_id &&
+                   (left_us = deadline - esp_timer_get_time()) > 0) {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(left_us / 1000) + 1);
+            }
+            sf_wait_msg_id = -1;
+            if (sf_acked_msg_id == msg_id) {
+                storage_ring_consume(count);
+                ESP_LOGI(TAG, "→ Reenviadas %d muestras guardadas (#%" PRIu32 "..#%" PRIu32 "), quedan %" PRIu32,
+                         valid, batch[0].seq, batch[valid - 1].seq, storage_ring_pending());
+            } else {
+                ESP_LOGW(TAG, "⚠ Lote guardado sin PUBACK (msg_id=%d), se reenvía", msg_id);
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_CISTERNA_SF_INTERVAL_MS));
+    }
+}
+#endif
+
+static const char *reset_reason_str(esp_reset_reason_t reason)
+{
+    switch (reason) {
+        case ESP_RST_POWERON:   return "POWERON";
+        case ESP_RST_SW:        return "SW";
+        case ESP_RST_PANIC:     return "PANIC";
+        case ESP_RST_INT_WDT:   return "INT_WDT";
+        case ESP_RST_TASK_WDT:  return "TASK_WDT";
+        case ESP_RST_WDT:       return "WDT";
+        case ESP_RST_DEEPSLEEP: return "DEEPSLEEP";
+        case ESP_RST_BROWNOUT:  return "BROWNOUT";
+        default:                return "OTHER";
+    }
+}
+
+/**
+ * @brief Tarea de arranque de la red (máquina de estados)
+ *
+ * Empieza con los sensores y las tareas ya corriendo: mientras no hay
+ * conexión, las muestras van al anillo sin conexión
+ * (CONFIG_CISTERNA_STORE_FORWARD) y telemetry_replay_task las reenvía al
+ * conectar. Estados:
+ *
+ *   WIFI_START → WIFI_WAIT → MQTT_START → MQTT_WAIT → ONLINE
+ *
+ * Las esperas bloquean en el event group de Wi-Fi o en la notificación del
+ * handler MQTT, sin sondeo. En línea publica los tiempos de arranque en
+ * TOPIC_DIAG_BOOT (retenido) y termina: desde ahí wifi.c y el cliente MQTT
+ * se encargan de reconectar.
+ */
+typedef enum {
+    NET_WIFI_START,
+    NET_WIFI_WAIT,
+    NET_MQTT_START,
+    NET_MQTT_WAIT,
+    NET_ONLINE,
+} net_stage_t;
+
+#define NET_WIFI_RETRY_MS 30000     // Sin IP en este plazo: reactivar reintentos
+#define NET_MQTT_LOG_MS   30000     // Aviso periódico mientras el broker no responde
+
+static void network_start_task(void *pvParameters)
+{
+    net_stage_t stage = NET_WIFI_START;
+
+    while (stage != NET_ONLINE) {
+        switch (stage) {
+            case NET_WIFI_START: {
+                ESP_LOGI(TAG, "→ Inicializando Wi-Fi...");
+                esp_err_t wifi_err = wifi_init(WIFI_SSID, WIFI_PASSWORD);
+                if (wifi_err != ESP_OK) {
+                    // Sin Wi-Fi el nodo sigue midiendo y guardando muestras
+                    ESP_LOGE(TAG, "✗ Error al inicializar Wi-Fi: %s", esp_err_to_name(wifi_err));
+                    network_task_handle = NULL;
+                    vTaskDelete(NULL);
+                    return;
+                }
+                stage = NET_WIFI_WAIT;
+                break;
+            }
+
+            case NET_WIFI_WAIT:
+                if (wifi_wait_connected(NET_WIFI_RETRY_MS)) {
+                    boot_mark(BOOT_STAGE_WIFI);
+                    stage = NET_MQTT_START;
+                } else {
+                    ESP_LOGW(TAG, "⚠ Sin Wi-Fi tras %d s, reintentando", NET_WIFI_RETRY_MS / 1000);
+                    wifi_reconnect();
+                }
+                break;
+
+            case NET_MQTT_START: {
+                ESP_LOGI(TAG, "→ Inicializando MQTT...");
+                mqtt_config_t mqtt_cfg = {
+                    .broker_uri = MQTT_BROKER_URI,
+                    .client_id = "esp32c6_cisterna",
+                    .username = "",  // Opcional
+                    .password = ""   // Opcional
+                };
+                mqtt_routes_init();
+                mqtt_client = mqtt_init(&mqtt_cfg, mqtt_event_handler);
+                if (mqtt_client == NULL) {
+                    ESP_LOGE(TAG, "✗ Error al inicializar cliente MQTT");
+                    network_task_handle = NULL;
+                    vTaskDelete(NULL);
+                    return;
+                }
+                mqtt_connect(mqtt_client);
+                stage = NET_MQTT_WAIT;
+                break;
+            }
+
+            case NET_MQTT_WAIT:
+                // El handler MQTT notifica en MQTT_EVENT_CONNECTED
+                if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NET_MQTT_LOG_MS)) > 0) {
+                    stage = NET_ONLINE;
+                } else {
+                    ESP_LOGW(TAG, "⚠ Broker MQTT aún no disponible (el cliente reintenta solo)");
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    bool fast = false;
+    wifi_connected_at_us(&fast);
+    char report[192];
+    int len = boot_timing_encode_json(reset_reason_str(esp_reset_reason()), fast, report, sizeof(report));
+    if (len > 0) {
+        mqtt_publish_class(mqtt_client, TOPIC_DIAG_BOOT, report, len, 1, true, MQTT_MSG_STATE);
+    }
+    ESP_LOGI(TAG, "✓ Red en línea");
+
+    network_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
 /**
  * @brief Inicialización de NVS Flash
  * 
@@ -196,56 +631,181 @@ static void nvs_init(void)
     ESP_ERROR_CHECK(ret);
 }
 
-// Console REPL task (defined as a proper C function instead of a C++ lambda)
-static void console_repl_task(void *arg)
+/**
+ * @brief Comando "pump on|off|auto|state" (UART, MQTT)
+ */
+static int cmd_pump(int argc, char **argv, char *reply, size_t reply_len)
 {
-    (void)arg;
-    ESP_LOGI(TAG, "→ Console REPL task starting");
-    /* Initialize console but avoid heavy linenoise features that consume significant stack.
-       Use VFS UART driver and a small heap-allocated input buffer read via fgets(). */
-    esp_console_config_t cfg = ESP_CONSOLE_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK( esp_console_init(&cfg) );
-    esp_console_register_help_command();
-
-    /* Enable VFS for the UART used by the console */
-    esp_vfs_dev_uart_use_driver(CONFIG_CONSOLE_UART_NUM);
-    /* Disable stdio buffering for immediate echo/read */
-    setvbuf(stdin, NULL, _IONBF, 0);
-
-    const size_t line_sz = 256;
-    char *line = (char *) calloc(1, line_sz);
-    if (line == NULL) {
-        ESP_LOGE(TAG, "✗ No se pudo reservar memoria para la consola");
-        vTaskDelete(NULL);
-        return;
-    }
+    static const char *const on_words[] = { "ON", "ENCENDER", "1", "TRUE" };
+    static const char *const off_words[] = { "OFF", "APAGAR", "0", "FALSE" };
+    int want = -1;
 
-    const char *prompt = "cisterna> ";
-    while (true) {
-        // Print prompt and read a line using fgets which allocates input on the heap
-        fputs(prompt, stdout);
-        fflush(stdout);
-        if (fgets(line, line_sz, stdin) == NULL) {
-            vTaskDelay(pdMS_TO_TICKS(100));
-            continue;
+    for (size_t i = 0; argc >= 2 && i < sizeof(on_words) / sizeof(on_words[0]); i++) {
+        if (strcasecmp(argv[1], on_words[i]) == 0) {
+            want = 1;
+        } else if (strcasecmp(argv[1], off_words[i]) == 0) {
+            want = 0;
         }
+    }
+    if (argc >= 2 && strcasecmp(argv[1], "state") == 0) {
+        snprintf(reply, reply_len, "%s", tasks_get_pump_relay_state() ? "ON" : "OFF");
+        return 0;
+    }
+    if (argc >= 2 && strcasecmp(argv[1], "auto") == 0) {
+        // Fin del comando manual: el control local vuelve a decidir
+        pump_ctrl_t ctrl;
+        if (tasks_pump_resume() != ESP_OK || !tasks_get_pump_ctrl(&ctrl)) {
+            snprintf(reply, reply_len, "local control disabled");
+            return -1;
+        }
+        snprintf(reply, reply_len, "AUTO %s low=%.0f high=%.0f switches=%" PRIu32,
+                 ctrl.on ? "ON" : "OFF", ctrl.cfg.low_cm, ctrl.cfg.high_cm, ctrl.switches);
+        return 0;
+    }
+    if (want < 0) {
+        ESP_LOGW(TAG, "Comando desconocido para la bomba: '%s' (aceptados: ON/OFF/AUTO/STATE)", argc >= 2 ? argv[1] : "");
+        snprintf(reply, reply_len, "usage: pump on|off|auto|state");
+        return -1;
+    }
+
+    esp_err_t rc = tasks_pump_command(want == 1);
+    if (rc != ESP_OK) {
+        ESP_LOGW(TAG, "tasks_pump_command(%s) -> %s", want ? "true" : "false", esp_err_to_name(rc));
+        snprintf(reply, reply_len, "pump error: %s", esp_err_to_name(rc));
+        return -1;
+    }
+    lat_hist_record(&relay_hist, (uint32_t)(esp_timer_get_time() - cmd_bus_current_posted_us()));
+    ESP_LOGI(TAG, "OK Bomba %s", want ? "encendida" : "apagada");
+    snprintf(reply, reply_len, "%s", tasks_get_pump_relay_state() ? "ON" : "OFF");
+    return 0;
+}
+
+/**
+ * @brief Comando "lat [reset]": percentiles de latencia (lectura, publish, comando -> relé)
+ */
+static int cmd_lat(int argc, char **argv, char *reply, size_t reply_len)
+{
+    bool reset = argc >= 2 && strcasecmp(argv[1], "reset") == 0;
+    if (lat_hist_format_text(reply, reply_len, reset) < 0) {
+        snprintf(reply, reply_len, "lat: respuesta demasiado larga");
+        return -1;
+    }
+    return 0;
+}
+
+static const cmd_def_t app_cmd_table[] = {
+    { "pump", "pump on|off|auto|state: controlar o consultar el relé", cmd_pump },
+    { "lat", "lat [reset]: latencias p50/p90/p99/max en µs", cmd_lat },
+};
+
+static void uart_cmd_reply(uint32_t tag, int status, const char *reply, void *ctx)
+{
+    const char *id = cmd_bus_current_id();
+    printf("%s%s%s%s%s\n", id[0] ? "#" : "", id, id[0] ? " " : "", status == 0 ? "" : "ERR ", reply);
+}
 
-        // Strip newline
-        size_t len = strlen(line);
-        if (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
-            line[len-1] = '\0';
-            if (len > 1 && line[len-2] == '\r') line[len-2] = '\0';
+static void mqtt_cmd_reply(uint32_t tag, int status, const char *reply, void *ctx)
+{
+    if (!mqtt_is_connected(mqtt_client)) {
+        return;
+    }
+    // Con ID de correlación la respuesta es JSON con marcas de llegada y actuación
+    char ack[CMD_BUS_MAX_REPLY + 128];
+    int ack_len = cmd_bus_current_id()[0] ? cmd_bus_format_ack(ack, sizeof(ack), status, reply) : -1;
+    if (tag == CMD_TAG_PUMP_STATE) {
+        // Confirmación del estado de la bomba (aunque no haya cambiado)
+        const char *pump_state_str = tasks_get_pump_relay_state() ? "ON" : "OFF";
+        mqtt_publish_class(mqtt_client, TOPIC_PUMP_STATE, pump_state_str, strlen(pump_state_str), CONFIG_CISTERNA_PUMP_STATE_QOS, true, MQTT_MSG_STATE);
+        if (ack_len > 0) {
+            mqtt_publish_class(mqtt_client, TOPIC_PUMP_ACK, ack, (size_t)ack_len, 1, false, MQTT_MSG_STATE);
         }
+    } else if (ack_len > 0) {
+        mqtt_publish_class(mqtt_client, TOPIC_CMD_ACK, ack, (size_t)ack_len, 1, false, MQTT_MSG_STATE);
+    } else {
+        mqtt_publish_class(mqtt_client, TOPIC_CMD_ACK, reply, strlen(reply), 1, false, MQTT_MSG_STATE);
+    }
+}
+
+/**
+ * @brief Bus de comandos: una cola y un worker para UART y MQTT
+ */
+static void commands_init(void)
+{
+    lat_hist_register(&relay_hist);
+    cmd_bus_register(tds_cmd_table, tds_cmd_table_len);
+    cmd_bus_register(app_cmd_table, sizeof(app_cmd_table) / sizeof(app_cmd_table[0]));
+    cmd_bus_set_reply(CMD_SRC_UART, uart_cmd_reply, NULL);
+    cmd_bus_set_reply(CMD_SRC_MQTT, mqtt_cmd_reply, NULL);
+    if (cmd_bus_start(4) != ESP_OK) {
+        ESP_LOGE(TAG, "✗ No se pudo iniciar el bus de comandos");
+    }
+}
+
+// Recepción UART: contadores para comparar los modos (ver CISTERNA_UART_RX_EVENTS)
+typedef struct {
+    uint32_t wakeups;        // veces que uart_cmd salió de su espera
+    uint32_t lines;          // líneas entregadas al bus
+    uint32_t dropped;        // líneas perdidas (desborde o demasiado largas)
+    uint32_t last_line_us;   // primer byte visto por la tarea -> línea encolada
+    uint32_t max_line_us;
+} uart_rx_stats_t;
+
+static uart_rx_stats_t uart_rx_stats;
+
+/**
+ * @brief Entrega una línea completa al bus y registra su latencia de recepción
+ */
+static void uart_post_line(const char *line, size_t len, int64_t first_us)
+{
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        len--;
+    }
+    if (len == 0) {
+        return;
+    }
+    uint32_t us = first_us ? (uint32_t)(esp_timer_get_time() - first_us) : 0;
+    uart_rx_stats.lines++;
+    uart_rx_stats.last_line_us = us;
+    if (us > uart_rx_stats.max_line_us) {
+        uart_rx_stats.max_line_us = us;
+    }
+    // Ejecuta el worker del bus; la respuesta vuelve por uart_cmd_reply()
+    esp_err_t err = cmd_bus_post(CMD_SRC_UART, 0, line, len);
+    if (err == ESP_ERR_TIMEOUT) {
+        printf("busy\n");
+    } else if (err == ESP_ERR_INVALID_SIZE) {
+        printf("ERR line too long (max %d)\n", CMD_BUS_MAX_LINE);
+    }
+}
 
-        if (strlen(line) > 0) {
-            int ret;
-            esp_console_run(line, &ret);
+#if CONFIG_CISTERNA_UART_RX_EVENTS
+#define UART_RX_BUF_SIZE   1024
+#define UART_EVT_QUEUE_LEN 16
+
+/**
+ * @brief Descarta n bytes del buffer del driver (línea que no entra en el buffer local)
+ */
+static void uart_discard(int n)
+{
+    uint8_t tmp[32];
+    while (n > 0) {
+        int got = uart_read_bytes(UART_NUM_0, tmp, n > (int)sizeof(tmp) ? sizeof(tmp) : (size_t)n, 0);
+        if (got <= 0) {
+            break;
         }
+        n -= got;
     }
-    free(line);
 }
+#endif
 
-// Minimal UART command parser task. Reads lines from UART0 and calls sensor handlers.
+/**
+ * @brief Lector de comandos por UART0
+ *
+ * Con CISTERNA_UART_RX_EVENTS la tarea duerme en la cola de eventos del
+ * driver y el hardware detecta el '\n' (UART_PATTERN_DET): se despierta con
+ * la línea ya completa en el buffer y la lee de una vez. Sin esa opción se
+ * usa el lector anterior, byte a byte con sondeo cada 10 ms.
+ */
 static void uart_command_task(void *arg)
 {
     (void)arg;
@@ -258,33 +818,96 @@ static void uart_command_task(void *arg)
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
     };
     uart_param_config(UART_NUM_0, &uart_config);
+#if CONFIG_CISTERNA_UART_RX_EVENTS
+    QueueHandle_t uart_queue = NULL;
+    uart_driver_install(UART_NUM_0, UART_RX_BUF_SIZE, 0, UART_EVT_QUEUE_LEN, &uart_queue, 0);
+    // Un solo carácter de patrón; los tiempos en ciclos de baud como en el ejemplo de IDF
+    uart_enable_pattern_det_baud_intr(UART_NUM_0, '\n', 1, 9, 0, 0);
+    uart_pattern_queue_reset(UART_NUM_0, UART_EVT_QUEUE_LEN);
+#else
     // RX buffer 256, no TX buffer
     uart_driver_install(UART_NUM_0, 256, 0, 0, NULL, 0);
+#endif
+#if CONFIG_CISTERNA_LIGHT_SLEEP
+    // Despertar del light sleep con actividad en RX (se pierden los primeros flancos)
+    uart_set_wakeup_threshold(UART_NUM_0, 3);
+    esp_sleep_enable_uart_wakeup(UART_NUM_0);
+#endif
 
-    char line[128];
+    char line[CMD_BUS_MAX_LINE + 2];    // + "\r\n"
+    int64_t first_us = 0;               // primer byte de la línea en curso
+#if CONFIG_CISTERNA_UART_RX_EVENTS
+    uart_event_t event;
+    while (1) {
+        if (xQueueReceive(uart_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        uart_rx_stats.wakeups++;
+        switch (event.type) {
+        case UART_DATA:
+            // Línea incompleta: queda en el buffer del driver hasta el '\n'
+            if (first_us == 0) {
+                first_us = esp_timer_get_time();
+            }
+            break;
+        case UART_PATTERN_DET: {
+            int pos = uart_pattern_pop_pos(UART_NUM_0);
+            if (pos < 0) {
+                // Cola de posiciones llena: no se sabe dónde termina cada línea
+                uart_flush_input(UART_NUM_0);
+                uart_rx_stats.dropped++;
+                first_us = 0;
+                break;
+            }
+            if (first_us == 0) {
+                first_us = esp_timer_get_time();
+            }
+            int n = pos + 1;    // incluye el '\n'
+            if (n > (int)sizeof(line)) {
+                ESP_LOGW(TAG, "⚠ Línea UART de %d bytes descartada (máx %d)", n, CMD_BUS_MAX_LINE);
+                uart_discard(n);
+                uart_rx_stats.dropped++;
+            } else {
+                int got = uart_read_bytes(UART_NUM_0, line, (uint32_t)n, pdMS_TO_TICKS(20));
+                if (got > 0) {
+                    uart_post_line(line, (size_t)got, first_us);
+                }
+            }
+            // Si ya hay más datos en el buffer, la próxima línea empezó antes de este evento
+            size_t pending = 0;
+            uart_get_buffered_data_len(UART_NUM_0, &pending);
+            first_us = pending ? esp_timer_get_time() : 0;
+            break;
+        }
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            ESP_LOGW(TAG, "⚠ Desborde de RX UART, entrada descartada");
+            uart_flush_input(UART_NUM_0);
+            xQueueReset(uart_queue);
+            uart_rx_stats.dropped++;
+            first_us = 0;
+            break;
+        default:
+            break;
+        }
+    }
+#else
     int idx = 0;
     while (1) {
         uint8_t ch;
         int len = uart_read_bytes(UART_NUM_0, &ch, 1, pdMS_TO_TICKS(100));
+        uart_rx_stats.wakeups++;
         if (len > 0) {
             if (ch == '\r' || ch == '\n') {
                 if (idx > 0) {
-                    line[idx] = '\0';
-                    ESP_LOGI(TAG, "UART CMD received: %s", line);
-                    if (strcasecmp(line, "calA") == 0) {
-                        sensor_do_calA();
-                    } else if (strcasecmp(line, "calB") == 0) {
-                        sensor_do_calB();
-                    } else if (strcasecmp(line, "save") == 0) {
-                        sensor_do_save();
-                    } else if (strcasecmp(line, "show") == 0) {
-                        sensor_do_show();
-                    } else {
-                        ESP_LOGI(TAG, "Unknown command: %s", line);
-                    }
+                    uart_post_line(line, (size_t)idx, first_us);
                     idx = 0;
+                    first_us = 0;
                 }
             } else {
+                if (idx == 0) {
+                    first_us = esp_timer_get_time();
+                }
                 if (idx < (int)sizeof(line) - 1) {
                     line[idx++] = (char)ch;
                 }
@@ -292,7 +915,78 @@ static void uart_command_task(void *arg)
         }
         vTaskDelay(pdMS_TO_TICKS(10));
     }
+#endif
+}
+
+#if CONFIG_CISTERNA_DIAG_PERIOD_S > 0
+// Niveles para el registro de diagnóstico que no son colas de FreeRTOS
+static void diag_cmd_level(uint32_t *used, uint32_t *capacity, void *ctx)
+{
+    cmd_bus_stats_t st;
+    cmd_bus_get_stats(&st);
+    *used = st.queue_depth;
+    *capacity = CMD_BUS_QUEUE_LEN;
+}
+
+static void diag_outbox_level(uint32_t *used, uint32_t *capacity, void *ctx)
+{
+    mqtt_outbox_stats_t ob;
+    mqtt_get_outbox_stats(&ob);
+    *used = ob.bytes;
+    *capacity = ob.cap_bytes;
+}
+
+#if CONFIG_CISTERNA_STORE_FORWARD
+static void diag_sf_level(uint32_t *used, uint32_t *capacity, void *ctx)
+{
+    storage_ring_stats_t sf;
+    storage_ring_get_stats(&sf);
+    *used = sf.pending;
+    *capacity = sf.capacity;
+}
+#endif
+
+// Percentiles de latencia por período: cada registro reinicia los histogramas
+static int diag_lat_section(char *buf, size_t len, void *ctx)
+{
+    return lat_hist_encode_json(buf, len, true);
+}
+
+/**
+ * @brief Registra las tareas y colas que aparecen en cistern/diag
+ */
+static void diagnostics_init(void)
+{
+    // Sin CONFIG_FREERTOS_USE_TRACE_FACILITY solo se informan estas tareas (pila libre)
+    static const char *const watched[] = { "sensor_task", "sensor_read_task", "uart_cmd", "cmd_bus", "tlm_replay" };
+    for (size_t i = 0; i < sizeof(watched) / sizeof(watched[0]); i++) {
+        diag_watch_task(watched[i]);
+    }
+    diag_watch_level("cmd", diag_cmd_level, NULL);
+    diag_watch_level("outbox_b", diag_outbox_level, NULL);
+    diag_add_section("lat", diag_lat_section, NULL);
+#if CONFIG_CISTERNA_STORE_FORWARD
+    diag_watch_level("sf", diag_sf_level, NULL);
+#endif
+}
+
+/**
+ * @brief Publica un registro de diagnóstico (QoS 0, sin retener)
+ */
+static void diagnostics_publish(void)
+{
+    static char json[1024];
+    int len = diag_encode_json(json, sizeof(json));
+    if (len < 0) {
+        ESP_LOGW(TAG, "⚠ Registro de diagnóstico demasiado grande, omitido");
+        return;
+    }
+    ESP_LOGD(TAG, "  Diag: %s", json);
+    if (mqtt_is_connected(mqtt_client)) {
+        mqtt_publish_class(mqtt_client, TOPIC_DIAG, json, len, 0, false, MQTT_MSG_STATE);
+    }
 }
+#endif
 
 /**
  * @brief Función principal de la aplicación
@@ -315,71 +1009,86 @@ void app_main(void)
     // 1. Inicializar NVS
     ESP_LOGI(TAG, "→ Inicializando NVS Flash...");
     nvs_init();
-    
-    // 2. Inicializar Wi-Fi
-    ESP_LOGI(TAG, "→ Inicializando Wi-Fi...");
-    // Configurar con credenciales (cambiar según red local)
-    esp_err_t wifi_err = wifi_init(WIFI_SSID, WIFI_PASSWORD);
-    if (wifi_err != ESP_OK) {
-        ESP_LOGE(TAG, "✗ Error al inicializar Wi-Fi: %s", esp_err_to_name(wifi_err));
-        // Continuar de todas formas para permitir debugging
-    }
-    
-    // Esperar a que se conecte a Wi-Fi (máximo 10 segundos)
-    uint32_t wifi_timeout = 30000; // 30 seconds timeout for Wi-Fi to obtain IP
-    uint32_t start_time = esp_log_timestamp();
-    while (!wifi_is_connected() && (esp_log_timestamp() - start_time) < wifi_timeout) {
-        vTaskDelay(pdMS_TO_TICKS(100));
-    }
-    
-    if (wifi_is_connected()) {
-        ESP_LOGI(TAG, "✓ Conectado a Wi-Fi");
-    } else {
-        ESP_LOGW(TAG, "✗ No se pudo conectar a Wi-Fi en 10 segundos");
-    }
-    
-    // 3. Inicializar MQTT
-    ESP_LOGI(TAG, "→ Inicializando MQTT...");
-    mqtt_config_t mqtt_cfg = {
+    boot_mark(BOOT_STAGE_NVS);
+
+#if CONFIG_CISTERNA_DEEP_SLEEP
+    // Modo a batería: leer, guardar, quizá subir, dormir (no retorna)
+    const duty_cycle_config_t ds_cfg = {
+        .ssid = WIFI_SSID,
+        .password = WIFI_PASSWORD,
         .broker_uri = MQTT_BROKER_URI,
         .client_id = "esp32c6_cisterna",
-        .username = "",  // Opcional
-        .password = ""   // Opcional
+        .ultrasonic_trig_pin = GPIO_NUM_10,
+        .ultrasonic_echo_pin = GPIO_NUM_11,
+        .tds_adc_pin = 0,
     };
-    
-    mqtt_client = mqtt_init(&mqtt_cfg, mqtt_event_handler);
-    if (mqtt_client == NULL) {
-        ESP_LOGE(TAG, "✗ Error al inicializar cliente MQTT");
-        // Continuar para permitir operación offline
-    } else {
-        mqtt_connect(mqtt_client);
-        // Suscribirse al topico de control de bomba (sera procesado en mqtt_event_handler)
-        mqtt_subscribe(mqtt_client, "cistern_control", 1);
-        ESP_LOGI(TAG, "-> Suscrito a topico 'cistern_control' para recibir comandos desde Node-RED");
-        // Publish initial retained state so Node-RED knows current state and mode
-        const char *initial_pump_state = tasks_get_pump_relay_state() ? "ON" : "OFF";
-        mqtt_publish(mqtt_client, "cistern/pump_state", initial_pump_state, strlen(initial_pump_state), 1, true);
-        // Mode topic removed; only pump_state retained publish is provided
+    duty_cycle_run(&ds_cfg);
+#endif
+
+#if CONFIG_CISTERNA_POWER_SAVE
+    // DFS + light sleep; los drivers retienen locks solo mientras miden
+    const power_config_t pm_cfg = {
+        .max_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_mhz = CONFIG_CISTERNA_PM_MIN_MHZ,
+#if CONFIG_CISTERNA_LIGHT_SLEEP
+        .light_sleep = true,
+#endif
+    };
+    power_init(&pm_cfg);
+#endif
+
+#if CONFIG_CISTERNA_STORE_FORWARD
+    // Anillo de muestras sin conexión (puede traer pendientes de antes del reinicio)
+    if (storage_ring_init(CONFIG_CISTERNA_SF_PARTITION) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠ Sin almacenamiento de muestras sin conexión");
     }
-    
-    // 4. Inicializar sensores y tareas
+#endif
+    boot_mark(BOOT_STAGE_STORAGE);
+
+    // 2. Inicializar sensores y tareas (antes que la red: el muestreo no espera a Wi-Fi)
     ESP_LOGI(TAG, "→ Inicializando sensores y tareas FreeRTOS...");
     task_config_t task_cfg = {
-        .sampling_interval_ms = 1000,        // 1 segundo
         .ultrasonic_trig_pin = GPIO_NUM_10,  // Pin TRIG del sensor ultrasónico
         .ultrasonic_echo_pin = GPIO_NUM_11,   // Pin ECHO del sensor ultrasónico
         .tds_adc_pin = 0,                    // Canal ADC 0 del sensor TDS
-        .pump_relay_pin = GPIO_NUM_1         // Pin del relé de la bomba
+        .pump_relay_pin = GPIO_NUM_1,        // Pin del relé de la bomba
         // (botón deshabilitado) 
+#if CONFIG_CISTERNA_PUMP_LOCAL_CONTROL
+        .pump_ctrl_enable = true,
+        .pump_ctrl = {
+            .low_cm = CONFIG_CISTERNA_WATER_LEVEL_LOW_THRESHOLD,
+            .high_cm = CONFIG_CISTERNA_WATER_LEVEL_HIGH_THRESHOLD,
+            .min_on_ms = CONFIG_CISTERNA_PUMP_MIN_ON_S * 1000u,
+            .min_off_ms = CONFIG_CISTERNA_PUMP_MIN_OFF_S * 1000u,
+            .override_ms = CONFIG_CISTERNA_PUMP_OVERRIDE_S * 1000u,
+            .max_missed = CONFIG_CISTERNA_PUMP_MAX_MISSED,
+        },
+#endif
+#if CONFIG_CISTERNA_SAMPLE_ADAPTIVE
+        .adaptive_sampling = true,
+        .sampling = {
+            .min_ms = CONFIG_CISTERNA_SAMPLE_MIN_MS,
+            .max_ms = CONFIG_CISTERNA_SAMPLE_MAX_MS,
+            .hold_ms = CONFIG_CISTERNA_SAMPLE_HOLD_S * 1000u,
+            .grow_pct = CONFIG_CISTERNA_SAMPLE_GROW_PCT,
+            .step_cm = CONFIG_CISTERNA_SAMPLE_STEP_MM / 10.0f,
+        },
+#else
+        .sampling_interval_ms = CONFIG_CISTERNA_SAMPLE_PERIOD_MS,
+#endif
     };
     
+    // Antes de tasks_init(): la primera muestra ya puede producir una decisión
+    extern void pump_ctrl_report_cb(const pump_ctrl_decision_t *decision, float level_cm);
+    tasks_register_pump_ctrl_cb(pump_ctrl_report_cb);
+
     esp_err_t tasks_err = tasks_init(&task_cfg);
     if (tasks_err != ESP_OK) {
         ESP_LOGE(TAG, "✗ Error al inicializar tareas: %s", esp_err_to_name(tasks_err));
         return;
     }
     
-    // 5. Crear tarea de lectura y publicación
+    // 3. Crear tarea de lectura y publicación
     // Increase stack for sensor task to reduce risk of stack overflow (allocations done on heap)
     xTaskCreate(sensor_read_and_publish_task, 
                 "sensor_task", 
@@ -388,15 +1097,21 @@ void app_main(void)
                 3,                         // Prioridad (más alta)
                 NULL);                     // Handle
 
+#if CONFIG_CISTERNA_STORE_FORWARD
+    xTaskCreate(telemetry_replay_task, "tlm_replay", 4096, NULL, 2, NULL);
+#endif
+
     // Registrar callback para publicar el estado de la bomba cuando cambie
     extern void pump_state_change_cb(bool state);
     tasks_register_pump_state_cb(pump_state_change_cb);
 
-    // Start minimal UART command task (reads lines and triggers sensor commands)
+    // Comandos por UART (y MQTT, una vez conectado) sobre un único bus
+    commands_init();
     xTaskCreate(uart_command_task, "uart_cmd", 3072, NULL, 2, NULL);
+    boot_mark(BOOT_STAGE_SENSORS);
 
-    // Start console REPL task (optional interactive console)
-    xTaskCreate(console_repl_task, "console", 4096, NULL, 1, NULL);
+    // 4. Wi-Fi y MQTT en segundo plano (las muestras se guardan hasta que haya conexión)
+    xTaskCreate(network_start_task, "net_start", 4096, NULL, 4, &network_task_handle);
     
     ESP_LOGI(TAG, "\n✓ INICIALIZACIÓN COMPLETADA");
     ESP_LOGI(TAG, "El sistema está en funcionamiento...\n");
@@ -405,7 +1120,15 @@ void app_main(void)
     // El sistema continúa funcionando a través de tareas FreeRTOS
     // Esta función puede monitorear memoria o ejecutar otras funciones
     
+#if CONFIG_CISTERNA_DIAG_PERIOD_S > 0
+    diagnostics_init();
+    // El bucle corre cada 10 s: el período se redondea a múltiplos de 10 s
+    const uint32_t diag_every = CONFIG_CISTERNA_DIAG_PERIOD_S < 10 ? 1 : CONFIG_CISTERNA_DIAG_PERIOD_S / 10;
+#endif
+
     TickType_t xLastWakeTime = xTaskGetTickCount();
+    uint32_t status_count = 0;
+    bool boot_timing_logged = false;
     while (1) {
         // Mostrar información cada 10 segundos
         vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(10000));
@@ -414,11 +1137,57 @@ void app_main(void)
                  wifi_is_connected() ? "✓" : "✗",
                  mqtt_is_connected(mqtt_client) ? "✓" : "✗",
                  tasks_get_pump_relay_state() ? "ON" : "OFF");
+
+        // Tiempos de arranque (una vez): comparar conexión rápida vs. escaneo completo
+        if (!boot_timing_logged && mqtt_first_publish_us() != 0) {
+            bool fast = false;
+            int64_t ip_us = wifi_connected_at_us(&fast);
+            ESP_LOGI(TAG, "  Arranque: IP a los %" PRId64 " ms (%s) | primer publish a los %" PRId64 " ms",
+                     ip_us / 1000, fast ? "rápida" : "completa", mqtt_first_publish_us() / 1000);
+            boot_timing_logged = true;
+        }
         
         // Información de memoria
         uint32_t free_heap = esp_get_free_heap_size();
         uint32_t min_free_heap = esp_get_minimum_free_heap_size();
         ESP_LOGD(TAG, "  Memoria: Libre=%" PRIu32 " B | Mínima=%" PRIu32 " B", free_heap, min_free_heap);
+#if CONFIG_CISTERNA_DEADBAND_ENABLE
+        ESP_LOGI(TAG, "  Telemetría: enviadas=%" PRIu32 " | suprimidas=%" PRIu32,
+                 g_deadband.sent, g_deadband.suppressed);
+#endif
+#if CONFIG_CISTERNA_STORE_FORWARD
+        storage_ring_stats_t sf;
+        storage_ring_get_stats(&sf);
+        if (sf.pending || sf.dropped) {
+            ESP_LOGI(TAG, "  Sin conexión: pendientes=%" PRIu32 " | descartadas=%" PRIu32 " | capacidad≈%" PRIu32,
+                     sf.pending, sf.dropped, sf.capacity);
+        }
+#endif
+        mqtt_outbox_stats_t ob;
+        mqtt_get_outbox_stats(&ob);
+        if (ob.depth || ob.dropped || ob.expired) {
+            ESP_LOGI(TAG, "  Outbox MQTT: %" PRIu32 " msj / %" PRIu32 " de %" PRIu32 " B | descartados=%" PRIu32
+                     " | reintentados=%" PRIu32 " | expirados=%" PRIu32,
+                     ob.depth, ob.bytes, ob.cap_bytes, ob.dropped, ob.retried, ob.expired);
+        }
+        // Ciclo de trabajo de los locks de energía (tiempo en que el nodo no pudo dormir)
+        if (++status_count % 6 == 0) {
+            power_report();
+
+            // Recepción UART del último minuto: despertares en reposo y latencia por línea
+            static uint32_t last_wakeups;
+            uint32_t wakeups = uart_rx_stats.wakeups;
+            ESP_LOGI(TAG, "  UART: %" PRIu32 " despertares/min | líneas=%" PRIu32 " | perdidas=%" PRIu32
+                     " | latencia línea última=%" PRIu32 " µs máx=%" PRIu32 " µs",
+                     wakeups - last_wakeups, uart_rx_stats.lines, uart_rx_stats.dropped,
+                     uart_rx_stats.last_line_us, uart_rx_stats.max_line_us);
+            last_wakeups = wakeups;
+        }
+#if CONFIG_CISTERNA_DIAG_PERIOD_S > 0
+        if (status_count % diag_every == 0) {
+            diagnostics_publish();
+        }
+#endif
     }
 }
 
@@ -430,7 +1199,38 @@ void pump_state_change_cb(bool state)
     ESP_LOGI(TAG, "Callback: pump_state changed -> %s", state ? "ON" : "OFF");
     if (mqtt_is_connected(mqtt_client)) {
         const char *pump_state_str = state ? "ON" : "OFF";
-        mqtt_publish(mqtt_client, "cistern/pump_state", pump_state_str, strlen(pump_state_str), 1, true);
+        mqtt_publish_class(mqtt_client, TOPIC_PUMP_STATE, pump_state_str, strlen(pump_state_str), CONFIG_CISTERNA_PUMP_STATE_QOS, true, MQTT_MSG_STATE);
+#if TELEMETRY_BATCHED && CONFIG_CISTERNA_TELEMETRY_CBOR
+        // Evento de bomba en el flujo binario, para consumidores que solo leen ese tópico
+        uint8_t bin[TELEMETRY_CBOR_MAX_LEN];
+        int len = telemetry_encode_pump_cbor(state, (uint32_t)(esp_timer_get_time() / 1000000), bin, sizeof(bin));
+        if (len > 0) {
+            mqtt_publish(mqtt_client, CONFIG_CISTERNA_TELEMETRY_TOPIC, (const char *)bin, len,
+                         CONFIG_CISTERNA_TELEMETRY_QOS, false);
+        }
+#endif
+    }
+}
+
+/**
+ * @brief Callback de decisiones del control local: log y publicación en cistern/pump_ctrl
+ *
+ * {"action":"switch","on":true,"why":"low","level":18.4,"wait_ms":0}
+ */
+void pump_ctrl_report_cb(const pump_ctrl_decision_t *decision, float level_cm)
+{
+    ESP_LOGI(TAG, "→ Control de bomba: %s %s %s (nivel %.1f cm, espera %" PRIu32 " ms)",
+             pump_ctrl_action_name(decision->action), decision->on ? "ON" : "OFF",
+             pump_ctrl_reason_name(decision->reason), level_cm, decision->wait_ms);
+    if (mqtt_is_connected(mqtt_client)) {
+        char json[112];
+        int len = snprintf(json, sizeof(json),
+                           "{\"action\":\"%s\",\"on\":%s,\"why\":\"%s\",\"level\":%.1f,\"wait_ms\":%" PRIu32 "}",
+                           pump_ctrl_action_name(decision->action), decision->on ? "true" : "false",
+                           pump_ctrl_reason_name(decision->reason), level_cm, decision->wait_ms);
+        if (len > 0 && len < (int)sizeof(json)) {
+            mqtt_publish_class(mqtt_client, TOPIC_PUMP_CTRL, json, (size_t)len, 1, false, MQTT_MSG_STATE);
+        }
     }
 }
 
@@ -0,0 +1,288 @@
+#include "cmd_bus.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "cmd_bus";
+
+typedef struct {
+    uint8_t src;
+    uint8_t len;
+    uint32_t tag;
+    int64_t posted_us;
+    char line[CMD_BUS_MAX_LINE + 1];
+} cmd_msg_t;
+
+typedef struct {
+    cmd_reply_fn fn;
+    void *ctx;
+} reply_route_t;
+
+static const cmd_def_t *s_tables[CMD_BUS_MAX_TABLES];
+static size_t s_table_len[CMD_BUS_MAX_TABLES];
+static size_t s_table_count;
+static reply_route_t s_reply[CMD_SRC_COUNT];
+static QueueHandle_t s_queue;
+static cmd_bus_stats_t s_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_current_posted_us;    // line being executed (worker only)
+static char s_current_id[CMD_BUS_MAX_ID + 1];
+
+static const char *const s_source_names[CMD_SRC_COUNT] = { "uart", "console", "mqtt" };
+
+const char *cmd_bus_source_name(cmd_source_t src)
+{
+    return src < CMD_SRC_COUNT ? s_source_names[src] : "?";
+}
+
+esp_err_t cmd_bus_register(const cmd_def_t *table, size_t count)
+{
+    if (!table || count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_queue || s_table_count >= CMD_BUS_MAX_TABLES) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_tables[s_table_count] = table;
+    s_table_len[s_table_count] = count;
+    s_table_count++;
+    return ESP_OK;
+}
+
+void cmd_bus_set_reply(cmd_source_t src, cmd_reply_fn fn, void *ctx)
+{
+    if (src < CMD_SRC_COUNT) {
+        s_reply[src].ctx = ctx;
+        s_reply[src].fn = fn;
+    }
+}
+
+static const cmd_def_t *lookup(const char *name)
+{
+    for (size_t t = 0; t < s_table_count; t++) {
+        for (size_t i = 0; i < s_table_len[t]; i++) {
+            if (strcasecmp(s_tables[t][i].name, name) == 0) {
+                return &s_tables[t][i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static int cmd_help(char *reply, size_t reply_len)
+{
+    size_t n = (size_t)snprintf(reply, reply_len, "commands: help");
+    for (size_t t = 0; t < s_table_count && n < reply_len; t++) {
+        for (size_t i = 0; i < s_table_len[t] && n < reply_len; i++) {
+            n += (size_t)snprintf(reply + n, reply_len - n, " %s", s_tables[t][i].name);
+        }
+    }
+    return 0;
+}
+
+/* Split on spaces/tabs in place; words past CMD_BUS_MAX_ARGS are dropped */
+static int tokenize(char *line, char **argv)
+{
+    int argc = 0;
+    char *p = line;
+    while (*p && argc < CMD_BUS_MAX_ARGS) {
+        while (*p == ' ' || *p == '\t') {
+            *p++ = '\0';
+        }
+        if (!*p) {
+            break;
+        }
+        argv[argc++] = p;
+        while (*p && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        if (*p) {
+            *p++ = '\0';
+        }
+    }
+    return argc;
+}
+
+/*
+ * Optional trailing "#<id>" word after the command: cut from the line and
+ * kept for cmd_bus_current_id(). Done before tokenize() so the ID survives
+ * lines with more than CMD_BUS_MAX_ARGS words.
+ */
+static void take_id(char *line)
+{
+    size_t end = strlen(line);
+    s_current_id[0] = '\0';
+    while (end > 0 && (line[end - 1] == ' ' || line[end - 1] == '\t')) {
+        end--;
+    }
+    size_t start = end;
+    while (start > 0 && line[start - 1] != ' ' && line[start - 1] != '\t') {
+        start--;
+    }
+    if (line[start] != '#' || end - start < 2 || strspn(line, " \t") >= start) {
+        return;     // not an ID, or nothing but the ID on the line
+    }
+    size_t k = 0;
+    for (const char *id = line + start + 1; k < end - start - 1 && k < CMD_BUS_MAX_ID; k++) {
+        // The ID is echoed inside JSON strings: no quotes or control characters
+        s_current_id[k] = (id[k] == '"' || id[k] == '\\' || (unsigned char)id[k] < 0x20) ? '_' : id[k];
+    }
+    s_current_id[k] = '\0';
+    line[start] = '\0';
+}
+
+static void execute(cmd_msg_t *msg)
+{
+    char reply[CMD_BUS_MAX_REPLY];
+    char *argv[CMD_BUS_MAX_ARGS];
+    int status;
+    reply[0] = '\0';
+
+    take_id(msg->line);
+    int argc = tokenize(msg->line, argv);
+    if (argc == 0) {
+        return;
+    }
+
+    const cmd_def_t *cmd = lookup(argv[0]);
+    s_current_posted_us = msg->posted_us;
+    if (cmd) {
+        status = cmd->fn(argc, argv, reply, sizeof(reply));
+    } else if (strcasecmp(argv[0], "help") == 0) {
+        status = cmd_help(reply, sizeof(reply));
+    } else {
+        snprintf(reply, sizeof(reply), "unknown command '%s' (try help)", argv[0]);
+        status = -1;
+    }
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - msg->posted_us);
+    portENTER_CRITICAL(&s_stats_mux);
+    if (cmd || status == 0) {
+        s_stats.executed++;
+        s_stats.failed += status != 0;
+        s_stats.last_us = us;
+        s_stats.total_us += us;
+        if (us > s_stats.max_us) {
+            s_stats.max_us = us;
+        }
+    } else {
+        s_stats.unknown++;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    ESP_LOGI(TAG, "%s '%s'%s%s -> %d in %" PRIu32 " us: %s", cmd_bus_source_name(msg->src), argv[0],
+             s_current_id[0] ? " #" : "", s_current_id, status, us, reply);
+
+    const reply_route_t *route = &s_reply[msg->src];
+    if (route->fn) {
+        route->fn(msg->tag, status, reply, route->ctx);
+    }
+}
+
+static void cmd_bus_task(void *arg)
+{
+    (void)arg;
+    cmd_msg_t msg;
+    while (true) {
+        if (xQueueReceive(s_queue, &msg, portMAX_DELAY) == pdTRUE) {
+            execute(&msg);
+        }
+    }
+}
+
+esp_err_t cmd_bus_start(UBaseType_t priority)
+{
+    if (s_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_queue = xQueueCreate(CMD_BUS_QUEUE_LEN, sizeof(cmd_msg_t));
+    if (!s_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(cmd_bus_task, "cmd_bus", CMD_BUS_STACK, NULL, priority, NULL) != pdPASS) {
+        vQueueDelete(s_queue);
+        s_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t cmd_bus_post(cmd_source_t src, uint32_t tag, const char *line, size_t len)
+{
+    if (!s_queue || src >= CMD_SRC_COUNT) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        len--;
+    }
+    esp_err_t err = ESP_OK;
+    if (len == 0 || len > CMD_BUS_MAX_LINE) {
+        err = ESP_ERR_INVALID_SIZE;
+    } else {
+        cmd_msg_t msg = {
+            .src = (uint8_t)src,
+            .len = (uint8_t)len,
+            .tag = tag,
+            .posted_us = esp_timer_get_time(),
+        };
+        memcpy(msg.line, line, len);
+        msg.line[len] = '\0';
+        if (xQueueSend(s_queue, &msg, 0) != pdTRUE) {
+            err = ESP_ERR_TIMEOUT;
+        }
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    if (err == ESP_OK) {
+        s_stats.posted++;
+    } else if (len > 0) {
+        s_stats.rejected++;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+    return err;
+}
+
+int64_t cmd_bus_current_posted_us(void)
+{
+    return s_current_posted_us;
+}
+
+const char *cmd_bus_current_id(void)
+{
+    return s_current_id;
+}
+
+int cmd_bus_format_ack(char *buf, size_t len, int status, const char *reply)
+{
+    size_t pos = 0;
+    int n = snprintf(buf, len, "{\"id\":\"%s\",\"ok\":%s,\"reply\":\"", s_current_id,
+                     status == 0 ? "true" : "false");
+    if (n < 0 || (size_t)n >= len) {
+        return -1;
+    }
+    pos = (size_t)n;
+    // Replies are plain text; keep the JSON valid without a full escaper
+    for (const char *p = reply; *p && pos + 1 < len; p++) {
+        buf[pos++] = (*p == '"' || *p == '\\' || (unsigned char)*p < 0x20) ? '\'' : *p;
+    }
+    n = snprintf(buf + pos, len - pos, "\",\"rx_us\":%" PRId64 ",\"act_us\":%" PRId64 "}",
+                 s_current_posted_us, esp_timer_get_time());
+    if (n < 0 || (size_t)n >= len - pos) {
+        return -1;
+    }
+    return (int)(pos + (size_t)n);
+}
+
+void cmd_bus_get_stats(cmd_bus_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_mux);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+    stats->queue_depth = s_queue ? (uint8_t)uxQueueMessagesWaiting(s_queue) : 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Command bus: one parsing and execution path for every command source.
+ *
+ * Transports (UART, stdin console, MQTT) post raw text lines into a single
+ * bounded queue. One worker task tokenizes each line, looks the first word
+ * up in the registered command tables (case-insensitive) and runs the
+ * handler. The handler's reply text goes back to the transport the line
+ * came from, through the reply callback registered for that source, along
+ * with the tag the transport passed when posting (e.g. which MQTT topic to
+ * answer on).
+ *
+ * A line may end with "#<id>" (e.g. "pump on #42"): the token is not passed
+ * to the handler; it is kept as the correlation ID of that command so reply
+ * callbacks can echo it (cmd_bus_current_id(), cmd_bus_format_ack()).
+ *
+ * Posting never blocks and never allocates: a full queue rejects the line.
+ * Latency from post to reply is measured for every command.
+ */
+
+#define CMD_BUS_MAX_LINE    64      // bytes per line, without terminator
+#define CMD_BUS_MAX_ARGS    6       // argv entries, command name included; extra words are dropped
+#define CMD_BUS_MAX_REPLY   256
+#define CMD_BUS_MAX_TABLES  4
+#define CMD_BUS_MAX_ID      24      // correlation ID characters kept
+#define CMD_BUS_QUEUE_LEN   8
+#define CMD_BUS_STACK       4096
+
+typedef enum {
+    CMD_SRC_UART = 0,
+    CMD_SRC_CONSOLE,
+    CMD_SRC_MQTT,
+    CMD_SRC_COUNT,
+} cmd_source_t;
+
+/**
+ * Command handler. argv[0] is the command name. Write a one-line reply
+ * (may be left empty) and return 0 on success, non-zero on failure.
+ */
+typedef int (*cmd_fn_t)(int argc, char **argv, char *reply, size_t reply_len);
+
+typedef struct {
+    const char *name;
+    const char *help;       // shown by the built-in "help" command
+    cmd_fn_t fn;
+} cmd_def_t;
+
+/** Called from the worker with the reply of a command posted by this source. */
+typedef void (*cmd_reply_fn)(uint32_t tag, int status, const char *reply, void *ctx);
+
+typedef struct {
+    uint32_t posted;        // lines accepted into the queue
+    uint32_t rejected;      // queue full or line too long
+    uint32_t executed;      // handlers run
+    uint32_t failed;        // handlers that returned non-zero
+    uint32_t unknown;       // first word not in any table
+    uint32_t last_us;       // post -> reply of the last command
+    uint32_t max_us;
+    uint64_t total_us;      // sum over executed commands (mean = total / executed)
+    uint8_t queue_depth;    // lines waiting right now
+} cmd_bus_stats_t;
+
+/** Add a command table (kept by pointer). Call before cmd_bus_start(). */
+esp_err_t cmd_bus_register(const cmd_def_t *table, size_t count);
+
+/** Route replies for lines posted by src. fn may be NULL to drop them. */
+void cmd_bus_set_reply(cmd_source_t src, cmd_reply_fn fn, void *ctx);
+
+/** Create the queue and the worker task. */
+esp_err_t cmd_bus_start(UBaseType_t priority);
+
+/**
+ * Queue one command line (copied; trailing CR/LF ignored). Safe from any
+ * task, including the MQTT event handler; not from an ISR.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before start, ESP_ERR_INVALID_SIZE
+ *         for an empty or too long line, ESP_ERR_TIMEOUT if the queue is full
+ */
+esp_err_t cmd_bus_post(cmd_source_t src, uint32_t tag, const char *line, size_t len);
+
+/**
+ * esp_timer time at which the command being executed was posted. Only
+ * meaningful inside a handler; lets it measure arrival-to-action latency.
+ */
+int64_t cmd_bus_current_posted_us(void);
+
+/** Correlation ID of the command being executed ("" if none). Worker only. */
+const char *cmd_bus_current_id(void);
+
+/**
+ * Acknowledgement for the command being executed, for reply callbacks:
+ * {"id":"42","ok":true,"reply":"ON","rx_us":..,"act_us":..}, where rx_us
+ * is the post time and act_us now (esp_timer, us since boot).
+ * @return bytes written, or -1 if buf is too small
+ */
+int cmd_bus_format_ack(char *buf, size_t len, int status, const char *reply);
+
+void cmd_bus_get_stats(cmd_bus_stats_t *stats);
+
+const char *cmd_bus_source_name(cmd_source_t src);
@@ -0,0 +1,223 @@
+#include "diag.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#ifdef configRUN_TIME_COUNTER_TYPE
+typedef configRUN_TIME_COUNTER_TYPE diag_rt_t;
+#else
+typedef uint32_t diag_rt_t;
+#endif
+
+typedef struct {
+    const char *name;
+    QueueHandle_t queue;
+    diag_level_fn fn;
+    void *ctx;
+} diag_level_t;
+
+static diag_level_t s_levels[DIAG_MAX_LEVELS];
+static size_t s_level_count;
+static const char *s_watch[DIAG_MAX_WATCH];
+static size_t s_watch_count;
+static struct {
+    const char *name;
+    diag_section_fn fn;
+    void *ctx;
+} s_sections[DIAG_MAX_SECTIONS];
+static size_t s_section_count;
+
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t s_status[DIAG_MAX_TASKS];
+#if configGENERATE_RUN_TIME_STATS
+// Run-time counters of the previous snapshot, matched by task handle
+static struct {
+    TaskHandle_t handle;
+    diag_rt_t run_time;
+} s_prev[DIAG_MAX_TASKS];
+static size_t s_prev_count;
+static diag_rt_t s_prev_total;
+#endif
+#endif
+
+esp_err_t diag_watch_queue(const char *name, QueueHandle_t queue)
+{
+    if (!name || !queue) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_level_count >= DIAG_MAX_LEVELS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_levels[s_level_count++] = (diag_level_t){ .name = name, .queue = queue };
+    return ESP_OK;
+}
+
+esp_err_t diag_watch_level(const char *name, diag_level_fn fn, void *ctx)
+{
+    if (!name || !fn) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_level_count >= DIAG_MAX_LEVELS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_levels[s_level_count++] = (diag_level_t){ .name = name, .fn = fn, .ctx = ctx };
+    return ESP_OK;
+}
+
+esp_err_t diag_watch_task(const char *name)
+{
+    if (!name) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_watch_count >= DIAG_MAX_WATCH) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_watch[s_watch_count++] = name;
+    return ESP_OK;
+}
+
+esp_err_t diag_add_section(const char *name, diag_section_fn fn, void *ctx)
+{
+    if (!name || !fn) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_section_count >= DIAG_MAX_SECTIONS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_sections[s_section_count].name = name;
+    s_sections[s_section_count].fn = fn;
+    s_sections[s_section_count].ctx = ctx;
+    s_section_count++;
+    return ESP_OK;
+}
+
+/* snprintf that tracks the position and reports overflow once */
+static bool put(char *buf, size_t len, size_t *pos, const char *fmt, ...)
+{
+    if (*pos >= len) {
+        return false;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *pos, len - *pos, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= len - *pos) {
+        *pos = len;
+        return false;
+    }
+    *pos += (size_t)n;
+    return true;
+}
+
+#if configUSE_TRACE_FACILITY
+static bool put_tasks(char *buf, size_t len, size_t *pos)
+{
+    diag_rt_t total = 0;
+    UBaseType_t count = 0;
+    if (uxTaskGetNumberOfTasks() <= DIAG_MAX_TASKS) {
+        count = uxTaskGetSystemState(s_status, DIAG_MAX_TASKS, &total);
+    }
+
+#if configGENERATE_RUN_TIME_STATS
+    // Run time accumulates per core, so the capacity is elapsed time x cores.
+    // The first snapshot covers the time since boot.
+    uint64_t window = (uint64_t)(diag_rt_t)(total - s_prev_total) * portNUM_PROCESSORS;
+    bool have_window = window > 0;
+#endif
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *t = &s_status[i];
+        int32_t permille = -1;
+#if configGENERATE_RUN_TIME_STATS
+        if (have_window) {
+            diag_rt_t prev = 0;
+            for (size_t k = 0; k < s_prev_count; k++) {
+                if (s_prev[k].handle == t->xHandle) {
+                    prev = s_prev[k].run_time;
+                    break;
+                }
+            }
+            permille = (int32_t)((uint64_t)(diag_rt_t)(t->ulRunTimeCounter - prev) * 1000 / window);
+        }
+#endif
+        if (!put(buf, len, pos, "%s\"%s\":[%" PRId32 ",%" PRIu32 "]", i ? "," : "",
+                 t->pcTaskName, permille, (uint32_t)t->usStackHighWaterMark)) {
+            return false;
+        }
+    }
+
+#if configGENERATE_RUN_TIME_STATS
+    for (UBaseType_t i = 0; i < count; i++) {
+        s_prev[i].handle = s_status[i].xHandle;
+        s_prev[i].run_time = s_status[i].ulRunTimeCounter;
+    }
+    s_prev_count = count;
+    s_prev_total = total;
+#endif
+    return true;
+}
+#else
+static bool put_tasks(char *buf, size_t len, size_t *pos)
+{
+    bool first = true;
+    for (size_t i = 0; i < s_watch_count; i++) {
+        TaskHandle_t h = xTaskGetHandle(s_watch[i]);
+        if (!h) {
+            continue;
+        }
+        if (!put(buf, len, pos, "%s\"%s\":[-1,%" PRIu32 "]", first ? "" : ",",
+                 s_watch[i], (uint32_t)uxTaskGetStackHighWaterMark(h))) {
+            return false;
+        }
+        first = false;
+    }
+    return true;
+}
+#endif
+
+int diag_encode_json(char *buf, size_t len)
+{
+    size_t pos = 0;
+
+    put(buf, len, &pos, "{\"up\":%" PRIu32 ",\"heap\":[%" PRIu32 ",%" PRIu32 ",%u],\"tasks\":{",
+        (uint32_t)(esp_timer_get_time() / 1000000), esp_get_free_heap_size(),
+        esp_get_minimum_free_heap_size(), (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    put_tasks(buf, len, &pos);
+    put(buf, len, &pos, "},\"q\":{");
+
+    for (size_t i = 0; i < s_level_count; i++) {
+        const diag_level_t *l = &s_levels[i];
+        uint32_t used = 0, cap = 0;
+        if (l->queue) {
+            used = (uint32_t)uxQueueMessagesWaiting(l->queue);
+            cap = used + (uint32_t)uxQueueSpacesAvailable(l->queue);
+        } else {
+            l->fn(&used, &cap, l->ctx);
+        }
+        put(buf, len, &pos, "%s\"%s\":[%" PRIu32 ",%" PRIu32 "]", i ? "," : "", l->name, used, cap);
+    }
+
+    put(buf, len, &pos, "}");
+
+    for (size_t i = 0; i < s_section_count; i++) {
+        if (!put(buf, len, &pos, ",\"%s\":", s_sections[i].name)) {
+            break;
+        }
+        int n = s_sections[i].fn(buf + pos, len - pos, s_sections[i].ctx);
+        if (n < 0 || (size_t)n >= len - pos) {
+            return -1;
+        }
+        pos += (size_t)n;
+    }
+
+    if (!put(buf, len, &pos, "}")) {
+        return -1;
+    }
+    return (int)pos;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/*
+ * Runtime diagnostics record.
+ *
+ * diag_encode_json() takes one snapshot and writes a compact JSON document:
+ *
+ *   {"up":3600,"heap":[free,min_free,largest_block],
+ *    "tasks":{"sensor_task":[cpu_permille,stack_free_bytes],...},
+ *    "q":{"cmd":[used,capacity],...},
+ *    <sections added with diag_add_section()>}
+ *
+ * CPU share is the task's run time since the previous snapshot (since boot
+ * for the first one), in tenths of a percent of all cores; -1 without
+ * CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ * With CONFIG_FREERTOS_USE_TRACE_FACILITY every task is listed; without it
+ * only the tasks named in diag_watch_task(), with their stack high-water
+ * mark. Queue levels come from FreeRTOS queues or from a callback, for
+ * buffers that are not queues (e.g. the MQTT outbox, in bytes).
+ *
+ * A snapshot walks the task list once with the scheduler suspended and does
+ * not allocate; meant to run every minute or so in production. Register
+ * everything at startup; snapshots must come from a single task.
+ */
+
+#define DIAG_MAX_TASKS  32      // tasks listed; more than this and the list is skipped
+#define DIAG_MAX_WATCH  8       // names for diag_watch_task()
+#define DIAG_MAX_LEVELS 6       // queues and level callbacks
+#define DIAG_MAX_SECTIONS 2     // extra members from other components
+
+/** Fill *used and *capacity for a level that is not a FreeRTOS queue. */
+typedef void (*diag_level_fn)(uint32_t *used, uint32_t *capacity, void *ctx);
+
+/**
+ * Write one JSON value (object, array, number) for an extra member.
+ * Return the bytes written, or -1 if len is too small.
+ */
+typedef int (*diag_section_fn)(char *buf, size_t len, void *ctx);
+
+/** Report the fill level of a FreeRTOS queue under name (not copied). */
+esp_err_t diag_watch_queue(const char *name, QueueHandle_t queue);
+
+/** Report a level read through fn (called from the snapshotting task). */
+esp_err_t diag_watch_level(const char *name, diag_level_fn fn, void *ctx);
+
+/** Stack high-water mark for this task even without the trace facility. */
+esp_err_t diag_watch_task(const char *name);
+
+/** Append "name":<fn output> to every record (e.g. latency histograms). */
+esp_err_t diag_add_section(const char *name, diag_section_fn fn, void *ctx);
+
+/**
+ * Take a snapshot and encode it.
+ * @return bytes written (without terminator), or -1 if buf is too small
+ */
+int diag_encode_json(char *buf, size_t len);
@@ -0,0 +1,161 @@
+#include "lat_hist.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#define SUB_COUNT (1u << LAT_HIST_SUB_BITS)
+
+static lat_hist_t *s_registered[LAT_HIST_MAX_REGISTERED];
+static size_t s_registered_count;
+
+static unsigned msb(uint32_t v)
+{
+    return 31u - (unsigned)__builtin_clz(v);
+}
+
+size_t lat_hist_bucket_index(uint32_t us)
+{
+    if (us < SUB_COUNT) {
+        return us;
+    }
+    unsigned e = msb(us);
+    unsigned shift = e - LAT_HIST_SUB_BITS;
+    size_t idx = SUB_COUNT + (size_t)shift * SUB_COUNT + ((us >> shift) & (SUB_COUNT - 1));
+    return idx < LAT_HIST_BUCKETS ? idx : LAT_HIST_BUCKETS - 1;
+}
+
+uint32_t lat_hist_bucket_upper(size_t index)
+{
+    if (index < SUB_COUNT) {
+        return (uint32_t)index;
+    }
+    if (index >= LAT_HIST_BUCKETS - 1) {
+        return UINT32_MAX;
+    }
+    unsigned shift = (unsigned)((index - SUB_COUNT) / SUB_COUNT);
+    uint32_t sub = (uint32_t)((index - SUB_COUNT) % SUB_COUNT);
+    return ((SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void lat_hist_record(lat_hist_t *h, uint32_t us)
+{
+    atomic_fetch_add_explicit(&h->bucket[lat_hist_bucket_index(us)], 1, memory_order_relaxed);
+
+    uint_least32_t cur = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (us > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &cur, us, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+void lat_hist_snapshot(lat_hist_t *h, lat_hist_snapshot_t *out, bool reset)
+{
+    out->count = 0;
+    for (size_t i = 0; i < LAT_HIST_BUCKETS; i++) {
+        out->bucket[i] = reset
+            ? (uint32_t)atomic_exchange_explicit(&h->bucket[i], 0, memory_order_relaxed)
+            : (uint32_t)atomic_load_explicit(&h->bucket[i], memory_order_relaxed);
+        out->count += out->bucket[i];
+    }
+    // A sample recorded mid-snapshot may show in this max and the next window's buckets
+    out->max = reset
+        ? (uint32_t)atomic_exchange_explicit(&h->max, 0, memory_order_relaxed)
+        : (uint32_t)atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+uint32_t lat_hist_percentile(const lat_hist_snapshot_t *s, uint32_t permille)
+{
+    if (s->count == 0) {
+        return 0;
+    }
+    // Rank of the sample we want, 1-based, rounded up
+    uint64_t rank = ((uint64_t)s->count * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LAT_HIST_BUCKETS; i++) {
+        seen += s->bucket[i];
+        if (seen >= rank) {
+            uint32_t upper = lat_hist_bucket_upper(i);
+            return upper < s->max ? upper : s->max;
+        }
+    }
+    return s->max;
+}
+
+void lat_hist_summarize(const lat_hist_snapshot_t *s, lat_hist_summary_t *out)
+{
+    out->count = s->count;
+    out->p50 = lat_hist_percentile(s, 500);
+    out->p90 = lat_hist_percentile(s, 900);
+    out->p99 = lat_hist_percentile(s, 990);
+    out->max = s->max;
+}
+
+int lat_hist_register(lat_hist_t *h)
+{
+    for (size_t i = 0; i < s_registered_count; i++) {
+        if (s_registered[i] == h) {
+            return 0;
+        }
+    }
+    if (s_registered_count >= LAT_HIST_MAX_REGISTERED) {
+        return -1;
+    }
+    s_registered[s_registered_count++] = h;
+    return 0;
+}
+
+typedef int (*put_fn)(char *buf, size_t len, bool first, const char *name, const lat_hist_summary_t *s);
+
+static int put_json(char *buf, size_t len, bool first, const char *name, const lat_hist_summary_t *s)
+{
+    return snprintf(buf, len, "%s\"%s\":[%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "]",
+                    first ? "" : ",", name, s->count, s->p50, s->p90, s->p99, s->max);
+}
+
+static int put_text(char *buf, size_t len, bool first, const char *name, const lat_hist_summary_t *s)
+{
+    return snprintf(buf, len, "%s%s n=%" PRIu32 " 50/90/99/max=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "us",
+                    first ? "" : "; ", name, s->count, s->p50, s->p90, s->p99, s->max);
+}
+
+static int encode(char *buf, size_t len, bool reset, const char *open, const char *close, put_fn put)
+{
+    lat_hist_snapshot_t snap;     // ~420 bytes of stack
+    lat_hist_summary_t sum;
+    size_t pos = 0;
+
+    int n = snprintf(buf, len, "%s", open);
+    if (n < 0 || (size_t)n >= len) {
+        return -1;
+    }
+    pos = (size_t)n;
+
+    for (size_t i = 0; i < s_registered_count; i++) {
+        lat_hist_snapshot(s_registered[i], &snap, reset);
+        lat_hist_summarize(&snap, &sum);
+        n = put(buf + pos, len - pos, i == 0, s_registered[i]->name, &sum);
+        if (n < 0 || (size_t)n >= len - pos) {
+            return -1;
+        }
+        pos += (size_t)n;
+    }
+
+    n = snprintf(buf + pos, len - pos, "%s", close);
+    if (n < 0 || (size_t)n >= len - pos) {
+        return -1;
+    }
+    return (int)(pos + (size_t)n);
+}
+
+int lat_hist_encode_json(char *buf, size_t len, bool reset)
+{
+    return encode(buf, len, reset, "{", "}", put_json);
+}
+
+int lat_hist_format_text(char *buf, size_t len, bool reset)
+{
+    return encode(buf, len, reset, "", "", put_text);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Fixed-bucket latency histograms.
+ *
+ * Values (microseconds) go into log-scaled buckets: 0..3 exactly, then four
+ * buckets per power of two, so every bucket is at most 25 % wide; the last
+ * bucket collects everything from ~117 s up. Recording is one relaxed
+ * atomic increment plus a max update, with no locks, so it is safe from
+ * any task or ISR, on several cores at once.
+ *
+ * lat_hist_snapshot() copies the counters (optionally zeroing them bucket
+ * by bucket with atomic exchanges: every sample lands in exactly one
+ * window). Percentiles are read from a snapshot and reported as the upper
+ * edge of their bucket, capped at the observed max.
+ *
+ * Histograms are meant to be static objects; lat_hist_register() puts them
+ * in a small global list that the JSON and text reports walk. Register at
+ * startup; a report needs ~0.5 KB of the caller's stack.
+ *
+ * Pure C11, no ESP-IDF dependencies, so it also builds on the host.
+ */
+
+#define LAT_HIST_SUB_BITS       2       // 2^SUB_BITS buckets per power of two
+#define LAT_HIST_BUCKETS        104     // covers up to 2^27 us (~134 s)
+#define LAT_HIST_MAX_REGISTERED 8
+
+typedef struct {
+    const char *name;                   // short; used as JSON key
+    atomic_uint_least32_t bucket[LAT_HIST_BUCKETS];
+    atomic_uint_least32_t max;
+} lat_hist_t;
+
+#define LAT_HIST_INIT(n) { .name = (n) }
+
+typedef struct {
+    uint32_t bucket[LAT_HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+} lat_hist_snapshot_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t max;
+} lat_hist_summary_t;
+
+/** Add one sample (microseconds). */
+void lat_hist_record(lat_hist_t *h, uint32_t us);
+
+/** Copy the counters; with reset they start over from zero. */
+void lat_hist_snapshot(lat_hist_t *h, lat_hist_snapshot_t *out, bool reset);
+
+/** Value at or below which permille/1000 of the samples fall (0 if empty). */
+uint32_t lat_hist_percentile(const lat_hist_snapshot_t *s, uint32_t permille);
+
+void lat_hist_summarize(const lat_hist_snapshot_t *s, lat_hist_summary_t *out);
+
+/** Bucket a value falls into, and the largest value that bucket holds. */
+size_t lat_hist_bucket_index(uint32_t us);
+uint32_t lat_hist_bucket_upper(size_t index);
+
+/** Add h to the report list (no-op if already there). Returns 0, or -1 when full. */
+int lat_hist_register(lat_hist_t *h);
+
+/**
+ * All registered histograms as {"name":[count,p50,p90,p99,max],...}.
+ * @return bytes written (without terminator), or -1 if buf is too small
+ */
+int lat_hist_encode_json(char *buf, size_t len, bool reset);
+
+/** Same data as one text line: "name n=12 50/90/99/max=80/95/120/130us; ...". */
+int lat_hist_format_text(char *buf, size_t len, bool reset);
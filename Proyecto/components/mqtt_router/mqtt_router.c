@@ -0,0 +1,173 @@
+#include "mqtt_router.h"
+
+#include <string.h>
+
+static uint32_t fnv1a(const char *s, size_t n)
+{
+    uint32_t h = 2166136261u;
+    while (n--) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool filter_valid(const char *f)
+{
+    if (*f == '\0') return false;
+    for (const char *p = f; *p; ++p) {
+        if (*p != '+' && *p != '#') continue;
+        // Wildcards occupy a whole level; '#' must also be the last one
+        if (p != f && p[-1] != '/') return false;
+        if (*p == '#' && p[1] != '\0') return false;
+        if (*p == '+' && p[1] != '\0' && p[1] != '/') return false;
+    }
+    return true;
+}
+
+bool mqtt_router_match(const char *f, const char *t, size_t tlen)
+{
+    size_t i = 0;
+
+    // Topics starting with '$' are never matched by a leading wildcard
+    if (tlen > 0 && t[0] == '$' && (*f == '+' || *f == '#')) return false;
+
+    while (*f) {
+        if (*f == '#') return true;
+        if (*f == '+') {
+            while (i < tlen && t[i] != '/') i++;
+            f++;
+        } else {
+            while (*f && *f != '/') {
+                if (i >= tlen || t[i] != *f) return false;
+                i++;
+                f++;
+            }
+        }
+        if (*f == '\0') return i == tlen;
+
+        // *f == '/': the topic must continue with a new level too
+        if (i == tlen) return f[1] == '#' && f[2] == '\0';  // "a/#" also matches "a"
+        if (t[i] != '/') return false;
+        f++;
+        i++;
+    }
+    return i == tlen;
+}
+
+bool mqtt_router_payload_eq(const uint8_t *data, size_t len, const char *word)
+{
+    size_t n = strlen(word);
+    if (len != n) return false;
+    for (size_t k = 0; k < n; ++k) {
+        uint8_t a = data[k], b = (uint8_t)word[k];
+        if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+        if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+        if (a != b) return false;
+    }
+    return true;
+}
+
+void mqtt_router_init(mqtt_router_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    memset(r->bucket, -1, sizeof(r->bucket));
+}
+
+int mqtt_router_add(mqtt_router_t *r, const char *filter, mqtt_route_fn fn, void *ctx)
+{
+    if (!filter || !fn || r->count >= MQTT_ROUTER_MAX_ROUTES || !filter_valid(filter)) {
+        return -1;
+    }
+    uint8_t idx = r->count++;
+    mqtt_route_t *rt = &r->routes[idx];
+    rt->filter = filter;
+    rt->filter_len = (uint16_t)strlen(filter);
+    rt->wildcard = strpbrk(filter, "+#") != NULL;
+    rt->fn = fn;
+    rt->ctx = ctx;
+    rt->next = -1;
+
+    if (rt->wildcard) {
+        r->wild[r->wild_count++] = idx;
+    } else {
+        rt->hash = fnv1a(filter, rt->filter_len);
+        // Append so routes fire in registration order
+        int8_t *link = &r->bucket[rt->hash & (MQTT_ROUTER_BUCKETS - 1)];
+        while (*link >= 0) link = &r->routes[*link].next;
+        *link = (int8_t)idx;
+    }
+    return 0;
+}
+
+int mqtt_router_dispatch(mqtt_router_t *r, const char *topic, size_t topic_len,
+                         const uint8_t *data, size_t len)
+{
+    int called = 0;
+    uint32_t h = fnv1a(topic, topic_len);
+
+    for (int8_t k = r->bucket[h & (MQTT_ROUTER_BUCKETS - 1)]; k >= 0; k = r->routes[k].next) {
+        const mqtt_route_t *rt = &r->routes[k];
+        if (rt->hash == h && rt->filter_len == topic_len &&
+            memcmp(rt->filter, topic, topic_len) == 0) {
+            rt->fn(topic, topic_len, data, len, rt->ctx);
+            called++;
+        }
+    }
+    for (uint8_t w = 0; w < r->wild_count; ++w) {
+        const mqtt_route_t *rt = &r->routes[r->wild[w]];
+        if (mqtt_router_match(rt->filter, topic, topic_len)) {
+            rt->fn(topic, topic_len, data, len, rt->ctx);
+            called++;
+        }
+    }
+
+    if (called) {
+        r->dispatched++;
+    } else {
+        r->unmatched++;
+    }
+    return called;
+}
+
+int mqtt_router_feed(mqtt_router_t *r, const char *topic, int topic_len,
+                     const char *data, int data_len, int offset, int total_len)
+{
+    if (data_len < 0 || offset < 0) return 0;
+    if (total_len < data_len + offset) total_len = data_len + offset;
+
+    // Whole message in one event: route the client's buffers directly
+    if (offset == 0 && data_len == total_len) {
+        r->assembling = false;
+        if (!topic || topic_len <= 0) return 0;
+        return mqtt_router_dispatch(r, topic, (size_t)topic_len, (const uint8_t *)data, (size_t)data_len);
+    }
+
+    if (offset == 0) {
+        // First fragment: the topic is only present here
+        r->assembling = false;
+        if (!topic || topic_len <= 0 || topic_len > MQTT_ROUTER_MAX_TOPIC ||
+            total_len > MQTT_ROUTER_MAX_PAYLOAD) {
+            r->oversize++;
+            return 0;
+        }
+        memcpy(r->topic, topic, (size_t)topic_len);
+        r->topic_len = (uint16_t)topic_len;
+        r->total = (uint32_t)total_len;
+        r->received = 0;
+        r->assembling = true;
+    }
+
+    // Fragments arrive in order; anything else means one was lost
+    if (!r->assembling || (uint32_t)offset != r->received ||
+        (uint32_t)(offset + data_len) > r->total) {
+        r->assembling = false;
+        return 0;
+    }
+    memcpy(r->buf + offset, data, (size_t)data_len);
+    r->received += (uint32_t)data_len;
+    if (r->received < r->total) return 0;
+
+    r->assembling = false;
+    return mqtt_router_dispatch(r, r->topic, r->topic_len, r->buf, r->total);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Table-driven MQTT topic router.
+ *
+ * Handlers register for topic filters once at startup. Filters without
+ * wildcards go into a small hash table (FNV-1a over the topic bytes), so an
+ * incoming topic costs one hash and, on a hit, one memcmp regardless of how
+ * many commands are registered. Filters with '+' or '#' are kept in a short
+ * list and matched level by level; every matching route is called.
+ *
+ * Dispatch is zero-copy: handlers receive the client's topic and payload
+ * pointers with explicit lengths (not NUL-terminated). Messages larger than
+ * the client's receive buffer arrive as several fragments; those are
+ * reassembled into the router's buffer (up to MQTT_ROUTER_MAX_PAYLOAD) and
+ * dispatched once complete.
+ *
+ * Filter strings are not copied and must outlive the router. Registration
+ * is not thread-safe: add every route before the client starts, and feed
+ * from a single task (the MQTT event task).
+ *
+ * No ESP-IDF dependencies, so the same code builds on the host.
+ */
+
+#define MQTT_ROUTER_MAX_ROUTES  16
+#define MQTT_ROUTER_BUCKETS     32      // power of two
+#define MQTT_ROUTER_MAX_TOPIC   64
+#define MQTT_ROUTER_MAX_PAYLOAD 512
+
+typedef void (*mqtt_route_fn)(const char *topic, size_t topic_len,
+                              const uint8_t *data, size_t len, void *ctx);
+
+typedef struct {
+    const char *filter;
+    uint16_t filter_len;
+    bool wildcard;
+    uint32_t hash;           // exact filters only
+    int8_t next;             // next route in the same bucket, -1 = end
+    mqtt_route_fn fn;
+    void *ctx;
+} mqtt_route_t;
+
+typedef struct {
+    mqtt_route_t routes[MQTT_ROUTER_MAX_ROUTES];
+    uint8_t count;
+    int8_t bucket[MQTT_ROUTER_BUCKETS];
+    uint8_t wild[MQTT_ROUTER_MAX_ROUTES];
+    uint8_t wild_count;
+
+    // Fragment reassembly
+    char topic[MQTT_ROUTER_MAX_TOPIC];
+    uint16_t topic_len;
+    uint8_t buf[MQTT_ROUTER_MAX_PAYLOAD];
+    uint32_t total;          // expected payload length of the message in progress
+    uint32_t received;       // bytes copied so far
+    bool assembling;
+
+    uint32_t dispatched;     // messages delivered to at least one handler
+    uint32_t unmatched;      // messages no route matched
+    uint32_t oversize;       // fragmented messages dropped (payload or topic too big)
+} mqtt_router_t;
+
+/** Reset the table and counters. */
+void mqtt_router_init(mqtt_router_t *r);
+
+/**
+ * Register fn for filter ('+' and '#' allowed as whole levels, '#' last).
+ * Returns 0, or -1 if the table is full or the filter is invalid.
+ */
+int mqtt_router_add(mqtt_router_t *r, const char *filter, mqtt_route_fn fn, void *ctx);
+
+/**
+ * Feed one MQTT DATA event. topic/topic_len are only needed on the first
+ * fragment (offset 0). Returns the number of handlers called (0 while a
+ * fragmented message is still incomplete or when nothing matched).
+ */
+int mqtt_router_feed(mqtt_router_t *r, const char *topic, int topic_len,
+                     const char *data, int data_len, int offset, int total_len);
+
+/** Route a complete message (no reassembly). Returns the handlers called. */
+int mqtt_router_dispatch(mqtt_router_t *r, const char *topic, size_t topic_len,
+                         const uint8_t *data, size_t len);
+
+/** True if topic matches filter under MQTT wildcard rules. */
+bool mqtt_router_match(const char *filter, const char *topic, size_t topic_len);
+
+/** Case-insensitive comparison of a payload against a NUL-terminated word. */
+bool mqtt_router_payload_eq(const uint8_t *data, size_t len, const char *word);
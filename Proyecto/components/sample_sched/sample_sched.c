@@ -0,0 +1,93 @@
+#include "sample_sched.h"
+
+#include <string.h>
+
+void sample_sched_init(sample_sched_t *s, const sample_sched_config_t *cfg, uint32_t now_ms)
+{
+    memset(s, 0, sizeof(*s));
+    s->cfg = *cfg;
+    if (s->cfg.max_ms < s->cfg.min_ms) {
+        s->cfg.max_ms = s->cfg.min_ms;
+    }
+    s->period_ms = s->cfg.min_ms;
+    s->mode = SAMPLE_SCHED_HOLD;
+    s->active_ms = now_ms;
+}
+
+void sample_sched_wake(sample_sched_t *s, uint32_t now_ms)
+{
+    s->active_ms = now_ms;
+    s->mode = SAMPLE_SCHED_HOLD;
+}
+
+/* |rate| in cm/min, or < 0 when the level is not known to be moving */
+static float level_rate(sample_sched_t *s, const sample_sched_input_t *in, uint32_t now_ms)
+{
+    if (in->has_rate) {
+        return in->rate_cm_min < 0.0f ? -in->rate_cm_min : in->rate_cm_min;
+    }
+    if (!s->have_ref) {
+        s->have_ref = true;
+        s->ref_cm = in->level_cm;
+        s->ref_ms = now_ms;
+        return -1.0f;
+    }
+    float d = in->level_cm - s->ref_cm;
+    if (d < 0.0f) {
+        d = -d;
+    }
+    uint32_t dt_ms = now_ms - s->ref_ms;
+    if (d < s->cfg.step_cm || dt_ms == 0) {
+        return -1.0f;
+    }
+    s->ref_cm = in->level_cm;
+    s->ref_ms = now_ms;
+    return d * 60000.0f / (float)dt_ms;
+}
+
+uint32_t sample_sched_update(sample_sched_t *s, const sample_sched_input_t *in, uint32_t now_ms)
+{
+    const sample_sched_config_t *cfg = &s->cfg;
+
+    if (in->pump_on) {
+        s->active_ms = now_ms;
+    }
+    // A missed echo leaves the raw anchor alone
+    float rate = in->level_cm >= 0.0f ? level_rate(s, in, now_ms) : -1.0f;
+
+    uint32_t target = cfg->max_ms;
+    s->mode = SAMPLE_SCHED_IDLE;
+    if (in->pump_on) {
+        s->mode = SAMPLE_SCHED_PUMP;
+        target = cfg->min_ms;
+    } else if (now_ms - s->active_ms < cfg->hold_ms) {
+        s->mode = SAMPLE_SCHED_HOLD;
+        target = cfg->min_ms;
+    } else if (in->level_cm < 0.0f) {
+        s->mode = SAMPLE_SCHED_BLIND;
+        target = s->period_ms;
+    } else if (rate > 0.0f && cfg->step_cm * 60000.0f < rate * (float)cfg->max_ms) {
+        s->mode = SAMPLE_SCHED_MOVING;
+        target = (uint32_t)(cfg->step_cm * 60000.0f / rate);
+        if (target < cfg->min_ms) {
+            target = cfg->min_ms;
+        }
+    }
+
+    if (target <= s->period_ms || cfg->grow_pct == 0) {
+        s->period_ms = target;
+    } else {
+        uint32_t grown = s->period_ms + (uint32_t)((uint64_t)s->period_ms * cfg->grow_pct / 100);
+        if (grown == s->period_ms) {
+            grown++;
+        }
+        s->period_ms = grown < target ? grown : target;
+    }
+    return s->period_ms;
+}
+
+const char *sample_sched_mode_name(sample_sched_mode_t mode)
+{
+    static const char *const names[] = { "idle", "pump", "hold", "moving", "blind" };
+    return (unsigned)mode < sizeof(names) / sizeof(names[0]) ? names[mode] : "?";
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Adaptive sampling period.
+ *
+ * Called once per sample, returns how long to wait before the next one:
+ *
+ *  - pump running, or within hold_ms of it stopping or of a wake event:
+ *    min_ms, so a fill is tracked closely and the relay change shows up at
+ *    once;
+ *  - level moving: the time it takes to move step_cm at the current rate,
+ *    clamped to [min_ms, max_ms];
+ *  - quiet: grows towards max_ms by at most grow_pct per sample.
+ *
+ * Shorter periods apply immediately, longer ones only through the grow_pct
+ * slew, so one quiet reading in the middle of a fill does not drop the rate.
+ * A missed echo (level < 0) keeps the current period.
+ *
+ * The rate comes from the caller (e.g. a filter) when it has one; otherwise
+ * it is estimated from raw readings: the level has to move step_cm away
+ * from the last anchor before it counts, so step_cm must be above the
+ * sensor noise. Distance works as well as level, only |rate| is used.
+ *
+ * Not thread-safe, no ESP-IDF dependencies (simulated on the host, see
+ * tools/sample_sched_sim). Times in ms of a 32-bit monotonic clock;
+ * differences tolerate wrap-around.
+ */
+
+typedef struct {
+    uint32_t min_ms;        // period while the pump runs or the level moves fast
+    uint32_t max_ms;        // period once everything is quiet
+    uint32_t hold_ms;       // stay at min_ms this long after the pump stops or a wake
+    uint16_t grow_pct;      // max growth per quiet sample; 0 = jump straight to the target
+    float step_cm;          // level change one sample should resolve
+} sample_sched_config_t;
+
+typedef enum {
+    SAMPLE_SCHED_IDLE = 0,  // quiet, growing towards max_ms
+    SAMPLE_SCHED_PUMP,      // pump running
+    SAMPLE_SCHED_HOLD,      // pump just stopped or woken: still at min_ms
+    SAMPLE_SCHED_MOVING,    // level changing: period follows the rate
+    SAMPLE_SCHED_BLIND,     // no reading: period kept
+} sample_sched_mode_t;
+
+typedef struct {
+    bool pump_on;
+    float level_cm;         // level or distance; < 0 = missed echo
+    bool has_rate;          // rate_cm_min is valid (otherwise estimated from level_cm)
+    float rate_cm_min;
+} sample_sched_input_t;
+
+typedef struct {
+    sample_sched_config_t cfg;
+    uint32_t period_ms;
+    sample_sched_mode_t mode;
+    uint32_t active_ms;     // last time the pump ran or a wake arrived
+    bool have_ref;
+    float ref_cm;           // anchor for the rate from raw readings
+    uint32_t ref_ms;
+} sample_sched_t;
+
+/** Start at min_ms, holding it for hold_ms from now. */
+void sample_sched_init(sample_sched_t *s, const sample_sched_config_t *cfg, uint32_t now_ms);
+
+/** Feed one sample; returns the wait until the next one (ms). */
+uint32_t sample_sched_update(sample_sched_t *s, const sample_sched_input_t *in, uint32_t now_ms);
+
+/** Something is about to happen (pump command): the next update starts hold_ms at min_ms. */
+void sample_sched_wake(sample_sched_t *s, uint32_t now_ms);
+
+const char *sample_sched_mode_name(sample_sched_mode_t mode);
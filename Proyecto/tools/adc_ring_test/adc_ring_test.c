@@ -0,0 +1,274 @@
+/*
+ * Prueba de host del historial de muestras ADC con promedio móvil
+ * (components/adc_driver/adc_ring.c, compilado tal cual). Un productor
+ * stub reemplaza a la tarea de streaming del ADC (muestras de 12 bits con
+ * rampas, ruido y saturación) y un modelo guarda el historial completo.
+ * Verifica:
+ *
+ *   - promedio de la ventana (división entera, ventana parcial mientras se
+ *     llena) igual al del modelo tras cada muestra, para varias ventanas y
+ *     con valores de 16 bits al máximo;
+ *   - lectura en bloque: las n más nuevas, la más vieja primero, menos
+ *     mientras se llena, acotada a ADC_RING_SIZE - 1;
+ *   - vueltas del índice del ring y del contador de 32 bits;
+ *   - con un hilo productor y lectores concurrentes, todo bloque copiado es
+ *     consecutivo (nunca mezcla muestras de dos vueltas).
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "adc_ring.h"
+
+#define HISTORY_MAX (16 * ADC_RING_SIZE)
+#define MAX_READERS 8
+
+static int failures;
+static int checks;
+
+static void check(bool ok, const char *caso, const char *what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA [%s] %s\n", caso, what);
+        }
+    }
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* Productor stub: lo que entregaría el ADC de 12 bits del C6 con una sonda TDS */
+static uint16_t stub_adc_sample(uint32_t k)
+{
+    int32_t base;
+    switch ((k / 700) % 4) {
+    case 0:  base = 1200; break;                              // estable
+    case 1:  base = 1200 + (int32_t)(k % 700) * 4; break;     // rampa de subida
+    case 2:  base = 4095; break;                              // saturado
+    default: base = (int32_t)(k % 700) * 3; break;            // desde 0
+    }
+    int32_t v = base + (int32_t)(rng() % 41) - 20;
+    return (uint16_t)(v < 0 ? 0 : v > 4095 ? 4095 : v);
+}
+
+static uint16_t history[HISTORY_MAX];
+
+/* Promedio esperado de las últimas min(n, window) muestras de history[0..n) */
+static uint32_t model_avg(uint32_t n, uint32_t window)
+{
+    uint32_t w = n < window ? n : window;
+    uint64_t sum = 0;
+    for (uint32_t i = n - w; i < n; i++) {
+        sum += history[i];
+    }
+    return (uint32_t)(sum / w);
+}
+
+/* Compara una lectura en bloque de n con el modelo tras `pushed` muestras */
+static void check_copy(const adc_ring_t *ring, uint32_t pushed, size_t n, const char *caso)
+{
+    uint16_t out[ADC_RING_SIZE + 16];
+    memset(out, 0xA5, sizeof(out));
+    size_t got = adc_ring_copy_latest(ring, out, n);
+
+    size_t want = n > ADC_RING_SIZE - 1 ? ADC_RING_SIZE - 1 : n;
+    if (want > pushed) {
+        want = pushed;
+    }
+    if (got != want) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "copia de %zu tras %" PRIu32 " muestras devolvió %zu (esperado %zu)",
+                 n, pushed, got, want);
+        check(false, caso, msg);
+        return;
+    }
+    check(memcmp(out, &history[pushed - got], got * sizeof(uint16_t)) == 0, caso,
+          "la copia no son las más nuevas en orden");
+    check(out[got] == 0xA5A5, caso, "la copia escribió de más");
+}
+
+/* Alimenta el ring y compara promedio y bloques tras cada muestra */
+static void test_window(uint32_t window, uint32_t start_count, bool full_scale)
+{
+    char caso[64];
+    snprintf(caso, sizeof(caso), "ventana %" PRIu32 "%s%s", window, start_count ? ", contador cerca de 2^32" : "",
+             full_scale ? ", 0xFFFF" : "");
+    adc_ring_t *ring = malloc(sizeof(*ring));
+    adc_ring_init(ring, window);
+    // Simula días de streaming: el contador da la vuelta durante la prueba
+    atomic_store(&ring->head, start_count);
+    check(adc_ring_latest_avg(ring) == 0 && adc_ring_count(ring) == start_count, caso, "estado inicial");
+    uint16_t none[4];
+    check(adc_ring_copy_latest(ring, none, 4) == 0, caso, "copia con el ring vacío");
+
+    const uint32_t eff = window == 0 ? 1 : window > ADC_RING_SIZE ? ADC_RING_SIZE : window;
+    const uint32_t total = 5 * ADC_RING_SIZE + 37;
+    int avg_errors = 0;
+    for (uint32_t k = 0; k < total; k++) {
+        uint16_t s = full_scale ? 0xFFFF : stub_adc_sample(k);
+        history[k] = s;
+        adc_ring_push(ring, s);
+        if (adc_ring_latest_avg(ring) != model_avg(k + 1, eff) && avg_errors++ < 3) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "promedio %" PRIu32 " tras %" PRIu32 " muestras (esperado %" PRIu32 ")",
+                     adc_ring_latest_avg(ring), k + 1, model_avg(k + 1, eff));
+            check(false, caso, msg);
+        }
+        if (adc_ring_count(ring) != start_count + k + 1 && avg_errors++ < 3) {
+            check(false, caso, "el contador no cuenta las muestras");
+        }
+        // Bloques justo en los bordes del llenado y de cada vuelta del índice
+        uint32_t m = (k + 1) % ADC_RING_SIZE;
+        if (k < 4 || m <= 1 || m == ADC_RING_SIZE - 1 || k % 97 == 0) {
+            check_copy(ring, k + 1, 1, caso);
+            check_copy(ring, k + 1, eff, caso);
+            check_copy(ring, k + 1, ADC_RING_SIZE - 1, caso);
+            check_copy(ring, k + 1, ADC_RING_SIZE, caso);
+            check_copy(ring, k + 1, ADC_RING_SIZE + 16, caso);
+        }
+    }
+    check(avg_errors == 0, caso, "promedio distinto del modelo");
+    check(adc_ring_copy_latest(ring, none, 0) == 0, caso, "copia de 0 muestras");
+    free(ring);
+}
+
+/* ---- Productor y lectores concurrentes ---- */
+
+static adc_ring_t conc_ring;
+static atomic_bool producer_done;
+static uint32_t conc_samples = 5000000;
+
+static void *producer_main(void *arg)
+{
+    (void)arg;
+    // Valores consecutivos: un bloque válido siempre es una secuencia +1
+    for (uint32_t k = 1; k <= conc_samples; k++) {
+        adc_ring_push(&conc_ring, (uint16_t)k);
+    }
+    atomic_store(&producer_done, true);
+    return NULL;
+}
+
+typedef struct {
+    uint64_t copies, empty, torn;
+} reader_stats_t;
+
+static void *reader_main(void *arg)
+{
+    reader_stats_t *st = arg;
+    uint16_t out[ADC_RING_SIZE];
+    size_t n = 1;
+    while (adc_ring_count(&conc_ring) == 0) {
+        sched_yield();
+    }
+    while (!atomic_load(&producer_done)) {
+        n = n % ADC_RING_SIZE + 1;
+        uint32_t before = adc_ring_count(&conc_ring);
+        size_t got = adc_ring_copy_latest(&conc_ring, out, n);
+        st->copies++;
+        if (got == 0) {
+            // Reintentos agotados con el productor encima
+            st->empty++;
+            continue;
+        }
+        bool ok = got <= n;
+        for (size_t i = 1; i < got && ok; i++) {
+            ok = out[i] == (uint16_t)(out[i - 1] + 1);
+        }
+        // La más nueva copiada se publicó entre antes y después de copiar
+        // (con el lector dormido más de 65536 muestras no se puede saber)
+        uint32_t after = adc_ring_count(&conc_ring);
+        if (after - before < 0x10000u) {
+            ok = ok && (uint16_t)(out[got - 1] - (uint16_t)before) <= after - before;
+        }
+        if (!ok) {
+            st->torn++;
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent(int readers)
+{
+    const char *caso = "concurrente";
+    pthread_t prod, rd[MAX_READERS];
+    reader_stats_t stats[MAX_READERS] = { 0 };
+
+    adc_ring_init(&conc_ring, 64);
+    atomic_store(&producer_done, false);
+    for (int i = 0; i < readers; i++) {
+        pthread_create(&rd[i], NULL, reader_main, &stats[i]);
+    }
+    pthread_create(&prod, NULL, producer_main, NULL);
+    pthread_join(prod, NULL);
+    uint64_t copies = 0, empty = 0, torn = 0;
+    for (int i = 0; i < readers; i++) {
+        pthread_join(rd[i], NULL);
+        copies += stats[i].copies;
+        empty += stats[i].empty;
+        torn += stats[i].torn;
+    }
+    check(torn == 0, caso, "bloque con muestras de dos vueltas o fuera de orden");
+    check(copies > empty, caso, "ninguna copia se solapó con el productor");
+    // Sin productor, el promedio es el de las 64 muestras más nuevas
+    uint16_t tail[64];
+    check(adc_ring_copy_latest(&conc_ring, tail, 64) == 64, caso, "copia final");
+    uint64_t sum = 0;
+    for (int i = 0; i < 64; i++) {
+        sum += tail[i];
+    }
+    check(adc_ring_latest_avg(&conc_ring) == sum / 64, caso, "promedio final distinto de sus 64 muestras");
+    printf("concurrente: %" PRIu32 " muestras, %d lectores, %" PRIu64 " copias, %" PRIu64 " sin copia, %" PRIu64
+           " rotas\n", conc_samples, readers, copies, empty, torn);
+}
+
+int main(int argc, char **argv)
+{
+    int readers = 3;
+    int c;
+    while ((c = getopt(argc, argv, "n:r:s:")) != -1) {
+        switch (c) {
+        case 'n': conc_samples = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'r': readers = atoi(optarg); break;
+        case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "uso: %s [-n muestras_concurrentes] [-r lectores] [-s semilla]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (readers < 1 || readers > MAX_READERS || rng_state == 0) {
+        fprintf(stderr, "lectores 1..%d, semilla distinta de 0\n", MAX_READERS);
+        return 2;
+    }
+
+    const uint32_t windows[] = { 0, 1, 7, 64, ADC_RING_SIZE - 1, ADC_RING_SIZE, ADC_RING_SIZE + 100 };
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        test_window(windows[i], 0, false);
+    }
+    test_window(64, UINT32_MAX - 1000, false);
+    test_window(ADC_RING_SIZE, UINT32_MAX - 3 * ADC_RING_SIZE, true);
+    printf("ventanas: %zu casos de %d muestras\n", sizeof(windows) / sizeof(windows[0]) + 2, 5 * ADC_RING_SIZE + 37);
+
+    test_concurrent(readers);
+
+    printf("%s (%d verificaciones, %d fallas)\n", failures ? "FALLA" : "OK", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+/*
+ * Prueba de host del bus de comandos compartido (components/cmd_bus,
+ * compilado tal cual: se incluye cmd_bus.c para llegar a tokenize(),
+ * take_id() y execute(), con sustitutos mínimos de FreeRTOS, esp_log y
+ * esp_timer en host/). Verifica:
+ *
+ *   - tokenize(): palabras separadas por espacios o tabs, en el lugar; casos
+ *     fijos y líneas aleatorias contra un modelo; más de CMD_BUS_MAX_ARGS
+ *     palabras se descartan sin pegarse a la última;
+ *   - take_id(): el "#<id>" final (solo después de un comando) sale de la
+ *     línea, con comillas, barras y controles reemplazados y como mucho
+ *     CMD_BUS_MAX_ID caracteres; casos fijos y aleatorios contra un modelo;
+ *   - el bus: registro, cmd_bus_post() (CR/LF, largo, cola llena, antes de
+ *     arrancar), búsqueda sin mayúsculas, help, desconocidos, respuesta al
+ *     origen con su tag, estadísticas, latencia y cmd_bus_format_ack().
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cmd_bus.c"
+
+#define RANDOM_LINES 200000
+
+static int failures;
+static int checks;
+
+static void check(bool ok, const char *caso, const char *what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA [%s] %s\n", caso, what);
+        }
+    }
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/* Modelo de tokenize(): copia las primeras max palabras en words[] */
+static int model_words(const char *line, char words[][CMD_BUS_MAX_LINE + 1], int max)
+{
+    int n = 0;
+    const char *p = line;
+    while (*p && n < max) {
+        while (is_blank(*p)) {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        size_t k = 0;
+        while (p[k] && !is_blank(p[k])) {
+            k++;
+        }
+        memcpy(words[n], p, k);
+        words[n][k] = '\0';
+        n++;
+        p += k;
+    }
+    return n;
+}
+
+/*
+ * Modelo de take_id(): la última palabra, si empieza con '#', tiene algo
+ * después y no es la única. Devuelve el id esperado y en rest la línea sin él.
+ */
+static void model_id(const char *line, char *id, char *rest)
+{
+    char words[CMD_BUS_MAX_LINE][CMD_BUS_MAX_LINE + 1];
+    int n = model_words(line, words, CMD_BUS_MAX_LINE);
+    id[0] = '\0';
+    strcpy(rest, line);
+    if (n < 2 || words[n - 1][0] != '#' || words[n - 1][1] == '\0') {
+        return;
+    }
+    size_t k = 0;
+    for (const char *s = words[n - 1] + 1; *s && k < CMD_BUS_MAX_ID; s++) {
+        id[k++] = (*s == '"' || *s == '\\' || (unsigned char)*s < 0x20) ? '_' : *s;
+    }
+    id[k] = '\0';
+    // La línea se corta donde empieza la última palabra (lo que sigue son blancos)
+    size_t end = strlen(rest);
+    while (end > 0 && is_blank(rest[end - 1])) {
+        end--;
+    }
+    rest[end - strlen(words[n - 1])] = '\0';
+}
+
+typedef struct {
+    const char *line;
+    int argc;
+    const char *argv[CMD_BUS_MAX_ARGS];
+} tok_case_t;
+
+static void test_tokenize(void)
+{
+    const char *caso = "tokenize";
+    static const tok_case_t cases[] = {
+        { "pump on", 2, { "pump", "on" } },
+        { "  pump   on  ", 2, { "pump", "on" } },
+        { "\tcalA\t1.5 \t", 2, { "calA", "1.5" } },
+        { "help", 1, { "help" } },
+        { "", 0, { NULL } },
+        { " \t  ", 0, { NULL } },
+        { "a b c d e f", 6, { "a", "b", "c", "d", "e", "f" } },
+        { "a b c d e f g h", 6, { "a", "b", "c", "d", "e", "f" } },
+        { "a b c d e f\tg", 6, { "a", "b", "c", "d", "e", "f" } },
+        { "a b c d e f ", 6, { "a", "b", "c", "d", "e", "f" } },
+    };
+    char msg[128];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char line[CMD_BUS_MAX_LINE + 1];
+        char *argv[CMD_BUS_MAX_ARGS];
+        strcpy(line, cases[i].line);
+        int argc = tokenize(line, argv);
+        bool ok = argc == cases[i].argc;
+        for (int k = 0; ok && k < argc; k++) {
+            ok = strcmp(argv[k], cases[i].argv[k]) == 0;
+        }
+        snprintf(msg, sizeof(msg), "\"%s\": %d palabras%s%s", cases[i].line, argc, argc ? ", última " : "",
+                 argc ? argv[argc - 1] : "");
+        check(ok, caso, msg);
+    }
+
+    // Líneas aleatorias de letras, espacios y tabs
+    static const char alphabet[] = "ab#  \t";
+    int bad = 0;
+    for (int k = 0; k < RANDOM_LINES; k++) {
+        char line[CMD_BUS_MAX_LINE + 1], copy[CMD_BUS_MAX_LINE + 1];
+        char words[CMD_BUS_MAX_ARGS][CMD_BUS_MAX_LINE + 1];
+        char *argv[CMD_BUS_MAX_ARGS];
+        size_t len = rng() % (CMD_BUS_MAX_LINE + 1);
+        for (size_t i = 0; i < len; i++) {
+            line[i] = alphabet[rng() % (sizeof(alphabet) - 1)];
+        }
+        line[len] = '\0';
+        strcpy(copy, line);
+        int want = model_words(copy, words, CMD_BUS_MAX_ARGS);
+        int argc = tokenize(line, argv);
+        bool ok = argc == want;
+        for (int i = 0; ok && i < argc; i++) {
+            // Cada palabra queda en su lugar dentro de la línea
+            ok = strcmp(argv[i], words[i]) == 0 && argv[i] >= line && argv[i] < line + len;
+        }
+        if (!ok && bad++ < 5) {
+            snprintf(msg, sizeof(msg), "\"%s\": %d palabras (esperadas %d)", copy, argc, want);
+            check(false, caso, msg);
+        }
+    }
+    check(bad == 0, caso, "líneas aleatorias distintas del modelo");
+    printf("tokenize: %d líneas aleatorias, %d diferencias\n", RANDOM_LINES, bad);
+}
+
+typedef struct {
+    const char *line;
+    const char *id;
+    const char *rest;
+} id_case_t;
+
+static void test_take_id(void)
+{
+    const char *caso = "id";
+    static const id_case_t cases[] = {
+        { "pump on #42", "42", "pump on " },
+        { "pump on #42 \t ", "42", "pump on " },
+        { "pump\t#x", "x", "pump\t" },
+        { "pump on #", "", "pump on #" },
+        { "#42", "", "#42" },
+        { "  #42 ", "", "  #42 " },
+        { "pump #1 on", "", "pump #1 on" },
+        { "pump on#42", "", "pump on#42" },
+        { "pump ##", "#", "pump " },
+        { "pump #a\"b\\c\x01", "a_b_c_", "pump " },
+        { "pump #0123456789abcdefghijklmnopq", "0123456789abcdefghijklmn", "pump " },
+        { "a b c d e f g #7", "7", "a b c d e f g " },
+        { "", "", "" },
+    };
+    char msg[160];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char line[CMD_BUS_MAX_LINE + 1];
+        char id[CMD_BUS_MAX_ID + 1], rest[CMD_BUS_MAX_LINE + 1];
+        strcpy(line, cases[i].line);
+        take_id(line);
+        snprintf(msg, sizeof(msg), "\"%s\": id \"%s\" resto \"%s\"", cases[i].line, s_current_id, line);
+        check(strcmp(s_current_id, cases[i].id) == 0 && strcmp(line, cases[i].rest) == 0, caso, msg);
+        model_id(cases[i].line, id, rest);
+        check(strcmp(id, cases[i].id) == 0 && strcmp(rest, cases[i].rest) == 0, "modelo", msg);
+    }
+
+    static const char alphabet[] = "a#\"  \t";
+    int bad = 0, with_id = 0;
+    for (int k = 0; k < RANDOM_LINES; k++) {
+        char line[CMD_BUS_MAX_LINE + 1];
+        char id[CMD_BUS_MAX_ID + 1], rest[CMD_BUS_MAX_LINE + 1];
+        size_t len = rng() % (CMD_BUS_MAX_LINE + 1);
+        for (size_t i = 0; i < len; i++) {
+            line[i] = alphabet[rng() % (sizeof(alphabet) - 1)];
+        }
+        line[len] = '\0';
+        model_id(line, id, rest);
+        take_id(line);
+        with_id += id[0] != '\0';
+        if ((strcmp(s_current_id, id) != 0 || strcmp(line, rest) != 0) && bad++ < 5) {
+            snprintf(msg, sizeof(msg), "resto \"%s\": id \"%s\" (esperado \"%s\")", line, s_current_id, id);
+            check(false, caso, msg);
+        }
+    }
+    check(bad == 0, caso, "líneas aleatorias distintas del modelo");
+    check(with_id > RANDOM_LINES / 20, caso, "muy pocas líneas con id: los casos no prueban nada");
+    printf("id: %d líneas aleatorias, %d con id, %d diferencias\n", RANDOM_LINES, with_id, bad);
+}
+
+/* Handlers y respuestas registradas */
+static char last_args[CMD_BUS_MAX_LINE * 2];
+static int handler_calls;
+
+static int cmd_echo(int argc, char **argv, char *reply, size_t reply_len)
+{
+    size_t n = 0;
+    handler_calls++;
+    last_args[0] = '\0';
+    for (int i = 0; i < argc; i++) {
+        n += (size_t)snprintf(last_args + n, sizeof(last_args) - n, "%s%s", i ? "|" : "", argv[i]);
+    }
+    snprintf(reply, reply_len, "%d \"args\"", argc);
+    return 0;
+}
+
+static int cmd_fail(int argc, char **argv, char *reply, size_t reply_len)
+{
+    (void)argc; (void)argv;
+    handler_calls++;
+    snprintf(reply, reply_len, "bad");
+    return 1;
+}
+
+static const cmd_def_t table_a[] = {
+    { "pump", "pump on|off", cmd_echo },
+    { "calA", "calibrate A", cmd_echo },
+};
+static const cmd_def_t table_b[] = {
+    { "fail", "always fails", cmd_fail },
+};
+
+typedef struct {
+    int calls;
+    uint32_t tag;
+    int status;
+    char reply[CMD_BUS_MAX_REPLY];
+    char id[CMD_BUS_MAX_ID + 1];
+    char ack[CMD_BUS_MAX_REPLY + 96];
+    int ack_len;
+} reply_rec_t;
+
+static reply_rec_t rec_mqtt, rec_uart;
+
+static void on_reply(uint32_t tag, int status, const char *reply, void *ctx)
+{
+    reply_rec_t *r = ctx;
+    r->calls++;
+    r->tag = tag;
+    r->status = status;
+    snprintf(r->reply, sizeof(r->reply), "%s", reply);
+    snprintf(r->id, sizeof(r->id), "%s", cmd_bus_current_id());
+    r->ack_len = cmd_bus_format_ack(r->ack, sizeof(r->ack), status, reply);
+}
+
+/* Lo que haría la tarea del bus: ejecutar todo lo encolado */
+static int run_queue(void)
+{
+    cmd_msg_t msg;
+    int n = 0;
+    while (xQueueReceive(s_queue, &msg, portMAX_DELAY) == pdTRUE) {
+        execute(&msg);
+        n++;
+    }
+    return n;
+}
+
+static esp_err_t post(cmd_source_t src, uint32_t tag, const char *line)
+{
+    return cmd_bus_post(src, tag, line, strlen(line));
+}
+
+static void test_bus(void)
+{
+    const char *caso = "bus";
+    cmd_bus_stats_t st;
+    char msg[512];
+
+    check(post(CMD_SRC_MQTT, 0, "pump on") == ESP_ERR_INVALID_STATE, caso, "post antes de arrancar");
+    check(cmd_bus_register(NULL, 1) == ESP_ERR_INVALID_ARG, caso, "tabla NULL");
+    check(cmd_bus_register(table_a, 0) == ESP_ERR_INVALID_ARG, caso, "tabla vacía");
+    check(cmd_bus_register(table_a, 2) == ESP_OK, caso, "registro");
+    check(cmd_bus_register(table_b, 1) == ESP_OK, caso, "segundo registro");
+    cmd_bus_set_reply(CMD_SRC_MQTT, on_reply, &rec_mqtt);
+    cmd_bus_set_reply(CMD_SRC_UART, on_reply, &rec_uart);
+    cmd_bus_set_reply(CMD_SRC_COUNT, on_reply, &rec_uart);             // fuera de rango: ignorado
+
+    host_task_fail = 1;
+    check(cmd_bus_start(5) == ESP_ERR_NO_MEM && s_queue == NULL, caso, "sin tarea no queda la cola");
+    host_task_fail = 0;
+    check(cmd_bus_start(5) == ESP_OK && host_tasks_created == 1, caso, "arranque");
+    check(cmd_bus_start(5) == ESP_ERR_INVALID_STATE, caso, "segundo arranque");
+    check(cmd_bus_register(table_b, 1) == ESP_ERR_INVALID_STATE, caso, "registro después de arrancar");
+    check(post(CMD_SRC_COUNT, 0, "pump on") == ESP_ERR_INVALID_STATE, caso, "origen fuera de rango");
+
+    // Comando con id, CR/LF y más palabras que argv: el id llega a la respuesta
+    host_time_us = 1000;
+    check(post(CMD_SRC_MQTT, 77, "PUMP on a b c d e #42\r\n") == ESP_OK, caso, "post con id");
+    host_time_us = 1500;
+    check(run_queue() == 1, caso, "una línea en la cola");
+    snprintf(msg, sizeof(msg), "argv \"%s\", id \"%s\", respuesta \"%s\"", last_args, rec_mqtt.id, rec_mqtt.reply);
+    check(strcmp(last_args, "PUMP|on|a|b|c|d") == 0 && strcmp(rec_mqtt.id, "42") == 0 &&
+          rec_mqtt.tag == 77 && rec_mqtt.status == 0 && strcmp(rec_mqtt.reply, "6 \"args\"") == 0, caso, msg);
+    const char *want_ack = "{\"id\":\"42\",\"ok\":true,\"reply\":\"6 'args'\",\"rx_us\":1000,\"act_us\":1500}";
+    snprintf(msg, sizeof(msg), "ack %s", rec_mqtt.ack);
+    check(rec_mqtt.ack_len == (int)strlen(want_ack) && strcmp(rec_mqtt.ack, want_ack) == 0, caso, msg);
+    cmd_bus_get_stats(&st);
+    check(st.posted == 1 && st.executed == 1 && st.last_us == 500 && st.max_us == 500 && st.total_us == 500,
+          caso, "estadísticas del primer comando");
+    check(strstr(host_last_log, "mqtt 'PUMP' #42 -> 0 in 500 us") != NULL, caso, host_last_log);
+
+    // Sin id: el del comando anterior no queda
+    check(post(CMD_SRC_UART, 3, "calA 1.5") == ESP_OK && run_queue() == 1, caso, "post sin id");
+    check(rec_uart.calls == 1 && rec_uart.tag == 3 && rec_uart.id[0] == '\0' && rec_mqtt.calls == 1 &&
+          strcmp(last_args, "calA|1.5") == 0, caso, "respuesta al origen, sin id");
+    check(strncmp(rec_uart.ack, "{\"id\":\"\",\"ok\":true", 18) == 0, caso, rec_uart.ack);
+
+    // Falla, desconocido, help, solo el id y línea en blanco
+    check(post(CMD_SRC_MQTT, 1, "fail #x") == ESP_OK && run_queue() == 1 && rec_mqtt.status == 1 &&
+          strcmp(rec_mqtt.id, "x") == 0 && strncmp(rec_mqtt.ack, "{\"id\":\"x\",\"ok\":false", 20) == 0,
+          caso, "handler que falla");
+    check(post(CMD_SRC_MQTT, 1, "nope") == ESP_OK && run_queue() == 1 && rec_mqtt.status == -1 &&
+          strstr(rec_mqtt.reply, "unknown command 'nope'") != NULL, caso, "comando desconocido");
+    check(post(CMD_SRC_MQTT, 1, "#5") == ESP_OK && run_queue() == 1 && rec_mqtt.status == -1 &&
+          rec_mqtt.id[0] == '\0' && strstr(rec_mqtt.reply, "'#5'") != NULL, caso, "solo el id es un comando");
+    check(post(CMD_SRC_MQTT, 1, "HeLp") == ESP_OK && run_queue() == 1 && rec_mqtt.status == 0 &&
+          strcmp(rec_mqtt.reply, "commands: help pump calA fail") == 0, caso, rec_mqtt.reply);
+    int before = rec_mqtt.calls;
+    check(post(CMD_SRC_MQTT, 1, " \t ") == ESP_OK && run_queue() == 1 && rec_mqtt.calls == before, caso,
+          "línea en blanco sin respuesta");
+    handler_calls = 0;
+    check(post(CMD_SRC_CONSOLE, 1, "pump off") == ESP_OK && run_queue() == 1 && handler_calls == 1, caso,
+          "origen sin callback: se ejecuta y la respuesta se descarta");
+    cmd_bus_get_stats(&st);
+    snprintf(msg, sizeof(msg), "posted %" PRIu32 " executed %" PRIu32 " failed %" PRIu32 " unknown %" PRIu32,
+             st.posted, st.executed, st.failed, st.unknown);
+    check(st.posted == 8 && st.executed == 5 && st.failed == 1 && st.unknown == 2, caso, msg);
+
+    // Largo de línea
+    char line[CMD_BUS_MAX_LINE + 3];
+    memset(line, 'a', sizeof(line));
+    line[CMD_BUS_MAX_LINE] = '\0';
+    check(post(CMD_SRC_MQTT, 1, line) == ESP_OK, caso, "línea del largo máximo");
+    run_queue();
+    memcpy(line + CMD_BUS_MAX_LINE, "\r\n", 3);
+    check(post(CMD_SRC_MQTT, 1, line) == ESP_OK, caso, "largo máximo más CR/LF");
+    run_queue();
+    line[CMD_BUS_MAX_LINE] = 'a';
+    line[CMD_BUS_MAX_LINE + 1] = '\0';
+    check(post(CMD_SRC_MQTT, 1, line) == ESP_ERR_INVALID_SIZE, caso, "línea demasiado larga");
+    check(post(CMD_SRC_MQTT, 1, "\r\n") == ESP_ERR_INVALID_SIZE, caso, "línea vacía");
+    cmd_bus_get_stats(&st);
+    check(st.rejected == 1, caso, "solo la línea larga cuenta como rechazada");
+
+    // Cola llena
+    for (int i = 0; i < CMD_BUS_QUEUE_LEN; i++) {
+        post(CMD_SRC_MQTT, (uint32_t)i, "pump on");
+    }
+    cmd_bus_get_stats(&st);
+    check(st.queue_depth == CMD_BUS_QUEUE_LEN, caso, "profundidad de la cola");
+    check(post(CMD_SRC_MQTT, 99, "pump on") == ESP_ERR_TIMEOUT, caso, "cola llena");
+    check(run_queue() == CMD_BUS_QUEUE_LEN && rec_mqtt.tag == CMD_BUS_QUEUE_LEN - 1, caso,
+          "la cola se vacía en orden");
+    cmd_bus_get_stats(&st);
+    check(st.rejected == 2 && st.queue_depth == 0, caso, "rechazo por cola llena");
+
+    // Ack que no entra en el buffer
+    char small[40];
+    check(cmd_bus_format_ack(small, 10, 0, "x") == -1, caso, "ack sin lugar para el encabezado");
+    check(cmd_bus_format_ack(small, sizeof(small), 0, "x") == -1, caso, "ack sin lugar para los tiempos");
+    char ack[128];
+    check(cmd_bus_format_ack(ack, sizeof(ack), 0, "a\nb\"c\\d") > 0 && strstr(ack, "\"reply\":\"a'b'c'd\"") != NULL,
+          caso, "ack con saltos, comillas y barras en la respuesta");
+    check(strcmp(cmd_bus_source_name(CMD_SRC_UART), "uart") == 0 &&
+          strcmp(cmd_bus_source_name(CMD_SRC_COUNT), "?") == 0, caso, "nombres de origen");
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "s:")) != -1) {
+        switch (c) {
+        case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "uso: %s [-s semilla]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rng_state == 0) {
+        fprintf(stderr, "semilla distinta de 0\n");
+        return 2;
+    }
+
+    test_tokenize();
+    test_take_id();
+    test_bus();
+
+    printf("%s (%d verificaciones, %d fallas)\n", failures ? "FALLA" : "OK", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+/* Sustituto de host: guarda la última línea de log (sin imprimirla) */
+#include <stdarg.h>
+#include <stdio.h>
+
+static char host_last_log[512];
+
+__attribute__((format(printf, 2, 3)))
+static inline void host_log(const char *tag, const char *fmt, ...)
+{
+    int n = snprintf(host_last_log, sizeof(host_last_log), "%s: ", tag);
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(host_last_log + n, sizeof(host_last_log) - (size_t)n, fmt, ap);
+    va_end(ap);
+}
+
+#define ESP_LOGE(tag, ...) host_log(tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) host_log(tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) host_log(tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) host_log(tag, __VA_ARGS__)
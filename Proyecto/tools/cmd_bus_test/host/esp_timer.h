@@ -0,0 +1,10 @@
+#pragma once
+/* Sustituto de host: reloj en µs que maneja la prueba */
+#include <stdint.h>
+
+static int64_t host_time_us;
+
+static inline int64_t esp_timer_get_time(void)
+{
+    return host_time_us;
+}
@@ -0,0 +1,23 @@
+#pragma once
+/*
+ * Sustituto de host de FreeRTOS para cmd_bus: tipos, y secciones críticas
+ * vacías (la prueba corre en un solo hilo).
+ */
+#include <stdint.h>
+
+typedef unsigned int UBaseType_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          pdTRUE
+#define portMAX_DELAY   ((TickType_t)0xffffffffu)
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux)      ((void)(mux))
+#define portEXIT_CRITICAL(mux)       ((void)(mux))
@@ -0,0 +1,64 @@
+#pragma once
+/* Sustituto de host: cola FIFO de copia, sin esperas (un solo hilo) */
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+    size_t item;
+    UBaseType_t len;
+    UBaseType_t head;
+    UBaseType_t count;
+    unsigned char *buf;
+} host_queue_t;
+
+typedef host_queue_t *QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreate(UBaseType_t len, size_t item)
+{
+    QueueHandle_t q = calloc(1, sizeof(*q));
+    if (q) {
+        q->item = item;
+        q->len = len;
+        q->buf = calloc(len, item);
+        if (!q->buf) {
+            free(q);
+            q = NULL;
+        }
+    }
+    return q;
+}
+
+static inline void vQueueDelete(QueueHandle_t q)
+{
+    free(q->buf);
+    free(q);
+}
+
+static inline BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    (void)wait;
+    if (q->count == q->len) {
+        return pdFALSE;
+    }
+    memcpy(q->buf + ((q->head + q->count) % q->len) * q->item, item, q->item);
+    q->count++;
+    return pdTRUE;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+    (void)wait;
+    if (q->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, q->buf + q->head * q->item, q->item);
+    q->head = (q->head + 1) % q->len;
+    q->count--;
+    return pdTRUE;
+}
+
+static inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    return q->count;
+}
@@ -0,0 +1,23 @@
+#pragma once
+/*
+ * Sustituto de host: la tarea no se crea; la prueba saca las líneas de la
+ * cola y llama a execute() ella misma. host_task_fail simula falta de memoria.
+ */
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+static int host_tasks_created;
+static int host_task_fail;
+
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                     UBaseType_t prio, TaskHandle_t *handle)
+{
+    (void)fn; (void)name; (void)stack; (void)arg; (void)prio; (void)handle;
+    if (host_task_fail) {
+        return pdFALSE;
+    }
+    host_tasks_created++;
+    return pdPASS;
+}
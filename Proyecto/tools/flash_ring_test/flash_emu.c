@@ -0,0 +1,151 @@
+#include "flash_emu.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static bool in_range(const flash_emu_t *emu, uint32_t addr, uint32_t len)
+{
+    return addr <= emu->size && len <= emu->size - addr;
+}
+
+static int emu_read(void *ctx, uint32_t addr, void *dst, uint32_t len)
+{
+    flash_emu_t *emu = ctx;
+    if (emu->dead || !in_range(emu, addr, len)) {
+        return -1;
+    }
+    return pread(emu->fd, dst, len, addr) == (ssize_t)len ? 0 : -1;
+}
+
+static int emu_write(void *ctx, uint32_t addr, const void *src, uint32_t len)
+{
+    flash_emu_t *emu = ctx;
+    uint8_t cur[512];
+    const uint8_t *s = src;
+
+    if (emu->dead || !in_range(emu, addr, len)) {
+        return -1;
+    }
+    emu->writes++;
+    uint32_t todo = len;
+    if (emu->cut_budget >= 0 && (uint64_t)emu->cut_budget < len) {
+        todo = (uint32_t)emu->cut_budget;
+        emu->dead = true;
+        emu->cuts++;
+        emu->cut_addr = addr;
+        emu->cut_len = len;
+        emu->cut_done = todo;
+    }
+    if (emu->cut_budget >= 0) {
+        emu->cut_budget -= todo;
+    }
+
+    // Programar por tramos: solo se bajan bits
+    for (uint32_t off = 0; off < todo;) {
+        uint32_t n = todo - off < sizeof(cur) ? todo - off : (uint32_t)sizeof(cur);
+        if (pread(emu->fd, cur, n, addr + off) != (ssize_t)n) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t want = s[off + i];
+            emu->violations += (uint64_t)__builtin_popcount((unsigned)(want & ~cur[i]));
+            cur[i] &= want;
+        }
+        if (pwrite(emu->fd, cur, n, addr + off) != (ssize_t)n) {
+            return -1;
+        }
+        off += n;
+    }
+    return emu->dead ? -1 : 0;
+}
+
+static int emu_erase(void *ctx, uint32_t addr)
+{
+    flash_emu_t *emu = ctx;
+    if (emu->dead || addr % emu->sector_size || !in_range(emu, addr, emu->sector_size)) {
+        return -1;
+    }
+    uint8_t *ff = malloc(emu->sector_size);
+    if (ff == NULL) {
+        return -1;
+    }
+    memset(ff, 0xFF, emu->sector_size);
+    int rc = pwrite(emu->fd, ff, emu->sector_size, addr) == (ssize_t)emu->sector_size ? 0 : -1;
+    free(ff);
+    if (rc == 0) {
+        emu->erases[addr / emu->sector_size]++;
+    }
+    return rc;
+}
+
+int flash_emu_open(flash_emu_t *emu, const char *path, uint32_t size, uint32_t sector_size)
+{
+    memset(emu, 0, sizeof(*emu));
+    emu->fd = -1;
+    if (sector_size == 0 || size % sector_size || strlen(path) >= sizeof(emu->path)) {
+        return -1;
+    }
+    snprintf(emu->path, sizeof(emu->path), "%s", path);
+    emu->size = size;
+    emu->sector_size = sector_size;
+    emu->cut_budget = -1;
+    emu->erases = calloc(size / sector_size, sizeof(uint32_t));
+    emu->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (emu->erases == NULL || emu->fd < 0) {
+        flash_emu_close(emu);
+        return -1;
+    }
+    // Chip nuevo: todo en 0xFF, sin contar como borrado
+    uint8_t ff[512];
+    memset(ff, 0xFF, sizeof(ff));
+    for (uint32_t off = 0; off < size; off += sizeof(ff)) {
+        uint32_t n = size - off < sizeof(ff) ? size - off : (uint32_t)sizeof(ff);
+        if (pwrite(emu->fd, ff, n, off) != (ssize_t)n) {
+            flash_emu_close(emu);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int flash_emu_reopen(flash_emu_t *emu)
+{
+    if (emu->fd >= 0) {
+        close(emu->fd);
+    }
+    emu->fd = open(emu->path, O_RDWR);
+    emu->dead = false;
+    emu->cut_budget = -1;
+    return emu->fd >= 0 ? 0 : -1;
+}
+
+void flash_emu_close(flash_emu_t *emu)
+{
+    if (emu->fd >= 0) {
+        close(emu->fd);
+    }
+    emu->fd = -1;
+    free(emu->erases);
+    emu->erases = NULL;
+}
+
+void flash_emu_arm_cut(flash_emu_t *emu, int64_t bytes)
+{
+    emu->cut_budget = bytes;
+}
+
+flash_ring_io_t flash_emu_io(flash_emu_t *emu)
+{
+    flash_ring_io_t io = {
+        .read = emu_read,
+        .write = emu_write,
+        .erase_sector = emu_erase,
+        .ctx = emu,
+        .size = emu->size,
+        .sector_size = emu->sector_size,
+    };
+    return io;
+}
@@ -0,0 +1,51 @@
+#ifndef FLASH_EMU_H
+#define FLASH_EMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "flash_ring.h"
+
+/*
+ * Emulador de flash NOR sobre un archivo, para flash_ring en el host.
+ *
+ * Como en la NOR real, escribir solo baja bits (el byte queda en
+ * viejo & nuevo) y borrar un sector lo deja en 0xFF. Cada intento de subir
+ * un bit sin borrar se cuenta como violación. Se puede armar un corte de
+ * energía: la escritura que cruza el presupuesto de bytes graba solo la
+ * parte que entra y desde ahí toda operación falla hasta flash_emu_reopen(),
+ * que relee el archivo como un arranque nuevo. El borrado se considera
+ * atómico.
+ */
+
+typedef struct {
+    int fd;
+    char path[256];
+    uint32_t size;
+    uint32_t sector_size;
+    uint32_t *erases;          // Borrados por sector
+    uint64_t violations;       // Bits 0 -> 1 pedidos sin borrar
+    uint64_t writes;           // Escrituras aceptadas (completas o cortadas)
+    uint32_t cuts;             // Cortes de energía ocurridos
+    int64_t cut_budget;        // Bytes que se graban antes del corte (-1 = sin corte)
+    bool dead;                 // Se cortó la energía: todo falla hasta reopen
+    uint32_t cut_addr;         // Escritura cortada: dirección, largo pedido y grabado
+    uint32_t cut_len;
+    uint32_t cut_done;
+} flash_emu_t;
+
+/** Crea (o trunca) el archivo con todo borrado. 0 o negativo. */
+int flash_emu_open(flash_emu_t *emu, const char *path, uint32_t size, uint32_t sector_size);
+
+/** Cierra y reabre el archivo: simula el rearranque tras un corte. */
+int flash_emu_reopen(flash_emu_t *emu);
+
+void flash_emu_close(flash_emu_t *emu);
+
+/** Arma un corte de energía tras @p bytes bytes grabados (0 incluido; -1 lo desarma). */
+void flash_emu_arm_cut(flash_emu_t *emu, int64_t bytes);
+
+/** Interfaz para flash_ring_mount(). */
+flash_ring_io_t flash_emu_io(flash_emu_t *emu);
+
+#endif // FLASH_EMU_H
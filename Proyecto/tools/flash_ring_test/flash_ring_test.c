@@ -0,0 +1,411 @@
+/*
+ * Prueba de host del ring de registros en flash
+ * (components/storage/flash_ring.c, compilado tal cual) sobre el emulador
+ * NOR de flash_emu.c. Un modelo (cola de registros pendientes) dice qué
+ * debería devolver el ring después de cada operación. Tres fases:
+ *
+ *   - desborde: registros de largo fijo sin consumir; el primer descarte
+ *     llega con el ring lleno, descarta un sector entero de los más viejos
+ *     y el ring sigue guardando al menos flash_ring_capacity();
+ *   - aleatoria: altas de largo variable, consumos (con rachas sin enlace
+ *     que desbordan el ring), remontajes y cortes de energía en cualquier
+ *     byte de cualquier escritura (registro, palabra de estado o cabecera
+ *     de sector), seguidos de un remontaje;
+ *   - desgaste: flujo continuo de altas y consumos; todos los sectores se
+ *     borran la misma cantidad de veces (±1).
+ *
+ * En todas se verifica que el orden y el contenido de los pendientes, la
+ * cuenta de pendientes y la de descartados coinciden con el modelo, y que
+ * el ring nunca pide subir un bit sin borrar. Termina con código 1 si
+ * alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "flash_emu.h"
+#include "flash_ring.h"
+
+#define MODEL_MAX    65536u     // Potencia de dos
+#define SECTOR_HDR   8u         // Como en flash_ring.c
+#define RECORD_HDR   8u
+#define FIXED_LEN    20         // Largo de la fase de desborde y de desgaste
+#define VERIFY_EVERY 32         // Operaciones entre verificaciones completas
+
+typedef struct {
+    uint32_t sector_size;
+    uint32_t sectors;
+    uint32_t ops;
+    uint32_t seed;
+    const char *image;
+} test_options_t;
+
+typedef struct {
+    uint32_t id;
+    uint16_t len;
+} model_rec_t;
+
+static test_options_t opt = { .sector_size = 1024, .sectors = 8, .ops = 20000, .seed = 1,
+                              .image = "flash_ring_test.img" };
+static flash_emu_t emu;
+static flash_ring_t ring;
+static int failures;
+static uint64_t violations;     // Bits subidos sin borrar, de todas las imágenes
+static const char *phase = "";
+
+static model_rec_t model[MODEL_MAX];
+static uint32_t model_first, model_count, next_id = 1;
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA [%s] %s (pendientes: modelo %" PRIu32 ", ring %" PRIu32 ")\n",
+                   phase, what, model_count, ring.pending);
+        }
+    }
+}
+
+// Contenido del registro id: nunca 0xFF, así un corte dentro del payload
+// siempre deja bytes distintos de los que faltaban grabar
+static void payload_of(uint32_t id, uint16_t len, uint8_t *out)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        out[i] = (uint8_t)((id * 131u + i * 7u + (id >> 8)) % 255u);
+    }
+}
+
+static model_rec_t *model_at(uint32_t i)
+{
+    return &model[(model_first + i) & (MODEL_MAX - 1)];
+}
+
+static void model_pop(uint32_t n)
+{
+    model_first = (model_first + n) & (MODEL_MAX - 1);
+    model_count -= n;
+}
+
+/* Recorre los pendientes del ring y los compara con el modelo */
+static void verify(void)
+{
+    uint8_t buf[FLASH_RING_MAX_PAYLOAD], want[FLASH_RING_MAX_PAYLOAD];
+    flash_ring_pos_t it = flash_ring_begin(&ring);
+
+    check(ring.pending == model_count, "cuenta de pendientes distinta del modelo");
+    for (uint32_t i = 0; i < model_count; i++) {
+        uint16_t len = 0;
+        int got = flash_ring_next(&ring, &it, buf, sizeof(buf), &len);
+        if (got != 1) {
+            check(false, "faltan registros pendientes");
+            return;
+        }
+        const model_rec_t *m = model_at(i);
+        payload_of(m->id, m->len, want);
+        if (len != m->len || memcmp(buf, want, len) != 0) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "orden o contenido distinto en la posición %" PRIu32
+                     " (esperado id %" PRIu32 ")", i, m->id);
+            check(false, msg);
+            return;
+        }
+    }
+    uint16_t len;
+    check(flash_ring_next(&ring, &it, buf, sizeof(buf), &len) == 0, "registros de más tras el último pendiente");
+}
+
+/* Solo el más viejo, con un buffer más chico que el registro */
+static void verify_front(void)
+{
+    uint8_t buf[8], want[FLASH_RING_MAX_PAYLOAD];
+    flash_ring_pos_t it = flash_ring_begin(&ring);
+    uint16_t len = 0;
+    int got = flash_ring_next(&ring, &it, buf, sizeof(buf), &len);
+
+    check(ring.pending == model_count, "cuenta de pendientes distinta del modelo");
+    if (model_count == 0) {
+        check(got == 0, "registro pendiente con el modelo vacío");
+        return;
+    }
+    const model_rec_t *m = model_at(0);
+    payload_of(m->id, m->len, want);
+    check(got == 1 && len == m->len && memcmp(buf, want, len < sizeof(buf) ? len : sizeof(buf)) == 0,
+          "el más viejo no coincide con el modelo");
+}
+
+static int mount(void)
+{
+    flash_ring_io_t io = flash_emu_io(&emu);
+    int rc = flash_ring_mount(&ring, &io);
+    check(rc == 0, "flash_ring_mount() falló");
+    return rc;
+}
+
+static void fresh_image(void)
+{
+    violations += emu.violations;
+    flash_emu_close(&emu);
+    if (flash_emu_open(&emu, opt.image, opt.sector_size * opt.sectors, opt.sector_size) != 0) {
+        fprintf(stderr, "no se pudo crear %s\n", opt.image);
+        exit(2);
+    }
+    model_first = model_count = 0;
+    mount();
+}
+
+/* Corte de energía: rearrancar desde el archivo */
+static void power_cycle(void)
+{
+    if (flash_emu_reopen(&emu) != 0) {
+        fprintf(stderr, "no se pudo reabrir %s\n", opt.image);
+        exit(2);
+    }
+    mount();
+}
+
+/*
+ * Alta de un registro. Con un corte armado decide, según qué escritura se
+ * cortó y cuántos bytes llegó a grabar, si el registro sobrevive al remontaje.
+ * Devuelve los registros descartados por reciclar un sector.
+ */
+static uint32_t append(uint16_t len, bool cut_armed)
+{
+    uint8_t data[FLASH_RING_MAX_PAYLOAD];
+    uint32_t id = next_id++;
+    uint32_t dropped0 = ring.dropped, pending0 = ring.pending;
+
+    payload_of(id, len, data);
+    int rc = flash_ring_append(&ring, data, len);
+    uint32_t dropped = ring.dropped - dropped0;
+
+    // Los descartados salen del frente: los más viejos
+    check(dropped <= model_count, "más descartados que pendientes");
+    if (dropped > model_count) {
+        dropped = model_count;
+    }
+    model_pop(dropped);
+    check(dropped == 0 || pending0 >= dropped, "descarte sin pendientes suficientes");
+
+    bool stored = rc == 0;
+    if (emu.dead) {
+        check(cut_armed && rc != 0, "escritura cortada sin error");
+        // La cabecera de sector (secuencia y luego magic) ocupa los primeros bytes
+        bool sector_hdr = emu.cut_addr % opt.sector_size < SECTOR_HDR;
+        // Registro completo si entró el payload: el relleno que falta ya es 0xFF
+        stored = !sector_hdr && emu.cut_done >= RECORD_HDR + len;
+        bool torn = !sector_hdr && emu.cut_done > 0 && !stored;
+        power_cycle();
+        if (torn) {
+            check(ring.corrupt >= 1, "registro cortado no detectado al montar");
+        }
+    } else {
+        check(rc == 0, "flash_ring_append() falló sin corte");
+    }
+    if (stored) {
+        check(model_count < MODEL_MAX, "modelo lleno");
+        *model_at(model_count) = (model_rec_t){ id, len };
+        model_count++;
+    }
+    return dropped;
+}
+
+/* Consume n pendientes; con un corte, cuenta los que alcanzaron a marcarse */
+static void consume(uint32_t n)
+{
+    uint64_t writes0 = emu.writes;
+    int rc = flash_ring_consume(&ring, n);
+
+    if (emu.dead) {
+        uint32_t done = (uint32_t)(emu.writes - writes0) - 1;
+        // Una palabra de estado con algún byte en cero ya cuenta como entregada
+        if (emu.cut_done > 0) {
+            done++;
+        }
+        model_pop(done);
+        power_cycle();
+        return;
+    }
+    check(rc == 0, "flash_ring_consume() falló sin corte");
+    model_pop(n < model_count ? n : model_count);
+}
+
+static void phase_overflow(void)
+{
+    phase = "desborde";
+    fresh_image();
+    const uint32_t per_sector = (opt.sector_size - SECTOR_HDR) / flash_ring_record_size(FIXED_LEN);
+    const uint32_t capacity = flash_ring_capacity(&ring, FIXED_LEN);
+    check(capacity == per_sector * (opt.sectors - 1), "capacidad inesperada");
+
+    uint32_t first_drop = 0, drops = 0;
+    for (uint32_t k = 1; k <= 4 * opt.sectors * per_sector; k++) {
+        uint32_t pending0 = ring.pending;
+        uint32_t dropped = append(FIXED_LEN, false);
+        if (dropped) {
+            drops++;
+            if (first_drop == 0) {
+                first_drop = k;
+            }
+            check(dropped == per_sector, "un reciclado no descartó un sector entero");
+            check(pending0 >= capacity, "descarte antes de llenar la capacidad");
+        }
+        if (first_drop) {
+            check(ring.pending >= capacity, "quedan menos pendientes que la capacidad");
+        }
+        if (k % VERIFY_EVERY == 0) {
+            verify();
+        }
+    }
+    check(first_drop == opt.sectors * per_sector + 1, "primer descarte fuera de lugar");
+    check(ring.dropped == drops * per_sector, "cuenta de descartados distinta");
+    verify();
+    // Tras remontar se conservan los mismos pendientes en el mismo orden
+    mount();
+    check(ring.dropped == 0 && ring.corrupt == 0, "contadores inesperados tras remontar");
+    verify();
+    printf("desborde: %" PRIu32 " por sector, capacidad %" PRIu32 ", primer descarte en el alta %" PRIu32
+           ", %" PRIu32 " sectores reciclados con pendientes\n", per_sector, capacity, first_drop, drops);
+}
+
+static void phase_random(void)
+{
+    phase = "aleatoria";
+    fresh_image();
+    uint32_t appends = 0, consumes = 0, remounts = 0, cuts = 0, drops = 0;
+    bool offline = false;
+
+    for (uint32_t k = 0; k < opt.ops; k++) {
+        // Rachas sin enlace: solo altas, hasta desbordar el ring
+        if (rng() % 400 == 0) {
+            offline = !offline;
+        }
+        uint32_t a = rng() % 100;
+        if (offline && a >= 60 && a < 95) {
+            a = 10;
+        }
+        uint16_t len = (uint16_t)(1 + rng() % FLASH_RING_MAX_PAYLOAD);
+        uint32_t n = model_count ? 1 + rng() % (model_count < 12 ? model_count : 12) : 0;
+
+        if (a < 10) {
+            // Corte en un byte cualquiera de la próxima operación (o ninguno si no llega)
+            uint32_t cuts0 = emu.cuts;
+            flash_emu_arm_cut(&emu, rng() % (flash_ring_record_size(len) + 8));
+            if (offline || rng() & 1 || model_count == 0) {
+                drops += append(len, true) ? 1 : 0;
+                appends++;
+            } else {
+                consume(n);
+                consumes++;
+            }
+            if (emu.cuts != cuts0) {
+                cuts++;
+                verify();
+            }
+            flash_emu_arm_cut(&emu, -1);
+        } else if (a < 60) {
+            drops += append(len, false) ? 1 : 0;
+            appends++;
+        } else if (a < 95) {
+            consume(n);
+            consumes++;
+        } else {
+            mount();
+            remounts++;
+            verify();
+        }
+        verify_front();
+        if (k % VERIFY_EVERY == 0) {
+            verify();
+        }
+    }
+    verify();
+    power_cycle();
+    verify();
+    printf("aleatoria: %" PRIu32 " operaciones, %" PRIu32 " altas, %" PRIu32 " consumos, %" PRIu32
+           " remontajes, %" PRIu32 " cortes, %" PRIu32 " reciclados con pendientes, %" PRIu32 " pendientes al final\n",
+           opt.ops, appends, consumes, remounts, cuts, drops, model_count);
+}
+
+static void phase_wear(void)
+{
+    phase = "desgaste";
+    fresh_image();
+    const uint32_t per_sector = (opt.sector_size - SECTOR_HDR) / flash_ring_record_size(FIXED_LEN);
+    const uint32_t turns = 50;
+
+    // Entre la mitad y el total de un sector pendiente, consumiendo en tandas
+    for (uint32_t k = 0; k < turns * opt.sectors * per_sector; k++) {
+        check(append(FIXED_LEN, false) == 0, "descarte con el consumidor al día");
+        if (model_count > per_sector) {
+            consume(per_sector / 2);
+        }
+        if (k % (VERIFY_EVERY * 8) == 0) {
+            verify();
+        }
+    }
+    verify();
+
+    uint32_t min = UINT32_MAX, max = 0;
+    for (uint32_t s = 0; s < opt.sectors; s++) {
+        min = emu.erases[s] < min ? emu.erases[s] : min;
+        max = emu.erases[s] > max ? emu.erases[s] : max;
+    }
+    check(max - min <= 1, "desgaste desparejo entre sectores");
+    check(min >= turns, "menos vueltas al ring que las esperadas");
+    printf("desgaste: %" PRIu32 " vueltas, borrados por sector %" PRIu32 "..%" PRIu32 "\n", turns, min, max);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "S:n:o:r:f:")) != -1) {
+        switch (c) {
+        case 'S': opt.sector_size = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'n': opt.sectors = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'o': opt.ops = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'r': opt.seed = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'f': opt.image = optarg; break;
+        default:
+            fprintf(stderr, "uso: %s [-S bytes_sector] [-n sectores] [-o operaciones] [-r semilla] [-f imagen]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    // Cada sector debe admitir al menos un registro máximo
+    if (opt.sectors < 2 || opt.sector_size % 4 ||
+        opt.sector_size < SECTOR_HDR + flash_ring_record_size(FLASH_RING_MAX_PAYLOAD) ||
+        (uint64_t)opt.sectors * opt.sector_size > UINT32_MAX) {
+        fprintf(stderr, "geometría inválida: al menos 2 sectores de %" PRIu32 " bytes o más, múltiplo de 4\n",
+                SECTOR_HDR + flash_ring_record_size(FLASH_RING_MAX_PAYLOAD));
+        return 2;
+    }
+    rng_state = opt.seed ? opt.seed : 1;
+    emu.fd = -1;
+
+    printf("%" PRIu32 " sectores de %" PRIu32 " bytes, imagen %s\n", opt.sectors, opt.sector_size, opt.image);
+    phase_overflow();
+    phase_random();
+    phase_wear();
+    phase = "NOR";
+    violations += emu.violations;
+    check(violations == 0, "escritura que sube bits sin borrar");
+
+    flash_emu_close(&emu);
+    unlink(opt.image);
+    printf("%s (%d fallas)\n", failures ? "FALLA" : "OK", failures);
+    return failures ? 1 : 0;
+}
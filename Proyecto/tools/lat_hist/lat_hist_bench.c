@@ -0,0 +1,387 @@
+/*
+ * Histogramas de latencia (components/lat_hist) en el host: verificaciones y
+ * costo de registro con uno y varios hilos, snapshot y reporte JSON. Compila
+ * el código del firmware tal cual (C11 puro). Verifica:
+ *
+ *   - lat_hist_bucket_index() / lat_hist_bucket_upper() ida y vuelta en cada
+ *     límite de bucket (todas las potencias de dos incluidas), 0..3 exactos,
+ *     ancho de cada bucket <= 25 % y el bucket de desborde hasta UINT32_MAX;
+ *   - percentiles de distribuciones conocidas (uniforme, constante, bimodal,
+ *     aleatoria, todo en el desborde): el límite superior del bucket de la
+ *     muestra exacta, acotado por el máximo;
+ *   - seguimiento del máximo, también con hilos concurrentes;
+ *   - snapshot con reset deja buckets, cuenta y máximo en cero (también a
+ *     través del reporte JSON) y sin reset no toca nada;
+ *   - ninguna muestra perdida con hilos concurrentes.
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "lat_hist.h"
+
+#define ITERATIONS 10000000
+#define THREADS    4
+#define DIST_MAX   100000
+
+static lat_hist_t hist = LAT_HIST_INIT("bench");
+static lat_hist_t probe = LAT_HIST_INIT("probe");
+
+static int failures;
+static int checks;
+
+static void check(bool ok, const char *caso, const char *what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA [%s] %s\n", caso, what);
+        }
+    }
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Valores repartidos entre 0 y ~1 s, como latencias reales de distinto orden
+static uint32_t value(uint32_t i)
+{
+    return (i * 2654435761u) >> 12;
+}
+
+/* Comprueba que v cae en el bucket i: (upper(i - 1), upper(i)] */
+static void check_in_bucket(uint32_t v, const char *caso)
+{
+    size_t i = lat_hist_bucket_index(v);
+    bool ok = i < LAT_HIST_BUCKETS && v <= lat_hist_bucket_upper(i) && (i == 0 || v > lat_hist_bucket_upper(i - 1));
+    if (!ok) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "%" PRIu32 " us en el bucket %zu (%" PRIu32 "..%" PRIu32 ")", v, i,
+                 i > 0 ? lat_hist_bucket_upper(i - 1) + 1 : 0, lat_hist_bucket_upper(i));
+        check(false, caso, msg);
+    }
+}
+
+static void test_buckets(void)
+{
+    const char *caso = "buckets";
+    char msg[96];
+
+    for (uint32_t v = 0; v < 4; v++) {
+        check(lat_hist_bucket_index(v) == v && lat_hist_bucket_upper(v) == v, caso, "0..3 no son exactos");
+    }
+
+    // Ida y vuelta en cada límite: upper(i) es del bucket i y upper(i) + 1 del siguiente
+    for (size_t i = 0; i + 1 < LAT_HIST_BUCKETS; i++) {
+        uint32_t up = lat_hist_bucket_upper(i);
+        if (lat_hist_bucket_index(up) != i || lat_hist_bucket_index(up + 1) != i + 1) {
+            snprintf(msg, sizeof(msg), "bucket %zu: upper %" PRIu32 " -> %zu, upper + 1 -> %zu", i, up,
+                     lat_hist_bucket_index(up), lat_hist_bucket_index(up + 1));
+            check(false, caso, msg);
+        }
+        // Cada bucket abarca como mucho un 25 % de su valor inicial
+        if (i >= 4) {
+            uint32_t lo = lat_hist_bucket_upper(i - 1) + 1;
+            if ((uint64_t)(up - lo + 1) * 4 > lo) {
+                snprintf(msg, sizeof(msg), "bucket %zu (%" PRIu32 "..%" PRIu32 ") más ancho que 25 %%", i, lo, up);
+                check(false, caso, msg);
+            }
+        }
+    }
+
+    // Cada potencia de dos y sus vecinos, hasta 2^31
+    for (unsigned e = 0; e < 32; e++) {
+        uint32_t p = (uint32_t)1 << e;
+        check_in_bucket(p - 1, caso);
+        check_in_bucket(p, caso);
+        check_in_bucket(p + 1, caso);
+        if (e >= LAT_HIST_SUB_BITS) {
+            // Una potencia de dos siempre abre un bucket (salvo en el desborde)
+            size_t i = lat_hist_bucket_index(p);
+            check(i == LAT_HIST_BUCKETS - 1 || lat_hist_bucket_upper(i - 1) == p - 1, caso,
+                  "una potencia de dos no abre su bucket");
+        }
+    }
+
+    // Desborde: desde upper(penúltimo) + 1 hasta UINT32_MAX, todo en el último
+    uint32_t last_lo = lat_hist_bucket_upper(LAT_HIST_BUCKETS - 2) + 1;
+    check(last_lo > 100000000u && last_lo < 134217728u, caso, "el desborde no empieza entre 100 s y 2^27 us");
+    check(lat_hist_bucket_index(last_lo) == LAT_HIST_BUCKETS - 1, caso, "primer valor del desborde");
+    check(lat_hist_bucket_index(UINT32_MAX) == LAT_HIST_BUCKETS - 1, caso, "UINT32_MAX fuera del desborde");
+    check(lat_hist_bucket_index(1u << 31) == LAT_HIST_BUCKETS - 1, caso, "2^31 fuera del desborde");
+    check(lat_hist_bucket_upper(LAT_HIST_BUCKETS - 1) == UINT32_MAX, caso, "upper del desborde");
+    check(lat_hist_bucket_upper(LAT_HIST_BUCKETS + 10) == UINT32_MAX, caso, "upper fuera de rango");
+
+    // Barrido denso hasta 2^20 y valores aleatorios de 32 bits
+    size_t prev = 0;
+    for (uint32_t v = 0; v <= (1u << 20); v++) {
+        size_t i = lat_hist_bucket_index(v);
+        if (i < prev || i > prev + 1) {
+            check(false, caso, "el índice no crece de a un bucket");
+            break;
+        }
+        prev = i;
+    }
+    for (int k = 0; k < 1000000; k++) {
+        check_in_bucket(rng() >> (rng() % 32), caso);
+    }
+}
+
+/* Percentil esperado: límite superior del bucket de la muestra de ese rango, acotado por el máximo */
+static uint32_t expected_percentile(const uint32_t *sorted, uint32_t n, uint32_t permille)
+{
+    uint64_t rank = ((uint64_t)n * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint32_t exact = sorted[rank - 1];
+    uint32_t upper = lat_hist_bucket_upper(lat_hist_bucket_index(exact));
+    return upper < sorted[n - 1] ? upper : sorted[n - 1];
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void check_distribution(const char *caso, uint32_t *values, uint32_t n)
+{
+    static const uint32_t permilles[] = { 0, 1, 100, 500, 900, 950, 990, 995, 999, 1000 };
+    lat_hist_snapshot_t snap;
+    lat_hist_summary_t sum;
+    char msg[96];
+
+    lat_hist_snapshot(&probe, &snap, true);
+    for (uint32_t i = 0; i < n; i++) {
+        lat_hist_record(&probe, values[i]);
+    }
+    lat_hist_snapshot(&probe, &snap, true);
+    qsort(values, n, sizeof(values[0]), cmp_u32);
+    check(snap.count == n && snap.max == values[n - 1], caso, "cuenta o máximo del snapshot");
+
+    for (size_t k = 0; k < sizeof(permilles) / sizeof(permilles[0]); k++) {
+        uint32_t got = lat_hist_percentile(&snap, permilles[k]);
+        uint32_t want = expected_percentile(values, n, permilles[k]);
+        if (got != want) {
+            snprintf(msg, sizeof(msg), "p%.1f = %" PRIu32 " (esperado %" PRIu32 ")", permilles[k] / 10.0, got, want);
+            check(false, caso, msg);
+        }
+        // Informado por arriba, como mucho un 25 % por encima de la muestra exacta
+        uint64_t rank = ((uint64_t)n * permilles[k] + 999) / 1000;
+        uint32_t exact = values[rank ? rank - 1 : 0];
+        if (exact < lat_hist_bucket_upper(LAT_HIST_BUCKETS - 2) &&
+            (got < exact || (uint64_t)got > exact + (uint64_t)exact / 4 + 1)) {
+            snprintf(msg, sizeof(msg), "p%.1f = %" PRIu32 " lejos de la muestra %" PRIu32, permilles[k] / 10.0, got,
+                     exact);
+            check(false, caso, msg);
+        }
+    }
+    lat_hist_summarize(&snap, &sum);
+    check(sum.count == n && sum.max == values[n - 1] && sum.p50 == expected_percentile(values, n, 500) &&
+          sum.p90 == expected_percentile(values, n, 900) && sum.p99 == expected_percentile(values, n, 990),
+          caso, "lat_hist_summarize() distinto de los percentiles");
+}
+
+static void test_percentiles(void)
+{
+    static uint32_t v[DIST_MAX];
+    lat_hist_snapshot_t snap;
+    lat_hist_summary_t sum;
+
+    lat_hist_snapshot(&probe, &snap, true);
+    lat_hist_summarize(&snap, &sum);
+    check(snap.count == 0 && lat_hist_percentile(&snap, 500) == 0 && sum.p99 == 0 && sum.max == 0, "vacío",
+          "percentiles de un histograma vacío");
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        v[i] = i + 1;
+    }
+    check_distribution("uniforme 1..1000", v, 1000);
+    // Cuentas que no son múltiplo de 1000: el rango se redondea hacia arriba
+    check_distribution("uniforme 1..37", v, 37);
+
+    for (uint32_t i = 0; i < 777; i++) {
+        v[i] = 4242;
+    }
+    check_distribution("constante", v, 777);
+
+    v[0] = 0;
+    check_distribution("solo 0", v, 1);
+
+    // 99 % rápidas y 1 % lentas: p99 todavía rápido, p99.5 ya lento
+    for (uint32_t i = 0; i < 1000; i++) {
+        v[i] = i < 990 ? 100 + i % 7 : 50000 + i;
+    }
+    check_distribution("bimodal", v, 1000);
+
+    for (uint32_t i = 0; i < DIST_MAX; i++) {
+        // ~exponencial: la mitad cada vez que se duplica el valor
+        v[i] = (rng() & 0xFFF) >> (rng() % 12) << (rng() % 8);
+    }
+    check_distribution("aleatoria", v, DIST_MAX - 9);
+
+    for (uint32_t i = 0; i < 100; i++) {
+        v[i] = UINT32_MAX - i * 1000u;
+    }
+    check_distribution("desborde", v, 100);
+
+    // Control documentado: 1..1000 us en el reporte de texto
+    for (uint32_t i = 1; i <= 1000; i++) {
+        lat_hist_record(&hist, i);
+    }
+    char buf[256];
+    lat_hist_register(&hist);
+    lat_hist_format_text(buf, sizeof(buf), true);
+    printf("control 1..1000 us: %s\n\n", buf);
+    check(strcmp(buf, "bench n=1000 50/90/99/max=511/1000/1000/1000us") == 0, "control", "reporte de texto");
+}
+
+static void test_max(void)
+{
+    const char *caso = "máximo";
+    lat_hist_snapshot_t snap;
+
+    lat_hist_snapshot(&probe, &snap, true);
+    lat_hist_record(&probe, 0);
+    lat_hist_snapshot(&probe, &snap, false);
+    check(snap.max == 0 && snap.count == 1, caso, "solo un 0");
+
+    const uint32_t seq[] = { 500, 20, 900, 899, 1, 900, 70000, 3 };
+    uint32_t want = 0;
+    for (size_t i = 0; i < sizeof(seq) / sizeof(seq[0]); i++) {
+        lat_hist_record(&probe, seq[i]);
+        want = seq[i] > want ? seq[i] : want;
+        lat_hist_snapshot(&probe, &snap, false);
+        check(snap.max == want, caso, "el máximo no es el mayor registrado");
+    }
+    lat_hist_record(&probe, UINT32_MAX);
+    lat_hist_record(&probe, 5);
+    lat_hist_snapshot(&probe, &snap, true);
+    check(snap.max == UINT32_MAX, caso, "UINT32_MAX");
+    check(lat_hist_percentile(&snap, 1000) == UINT32_MAX, caso, "p100 con UINT32_MAX");
+}
+
+static void test_reset(void)
+{
+    const char *caso = "reset";
+    lat_hist_snapshot_t a, b;
+
+    lat_hist_snapshot(&probe, &a, true);
+    for (uint32_t i = 0; i < 5000; i++) {
+        lat_hist_record(&probe, value(i));
+    }
+    lat_hist_snapshot(&probe, &a, false);
+    lat_hist_snapshot(&probe, &b, false);
+    check(a.count == 5000 && memcmp(&a, &b, sizeof(a)) == 0, caso, "un snapshot sin reset cambió el histograma");
+
+    lat_hist_snapshot(&probe, &b, true);
+    check(memcmp(&a, &b, sizeof(a)) == 0, caso, "el snapshot con reset no devolvió lo acumulado");
+    lat_hist_snapshot(&probe, &b, false);
+    bool zero = b.count == 0 && b.max == 0;
+    for (size_t i = 0; i < LAT_HIST_BUCKETS; i++) {
+        zero = zero && b.bucket[i] == 0 && atomic_load(&probe.bucket[i]) == 0;
+    }
+    check(zero, caso, "buckets, cuenta o máximo distintos de cero tras el reset");
+
+    // La ventana siguiente empieza de cero
+    lat_hist_record(&probe, 7);
+    lat_hist_snapshot(&probe, &b, true);
+    check(b.count == 1 && b.max == 7 && b.bucket[lat_hist_bucket_index(7)] == 1, caso, "ventana tras el reset");
+
+    // El reporte JSON con reset también reinicia los histogramas registrados
+    char buf[256];
+    lat_hist_record(&hist, 300);
+    lat_hist_record(&hist, 310);
+    int n = lat_hist_encode_json(buf, sizeof(buf), true);
+    // 300 y 310 caen en el bucket 256..319: percentiles acotados por el máximo
+    check(n > 0 && strcmp(buf, "{\"bench\":[2,310,310,310,310]}") == 0, caso, "JSON con reset");
+    lat_hist_encode_json(buf, sizeof(buf), false);
+    check(strcmp(buf, "{\"bench\":[0,0,0,0,0]}") == 0, caso, "el JSON con reset no reinició");
+    check(lat_hist_encode_json(buf, 10, false) == -1, caso, "JSON en un buffer chico");
+}
+
+/* ---- Hilos concurrentes ---- */
+
+static void *record_worker(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < ITERATIONS / THREADS; i++) {
+        lat_hist_record(&hist, value(i));
+    }
+    // Cada hilo termina con un máximo propio: queda el mayor, sin importar el orden
+    lat_hist_record(&hist, 2000000000u + id);
+    return NULL;
+}
+
+int main(void)
+{
+    lat_hist_snapshot_t snap;
+    pthread_t th[THREADS];
+    char buf[256];
+
+    test_buckets();
+    test_percentiles();
+    test_max();
+    test_reset();
+
+    double t0 = now_ns();
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        lat_hist_record(&hist, value(i));
+    }
+    double t1 = now_ns();
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&th[i], NULL, record_worker, (void *)(uintptr_t)i);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    double t2 = now_ns();
+    lat_hist_snapshot(&hist, &snap, false);
+    if (snap.count != 2u * ITERATIONS + THREADS) {
+        snprintf(buf, sizeof(buf), "se perdieron muestras: %" PRIu32 " de %u", snap.count,
+                 2u * ITERATIONS + THREADS);
+        check(false, "hilos", buf);
+    }
+    check(snap.max == 2000000000u + THREADS - 1, "hilos", "máximo con hilos concurrentes");
+
+    const int reports = 100000;
+    double t3 = now_ns();
+    for (int i = 0; i < reports; i++) {
+        lat_hist_snapshot(&hist, &snap, false);
+    }
+    double t4 = now_ns();
+    for (int i = 0; i < reports; i++) {
+        lat_hist_encode_json(buf, sizeof(buf), false);
+    }
+    double t5 = now_ns();
+
+    printf("%-34s %10s\n", "operación", "ns");
+    printf("%-34s %10.1f\n", "lat_hist_record (1 hilo)", (t1 - t0) / ITERATIONS);
+    printf("%-34s %10.1f\n", "lat_hist_record (4 hilos, mismo)", (t2 - t1) / ITERATIONS);
+    printf("%-34s %10.1f\n", "lat_hist_snapshot", (t4 - t3) / reports);
+    printf("%-34s %10.1f\n", "lat_hist_encode_json (1 hist)", (t5 - t4) / reports);
+    printf("(%zu bytes por histograma)\n", sizeof(lat_hist_t));
+
+    printf("%s (%d verificaciones, %d fallas)\n", failures ? "FALLA" : "OK", checks, failures);
+    return failures ? 1 : 0;
+}
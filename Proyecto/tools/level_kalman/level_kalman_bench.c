@@ -0,0 +1,322 @@
+/*
+ * Filtro de Kalman del nivel (components/sensors/level_kalman) en el host:
+ * precisión sobre una cisterna simulada y costo por actualización. Compila
+ * el código del firmware tal cual (C11 puro).
+ *
+ * La simulación llena con la bomba por histéresis, consume con ventanas de
+ * consumo fuerte y mide con ruido, ecos perdidos, outliers, un corte corto
+ * del sensor y uno más largo que max_gap_s. Cada conmutación de la bomba se
+ * avisa al filtro como en el firmware (-x lo desactiva). Verifica, lejos de
+ * los cambios de caudal (el filtro necesita unos segundos para seguirlos):
+ *
+ *   - nivel filtrado con menos error que la lectura cruda;
+ *   - velocidad y tiempo hasta lleno/vacío cerca de los reales (el
+ *     tiempo, en relación a lo que falta o a 5 min si falta menos);
+ *   - ningún outlier mueve el estimado;
+ *   - durante el corte corto el estimado sigue válido por predicción y el
+ *     largo lo invalida hasta la primera lectura.
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "level_kalman.h"
+
+// Cisterna: cm por segundo
+#define FILL_CM_S    0.50
+#define DRAIN_CM_S   0.12
+#define BURST_CM_S   0.35       // consumo fuerte en ventanas de 10 min por hora
+#define LOW_CM       20.0
+#define HIGH_CM      180.0
+#define NOISE_CM     0.8        // ruido acotado en ±NOISE_CM (desvío ~0,23 cm)
+#define MISS_PCT     2
+#define OUTLIER_PERMILLE 5      // ecos espurios a ±20..40 cm
+#define SETTLE_S     60.0       // margen tras un cambio de caudal antes de evaluar
+#define ETA_ABS_MIN  5.0        // min: por debajo el error de tiempo se mide absoluto
+
+// Cortes del sensor: uno dentro de max_gap_s y otro más largo
+#define SHORT_CUT_AT_S  3600.0
+#define SHORT_CUT_S     20.0
+#define LONG_CUT_AT_S   10800.0
+#define LONG_CUT_S      300.0
+
+#define BENCH_SAMPLES 4096
+
+static level_kalman_config_t cfg = {
+    .meas_sd_cm = 1.0f,
+    .accel_noise = 0.01f,
+    .gate_sigma = 4.0f,
+    .max_rejects = 3,
+    .max_gap_s = 60.0f,
+    .full_cm = (float)HIGH_CM,
+    .stable_cm_min = 0.5f,
+};
+
+static uint32_t rng_state;
+static uint32_t failures;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double noise(void)
+{
+    double s = 0;
+    for (int i = 0; i < 4; i++) {
+        s += (double)rng() / UINT32_MAX - 0.5;
+    }
+    return s * NOISE_CM / 2.0;
+}
+
+static void check(bool ok, double t_s, const char *what)
+{
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA t=%.0f s: %s\n", t_s, what);
+        }
+    }
+}
+
+typedef struct {
+    double level;
+    bool pump;
+    double rate;             // cm/s vigente
+    double changed_at;       // último cambio de caudal
+} tank_t;
+
+// Retorna true si la bomba cambió de estado
+static bool tank_step(tank_t *tank, double t, double dt)
+{
+    bool was_on = tank->pump;
+    bool burst = fmod(t, 3600.0) >= 1800.0 && fmod(t, 3600.0) < 2400.0;
+    if (!tank->pump && tank->level < LOW_CM) {
+        tank->pump = true;
+    } else if (tank->pump && tank->level > HIGH_CM) {
+        tank->pump = false;
+    }
+    double rate = (tank->pump ? FILL_CM_S : 0.0) - (burst ? BURST_CM_S : DRAIN_CM_S);
+    if (rate != tank->rate) {
+        tank->rate = rate;
+        tank->changed_at = t;
+    }
+    tank->level += rate * dt;
+    if (tank->level < 0.0) {
+        tank->level = 0.0;
+    }
+    return tank->pump != was_on;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int simulate(double hours, uint32_t period_ms, uint32_t seed, bool hints, bool verbose)
+{
+    level_kalman_t kf;
+    level_kalman_out_t out;
+    tank_t tank = { .level = 100.0, .changed_at = 0.0 };
+    double dt = period_ms / 1000.0;
+    double raw_se = 0, filt_se = 0, rate_se = 0, eta_sum = 0, eta_max = 0;
+    uint32_t n_level = 0, n_rate = 0, n_eta = 0, outliers = 0, missed = 0, restarts = 0;
+    double short_cut_err = 0;
+    bool long_cut_invalid = false;
+    char msg[128];
+
+    rng_state = seed ? seed : 1;
+    level_kalman_init(&kf, &cfg);
+
+    for (double t = 0; t < hours * 3600.0; t += dt) {
+        // Como en el firmware: cada conmutación del relé avisa al filtro
+        if (tank_step(&tank, t, dt) && hints) {
+            level_kalman_maneuver(&kf);
+        }
+
+        bool cut = (t >= SHORT_CUT_AT_S && t < SHORT_CUT_AT_S + SHORT_CUT_S) ||
+                   (t >= LONG_CUT_AT_S && t < LONG_CUT_AT_S + LONG_CUT_S);
+        bool outlier = false;
+        double meas = tank.level + noise();
+        if (meas < 0.0) {
+            meas = 0.0;
+        }
+        if (cut || rng() % 100 < MISS_PCT) {
+            meas = -1.0;
+            missed++;
+        } else if (rng() % 1000 < OUTLIER_PERMILLE) {
+            meas += (rng() & 1 ? 1 : -1) * (20.0 + rng() % 21);
+            if (meas < 0.0) meas = 0.0;
+            outlier = true;
+            outliers++;
+        }
+
+        level_kalman_update(&kf, (float)meas, (float)dt, &out);
+        if (verbose) {
+            printf("%.1f,%.2f,%.2f,%d,%.2f,%.2f,%.2f,%.1f\n", t, tank.level, meas, out.valid,
+                   out.level_cm, tank.rate * 60.0, out.rate_cm_min, out.eta_min);
+        }
+
+        // Corte corto: sigue válido por predicción
+        if (t >= SHORT_CUT_AT_S && t < SHORT_CUT_AT_S + SHORT_CUT_S) {
+            check(out.valid && !out.measured, t, "estimado inválido durante un corte corto");
+            double e = fabs(out.level_cm - tank.level);
+            if (e > short_cut_err) short_cut_err = e;
+        }
+        // Corte largo: inválido pasado max_gap_s, válido con la primera lectura
+        if (t >= LONG_CUT_AT_S + cfg.max_gap_s + dt && t < LONG_CUT_AT_S + LONG_CUT_S) {
+            check(!out.valid && out.level_cm < 0.0f, t, "estimado válido tras un corte largo");
+            long_cut_invalid = true;
+        }
+        if (meas >= 0.0 && !outlier && !out.valid) {
+            restarts++;           // Primera lectura tras un reinicio
+        }
+
+        double since_change = t - tank.changed_at;
+        if (!out.valid || since_change < SETTLE_S || t < SETTLE_S) {
+            continue;
+        }
+
+        double err = out.level_cm - tank.level;
+        if (outlier) {
+            snprintf(msg, sizeof(msg), "un outlier movió el estimado %.1f cm", err);
+            check(fabs(err) < 3.0, t, msg);
+            continue;
+        }
+        if (meas >= 0.0) {
+            raw_se += (meas - tank.level) * (meas - tank.level);
+            filt_se += err * err;
+            n_level++;
+        }
+        double rate_err = out.rate_cm_min - tank.rate * 60.0;
+        rate_se += rate_err * rate_err;
+        n_rate++;
+
+        // Tiempo real hasta el límite en la dirección del caudal, a caudal constante
+        if (out.eta_min >= 0.0f && (out.rate_cm_min > 0) == (tank.rate > 0)) {
+            double left = tank.rate > 0 ? HIGH_CM - tank.level : -tank.level;
+            double real = left / (tank.rate * 60.0);
+            // Relativo, salvo en los últimos minutos donde basta el absoluto
+            double e = fabs(out.eta_min - real) / (real > ETA_ABS_MIN ? real : ETA_ABS_MIN);
+            if (e > eta_max) eta_max = e;
+            eta_sum += e;
+            n_eta++;
+        }
+    }
+
+    double raw_rms = sqrt(raw_se / (n_level ? n_level : 1));
+    double filt_rms = sqrt(filt_se / (n_level ? n_level : 1));
+    double rate_rms = sqrt(rate_se / (n_rate ? n_rate : 1));
+    printf("período %u ms, %.0f h, semilla %u%s: %u ecos perdidos, %u outliers, %u reinicios\n",
+           period_ms, hours, seed, hints ? "" : ", sin avisos de bomba", missed, outliers, kf.resets);
+    printf("  nivel RMS: crudo %.3f cm, filtrado %.3f cm\n", raw_rms, filt_rms);
+    double eta_mean = eta_sum / (n_eta ? n_eta : 1);
+    printf("  velocidad RMS %.3f cm/min\n", rate_rms);
+    printf("  tiempo hasta límite: error medio %.1f %%, peor %.1f %% (%u muestras)\n",
+           eta_mean * 100.0, eta_max * 100.0, n_eta);
+    printf("  corte de %.0f s: error máximo de la predicción %.2f cm\n", SHORT_CUT_S, short_cut_err);
+
+    check(filt_rms < 0.8 * raw_rms, 0, "el nivel filtrado no mejora la lectura cruda");
+    check(rate_rms < 1.0, 0, "error de velocidad mayor a 1 cm/min");
+    check(n_eta > 0 && eta_mean < 0.05, 0, "tiempo hasta límite con más de 5 % de error medio");
+    check(eta_max < 0.30, 0, "tiempo hasta límite con más de 30 % de error");
+    check(short_cut_err < 2.0, 0, "la predicción durante el corte corto se alejó más de 2 cm");
+    check(restarts <= kf.resets + 1, 0, "estimado inválido con lecturas válidas fuera de un reinicio");
+    check(long_cut_invalid || hours * 3600.0 < LONG_CUT_AT_S + LONG_CUT_S, 0,
+          "el corte largo no invalidó el estimado");
+    return 0;
+}
+
+static void bench(uint32_t iterations)
+{
+    static float meas[BENCH_SAMPLES];
+    level_kalman_t kf;
+    level_kalman_out_t out;
+    double sink = 0;
+
+    rng_state = 12345;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        meas[i] = rng() % 100 < MISS_PCT ? -1.0f : (float)(100.0 + 0.1 * i / 60.0 + noise());
+    }
+    level_kalman_init(&kf, &cfg);
+
+    double t0 = now_ns();
+#if HAVE_TSC
+    uint64_t c0 = __rdtsc();
+#endif
+    for (uint32_t i = 0; i < iterations; i++) {
+        level_kalman_update(&kf, meas[i % BENCH_SAMPLES], 1.0f, &out);
+        sink += out.level_cm;
+    }
+#if HAVE_TSC
+    uint64_t c1 = __rdtsc();
+#endif
+    double t1 = now_ns();
+
+    printf("\n%-34s %10s", "operación", "ns");
+#if HAVE_TSC
+    printf(" %10s", "ciclos TSC");
+#endif
+    printf("\n%-34s %10.1f", "level_kalman_update", (t1 - t0) / iterations);
+#if HAVE_TSC
+    printf(" %10.1f", (double)(c1 - c0) / iterations);
+#endif
+    printf("\n(%zu bytes de estado, suma de control %.0f)\n", sizeof(level_kalman_t), sink);
+}
+
+int main(int argc, char **argv)
+{
+    double hours = 6.0;
+    uint32_t period_ms = 1000;
+    uint32_t seed = 1;
+    uint32_t iterations = 10000000;
+    bool hints = true;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:s:r:q:m:n:xv")) != -1) {
+        switch (opt) {
+            case 'd': hours = atof(optarg); break;
+            case 's': period_ms = (uint32_t)atoi(optarg); break;
+            case 'r': seed = (uint32_t)atoi(optarg); break;
+            case 'q': cfg.accel_noise = (float)atof(optarg); break;
+            case 'm': cfg.meas_sd_cm = (float)atof(optarg); break;
+            case 'n': iterations = (uint32_t)atoi(optarg); break;
+            case 'x': hints = false; break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "uso: %s [-d horas] [-s período_ms] [-r semilla] "
+                                "[-q ruido_aceleración] [-m desvío_medición_cm] [-n iteraciones] [-x] [-v]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+    if (period_ms == 0) {
+        period_ms = 1;
+    }
+
+    simulate(hours, period_ms, seed, hints, verbose);
+    if (!verbose && iterations > 0) {
+        bench(iterations);
+    }
+    if (failures) {
+        printf("%u verificaciones fallidas\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,586 @@
+/*
+ * Prueba de host del enrutador de tópicos MQTT compartido
+ * (components/mqtt_router, compilado tal cual). Verifica:
+ *
+ *   - mqtt_router_match() contra las reglas de comodines de MQTT: casos
+ *     fijos ('+' de un nivel, también vacío; '#' al final, también sobre el
+ *     nivel padre; tópicos '$' fuera de los comodines iniciales) y filtros y
+ *     tópicos aleatorios contra un modelo que compara nivel por nivel;
+ *   - registro: filtros inválidos rechazados y tabla llena;
+ *   - despacho: cada tópico llama exactamente a las rutas que corresponden,
+ *     en orden de registro, también con tópicos exactos que comparten bucket
+ *     del hash; sin copia (mismos punteros) y contadores;
+ *   - reensamblado de mensajes fragmentados (current_data_offset): cualquier
+ *     partición entrega un solo mensaje con el tópico del primer fragmento y
+ *     el payload completo; un fragmento perdido, repetido o de otro mensaje
+ *     lo descarta; un primer fragmento nuevo reinicia; payload o tópico
+ *     demasiado grandes se cuentan y se descartan.
+ *
+ * Informa además el costo por despacho. Termina con código 1 si alguna
+ * verificación falla.
+ */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mqtt_router.h"
+
+#define MODEL_CASES   300000
+#define FRAG_MESSAGES 20000
+#define BENCH_ROUNDS  2000000
+#define MAX_CALLS     (MQTT_ROUTER_MAX_ROUTES + 1)
+
+static int failures;
+static int checks;
+
+static void check(bool ok, const char *caso, const char *what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA [%s] %s\n", caso, what);
+        }
+    }
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Llamadas registradas por el handler: ruta (ctx), punteros y longitudes recibidos */
+typedef struct {
+    int route;
+    const char *topic;
+    size_t topic_len;
+    const uint8_t *data;
+    size_t len;
+} call_t;
+
+static call_t calls[MAX_CALLS];
+static int ncalls;
+
+static void on_route(const char *topic, size_t topic_len, const uint8_t *data, size_t len, void *ctx)
+{
+    if (ncalls < MAX_CALLS) {
+        calls[ncalls] = (call_t){ (int)(intptr_t)ctx, topic, topic_len, data, len };
+    }
+    ncalls++;
+}
+
+/* Modelo: separa en niveles y compara uno por uno */
+static int split(const char *s, size_t n, const char **lv, size_t *ln, int max)
+{
+    int k = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= n && k < max; i++) {
+        if (i == n || s[i] == '/') {
+            lv[k] = s + start;
+            ln[k] = i - start;
+            k++;
+            start = i + 1;
+        }
+    }
+    return k;
+}
+
+static bool model_match(const char *filter, const char *topic, size_t topic_len)
+{
+    const char *fl[32], *tl[32];
+    size_t fn[32], tn[32];
+    int nf = split(filter, strlen(filter), fl, fn, 32);
+    int nt = split(topic, topic_len, tl, tn, 32);
+
+    if (topic_len > 0 && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+    for (int i = 0; i < nf; i++) {
+        if (fn[i] == 1 && fl[i][0] == '#') {
+            return true;                       // el resto, incluido el nivel padre
+        }
+        if (i >= nt) {
+            return false;
+        }
+        if (fn[i] == 1 && fl[i][0] == '+') {
+            continue;                          // un nivel cualquiera, también vacío
+        }
+        if (fn[i] != tn[i] || memcmp(fl[i], tl[i], fn[i]) != 0) {
+            return false;
+        }
+    }
+    return nf == nt;
+}
+
+static void expect_match(const char *filter, const char *topic, bool want)
+{
+    char msg[128];
+    bool got = mqtt_router_match(filter, topic, strlen(topic));
+    snprintf(msg, sizeof(msg), "\"%s\" contra \"%s\": %s (esperado %s)", filter, topic, got ? "sí" : "no",
+             want ? "sí" : "no");
+    check(got == want, "comodines", msg);
+    check(model_match(filter, topic, strlen(topic)) == want, "modelo", msg);
+}
+
+static void test_match_fixed(void)
+{
+    expect_match("a/b", "a/b", true);
+    expect_match("a/b", "a/bc", false);
+    expect_match("a/b", "a", false);
+    expect_match("a/b", "a/b/c", false);
+    expect_match("a/b", "A/b", false);
+    expect_match("+", "a", true);
+    expect_match("+", "", true);
+    expect_match("+", "a/b", false);
+    expect_match("+", "/a", false);
+    expect_match("+/+", "/a", true);
+    expect_match("a/+", "a/b", true);
+    expect_match("a/+", "a/", true);
+    expect_match("a/+", "a", false);
+    expect_match("a/+", "a/b/c", false);
+    expect_match("a/+/c", "a//c", true);
+    expect_match("a/+/c", "a/b/d", false);
+    expect_match("+/b/+", "x/b/y", true);
+    expect_match("#", "a/b/c", true);
+    expect_match("#", "", true);
+    expect_match("#", "/", true);
+    expect_match("a/#", "a", true);            // '#' incluye el nivel padre
+    expect_match("a/#", "a/", true);
+    expect_match("a/#", "a/b/c", true);
+    expect_match("a/#", "ab", false);
+    expect_match("a/#", "b/a", false);
+    expect_match("a/+/#", "a/b", true);
+    expect_match("a/+/#", "a", false);
+    expect_match("#", "$SYS/x", false);
+    expect_match("+/x", "$SYS/x", false);
+    expect_match("$SYS/#", "$SYS/x", true);
+    expect_match("a/#", "a/$x", true);
+    expect_match("cistern_control", "cistern_control", true);
+    expect_match("cistern/+", "cistern/pump_cmd", true);
+}
+
+/* Filtros y tópicos aleatorios con pocos valores por nivel: muchas coincidencias */
+static const char *const level_words[] = { "a", "b", "", "ab", "ba" };
+#define N_WORDS (sizeof(level_words) / sizeof(level_words[0]))
+
+static void random_topic(char *buf, size_t cap)
+{
+    int levels = 1 + rng() % 4;
+    size_t n = 0;
+    for (int i = 0; i < levels && n + 4 < cap; i++) {
+        const char *w = (i == 0 && rng() % 16 == 0) ? "$s" : level_words[rng() % N_WORDS];
+        n += (size_t)snprintf(buf + n, cap - n, "%s%s", i ? "/" : "", w);
+    }
+}
+
+static void random_filter(char *buf, size_t cap)
+{
+    int levels = 1 + rng() % 4;
+    size_t n = 0;
+    for (int i = 0; i < levels && n + 4 < cap; i++) {
+        uint32_t k = rng() % 8;
+        const char *w = k == 0 ? "+" : (k == 1 && i == levels - 1) ? "#" : level_words[rng() % N_WORDS];
+        n += (size_t)snprintf(buf + n, cap - n, "%s%s", i ? "/" : "", w);
+    }
+}
+
+static void test_match_model(void)
+{
+    int mismatches = 0, matches = 0;
+    char filter[48], topic[48];
+    for (int k = 0; k < MODEL_CASES; k++) {
+        random_filter(filter, sizeof(filter));
+        random_topic(topic, sizeof(topic));
+        bool want = model_match(filter, topic, strlen(topic));
+        bool got = mqtt_router_match(filter, topic, strlen(topic));
+        matches += want;
+        if (got != want && mismatches++ < 5) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "\"%s\" contra \"%s\": %s", filter, topic, got ? "sí" : "no");
+            check(false, "modelo", msg);
+        }
+        // El tópico no está terminado en NUL para el enrutador: un byte más no debe leerse
+        size_t tl = strlen(topic);
+        if (tl > 0) {
+            topic[tl] = 'x';
+            if (mqtt_router_match(filter, topic, tl) != want && mismatches++ < 5) {
+                check(false, "modelo", "leyó más allá de topic_len");
+            }
+            topic[tl] = '\0';
+        }
+    }
+    check(mismatches == 0, "modelo", "resultados distintos del modelo");
+    check(matches > MODEL_CASES / 20, "modelo", "muy pocas coincidencias: los casos no prueban nada");
+    printf("comodines: %d pares aleatorios, %d coinciden, %d diferencias\n", MODEL_CASES, matches, mismatches);
+}
+
+static void test_add(void)
+{
+    const char *caso = "registro";
+    static const char *const invalid[] = { "", "a/#/b", "a#", "#a", "a+", "+a", "a/b+", "a/+b", "##", "a/b#" };
+    static const char *const valid[] = { "a", "/", "+", "#", "a/+", "+/b", "a/#", "+/+/#", "/#", "a//b" };
+    static const char *const fill[MQTT_ROUTER_MAX_ROUTES] = {
+        "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7", "t8", "t9", "t10", "t11", "t12", "t13", "t14", "t15",
+    };
+    static mqtt_router_t r;
+    char msg[64];
+
+    mqtt_router_init(&r);
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        snprintf(msg, sizeof(msg), "filtro inválido \"%s\" aceptado", invalid[i]);
+        check(mqtt_router_add(&r, invalid[i], on_route, NULL) == -1, caso, msg);
+    }
+    check(mqtt_router_add(&r, NULL, on_route, NULL) == -1, caso, "filtro NULL aceptado");
+    check(mqtt_router_add(&r, "a", NULL, NULL) == -1, caso, "handler NULL aceptado");
+    check(r.count == 0, caso, "un rechazo ocupó lugar");
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        snprintf(msg, sizeof(msg), "filtro válido \"%s\" rechazado", valid[i]);
+        check(mqtt_router_add(&r, valid[i], on_route, NULL) == 0, caso, msg);
+    }
+
+    mqtt_router_init(&r);
+    for (int i = 0; i < MQTT_ROUTER_MAX_ROUTES; i++) {
+        check(mqtt_router_add(&r, fill[i], on_route, NULL) == 0, caso, "rechazada con lugar libre");
+    }
+    check(mqtt_router_add(&r, "extra", on_route, NULL) == -1, caso, "tabla llena aceptó una ruta");
+    check(mqtt_router_add(&r, "+", on_route, NULL) == -1, caso, "tabla llena aceptó un comodín");
+}
+
+/* FNV-1a como en el enrutador: para elegir tópicos que caen en el mismo bucket */
+static uint32_t fnv1a(const char *s, size_t n)
+{
+    uint32_t h = 2166136261u;
+    while (n--) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Despacha topic y compara las rutas llamadas (en orden) con want[0..nwant) */
+static void expect_routes(mqtt_router_t *r, const char *caso, const char *topic, const int *want, int nwant)
+{
+    static const uint8_t payload[] = "ON";
+    char msg[128];
+    ncalls = 0;
+    int ret = mqtt_router_dispatch(r, topic, strlen(topic), payload, 2);
+    bool ok = ret == nwant && ncalls == nwant;
+    for (int i = 0; ok && i < nwant; i++) {
+        ok = calls[i].route == want[i] && calls[i].topic == topic && calls[i].topic_len == strlen(topic) &&
+             calls[i].data == payload && calls[i].len == 2;
+    }
+    if (!ok) {
+        int n = snprintf(msg, sizeof(msg), "\"%s\": rutas", topic);
+        for (int i = 0; i < ncalls && i < MAX_CALLS && n < (int)sizeof(msg); i++) {
+            n += snprintf(msg + n, sizeof(msg) - (size_t)n, " %d", calls[i].route);
+        }
+        snprintf(msg + n, sizeof(msg) - (size_t)n, " (esperadas %d)", nwant);
+        check(false, caso, msg);
+    }
+}
+
+static void test_dispatch(void)
+{
+    const char *caso = "despacho";
+    static mqtt_router_t r;
+    static char same_bucket[3][16];
+
+    // Tres tópicos exactos en el mismo bucket, para recorrer la cadena
+    uint32_t target = fnv1a("cmd", 3) & (MQTT_ROUTER_BUCKETS - 1);
+    int found = 0;
+    for (int k = 0; found < 3 && k < 100000; k++) {
+        char t[16];
+        snprintf(t, sizeof(t), "c%d", k);
+        if ((fnv1a(t, strlen(t)) & (MQTT_ROUTER_BUCKETS - 1)) == target) {
+            strcpy(same_bucket[found++], t);
+        }
+    }
+    check(found == 3, caso, "no se hallaron tópicos del mismo bucket");
+
+    mqtt_router_init(&r);
+    mqtt_router_add(&r, "cistern_control", on_route, (void *)0);
+    mqtt_router_add(&r, "cistern/pump_cmd", on_route, (void *)1);
+    mqtt_router_add(&r, "cistern/+", on_route, (void *)2);
+    mqtt_router_add(&r, "cmd", on_route, (void *)3);
+    mqtt_router_add(&r, same_bucket[0], on_route, (void *)4);
+    mqtt_router_add(&r, same_bucket[1], on_route, (void *)5);
+    mqtt_router_add(&r, "#", on_route, (void *)6);
+    mqtt_router_add(&r, same_bucket[2], on_route, (void *)7);
+    mqtt_router_add(&r, "cistern_control", on_route, (void *)8);   // duplicada: también se llama
+
+    expect_routes(&r, caso, "cistern_control", (const int[]){ 0, 8, 6 }, 3);
+    expect_routes(&r, caso, "cistern/pump_cmd", (const int[]){ 1, 2, 6 }, 3);
+    expect_routes(&r, caso, "cistern/cmd", (const int[]){ 2, 6 }, 2);
+    expect_routes(&r, caso, "cmd", (const int[]){ 3, 6 }, 2);
+    expect_routes(&r, caso, same_bucket[0], (const int[]){ 4, 6 }, 2);
+    expect_routes(&r, caso, same_bucket[1], (const int[]){ 5, 6 }, 2);
+    expect_routes(&r, caso, same_bucket[2], (const int[]){ 7, 6 }, 2);
+    expect_routes(&r, caso, "cistern_contro", (const int[]){ 6 }, 1);
+    expect_routes(&r, caso, "$SYS/uptime", NULL, 0);
+    check(r.dispatched == 8 && r.unmatched == 1, caso, "contadores de despachados / sin ruta");
+
+    // Un prefijo o un tópico más largo con el mismo inicio no coinciden
+    mqtt_router_init(&r);
+    mqtt_router_add(&r, "cistern/cmd", on_route, (void *)0);
+    expect_routes(&r, caso, "cistern/cmd/ack", NULL, 0);
+    expect_routes(&r, caso, "cistern/cm", NULL, 0);
+    expect_routes(&r, caso, "cistern/cmd", (const int[]){ 0 }, 1);
+
+    // Sin rutas
+    mqtt_router_init(&r);
+    expect_routes(&r, caso, "x", NULL, 0);
+    check(r.unmatched == 1, caso, "sin rutas no contó el mensaje");
+}
+
+/*
+ * Entrega payload[0..len) en fragmentos de 1..max_frag bytes como el cliente
+ * (tópico solo en el primero). Puede omitir el fragmento número skip o repetir
+ * el número repeat si no es el último; *damaged indica si alguno ocurrió.
+ * Devuelve el retorno del último fragmento y suma en *intermediate los de los
+ * anteriores; deja en last_frags la cantidad de fragmentos.
+ */
+static int last_frags;
+
+static int feed_fragments(mqtt_router_t *r, const char *topic, const uint8_t *payload, int len, int max_frag,
+                          int skip, int repeat, int *intermediate, bool *damaged)
+{
+    int offset = 0, frag = 0, ret = 0;
+    *intermediate = 0;
+    *damaged = false;
+    do {
+        int n = 1 + (int)(rng() % (uint32_t)max_frag);
+        if (n > len - offset) {
+            n = len - offset;
+        }
+        bool last = offset + n >= len;
+        ret = 0;
+        if (frag == skip) {
+            *damaged = true;
+        } else {
+            ret = mqtt_router_feed(r, offset == 0 ? topic : NULL, offset == 0 ? (int)strlen(topic) : 0,
+                                   (const char *)payload + offset, n, offset, len);
+            if (frag == repeat && !last) {
+                // El mismo fragmento otra vez: ya no es el esperado
+                *intermediate += ret;
+                ret = mqtt_router_feed(r, NULL, 0, (const char *)payload + offset, n, offset, len);
+                *damaged = true;
+            }
+        }
+        offset += n;
+        last_frags = ++frag;
+        if (!last) {
+            *intermediate += ret;
+        }
+    } while (offset < len);
+    return ret;
+}
+
+static void test_fragments(void)
+{
+    const char *caso = "fragmentos";
+    static mqtt_router_t r;
+    static uint8_t payload[MQTT_ROUTER_MAX_PAYLOAD + 64];
+    const char *topic = "cistern/cmd";
+    int bad = 0, delivered = 0, dropped = 0;
+
+    mqtt_router_init(&r);
+    mqtt_router_add(&r, "cistern/+", on_route, (void *)1);
+
+    for (int k = 0; k < FRAG_MESSAGES; k++) {
+        int len = 2 + (int)(rng() % (MQTT_ROUTER_MAX_PAYLOAD - 1));
+        for (int i = 0; i < len; i++) {
+            payload[i] = (uint8_t)rng();
+        }
+        int max_frag = 1 + (int)(rng() % (uint32_t)len);
+        int mode = (int)(rng() % 8);
+        // Perder cualquier fragmento o repetir uno intermedio: el mensaje se descarta
+        int skip = mode == 0 ? (int)(rng() % 3) : -1;
+        int repeat = mode == 1 ? 1 + (int)(rng() % 2) : -1;
+
+        int intermediate;
+        bool damaged;
+        ncalls = 0;
+        int ret = feed_fragments(&r, topic, payload, len, max_frag, skip, repeat, &intermediate, &damaged);
+
+        if (damaged) {
+            if ((ncalls != 0 || ret != 0) && bad++ < 5) {
+                check(false, caso, "mensaje entregado tras perder o repetir un fragmento");
+            }
+            dropped++;
+            continue;
+        }
+        delivered++;
+        bool ok = ret == 1 && ncalls == 1 && intermediate == 0 && calls[0].len == (size_t)len &&
+                  calls[0].topic_len == strlen(topic) && memcmp(calls[0].topic, topic, strlen(topic)) == 0 &&
+                  memcmp(calls[0].data, payload, (size_t)len) == 0;
+        // Sin fragmentar, sin copia: el handler recibe el buffer del cliente
+        if (ok && last_frags == 1) {
+            ok = calls[0].data == payload && calls[0].topic == topic;
+        }
+        if (!ok && bad++ < 5) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "%d bytes en fragmentos de hasta %d: %d llamadas, retorno %d", len,
+                     max_frag, ncalls, ret);
+            check(false, caso, msg);
+        }
+    }
+    check(bad == 0, caso, "mensajes mal reensamblados o entregados tras perder un fragmento");
+    printf("fragmentos: %d mensajes entregados, %d descartados por fragmento perdido o repetido, %d errores\n",
+           delivered, dropped, bad);
+
+    // Un primer fragmento nuevo descarta el mensaje a medias y se reensambla el nuevo
+    int intermediate;
+    bool damaged;
+    memset(payload, 'x', 100);
+    ncalls = 0;
+    check(mqtt_router_feed(&r, topic, (int)strlen(topic), (const char *)payload, 40, 0, 100) == 0, caso,
+          "primer fragmento despachado");
+    memset(payload, 'y', 100);
+    check(feed_fragments(&r, "cistern/b", payload, 100, 30, -1, -1, &intermediate, &damaged) == 1 && ncalls == 1 &&
+          calls[0].topic_len == 9 && memcmp(calls[0].data, payload, 100) == 0, caso,
+          "un mensaje nuevo no reemplazó al incompleto");
+    // El resto del mensaje viejo ya no se acepta
+    ncalls = 0;
+    check(mqtt_router_feed(&r, NULL, 0, (const char *)payload + 40, 60, 40, 100) == 0 && ncalls == 0, caso,
+          "se aceptó el resto de un mensaje descartado");
+
+    // Un fragmento de más allá del total anunciado descarta el mensaje
+    ncalls = 0;
+    mqtt_router_feed(&r, topic, (int)strlen(topic), (const char *)payload, 50, 0, 100);
+    check(mqtt_router_feed(&r, NULL, 0, (const char *)payload + 50, 60, 50, 100) == 0 && ncalls == 0, caso,
+          "fragmento que excede el total aceptado");
+
+    // Payload fragmentado mayor que el buffer: se cuenta y se descarta entero
+    uint32_t oversize = r.oversize;
+    ncalls = 0;
+    int big = MQTT_ROUTER_MAX_PAYLOAD + 1;
+    check(feed_fragments(&r, topic, payload, big, 200, -1, -1, &intermediate, &damaged) == 0 && ncalls == 0 &&
+          r.oversize == oversize + 1, caso, "payload mayor que el buffer");
+    // Justo del tamaño del buffer entra
+    ncalls = 0;
+    check(feed_fragments(&r, topic, payload, MQTT_ROUTER_MAX_PAYLOAD, 200, -1, -1, &intermediate, &damaged) == 1 &&
+          ncalls == 1 && calls[0].len == MQTT_ROUTER_MAX_PAYLOAD, caso, "payload del tamaño del buffer");
+
+    // Tópico fragmentado más largo que el buffer de tópico
+    char long_topic[MQTT_ROUTER_MAX_TOPIC + 2];
+    memset(long_topic, 'a', sizeof(long_topic));
+    memcpy(long_topic, "cistern/", 8);
+    long_topic[MQTT_ROUTER_MAX_TOPIC + 1] = '\0';
+    ncalls = 0;
+    check(feed_fragments(&r, long_topic, payload, 100, 30, -1, -1, &intermediate, &damaged) == 0 && ncalls == 0 &&
+          r.oversize == oversize + 2, caso, "tópico mayor que el buffer");
+    long_topic[MQTT_ROUTER_MAX_TOPIC] = '\0';
+    ncalls = 0;
+    check(feed_fragments(&r, long_topic, payload, 100, 30, -1, -1, &intermediate, &damaged) == 1 && ncalls == 1, caso,
+          "tópico del tamaño del buffer");
+
+    // Sin fragmentar no hay límite de tamaño (el payload no se copia)
+    ncalls = 0;
+    check(mqtt_router_feed(&r, topic, (int)strlen(topic), (const char *)payload, big, 0, big) == 1 &&
+          ncalls == 1 && calls[0].len == (size_t)big, caso, "mensaje completo grande");
+
+    // Entradas inválidas o vacías
+    ncalls = 0;
+    check(mqtt_router_feed(&r, topic, (int)strlen(topic), (const char *)payload, -1, 0, 10) == 0, caso,
+          "data_len negativo");
+    check(mqtt_router_feed(&r, NULL, 0, (const char *)payload, 5, 0, 5) == 0, caso, "mensaje sin tópico");
+    check(mqtt_router_feed(&r, topic, (int)strlen(topic), (const char *)payload, 5, 0, 2) == 1 &&
+          calls[0].len == 5, caso, "total menor que el fragmento: mensaje completo");
+    ncalls = 0;
+    check(mqtt_router_feed(&r, topic, (int)strlen(topic), (const char *)payload, 0, 0, 0) == 1 &&
+          ncalls == 1 && calls[0].len == 0, caso, "payload vacío");
+}
+
+static void test_payload_eq(void)
+{
+    const char *caso = "payload";
+    check(mqtt_router_payload_eq((const uint8_t *)"ON", 2, "on"), caso, "ON == on");
+    check(mqtt_router_payload_eq((const uint8_t *)"oFf", 3, "OFF"), caso, "oFf == OFF");
+    check(!mqtt_router_payload_eq((const uint8_t *)"ONX", 3, "on"), caso, "ONX != on");
+    check(mqtt_router_payload_eq((const uint8_t *)"ONX", 2, "on"), caso, "la longitud manda, no el NUL");
+    check(!mqtt_router_payload_eq((const uint8_t *)"O", 1, "on"), caso, "O != on");
+    check(mqtt_router_payload_eq((const uint8_t *)"", 0, ""), caso, "vacío == vacío");
+    check(!mqtt_router_payload_eq((const uint8_t *)"[", 1, "{"), caso, "solo letras ignoran mayúsculas");
+}
+
+static void noop(const char *topic, size_t topic_len, const uint8_t *data, size_t len, void *ctx)
+{
+    (void)topic; (void)topic_len; (void)data; (void)len; (void)ctx;
+}
+
+/* Costo por mensaje con la tabla llena: exactos + algunos comodines */
+static void bench(void)
+{
+    static mqtt_router_t r;
+    static char names[MQTT_ROUTER_MAX_ROUTES][24];
+    static const uint8_t payload[] = "ON";
+
+    mqtt_router_init(&r);
+    for (int i = 0; i < MQTT_ROUTER_MAX_ROUTES - 2; i++) {
+        snprintf(names[i], sizeof(names[i]), "cistern/cmd%02d", i);
+        mqtt_router_add(&r, names[i], noop, NULL);
+    }
+    mqtt_router_add(&r, "cistern/+/ack", noop, NULL);
+    mqtt_router_add(&r, "diag/#", noop, NULL);
+
+    const char *topics[] = { names[0], names[MQTT_ROUTER_MAX_ROUTES - 3], "cistern/x/ack", "otro/topico" };
+    for (size_t t = 0; t < sizeof(topics) / sizeof(topics[0]); t++) {
+        size_t len = strlen(topics[t]);
+        double t0 = now_ns();
+        volatile int sink = 0;
+        for (int k = 0; k < BENCH_ROUNDS; k++) {
+            sink += mqtt_router_dispatch(&r, topics[t], len, payload, 2);
+        }
+        printf("despacho \"%s\": %.1f ns (%d rutas, %d con comodín)\n", topics[t],
+               (now_ns() - t0) / BENCH_ROUNDS, r.count, r.wild_count);
+        (void)sink;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool run_bench = true;
+    int c;
+    while ((c = getopt(argc, argv, "ns:")) != -1) {
+        switch (c) {
+        case 'n': run_bench = false; break;
+        case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "uso: %s [-n sin medición] [-s semilla]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rng_state == 0) {
+        fprintf(stderr, "semilla distinta de 0\n");
+        return 2;
+    }
+
+    test_match_fixed();
+    test_match_model();
+    test_add();
+    test_dispatch();
+    test_fragments();
+    test_payload_eq();
+    if (run_bench) {
+        bench();
+    }
+
+    printf("%s (%d verificaciones, %d fallas)\n", failures ? "FALLA" : "OK", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Latencia de extremo a extremo del comando de bomba contra un broker MQTT.
+ *
+ * Envía N comandos "ON #<id>" / "OFF #<id>" alternados a ritmo fijo (lazo
+ * abierto: el horario de envío no espera a las confirmaciones) y empareja
+ * cada confirmación JSON del nodo por su ID. Informa la distribución del
+ * ida y vuelta medido en el host y de la latencia dentro del nodo
+ * (act_us - rx_us del propio nodo), más confirmaciones perdidas, tardías,
+ * duplicadas y fallidas. Los percentiles usan los histogramas del firmware
+ * (components/lat_hist).
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mosquitto.h>
+
+#include "lat_hist.h"
+
+typedef struct {
+    const char *host;
+    int port;
+    double rate;                // comandos por segundo
+    uint32_t count;
+    uint32_t timeout_ms;        // una confirmación más lenta cuenta como tardía
+    int qos;
+    const char *cmd_topic;
+    const char *ack_topic;
+} options_t;
+
+typedef struct {
+    uint32_t acked;
+    uint32_t late;
+    uint32_t duplicate;
+    uint32_t failed;            // "ok":false
+    uint32_t foreign;           // otra corrida, sin ID o ilegible
+} counters_t;
+
+static options_t opt = {
+    .host = "localhost",
+    .port = 1883,
+    .rate = 10.0,
+    .count = 100,
+    .timeout_ms = 2000,
+    .qos = 1,
+    .cmd_topic = "cistern_control",
+    .ack_topic = "cistern/pump_state/ack",
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t acked_cond = PTHREAD_COND_INITIALIZER;
+static int64_t *sent_ns;        // por secuencia; 0 = aún no enviado
+static uint8_t *seen;
+static counters_t counters;
+static unsigned run_id;
+static volatile bool subscribed;
+
+static lat_hist_t rtt_hist = LAT_HIST_INIT("rtt");
+static lat_hist_t node_hist = LAT_HIST_INIT("node");
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Valor de "key":<número> en un objeto JSON plano; false si falta
+static bool json_int(const char *json, const char *key, int64_t *out)
+{
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(json, pat);
+    if (!p) {
+        return false;
+    }
+    char *end;
+    *out = strtoll(p + strlen(pat), &end, 10);
+    return end != p + strlen(pat);
+}
+
+static void on_ack(struct mosquitto *mosq, void *obj, const struct mosquitto_message *msg)
+{
+    (void)mosq;
+    (void)obj;
+    int64_t rx_ns = now_ns();
+    char json[512];
+    size_t len = (size_t)msg->payloadlen < sizeof(json) - 1 ? (size_t)msg->payloadlen : sizeof(json) - 1;
+    memcpy(json, msg->payload, len);
+    json[len] = '\0';
+
+    // ID "<corrida>.<secuencia>"
+    unsigned run;
+    uint32_t seq;
+    int64_t dev_rx = 0, dev_act = 0;
+    const char *id = strstr(json, "\"id\":\"");
+    bool ours = id && sscanf(id + 6, "%x.%" SCNu32, &run, &seq) == 2 && run == run_id && seq < opt.count;
+
+    pthread_mutex_lock(&lock);
+    if (!ours || sent_ns[seq] == 0) {
+        counters.foreign++;
+    } else if (seen[seq]) {
+        counters.duplicate++;
+    } else {
+        seen[seq] = 1;
+        int64_t rtt_us = (rx_ns - sent_ns[seq]) / 1000;
+        if (rtt_us > (int64_t)opt.timeout_ms * 1000) {
+            counters.late++;
+        } else {
+            counters.acked++;
+            lat_hist_record(&rtt_hist, (uint32_t)rtt_us);
+            if (json_int(json, "rx_us", &dev_rx) && json_int(json, "act_us", &dev_act) && dev_act >= dev_rx) {
+                lat_hist_record(&node_hist, (uint32_t)(dev_act - dev_rx));
+            }
+        }
+        if (strstr(json, "\"ok\":false")) {
+            counters.failed++;
+        }
+        pthread_cond_signal(&acked_cond);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_count, const int *granted)
+{
+    (void)mosq;
+    (void)obj;
+    (void)mid;
+    (void)qos_count;
+    (void)granted;
+    subscribed = true;
+}
+
+static void print_hist(const char *label, lat_hist_t *h)
+{
+    lat_hist_snapshot_t snap;
+    lat_hist_summary_t s;
+    lat_hist_snapshot(h, &snap, false);
+    lat_hist_summarize(&snap, &s);
+    if (s.count == 0) {
+        printf("%-6s sin muestras\n", label);
+        return;
+    }
+    printf("%-6s n=%" PRIu32 "  p50=%.2f  p90=%.2f  p99=%.2f  max=%.2f ms\n", label, s.count,
+           s.p50 / 1000.0, s.p90 / 1000.0, s.p99 / 1000.0, s.max / 1000.0);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "uso: %s [-H host] [-p puerto] [-r cmd/s] [-n cantidad] [-t timeout_ms] [-q qos]\n"
+            "          [-c tópico_cmd] [-a tópico_ack] [-N]\n"
+            "  -N  tópicos de Node_Tank (cisterna/bomba/set, cisterna/bomba/ack)\n",
+            prog);
+}
+
+static bool parse_args(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "H:p:r:n:t:q:c:a:Nh")) != -1) {
+        switch (c) {
+        case 'H': opt.host = optarg; break;
+        case 'p': opt.port = atoi(optarg); break;
+        case 'r': opt.rate = atof(optarg); break;
+        case 'n': opt.count = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 't': opt.timeout_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'q': opt.qos = atoi(optarg); break;
+        case 'c': opt.cmd_topic = optarg; break;
+        case 'a': opt.ack_topic = optarg; break;
+        case 'N':
+            opt.cmd_topic = "cisterna/bomba/set";
+            opt.ack_topic = "cisterna/bomba/ack";
+            break;
+        default:
+            return false;
+        }
+    }
+    return opt.rate > 0 && opt.count > 0 && opt.qos >= 0 && opt.qos <= 2;
+}
+
+int main(int argc, char **argv)
+{
+    if (!parse_args(argc, argv)) {
+        usage(argv[0]);
+        return 2;
+    }
+    sent_ns = calloc(opt.count, sizeof(*sent_ns));
+    seen = calloc(opt.count, 1);
+    if (!sent_ns || !seen) {
+        return 2;
+    }
+    run_id = ((unsigned)getpid() ^ (unsigned)now_ns()) & 0xffff;
+
+    mosquitto_lib_init();
+    struct mosquitto *mosq = mosquitto_new(NULL, true, NULL);
+    if (!mosq) {
+        fprintf(stderr, "mosquitto_new falló\n");
+        return 2;
+    }
+    mosquitto_message_callback_set(mosq, on_ack);
+    mosquitto_subscribe_callback_set(mosq, on_subscribe);
+    int rc = mosquitto_connect(mosq, opt.host, opt.port, 30);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        fprintf(stderr, "conexión a %s:%d: %s\n", opt.host, opt.port, mosquitto_strerror(rc));
+        return 2;
+    }
+    mosquitto_loop_start(mosq);
+    mosquitto_subscribe(mosq, NULL, opt.ack_topic, 1);
+    for (int i = 0; i < 200 && !subscribed; i++) {
+        usleep(10000);
+    }
+
+    printf("%" PRIu32 " comandos a %.1f/s: %s -> %s (corrida %04x)\n", opt.count, opt.rate,
+           opt.cmd_topic, opt.ack_topic, run_id);
+
+    // Horario absoluto: un envío lento no corre los siguientes
+    int64_t period_ns = (int64_t)(1e9 / opt.rate);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint32_t publish_errors = 0;
+    for (uint32_t seq = 0; seq < opt.count; seq++) {
+        char payload[48];
+        int len = snprintf(payload, sizeof(payload), "%s #%04x.%" PRIu32, seq % 2 ? "OFF" : "ON", run_id, seq);
+        pthread_mutex_lock(&lock);
+        sent_ns[seq] = now_ns();
+        pthread_mutex_unlock(&lock);
+        if (mosquitto_publish(mosq, NULL, opt.cmd_topic, len, payload, opt.qos, false) != MOSQ_ERR_SUCCESS) {
+            publish_errors++;
+        }
+
+        next.tv_nsec += period_ns % 1000000000;
+        next.tv_sec += period_ns / 1000000000 + next.tv_nsec / 1000000000;
+        next.tv_nsec %= 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+    }
+
+    // Esperar las confirmaciones que faltan hasta el timeout del último envío
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += opt.timeout_ms / 1000;
+    deadline.tv_nsec += (long)(opt.timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&lock);
+    while (counters.acked + counters.late < opt.count &&
+           pthread_cond_timedwait(&acked_cond, &lock, &deadline) != ETIMEDOUT) {
+    }
+    counters_t c = counters;
+    pthread_mutex_unlock(&lock);
+
+    // Dejar la bomba apagada pase lo que pase
+    mosquitto_publish(mosq, NULL, opt.cmd_topic, 3, "OFF", opt.qos, false);
+    mosquitto_disconnect(mosq);
+    mosquitto_loop_stop(mosq, false);
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+
+    uint32_t lost = opt.count - c.acked - c.late;
+    printf("enviados %" PRIu32 "  confirmados %" PRIu32 "  perdidos %" PRIu32 " (%.1f %%)  tardíos %" PRIu32
+           "  duplicados %" PRIu32 "  fallidos %" PRIu32 "  ajenos %" PRIu32 "  errores de envío %" PRIu32 "\n",
+           opt.count, c.acked, lost, 100.0 * lost / opt.count, c.late, c.duplicate, c.failed, c.foreign,
+           publish_errors);
+    print_hist("rtt", &rtt_hist);
+    print_hist("nodo", &node_hist);
+
+    free(sent_ns);
+    free(seen);
+    return lost || c.late ? 1 : 0;
+}
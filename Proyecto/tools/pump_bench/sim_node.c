@@ -0,0 +1,173 @@
+/*
+ * Nodo simulado en el host para probar pump_bench sin hardware.
+ *
+ * Atiende los mismos tópicos de comando que el firmware (enrutados con
+ * components/mqtt_router), entiende "ON|OFF [#<id>]", espera un retardo
+ * de actuación configurable y contesta como el firmware: estado retenido
+ * y, si el comando traía ID, la confirmación JSON de cmd_bus_format_ack()
+ * con marcas en µs del reloj monotónico del host. Los comandos se atienden
+ * de a uno, como el worker del bus de comandos.
+ */
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mosquitto.h>
+
+#include "mqtt_router.h"
+
+#define MAX_ID 24       // CMD_BUS_MAX_ID
+
+typedef struct {
+    const char *state_topic;
+    const char *ack_topic;
+    const char *cmd_topics[2];
+} node_topics_t;
+
+static const node_topics_t nodo_cisterna = {
+    "cistern/pump_state", "cistern/pump_state/ack", { "cistern_control", "cistern/pump_cmd" },
+};
+static const node_topics_t node_tank = {
+    "cisterna/bomba/state", "cisterna/bomba/ack", { "cisterna/bomba/set", NULL },
+};
+
+static const node_topics_t *topics = &nodo_cisterna;
+static const char *host = "localhost";
+static int port = 1883;
+static uint32_t delay_us = 1000;
+static unsigned loss_pct;
+
+static struct mosquitto *mosq;
+static mqtt_router_t routes;
+static bool pump_on;
+static uint32_t received, dropped_acks;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void on_pump_command(const char *topic, size_t topic_len,
+                            const uint8_t *data, size_t len, void *ctx)
+{
+    (void)topic;
+    (void)topic_len;
+    (void)ctx;
+    int64_t rx_us = now_us();
+    received++;
+
+    // "<palabra> [#<id>]"; el ID se sanea igual que en cmd_bus
+    char line[64], id[MAX_ID + 1] = "";
+    snprintf(line, sizeof(line), "%.*s", (int)(len < sizeof(line) - 1 ? len : sizeof(line) - 1), (const char *)data);
+    char *word = strtok(line, " \t");
+    char *tag = strtok(NULL, " \t");
+    if (tag && tag[0] == '#' && tag[1]) {
+        size_t k = 0;
+        for (; tag[k + 1] && k < MAX_ID; k++) {
+            char ch = tag[k + 1];
+            id[k] = (ch == '"' || ch == '\\' || (unsigned char)ch < 0x20) ? '_' : ch;
+        }
+        id[k] = '\0';
+    }
+
+    bool ok = word && (strcasecmp(word, "ON") == 0 || strcasecmp(word, "OFF") == 0);
+    if (ok) {
+        struct timespec d = { .tv_sec = delay_us / 1000000, .tv_nsec = (long)(delay_us % 1000000) * 1000 };
+        nanosleep(&d, NULL);
+        pump_on = strcasecmp(word, "ON") == 0;
+    }
+    const char *state = pump_on ? "ON" : "OFF";
+    mosquitto_publish(mosq, NULL, topics->state_topic, (int)strlen(state), state, 1, true);
+
+    if (!id[0]) {
+        return;
+    }
+    if (loss_pct && (unsigned)(rand() % 100) < loss_pct) {
+        dropped_acks++;
+        return;
+    }
+    char ack[160];
+    int n = snprintf(ack, sizeof(ack),
+                     "{\"id\":\"%s\",\"ok\":%s,\"reply\":\"%s\",\"rx_us\":%" PRId64 ",\"act_us\":%" PRId64 "}",
+                     id, ok ? "true" : "false", ok ? state : "usage: pump on|off|auto|state", rx_us, now_us());
+    mosquitto_publish(mosq, NULL, topics->ack_topic, n, ack, 1, false);
+}
+
+static void on_message(struct mosquitto *m, void *obj, const struct mosquitto_message *msg)
+{
+    (void)m;
+    (void)obj;
+    mqtt_router_dispatch(&routes, msg->topic, strlen(msg->topic), msg->payload, (size_t)msg->payloadlen);
+}
+
+static void on_connect(struct mosquitto *m, void *obj, int rc)
+{
+    (void)obj;
+    if (rc != 0) {
+        return;
+    }
+    for (size_t i = 0; i < 2 && topics->cmd_topics[i]; i++) {
+        mosquitto_subscribe(m, NULL, topics->cmd_topics[i], 1);
+    }
+    printf("nodo simulado listo: %s (retardo %" PRIu32 " us, pérdida %u %%)\n",
+           topics->cmd_topics[0], delay_us, loss_pct);
+    fflush(stdout);
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    mosquitto_disconnect(mosq);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "H:p:d:l:Nh")) != -1) {
+        switch (c) {
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'd': delay_us = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'l': loss_pct = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'N': topics = &node_tank; break;
+        default:
+            fprintf(stderr, "uso: %s [-H host] [-p puerto] [-d retardo_us] [-l pérdida_%%] [-N]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand((unsigned)now_us());
+
+    mqtt_router_init(&routes);
+    for (size_t i = 0; i < 2 && topics->cmd_topics[i]; i++) {
+        mqtt_router_add(&routes, topics->cmd_topics[i], on_pump_command, NULL);
+    }
+
+    mosquitto_lib_init();
+    mosq = mosquitto_new(NULL, true, NULL);
+    if (!mosq) {
+        return 2;
+    }
+    mosquitto_connect_callback_set(mosq, on_connect);
+    mosquitto_message_callback_set(mosq, on_message);
+    int rc = mosquitto_connect(mosq, host, port, 30);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        fprintf(stderr, "conexión a %s:%d: %s\n", host, port, mosquitto_strerror(rc));
+        return 2;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    mosquitto_loop_forever(mosq, -1, 1);
+
+    printf("comandos %" PRIu32 "  confirmaciones descartadas %" PRIu32 "\n", received, dropped_acks);
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * Simulación en el host del control local de bomba (components/tasks/pump_ctrl).
+ *
+ * Un modelo simple de cisterna (llenado con la bomba, consumo variable,
+ * ruido de medición, ecos perdidos, un corte del sensor, un período de agua
+ * sucia y comandos manuales de Node-RED) alimenta al control del firmware
+ * muestra a muestra, con el reloj de 32 bits cerca del desborde. Verifica:
+ *
+ *   - conmutación en la misma muestra en que la medición cumple la
+ *     condición, y reacción desde el cruce real del umbral acotada por un
+ *     período más lo que el ruido puede ocultar el cruce;
+ *   - tiempos mínimos encendida/apagada salvo apagados de seguridad;
+ *   - nivel dentro de los umbrales más el sobrepaso de una muestra;
+ *   - apagado tras max_missed ecos perdidos y con agua sucia, sin arranques
+ *     mientras dure;
+ *   - comandos manuales respetados durante override_ms y reanudación.
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pump_ctrl.h"
+
+#define CLOCK_START_MS 0xFFF00000u      // desborda a los ~17 min de simulación
+
+static const pump_ctrl_config_t cfg = {
+    .low_cm = 20.0f,
+    .high_cm = 180.0f,
+    .min_on_ms = 30000,
+    .min_off_ms = 60000,
+    .override_ms = 900000,
+    .max_missed = 3,
+};
+
+// Cisterna: cm por segundo
+#define FILL_CM_S    0.50
+#define DRAIN_CM_S   0.12
+#define BURST_CM_S   0.35       // consumo fuerte (riego) en ventanas de 10 min
+#define NOISE_CM     0.8
+#define MISS_PCT     2
+
+typedef struct {
+    double hours;
+    uint32_t period_ms;
+    uint32_t seed;
+    bool verbose;
+} sim_options_t;
+
+static uint32_t rng_state;
+static uint32_t failures;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double noise(void)
+{
+    // Suma de uniformes: aproximadamente normal, acotada en ±NOISE_CM
+    double s = 0;
+    for (int i = 0; i < 4; i++) {
+        s += (double)rng() / UINT32_MAX - 0.5;
+    }
+    return s * NOISE_CM / 2.0;
+}
+
+static void check(bool ok, uint32_t t_s, const char *what)
+{
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA t=%" PRIu32 " s: %s\n", t_s, what);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    sim_options_t opt = { .hours = 24, .period_ms = 1000, .seed = 1 };
+    int c;
+    while ((c = getopt(argc, argv, "d:s:r:v")) != -1) {
+        switch (c) {
+        case 'd': opt.hours = atof(optarg); break;
+        case 's': opt.period_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'r': opt.seed = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'v': opt.verbose = true; break;
+        default:
+            fprintf(stderr, "uso: %s [-d horas] [-s período_ms] [-r semilla] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    rng_state = opt.seed ? opt.seed : 1;
+
+    const double dt = opt.period_ms / 1000.0;
+    const uint32_t steps = (uint32_t)(opt.hours * 3600.0 / dt);
+    // Corte del sensor y agua sucia: empiezan con la bomba en marcha pasadas 5 h y 9 h
+    uint32_t blackout_from = UINT32_MAX, blackout_to = UINT32_MAX, blackout_k = 0;
+    uint32_t dirty_from = UINT32_MAX, dirty_to = UINT32_MAX;
+    const uint32_t manual_on_at = 13 * 3600, manual_off_at = 16 * 3600, auto_at = manual_off_at + 600;
+
+    pump_ctrl_t ctrl;
+    pump_ctrl_init(&ctrl, &cfg, false, CLOCK_START_MS);
+    bool relay = false;
+    double level = 100.0;
+    uint32_t relay_since_ms = 0;
+    bool manual = false;
+    uint32_t manual_since_ms = 0;
+
+    // Cruce real del umbral pendiente de reacción (UINT32_MAX = ninguno)
+    uint32_t crossed_at_ms = UINT32_MAX;
+    bool crossing_held = false;
+    uint32_t reactions = 0, reaction_max_ms = 0;
+    uint64_t reaction_sum_ms = 0;
+    uint32_t holds = 0, safety_stops = 0, cycles = 0;
+    double on_time_s = 0;
+    double level_min = 1e9, level_max = -1e9;
+    const double overshoot = FILL_CM_S * dt + BURST_CM_S * dt + NOISE_CM;
+    // El ruido puede ocultar el cruce mientras el nivel recorre NOISE_CM a la pendiente más lenta
+    const uint32_t reaction_bound_ms = opt.period_ms + (uint32_t)(NOISE_CM / DRAIN_CM_S * 1000.0);
+
+    for (uint32_t k = 0; k < steps; k++) {
+        uint32_t t_ms = (uint32_t)((uint64_t)k * opt.period_ms);
+        uint32_t t_s = t_ms / 1000;
+        uint32_t now = CLOCK_START_MS + t_ms;
+
+        // Planta: llenado con la bomba y consumo (fuerte 10 de cada 60 minutos)
+        double prev = level;
+        double drain = (t_s / 600) % 6 == 0 ? BURST_CM_S : DRAIN_CM_S;
+        level += ((relay ? FILL_CM_S : 0.0) - drain) * dt;
+        if (level < 0) {
+            level = 0;
+        }
+        if (relay) {
+            on_time_s += dt;
+        }
+
+        if (crossed_at_ms == UINT32_MAX &&
+            ((!relay && prev >= cfg.low_cm && level < cfg.low_cm) ||
+             (relay && prev <= cfg.high_cm && level > cfg.high_cm))) {
+            crossed_at_ms = t_ms;
+            crossing_held = false;
+        }
+
+        if (relay && blackout_from == UINT32_MAX && t_s >= 5 * 3600 && t_ms - relay_since_ms >= 5000) {
+            blackout_from = t_s;
+            blackout_to = t_s + 20;
+            blackout_k = k;
+        }
+        if (relay && dirty_from == UINT32_MAX && t_s >= 9 * 3600 && t_ms - relay_since_ms >= 5000) {
+            dirty_from = t_s;
+            dirty_to = t_s + 1800;
+        }
+
+        // Medición: ruido, ecos perdidos, corte del sensor y agua sucia
+        bool blackout = t_s >= blackout_from && t_s < blackout_to;
+        bool dirty = t_s >= dirty_from && t_s < dirty_to;
+        // Una distancia medida nunca es negativa: -1 solo marca el eco perdido
+        float measured = (blackout || rng() % 100 < MISS_PCT) ? -1.0f : (float)fmax(level + noise(), 0.0);
+
+        // Comandos manuales (Node-RED) y vuelta a automático
+        pump_ctrl_decision_t d = { .action = PUMP_CTRL_KEEP };
+        bool evaluated = false;
+        if (t_ms == manual_on_at * 1000u || t_ms == manual_off_at * 1000u) {
+            relay = t_s == manual_on_at;
+            d = pump_ctrl_override(&ctrl, relay, now);
+            manual = true;
+            manual_since_ms = t_ms;
+            relay_since_ms = t_ms;
+        } else if (t_ms == auto_at * 1000u) {
+            d = pump_ctrl_resume(&ctrl);
+            manual = false;
+        } else {
+            d = pump_ctrl_update(&ctrl, measured, dirty, now);
+            evaluated = true;
+        }
+
+        if (opt.verbose && d.action != PUMP_CTRL_KEEP) {
+            printf("%6" PRIu32 " s  %-8s %-3s %-8s nivel %6.1f  espera %" PRIu32 " ms\n", t_s,
+                   pump_ctrl_action_name(d.action), d.on ? "ON" : "OFF", pump_ctrl_reason_name(d.reason),
+                   measured, d.wait_ms);
+        }
+
+        if (manual || !evaluated) {
+            check(d.action != PUMP_CTRL_SWITCH, t_s, "el control conmutó durante un comando manual");
+            if (d.action == PUMP_CTRL_RESUME && evaluated) {
+                check(t_ms - manual_since_ms >= cfg.override_ms, t_s, "comando manual vencido antes de tiempo");
+                manual = false;
+            }
+            crossed_at_ms = UINT32_MAX;
+            continue;
+        }
+
+        // Decisión esperada para esta medición: conmutar en la misma muestra
+        uint32_t state_ms = t_ms - relay_since_ms;
+        if (measured >= 0 && !relay && !dirty && measured < cfg.low_cm && state_ms >= cfg.min_off_ms) {
+            check(d.action == PUMP_CTRL_SWITCH && d.on, t_s, "nivel bajo sin arranque");
+        }
+        if (measured >= 0 && relay && measured > cfg.high_cm && state_ms >= cfg.min_on_ms) {
+            check(d.action == PUMP_CTRL_SWITCH && !d.on, t_s, "nivel alto sin apagado");
+        }
+        if (dirty && relay) {
+            check(d.action == PUMP_CTRL_SWITCH && !d.on, t_s, "bomba encendida con agua sucia");
+        }
+        if (blackout && relay && k - blackout_k + 1 >= cfg.max_missed) {
+            check(d.action == PUMP_CTRL_SWITCH && !d.on, t_s, "sin eco y la bomba sigue encendida");
+        }
+
+        if (d.action == PUMP_CTRL_HOLD || dirty) {
+            // Arranque retenido por tiempo mínimo o bloqueado por agua sucia: no cuenta como reacción
+            holds += d.action == PUMP_CTRL_HOLD;
+            crossing_held = true;
+        }
+        if (d.action == PUMP_CTRL_HOLD) {
+            check(d.wait_ms > 0 && d.wait_ms <= (d.on ? cfg.min_off_ms : cfg.min_on_ms), t_s, "espera fuera de rango");
+        }
+        if (d.action == PUMP_CTRL_SWITCH) {
+            bool safety = d.reason == PUMP_CTRL_REASON_DIRTY || d.reason == PUMP_CTRL_REASON_NO_ECHO;
+            uint32_t held_ms = t_ms - relay_since_ms;
+            if (d.on) {
+                // También tras un apagado de seguridad
+                check(held_ms >= cfg.min_off_ms, t_s, "arranque antes de min_off");
+                check(!dirty, t_s, "arranque con agua sucia");
+                cycles++;
+            } else {
+                check(safety || held_ms >= cfg.min_on_ms, t_s, "apagado antes de min_on");
+                safety_stops += safety;
+            }
+            relay = d.on;
+            relay_since_ms = t_ms;
+
+            if (crossed_at_ms != UINT32_MAX && !crossing_held && !safety) {
+                uint32_t r = t_ms - crossed_at_ms;
+                reactions++;
+                reaction_sum_ms += r;
+                if (r > reaction_max_ms) {
+                    reaction_max_ms = r;
+                }
+                check(r <= reaction_bound_ms, t_s, "reacción más lenta que la cota");
+            }
+            crossed_at_ms = UINT32_MAX;
+        }
+
+        // Nivel real dentro de la banda (después del transitorio inicial y fuera de eventos)
+        if (t_s > 3600 && !dirty && !(t_s >= dirty_to && t_s < dirty_to + 3600) &&
+            !(t_s >= manual_on_at && t_s < auto_at + 3600)) {
+            if (level < level_min) {
+                level_min = level;
+            }
+            if (level > level_max) {
+                level_max = level;
+            }
+            check(level <= cfg.high_cm + overshoot, t_s, "nivel por encima del umbral alto");
+        }
+    }
+
+    double hours = steps * dt / 3600.0;
+    printf("pump_ctrl: %.1f h simuladas, muestra cada %" PRIu32 " ms, reloj desde 0x%08" PRIx32 "\n",
+           hours, opt.period_ms, CLOCK_START_MS);
+    printf("  umbrales ON < %.0f / OFF > %.0f cm, mín. encendida %" PRIu32 " s / apagada %" PRIu32 " s\n",
+           cfg.low_cm, cfg.high_cm, cfg.min_on_ms / 1000, cfg.min_off_ms / 1000);
+    printf("  ciclos %" PRIu32 " (%.2f/h), bomba encendida %.0f %%, esperas por tiempo mínimo %" PRIu32
+           ", apagados de seguridad %" PRIu32 "\n",
+           cycles, cycles / hours, 100.0 * on_time_s / (hours * 3600.0), holds, safety_stops);
+    printf("  nivel real %.1f .. %.1f cm (sobrepaso admitido %.1f cm)\n", level_min, level_max, overshoot);
+    if (reactions) {
+        printf("  reacción cruce real -> relé: media %.0f ms, máx %" PRIu32 " ms (cota %" PRIu32 " ms) en %" PRIu32
+               " cruces\n", (double)reaction_sum_ms / reactions, reaction_max_ms, reaction_bound_ms, reactions);
+    }
+    check(cycles > 0, 0, "la bomba nunca arrancó");
+    check(reactions > 0, 0, "ningún cruce medido");
+    check(safety_stops >= 2, 0, "faltan los apagados por corte de sensor y agua sucia");
+    printf("%s (%" PRIu32 " fallas)\n", failures ? "FALLA" : "OK", failures);
+    return failures ? 1 : 0;
+}
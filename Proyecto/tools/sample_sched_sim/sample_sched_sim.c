@@ -0,0 +1,445 @@
+/*
+ * Muestreo adaptativo del firmware (components/sample_sched) en el host,
+ * comparado con el período fijo de siempre sobre la misma cisterna. Compila
+ * tal cual sample_sched.c, level_kalman.c y pump_ctrl.c, y los encadena como
+ * la tarea de muestreo de Nodo_Cisterna: lectura, filtro de nivel, control
+ * local de la bomba y período siguiente. Cada conmutación del relé despierta
+ * al muestreo (sample_sched_wake + muestra inmediata). Con -c la velocidad
+ * sale de las lecturas crudas, como en Node_Tank, que no tiene filtro.
+ *
+ * El día simulado: noche sin consumo, consumos de minutos durante el día,
+ * llenados por el control local y un ON/OFF manual de 2 min de madrugada.
+ * Ruido, ecos perdidos y outliers como en tools/level_kalman.
+ *
+ * Verifica, con el muestreo adaptativo:
+ *
+ *   - período mínimo durante todo llenado y hold_ms después (nunca más
+ *     desactualizado que una muestra a min_ms) y la muestra del comando
+ *     manual sin espera;
+ *   - durante un consumo, pasada la primera muestra que lo detecta (su
+ *     velocidad promedia el período largo anterior), el nivel no se mueve
+ *     más de dos pasos entre muestras;
+ *   - en reposo llega a max_ms sin crecer más de grow_pct por muestra, y en
+ *     total toma menos muestras que el período fijo (aunque llene a min_ms);
+ *   - el control de la bomba no sobrepasa el umbral alto más que con el
+ *     período fijo, y arranca por el bajo con a lo sumo un período máximo
+ *     de atraso (lo que tarda en verse un consumo que empieza en reposo).
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sample_sched.h"
+#include "level_kalman.h"
+#include "pump_ctrl.h"
+
+#define TICK_S        0.05      // paso de la simulación de la cisterna
+#define FILL_CM_S     0.50
+#define LOW_CM        20.0
+#define HIGH_CM       180.0
+#define NOISE_CM      0.8       // ruido acotado en ±NOISE_CM
+#define MISS_PCT      2
+#define OUTLIER_PERMILLE 5
+#define QUIET_MARGIN_S 120.0    // tras un cambio de caudal aún no cuenta como reposo
+
+// Consumos diurnos (6 a 23 h): uno por hora en promedio
+#define USE_MIN_CM_S  0.05
+#define USE_MAX_CM_S  0.25
+#define USE_MIN_S     180.0
+#define USE_MAX_S     900.0
+
+// Comando manual de madrugada
+#define MANUAL_ON_S   (3.0 * 3600.0)
+#define MANUAL_S      120.0
+
+static bool raw_rate;           // -c: velocidad de las lecturas crudas, como Node_Tank
+
+static sample_sched_config_t sched_cfg = {
+    .min_ms = 200,
+    .max_ms = 30000,
+    .hold_ms = 10000,
+    .grow_pct = 25,
+    .step_cm = 1.0f,
+};
+
+static const level_kalman_config_t kf_cfg = {
+    .meas_sd_cm = 1.0f,
+    .accel_noise = 0.01f,
+    .gate_sigma = 4.0f,
+    .max_rejects = 3,
+    .max_gap_s = 60.0f,
+    .full_cm = (float)HIGH_CM,
+    .stable_cm_min = 0.5f,
+};
+
+static const pump_ctrl_config_t ctrl_cfg = {
+    .low_cm = (float)LOW_CM,
+    .high_cm = (float)HIGH_CM,
+    .min_on_ms = 30000,
+    .min_off_ms = 60000,
+    .override_ms = 15 * 60000,
+    .max_missed = 3,
+};
+
+static uint32_t rng_state;
+static uint32_t failures;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double uniform(double lo, double hi)
+{
+    return lo + (hi - lo) * ((double)rng() / UINT32_MAX);
+}
+
+static double noise(void)
+{
+    double s = 0;
+    for (int i = 0; i < 4; i++) {
+        s += (double)rng() / UINT32_MAX - 0.5;
+    }
+    return s * NOISE_CM / 2.0;
+}
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        failures++;
+        printf("FALLA: %s\n", what);
+    }
+}
+
+// Consumos del día, iguales para las dos corridas
+#define MAX_USES 64
+typedef struct {
+    double start, end, rate;
+} use_t;
+static use_t uses[MAX_USES];
+static int n_uses;
+
+static void plan_uses(double hours, uint32_t seed)
+{
+    rng_state = seed ? seed : 1;
+    n_uses = 0;
+    for (double h = 0; h < hours && n_uses < MAX_USES; h += 1.0) {
+        double hod = fmod(h, 24.0);
+        if (hod < 6.0 || hod >= 23.0) {
+            continue;
+        }
+        double start = h * 3600.0 + uniform(0, 3600.0 - USE_MAX_S);
+        uses[n_uses++] = (use_t){ start, start + uniform(USE_MIN_S, USE_MAX_S),
+                                  uniform(USE_MIN_CM_S, USE_MAX_CM_S) };
+    }
+}
+
+static double use_rate(double t)
+{
+    for (int i = 0; i < n_uses; i++) {
+        if (t >= uses[i].start && t < uses[i].end) {
+            return uses[i].rate;
+        }
+    }
+    return 0.0;
+}
+
+typedef struct {
+    uint32_t samples;
+    uint32_t quiet_samples;
+    double quiet_s;
+    double fill_stale_cm;     // máx. |real - real en la última muestra| con la bomba en marcha
+    double use_stale_cm;      // ídem durante consumos
+    double use_track_cm;      // ídem, desde la segunda muestra en MOVING
+    double use_stale_sum;     // ídem integrado en el tiempo, para el promedio
+    double use_s;
+    double overshoot_cm;      // máx. por encima del umbral alto
+    double low_delay_s;       // máx. desde el cruce real del umbral bajo hasta el arranque
+    double cmd_latency_s;     // comando manual -> primera muestra
+    uint32_t slow_fill;       // muestras con la bomba en marcha y período > min_ms
+    uint32_t slow_hold;       // ídem dentro de hold_ms desde que paró
+    uint32_t max_period_ms;
+    double max_growth;        // mayor cociente entre dos períodos seguidos
+    uint32_t fills;
+    uint32_t mode_samples[SAMPLE_SCHED_BLIND + 1];
+} result_t;
+
+static void run(double hours, uint32_t seed, uint32_t fixed_ms, bool verbose, result_t *r)
+{
+    level_kalman_t kf;
+    level_kalman_out_t out;
+    pump_ctrl_t ctrl;
+    sample_sched_t sched;
+
+    *r = (result_t){ 0 };
+    rng_state = (seed ? seed : 1) * 2654435761u;
+    level_kalman_init(&kf, &kf_cfg);
+    // Reloj de 32 bits que desborda durante la simulación
+    const uint32_t t0_ms = 0xFFF00000u;
+    pump_ctrl_init(&ctrl, &ctrl_cfg, false, t0_ms);
+    sample_sched_init(&sched, &sched_cfg, t0_ms);
+
+    double level = 100.0, sampled_level = level;
+    bool pump = false, manual_on_done = false, manual_off_done = false;
+    double next_sample = 0.0, last_sample = 0.0, last_change = 0.0, below_low_since = -1.0;
+    double prev_rate = 0.0, cmd_at = -1.0;
+    uint32_t prev_period = 0;
+    double stopped_at = -1.0;
+    uint32_t moving = 0;      // muestras seguidas en MOVING
+
+    for (double t = 0.0; t < hours * 3600.0; t += TICK_S) {
+        uint32_t now_ms = t0_ms + (uint32_t)(t * 1000.0);
+
+        // Comando manual: conmuta el relé y despierta al muestreo
+        if (!manual_on_done && t >= MANUAL_ON_S) {
+            manual_on_done = true;
+            pump = true;
+            pump_ctrl_override(&ctrl, true, now_ms);
+            level_kalman_maneuver(&kf);
+            cmd_at = t;
+            if (!fixed_ms) {
+                sample_sched_wake(&sched, now_ms);
+                next_sample = t;
+            }
+        } else if (!manual_off_done && t >= MANUAL_ON_S + MANUAL_S) {
+            manual_off_done = true;
+            pump = false;
+            stopped_at = t;
+            pump_ctrl_override(&ctrl, false, now_ms);
+            pump_ctrl_resume(&ctrl);
+            level_kalman_maneuver(&kf);
+            if (!fixed_ms) {
+                sample_sched_wake(&sched, now_ms);
+                next_sample = t;
+            }
+        }
+
+        double rate = (pump ? FILL_CM_S : 0.0) - use_rate(t);
+        if (rate != prev_rate) {
+            prev_rate = rate;
+            last_change = t;
+        }
+        level += rate * TICK_S;
+        if (level < 0.0) {
+            level = 0.0;
+        }
+
+        double stale = fabs(level - sampled_level);
+        if (pump && stale > r->fill_stale_cm) {
+            r->fill_stale_cm = stale;
+        }
+        if (!pump && use_rate(t) > 0.0) {
+            r->use_stale_sum += stale * TICK_S;
+            r->use_s += TICK_S;
+            if (stale > r->use_stale_cm) {
+                r->use_stale_cm = stale;
+            }
+            if (moving >= 2 && last_change <= last_sample && stale > r->use_track_cm) {
+                r->use_track_cm = stale;
+            }
+        }
+        if (level - HIGH_CM > r->overshoot_cm) {
+            r->overshoot_cm = level - HIGH_CM;
+        }
+        if (!pump && level < LOW_CM) {
+            if (below_low_since < 0.0) {
+                below_low_since = t;
+            }
+        } else {
+            below_low_since = -1.0;
+        }
+        bool quiet = !pump && rate == 0.0 && t - last_change >= QUIET_MARGIN_S;
+        if (quiet) {
+            r->quiet_s += TICK_S;
+        }
+
+        if (t + 1e-9 < next_sample) {
+            continue;
+        }
+
+        // Una muestra, como en task_sensor_read_loop
+        r->samples++;
+        if (quiet) {
+            r->quiet_samples++;
+        }
+        if (cmd_at >= 0.0) {
+            r->cmd_latency_s = t - cmd_at;
+            cmd_at = -1.0;
+        }
+        double meas = level + noise();
+        if (meas < 0.0) {
+            meas = 0.0;
+        }
+        if (rng() % 100 < MISS_PCT) {
+            meas = -1.0;
+        } else if (rng() % 1000 < OUTLIER_PERMILLE) {
+            meas += (rng() & 1 ? 1 : -1) * (20.0 + rng() % 21);
+            if (meas < 0.0) meas = 0.0;
+        }
+        sampled_level = level;
+        level_kalman_update(&kf, (float)meas, (float)(t - last_sample), &out);
+        last_sample = t;
+
+        bool woken = false;
+        pump_ctrl_decision_t d = pump_ctrl_update(&ctrl, (float)meas, false, now_ms);
+        if (d.action == PUMP_CTRL_SWITCH) {
+            if (d.on) {
+                r->fills++;
+                if (below_low_since >= 0.0 && t - below_low_since > r->low_delay_s) {
+                    r->low_delay_s = t - below_low_since;
+                }
+            }
+            pump = d.on;
+            if (!pump) {
+                stopped_at = t;
+            }
+            level_kalman_maneuver(&kf);
+            woken = true;
+        }
+
+        uint32_t period = fixed_ms;
+        if (!fixed_ms) {
+            sample_sched_input_t in = {
+                .pump_on = pump,
+                .level_cm = (float)meas,
+                .has_rate = out.valid && !raw_rate,
+                .rate_cm_min = out.rate_cm_min,
+            };
+            period = sample_sched_update(&sched, &in, now_ms);
+            r->mode_samples[sched.mode]++;
+            moving = sched.mode == SAMPLE_SCHED_MOVING ? moving + 1 : 0;
+            if (pump && period > sched_cfg.min_ms) {
+                r->slow_fill++;
+            }
+            if (!pump && stopped_at >= 0.0 && (t - stopped_at) * 1000.0 + 1.0 < sched_cfg.hold_ms &&
+                period > sched_cfg.min_ms) {
+                r->slow_hold++;
+            }
+            if (prev_period && (double)period / prev_period > r->max_growth) {
+                r->max_growth = (double)period / prev_period;
+            }
+            prev_period = period;
+            if (woken) {
+                // El bit de despertar ya quedó levantado: otra muestra enseguida
+                sample_sched_wake(&sched, now_ms);
+                period = 0;
+            }
+        }
+        if (period > r->max_period_ms) {
+            r->max_period_ms = period;
+        }
+        if (verbose) {
+            printf("%.2f,%.2f,%.2f,%d,%.2f,%u,%s\n", t, level, meas, pump, out.rate_cm_min,
+                   period, fixed_ms ? "fixed" : sample_sched_mode_name(sched.mode));
+        }
+        next_sample = t + period / 1000.0;
+    }
+}
+
+static void report(const char *name, double hours, const result_t *r)
+{
+    printf("%-10s %8u %8.1f %10.0f %9.2f %9.2f %9.2f %8.1f %8.2f %7u\n", name, r->samples,
+           r->samples / hours, r->quiet_s > 0 ? r->quiet_samples / (r->quiet_s / 3600.0) : 0.0,
+           r->fill_stale_cm, r->use_stale_cm, r->overshoot_cm, r->low_delay_s,
+           r->cmd_latency_s, r->fills);
+}
+
+int main(int argc, char **argv)
+{
+    double hours = 24.0;
+    uint32_t seed = 1;
+    uint32_t fixed_ms = 1000;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:r:f:m:M:g:h:s:cv")) != -1) {
+        switch (opt) {
+            case 'd': hours = atof(optarg); break;
+            case 'r': seed = (uint32_t)atoi(optarg); break;
+            case 'f': fixed_ms = (uint32_t)atoi(optarg); break;
+            case 'm': sched_cfg.min_ms = (uint32_t)atoi(optarg); break;
+            case 'M': sched_cfg.max_ms = (uint32_t)atoi(optarg); break;
+            case 'g': sched_cfg.grow_pct = (uint16_t)atoi(optarg); break;
+            case 'h': sched_cfg.hold_ms = (uint32_t)atoi(optarg); break;
+            case 's': sched_cfg.step_cm = (float)atof(optarg); break;
+            case 'c': raw_rate = true; break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "uso: %s [-d horas] [-r semilla] [-f período_fijo_ms] [-m min_ms] "
+                                "[-M max_ms] [-g crecimiento_%%] [-h hold_ms] [-s paso_cm] [-c] [-v]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+    if (fixed_ms == 0) {
+        fixed_ms = 1;
+    }
+
+    result_t fixed, adaptive;
+    plan_uses(hours, seed);
+    run(hours, seed, fixed_ms, false, &fixed);
+    run(hours, seed, 0, verbose, &adaptive);
+    if (verbose) {
+        return 0;
+    }
+
+    printf("%.0f h, semilla %u, %d consumos; adaptativo %u..%u ms, +%u %%/muestra, "
+           "hold %u ms, paso %.1f cm, velocidad %s\n\n", hours, seed, n_uses, sched_cfg.min_ms,
+           sched_cfg.max_ms, sched_cfg.grow_pct, sched_cfg.hold_ms, sched_cfg.step_cm,
+           raw_rate ? "cruda" : "del filtro");
+    printf("%-10s %8s %8s %10s %9s %9s %9s %8s %8s %7s\n", "", "muestras", "por h", "reposo/h",
+           "llenado", "consumo", "sobrepaso", "bajo", "comando", "llenados");
+    printf("%-10s %8s %8s %10s %9s %9s %9s %8s %8s %7s\n", "", "", "", "", "cm", "cm", "cm",
+           "s", "s", "");
+    char name[16];
+    snprintf(name, sizeof(name), "fijo %u", fixed_ms);
+    report(name, hours, &fixed);
+    report("adaptativo", hours, &adaptive);
+    printf("\nmuestras (= publicaciones del flujo crudo): %.1f %% de las del período fijo; "
+           "en reposo %.1f %%\n", 100.0 * adaptive.samples / fixed.samples,
+           fixed.quiet_samples ? 100.0 * adaptive.quiet_samples / fixed.quiet_samples : 0.0);
+    double use_mean = adaptive.use_s > 0 ? adaptive.use_stale_sum / adaptive.use_s : 0.0;
+    printf("consumos: nivel real a %.2f cm en promedio de la última muestra (fijo %.2f cm)\n",
+           use_mean, fixed.use_s > 0 ? fixed.use_stale_sum / fixed.use_s : 0.0);
+    printf("modos:");
+    for (int m = SAMPLE_SCHED_IDLE; m <= SAMPLE_SCHED_BLIND; m++) {
+        printf(" %s=%u", sample_sched_mode_name((sample_sched_mode_t)m), adaptive.mode_samples[m]);
+    }
+    printf("\n");
+
+    double quiet_per_h = adaptive.quiet_s > 0 ? adaptive.quiet_samples / (adaptive.quiet_s / 3600.0) : 0.0;
+    check(adaptive.slow_fill == 0, "muestras con la bomba en marcha a más de min_ms");
+    check(adaptive.slow_hold == 0, "muestras a más de min_ms dentro de hold_ms tras parar la bomba");
+    check(adaptive.fill_stale_cm <= FILL_CM_S * sched_cfg.min_ms / 1000.0 + 0.05,
+          "llenado más desactualizado que una muestra a min_ms");
+    check(adaptive.cmd_latency_s <= TICK_S, "la muestra del comando manual esperó");
+    check(adaptive.max_period_ms == sched_cfg.max_ms, "en reposo no llegó a max_ms");
+    check(sched_cfg.grow_pct == 0 || adaptive.max_growth <= 1.0 + sched_cfg.grow_pct / 100.0 + 0.01,
+          "el período creció más rápido que grow_pct");
+    check(quiet_per_h <= 1.5 * 3600000.0 / sched_cfg.max_ms, "demasiadas muestras en reposo");
+    check(adaptive.samples < fixed.samples, "más muestras que con el período fijo");
+    check(adaptive.overshoot_cm <= fixed.overshoot_cm + 0.1, "más sobrepaso del umbral alto");
+    // Un consumo que empieza en reposo se ve con hasta un período máximo de atraso;
+    // desde ahí el período sigue al caudal (un paso_cm por muestra)
+    double max_s = sched_cfg.max_ms / 1000.0;
+    check(adaptive.use_stale_cm <= USE_MAX_CM_S * max_s + sched_cfg.step_cm + 2.0 * NOISE_CM,
+          "consumo más desactualizado que un período máximo más un paso");
+    check(adaptive.use_track_cm <= 2.0 * sched_cfg.step_cm + 2.0 * NOISE_CM,
+          "consumo detectado con más de dos pasos entre muestras");
+    check(use_mean <= sched_cfg.step_cm, "consumos con más de un paso de atraso medio");
+    check(adaptive.low_delay_s <= fixed.low_delay_s + max_s,
+          "el arranque por nivel bajo se demoró más que un período máximo");
+    if (failures) {
+        printf("%u verificaciones fallidas\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Prueba de estrés de host del snapshot de muestras del firmware
+ * (components/tasks/snapshot.c, compilado tal cual).
+ *
+ * Un hilo escritor publica muestras tan rápido como puede mientras varios
+ * lectores copian la última sin parar. Cada muestra k lleva en todas sus
+ * palabras un valor derivado de k, así que una copia que mezcla dos
+ * publicaciones (muestra rota) se detecta palabra por palabra. Verifica:
+ *
+ *   - ningún lector ni el escritor obtiene una muestra rota;
+ *   - el número devuelto coincide con el que lleva el dato;
+ *   - los números que ve cada lector nunca retroceden;
+ *   - snapshot_latest() nunca retrocede ni supera lo publicado;
+ *   - el escritor lee siempre la muestra que acaba de publicar.
+ *
+ * Con taskset -c 0 los hilos comparten un núcleo y el planificador los
+ * interrumpe en cualquier punto, como un lector de mayor prioridad en el
+ * ESP32-C6. Termina con código 1 si alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#define MAX_READERS 16
+
+typedef struct {
+    uint32_t samples;
+    int readers;
+    int words;
+} stress_options_t;
+
+typedef struct {
+    int id;
+    uint64_t reads;
+    uint64_t empty;
+    uint64_t distinct;      // Muestras distintas observadas
+} reader_stats_t;
+
+static snapshot_t snap;
+static stress_options_t opt = { .samples = 5000000, .readers = 3, .words = SNAPSHOT_MAX_WORDS };
+static atomic_bool writer_done;
+static atomic_uint failures;
+
+// Valor de la palabra w de la muestra k: distinto para cada par (k, w)
+static uint32_t word_value(uint32_t k, int w)
+{
+    uint32_t x = k * 0x9E3779B1u + (uint32_t)w * 0x85EBCA77u;
+    x ^= x >> 15;
+    x *= 0x2C1B3C6Du;
+    x ^= x >> 12;
+    return x;
+}
+
+static void check(bool ok, const char *who, uint32_t sample, const char *what)
+{
+    if (!ok) {
+        unsigned n = atomic_fetch_add(&failures, 1) + 1;
+        if (n <= 20) {
+            printf("FALLA %s muestra %" PRIu32 ": %s\n", who, sample, what);
+        }
+    }
+}
+
+// Comprueba que las palabras copiadas pertenecen todas a la muestra @p sample
+static bool sample_intact(const uint32_t *data, uint32_t sample)
+{
+    for (int w = 0; w < opt.words; w++) {
+        if (data[w] != word_value(sample, w)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *reader_main(void *arg)
+{
+    reader_stats_t *st = arg;
+    char who[16];
+    snprintf(who, sizeof(who), "lector %d", st->id);
+    uint32_t data[SNAPSHOT_MAX_WORDS];
+    uint32_t last = 0;
+
+    while (!atomic_load_explicit(&writer_done, memory_order_acquire)) {
+        uint32_t before = snapshot_latest(&snap);
+        uint32_t sample = snapshot_read(&snap, data);
+        uint32_t after = snapshot_latest(&snap);
+        st->reads++;
+        check(before <= after, who, after, "snapshot_latest() retrocedió");
+        if (sample == 0) {
+            st->empty++;
+            check(before == 0, who, before, "lectura vacía con muestras publicadas");
+            continue;
+        }
+        check(sample >= before && sample <= after, who, sample,
+              "número fuera de lo publicado durante la lectura");
+        check(sample >= last, who, sample, "el número de muestra retrocedió");
+        check(sample_intact(data, sample), who, sample, "muestra rota (palabras de publicaciones distintas)");
+        if (sample != last) {
+            st->distinct++;
+            last = sample;
+        }
+    }
+    return NULL;
+}
+
+static void *writer_main(void *arg)
+{
+    (void)arg;
+    uint32_t data[SNAPSHOT_MAX_WORDS];
+    uint32_t back[SNAPSHOT_MAX_WORDS];
+
+    for (uint32_t k = 1; k <= opt.samples; k++) {
+        for (int w = 0; w < opt.words; w++) {
+            data[w] = word_value(k, w);
+        }
+        uint32_t sample = snapshot_publish(&snap, data);
+        check(sample == k, "escritor", k, "snapshot_publish() devolvió otro número");
+        // El único escritor no compite consigo mismo: siempre lee lo que publicó
+        uint32_t got = snapshot_read(&snap, back);
+        check(got == k, "escritor", k, "la lectura no devolvió la muestra recién publicada");
+        check(sample_intact(back, k), "escritor", k, "muestra rota");
+    }
+    atomic_store_explicit(&writer_done, true, memory_order_release);
+    return NULL;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "n:r:w:")) != -1) {
+        switch (c) {
+        case 'n': opt.samples = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'r': opt.readers = atoi(optarg); break;
+        case 'w': opt.words = atoi(optarg); break;
+        default:
+            fprintf(stderr, "uso: %s [-n muestras] [-r lectores] [-w palabras]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (opt.readers < 1 || opt.readers > MAX_READERS || opt.words < 1 || opt.words > SNAPSHOT_MAX_WORDS ||
+        opt.samples == 0) {
+        fprintf(stderr, "lectores 1..%d, palabras 1..%d, muestras > 0\n", MAX_READERS, SNAPSHOT_MAX_WORDS);
+        return 2;
+    }
+
+    snapshot_init(&snap, (size_t)opt.words * sizeof(uint32_t));
+    uint32_t none[SNAPSHOT_MAX_WORDS];
+    check(snapshot_read(&snap, none) == 0 && snapshot_latest(&snap) == 0, "inicio", 0,
+          "hay una muestra antes de publicar");
+
+    pthread_t writer, readers[MAX_READERS];
+    reader_stats_t stats[MAX_READERS] = { 0 };
+    double t0 = now_s();
+    for (int i = 0; i < opt.readers; i++) {
+        stats[i].id = i;
+        pthread_create(&readers[i], NULL, reader_main, &stats[i]);
+    }
+    pthread_create(&writer, NULL, writer_main, NULL);
+    pthread_join(writer, NULL);
+    for (int i = 0; i < opt.readers; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    double elapsed = now_s() - t0;
+
+    check(snapshot_latest(&snap) == opt.samples, "fin", snapshot_latest(&snap),
+          "snapshot_latest() no es la última publicada");
+
+    printf("%" PRIu32 " muestras de %d palabras, %d lectores, %.2f s (%.0f ns por publicación)\n",
+           opt.samples, opt.words, opt.readers, elapsed, elapsed * 1e9 / opt.samples);
+    uint64_t distinct = 0;
+    for (int i = 0; i < opt.readers; i++) {
+        printf("  lector %d: %" PRIu64 " lecturas, %" PRIu64 " vacías, %" PRIu64 " muestras distintas\n",
+               i, stats[i].reads, stats[i].empty, stats[i].distinct);
+        distinct += stats[i].distinct;
+    }
+    // Sin solapamiento la prueba no prueba nada: algún lector tiene que ver varias muestras
+    check(distinct > 1, "fin", 0, "los lectores no se solaparon con el escritor");
+
+    unsigned f = atomic_load(&failures);
+    printf("%s (%u fallas)\n", f ? "FALLA" : "OK", f);
+    return f ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Compara costo de codificación y tamaño de payload de los formatos de
+ * telemetría: texto por tópico (histórico), JSON agrupado y CBOR.
+ * Usa los codificadores del firmware tal cual (son C puro).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+#include "telemetry_decode.h"
+
+#define ITERATIONS 1000000
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile size_t sink;
+
+// Formato histórico: cuatro publishes de texto, uno por campo
+static size_t encode_text_fields(const telemetry_sample_t *s, char *buf, size_t len)
+{
+    size_t total = 0;
+    total += (size_t)snprintf(buf, len, "%.2f", s->water_level_cm);
+    total += (size_t)snprintf(buf, len, "%.1f", s->tds_ppm);
+    total += (size_t)snprintf(buf, len, "%s", telemetry_water_state_str[s->water_state]);
+    total += (size_t)snprintf(buf, len, "%s", s->pump_on ? "ON" : "OFF");
+    return total;
+}
+
+int main(void)
+{
+    telemetry_sample_t s = {
+        .seq = 123456, .timestamp_s = 86400, .water_level_cm = 125.5f,
+        .tds_ppm = 450.2f, .water_state = 1, .pump_on = true,
+    };
+    char text[128];
+    uint8_t bin[TELEMETRY_CBOR_MAX_LEN];
+    telemetry_decoded_t msg;
+
+    size_t text_len = encode_text_fields(&s, text, sizeof(text));
+    int json_len = telemetry_encode_json(&s, text, sizeof(text));
+    int cbor_len = telemetry_encode_cbor(&s, bin, sizeof(bin));
+    if (json_len < 0 || cbor_len < 0 || telemetry_decode(bin, (size_t)cbor_len, &msg) != 0 ||
+        msg.seq != s.seq || msg.level != s.water_level_cm || msg.tds != s.tds_ppm) {
+        fprintf(stderr, "round-trip CBOR falló\n");
+        return 1;
+    }
+
+    double t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { s.seq = i; sink += encode_text_fields(&s, text, sizeof(text)); }
+    double t1 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { s.seq = i; sink += telemetry_encode_json(&s, text, sizeof(text)); }
+    double t2 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { s.seq = i; sink += telemetry_encode_cbor(&s, bin, sizeof(bin)); }
+    double t3 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { telemetry_decode(bin, (size_t)cbor_len, &msg); sink += msg.seq; }
+    double t4 = now_ns();
+
+    printf("%-22s %8s %10s %10s\n", "formato", "publish", "bytes", "ns/muestra");
+    printf("%-22s %8d %10zu %10.1f\n", "texto por tópico", 4, text_len, (t1 - t0) / ITERATIONS);
+    printf("%-22s %8d %10d %10.1f\n", "JSON agrupado", 1, json_len, (t2 - t1) / ITERATIONS);
+    printf("%-22s %8d %10d %10.1f\n", "CBOR v1", 1, cbor_len, (t3 - t2) / ITERATIONS);
+    printf("%-22s %8s %10s %10.1f\n", "decodificar CBOR", "-", "-", (t4 - t3) / ITERATIONS);
+    printf("(bytes = payload; cada publish suma además ~2 + len(tópico) de cabecera MQTT)\n");
+    return 0;
+}
@@ -0,0 +1,319 @@
+#include "telemetry_decode.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Claves del esquema v1 (deben coincidir con telemetry_key_t del firmware)
+enum {
+    KEY_VERSION = 0, KEY_TYPE = 1, KEY_SEQ = 2, KEY_TS = 3, KEY_LEVEL = 4,
+    KEY_TDS = 5, KEY_STATE = 6, KEY_PUMP = 7, KEY_HEAP_FREE = 8,
+    KEY_HEAP_MIN = 9, KEY_RSSI = 10, KEY_DROPPED = 11, KEY_WINDOW = 12,
+    KEY_DURATION = 13, KEY_COUNT = 14, KEY_LEVEL_STATS = 15, KEY_TDS_STATS = 16,
+    KEY_LEVEL_FILT = 17, KEY_RATE = 18, KEY_ETA = 19,
+};
+
+#define MAX_NESTING 8
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} reader_t;
+
+// Ítem escalar leído: entero (con signo), float o bool
+typedef struct {
+    enum { ITEM_INT, ITEM_FLOAT, ITEM_BOOL, ITEM_OTHER } kind;
+    int64_t i;
+    double f;
+    bool b;
+} item_t;
+
+static int read_be(reader_t *r, int n, uint64_t *out)
+{
+    if (r->end - r->p < n) return TELEMETRY_DECODE_ERR_TRUNCATED;
+    uint64_t v = 0;
+    for (int k = 0; k < n; k++) v = (v << 8) | *r->p++;
+    *out = v;
+    return 0;
+}
+
+// Lee la cabecera: tipo mayor, info adicional y argumento
+static int read_head(reader_t *r, uint8_t *major, uint8_t *info, uint64_t *arg)
+{
+    if (r->p >= r->end) return TELEMETRY_DECODE_ERR_TRUNCATED;
+    uint8_t ib = *r->p++;
+    *major = ib >> 5;
+    *info = ib & 0x1F;
+    if (*info < 24) {
+        *arg = *info;
+        return 0;
+    }
+    switch (*info) {
+        case 24: return read_be(r, 1, arg);
+        case 25: return read_be(r, 2, arg);
+        case 26: return read_be(r, 4, arg);
+        case 27: return read_be(r, 8, arg);
+        default: return TELEMETRY_DECODE_ERR_FORMAT;   // Longitud indefinida: no se usa
+    }
+}
+
+static double half_to_double(uint16_t h)
+{
+    int exp = (h >> 10) & 0x1F;
+    int mant = h & 0x3FF;
+    double v;
+    if (exp == 0) v = mant / 16777216.0;                          // 2^-24
+    else if (exp != 31) v = (mant + 1024) * (double)(1u << exp) / 33554432.0;  // 2^-25
+    else v = mant ? 0.0 / 0.0 : 1.0 / 0.0;
+    return (h & 0x8000) ? -v : v;
+}
+
+static int skip_item(reader_t *r, int depth);
+
+static int read_item(reader_t *r, item_t *it, int depth)
+{
+    uint8_t major, info;
+    uint64_t arg;
+    int err = read_head(r, &major, &info, &arg);
+    if (err) return err;
+
+    it->kind = ITEM_OTHER;
+    switch (major) {
+        case 0:
+            it->kind = ITEM_INT;
+            it->i = (int64_t)arg;
+            return 0;
+        case 1:
+            it->kind = ITEM_INT;
+            it->i = -1 - (int64_t)arg;
+            return 0;
+        case 2:
+        case 3:
+            if ((uint64_t)(r->end - r->p) < arg) return TELEMETRY_DECODE_ERR_TRUNCATED;
+            r->p += arg;
+            return 0;
+        case 4:
+        case 5: {
+            if (depth >= MAX_NESTING) return TELEMETRY_DECODE_ERR_FORMAT;
+            uint64_t items = major == 5 ? arg * 2 : arg;
+            for (uint64_t k = 0; k < items; k++) {
+                err = skip_item(r, depth + 1);
+                if (err) return err;
+            }
+            return 0;
+        }
+        case 6:
+            return skip_item(r, depth + 1);   // Tag: saltar el ítem etiquetado
+        default:
+            if (info == 20 || info == 21) {
+                it->kind = ITEM_BOOL;
+                it->b = info == 21;
+            } else if (info == 25) {
+                it->kind = ITEM_FLOAT;
+                it->f = half_to_double((uint16_t)arg);
+            } else if (info == 26) {
+                uint32_t bits = (uint32_t)arg;
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                it->kind = ITEM_FLOAT;
+                it->f = f;
+            } else if (info == 27) {
+                double d;
+                memcpy(&d, &arg, sizeof(d));
+                it->kind = ITEM_FLOAT;
+                it->f = d;
+            }
+            return 0;
+    }
+}
+
+static int skip_item(reader_t *r, int depth)
+{
+    item_t it;
+    return read_item(r, &it, depth);
+}
+
+static bool as_uint(const item_t *it, uint32_t *out)
+{
+    if (it->kind != ITEM_INT || it->i < 0 || it->i > 0xFFFFFFFFll) return false;
+    *out = (uint32_t)it->i;
+    return true;
+}
+
+static bool as_float(const item_t *it, float *out)
+{
+    if (it->kind == ITEM_FLOAT) *out = (float)it->f;
+    else if (it->kind == ITEM_INT) *out = (float)it->i;
+    else return false;
+    return true;
+}
+
+// Lee [n, min, max, mean, sd] de un resumen de ventana
+static int read_stats(reader_t *r, telemetry_decoded_stats_t *st)
+{
+    uint8_t major, info;
+    uint64_t items;
+    int err = read_head(r, &major, &info, &items);
+    if (err) return err;
+    if (major != 4 || items != 5) return TELEMETRY_DECODE_ERR_FORMAT;
+
+    item_t it;
+    float *dst[4] = { &st->min, &st->max, &st->mean, &st->sd };
+    if ((err = read_item(r, &it, 0)) != 0) return err;
+    if (!as_uint(&it, &st->n)) return TELEMETRY_DECODE_ERR_FORMAT;
+    for (int k = 0; k < 4; k++) {
+        if ((err = read_item(r, &it, 0)) != 0) return err;
+        if (!as_float(&it, dst[k])) return TELEMETRY_DECODE_ERR_FORMAT;
+    }
+    return 0;
+}
+
+// Decodifica un map de mensaje a partir de la posición actual del lector
+static int decode_map(reader_t *r, telemetry_decoded_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    uint8_t major, info;
+    uint64_t pairs;
+    int err = read_head(r, &major, &info, &pairs);
+    if (err) return err;
+    if (major != 5) return TELEMETRY_DECODE_ERR_FORMAT;
+
+    for (uint64_t k = 0; k < pairs; k++) {
+        item_t key, val;
+        if ((err = read_item(r, &key, 0)) != 0) return err;
+        if (key.kind == ITEM_INT && (key.i == KEY_LEVEL_STATS || key.i == KEY_TDS_STATS)) {
+            err = read_stats(r, key.i == KEY_LEVEL_STATS ? &out->level_stats : &out->tds_stats);
+            if (err) return err;
+            out->fields |= TELEMETRY_FIELD(key.i);
+            continue;
+        }
+        if ((err = read_item(r, &val, 0)) != 0) return err;
+        if (k == 0 && (key.kind != ITEM_INT || key.i != KEY_VERSION)) {
+            return TELEMETRY_DECODE_ERR_FORMAT;   // La versión va siempre primero
+        }
+        if (key.kind != ITEM_INT || key.i < 0 || key.i > 31) continue;
+
+        uint32_t u = 0;
+        bool ok = true;
+        switch (key.i) {
+            case KEY_VERSION:
+                ok = as_uint(&val, &u);
+                out->version = (uint8_t)u;
+                if (ok && out->version != TELEMETRY_DECODE_VERSION) return TELEMETRY_DECODE_ERR_VERSION;
+                break;
+            case KEY_TYPE:      ok = as_uint(&val, &u); out->type = (uint8_t)u; break;
+            case KEY_SEQ:       ok = as_uint(&val, &out->seq); break;
+            case KEY_TS:        ok = as_uint(&val, &out->ts); break;
+            case KEY_LEVEL:     ok = as_float(&val, &out->level); break;
+            case KEY_TDS:       ok = as_float(&val, &out->tds); break;
+            case KEY_STATE:     ok = as_uint(&val, &u); out->state = (uint8_t)u; break;
+            case KEY_PUMP:      ok = val.kind == ITEM_BOOL; out->pump = val.b; break;
+            case KEY_HEAP_FREE: ok = as_uint(&val, &out->heap_free); break;
+            case KEY_HEAP_MIN:  ok = as_uint(&val, &out->heap_min); break;
+            case KEY_RSSI:      ok = val.kind == ITEM_INT; out->rssi = (int32_t)val.i; break;
+            case KEY_DROPPED:   ok = as_uint(&val, &out->dropped); break;
+            case KEY_WINDOW:    ok = as_uint(&val, &out->window); break;
+            case KEY_DURATION:  ok = as_uint(&val, &out->duration); break;
+            case KEY_COUNT:     ok = as_uint(&val, &out->count); break;
+            case KEY_LEVEL_FILT: ok = as_float(&val, &out->level_filt); break;
+            case KEY_RATE:      ok = as_float(&val, &out->rate); break;
+            case KEY_ETA:       ok = as_float(&val, &out->eta); break;
+            default:            continue;   // Clave nueva: se ignora
+        }
+        if (!ok) return TELEMETRY_DECODE_ERR_FORMAT;
+        out->fields |= TELEMETRY_FIELD(key.i);
+    }
+
+    if (!(out->fields & TELEMETRY_FIELD(KEY_VERSION))) {
+        return TELEMETRY_DECODE_ERR_FORMAT;
+    }
+    return TELEMETRY_DECODE_OK;
+}
+
+int telemetry_decode(const uint8_t *buf, size_t len, telemetry_decoded_t *out)
+{
+    reader_t r = { buf, buf + len };
+    return decode_map(&r, out);
+}
+
+int telemetry_decode_batch(const uint8_t *buf, size_t len, telemetry_decoded_t *out, size_t max)
+{
+    reader_t r = { buf, buf + len };
+    if (len == 0) return TELEMETRY_DECODE_ERR_TRUNCATED;
+    if ((buf[0] >> 5) == 5) {
+        if (max == 0) return 0;
+        int err = decode_map(&r, &out[0]);
+        return err ? err : 1;
+    }
+
+    uint8_t major, info;
+    uint64_t items;
+    int err = read_head(&r, &major, &info, &items);
+    if (err) return err;
+    if (major != 4) return TELEMETRY_DECODE_ERR_FORMAT;
+
+    size_t n = 0;
+    for (uint64_t k = 0; k < items; k++) {
+        telemetry_decoded_t tmp;
+        err = decode_map(&r, n < max ? &out[n] : &tmp);
+        if (err) return err;
+        if (n < max) n++;
+    }
+    return (int)n;
+}
+
+int telemetry_decoded_to_json(const telemetry_decoded_t *m, char *buf, size_t len)
+{
+    static const char *const state_str[] = { "LIMPIA", "MEDIA", "SUCIA" };
+    size_t n = 0;
+    int w;
+
+#define APPEND(...)                                                         \
+    do {                                                                    \
+        w = snprintf(buf + n, n < len ? len - n : 0, __VA_ARGS__);          \
+        if (w < 0) return -1;                                               \
+        n += (size_t)w;                                                     \
+    } while (0)
+#define HAS(key) (m->fields & TELEMETRY_FIELD(key))
+
+#define STATS(name, st)                                                         \
+    APPEND(",\"" name "\":{\"n\":%u,\"min\":%.2f,\"max\":%.2f,\"mean\":%.2f,\"sd\":%.2f}", \
+           (st).n, (st).min, (st).max, (st).mean, (st).sd)
+
+    APPEND("{\"v\":%u,\"type\":%u", m->version, m->type);
+    if (HAS(KEY_WINDOW))    APPEND(",\"win\":%u", m->window);
+    if (HAS(KEY_SEQ))       APPEND(",\"seq\":%u", m->seq);
+    if (HAS(KEY_TS))        APPEND(",\"ts\":%u", m->ts);
+    if (HAS(KEY_DURATION))  APPEND(",\"dur\":%u", m->duration);
+    if (HAS(KEY_COUNT))     APPEND(",\"n\":%u", m->count);
+    if (HAS(KEY_LEVEL_STATS)) STATS("level", m->level_stats);
+    if (HAS(KEY_TDS_STATS)) STATS("tds", m->tds_stats);
+    if (HAS(KEY_LEVEL))     APPEND(",\"level\":%.2f", m->level);
+    if (HAS(KEY_TDS))       APPEND(",\"tds\":%.1f", m->tds);
+    if (HAS(KEY_STATE))     APPEND(",\"state\":\"%s\"", m->state < 3 ? state_str[m->state] : "?");
+    if (HAS(KEY_PUMP))      APPEND(",\"pump\":\"%s\"", m->pump ? "ON" : "OFF");
+    if (HAS(KEY_LEVEL_FILT)) APPEND(",\"level_f\":%.2f", m->level_filt);
+    if (HAS(KEY_RATE))      APPEND(",\"rate\":%.2f", m->rate);
+    if (HAS(KEY_ETA))       APPEND(",\"eta\":%.1f", m->eta);
+    if (HAS(KEY_HEAP_FREE)) APPEND(",\"heap_free\":%u", m->heap_free);
+    if (HAS(KEY_HEAP_MIN))  APPEND(",\"heap_min\":%u", m->heap_min);
+    if (HAS(KEY_RSSI))      APPEND(",\"rssi\":%d", m->rssi);
+    if (HAS(KEY_DROPPED))   APPEND(",\"dropped\":%u", m->dropped);
+    APPEND("}");
+
+#undef STATS
+#undef HAS
+#undef APPEND
+    return n < len ? (int)n : -1;
+}
+
+const char *telemetry_decode_strerror(int err)
+{
+    switch (err) {
+        case TELEMETRY_DECODE_OK:            return "ok";
+        case TELEMETRY_DECODE_ERR_TRUNCATED: return "payload truncado";
+        case TELEMETRY_DECODE_ERR_FORMAT:    return "formato inválido";
+        case TELEMETRY_DECODE_ERR_VERSION:   return "versión de esquema no soportada";
+        default:                             return "error desconocido";
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef TELEMETRY_DECODE_H
+#define TELEMETRY_DECODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Decodificador (host) de la telemetría CBOR de los nodos.
+ *
+ * Esquema: ver Nodo_Cisterna/components/telemetry/telemetry.h. Las claves
+ * desconocidas se saltan, así que mensajes con campos nuevos de la misma
+ * versión siguen decodificando.
+ */
+
+#define TELEMETRY_DECODE_VERSION 1   // Versión de esquema que entiende este decodificador
+
+typedef enum {
+    TELEMETRY_DECODE_OK = 0,
+    TELEMETRY_DECODE_ERR_TRUNCATED = -1,   // El payload termina a mitad de un ítem
+    TELEMETRY_DECODE_ERR_FORMAT = -2,      // No es un map CBOR con el esquema esperado
+    TELEMETRY_DECODE_ERR_VERSION = -3,     // Versión de esquema no soportada
+} telemetry_decode_err_t;
+
+// Bits de telemetry_decoded_t.fields (1 << clave)
+#define TELEMETRY_FIELD(key) (1u << (key))
+
+// Estadística de un campo en un resumen de ventana
+typedef struct {
+    uint32_t n;
+    float min;
+    float max;
+    float mean;
+    float sd;
+} telemetry_decoded_stats_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t type;          // 1 muestra, 2 bomba, 3 diagnóstico, 4 resumen
+    uint32_t fields;       // Claves presentes
+    uint32_t seq;
+    uint32_t ts;
+    float level;
+    float tds;
+    uint8_t state;
+    bool pump;
+    uint32_t heap_free;
+    uint32_t heap_min;
+    int32_t rssi;
+    uint32_t dropped;
+    uint32_t window;
+    uint32_t duration;
+    uint32_t count;
+    telemetry_decoded_stats_t level_stats;
+    telemetry_decoded_stats_t tds_stats;
+    float level_filt;      // cm, nivel filtrado
+    float rate;            // cm/min, + llenando
+    float eta;             // minutos hasta lleno/vacío
+} telemetry_decoded_t;
+
+/**
+ * @brief Decodifica un payload CBOR de telemetría
+ *
+ * @return TELEMETRY_DECODE_OK o un telemetry_decode_err_t negativo
+ */
+int telemetry_decode(const uint8_t *buf, size_t len, telemetry_decoded_t *out);
+
+/**
+ * @brief Decodifica un payload que puede ser un mensaje o un lote
+ *
+ * Los lotes (tópico de reenvío de muestras guardadas sin conexión) son un
+ * array CBOR de maps de muestra; un map suelto se trata como lote de uno.
+ * Los elementos que no caben en @p out se validan pero se descartan.
+ *
+ * @return Mensajes escritos en @p out, o un telemetry_decode_err_t negativo
+ */
+int telemetry_decode_batch(const uint8_t *buf, size_t len, telemetry_decoded_t *out, size_t max);
+
+/**
+ * @brief Representa un mensaje decodificado como JSON (mismos nombres que el modo JSON del nodo)
+ *
+ * @return Longitud escrita, o -1 si no cabe
+ */
+int telemetry_decoded_to_json(const telemetry_decoded_t *msg, char *buf, size_t len);
+
+/**
+ * @brief Texto de un código de error
+ */
+const char *telemetry_decode_strerror(int err);
+
+#endif // TELEMETRY_DECODE_H
@@ -0,0 +1,60 @@
+/*
+ * Decodifica payloads CBOR de telemetría escritos en hexadecimal, uno por
+ * línea, y los imprime como JSON. Pensado para usarse con:
+ *
+ *   mosquitto_sub -h 10.42.0.1 -t cistern/telemetry -F %x | ./telemetry_decode
+ *
+ * Los lotes de reenvío (array de muestras) se imprimen un JSON por muestra.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_decode.h"
+
+static int hex_nibble(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+int main(void)
+{
+    char line[4096];
+    uint8_t payload[2048];
+    telemetry_decoded_t msgs[32];
+    char json[512];
+    int rc = 0;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        size_t n = 0;
+        int hi = -1;
+        for (const char *c = line; *c && n < sizeof(payload); c++) {
+            int v = hex_nibble((unsigned char)*c);
+            if (v < 0) continue;
+            if (hi < 0) {
+                hi = v;
+            } else {
+                payload[n++] = (uint8_t)(hi << 4 | v);
+                hi = -1;
+            }
+        }
+        if (n == 0) continue;
+
+        int count = telemetry_decode_batch(payload, n, msgs, sizeof(msgs) / sizeof(msgs[0]));
+        if (count < 0) {
+            fprintf(stderr, "error: %s (%zu bytes)\n", telemetry_decode_strerror(count), n);
+            rc = 1;
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            if (telemetry_decoded_to_json(&msgs[i], json, sizeof(json)) > 0) {
+                puts(json);
+            }
+        }
+        fflush(stdout);
+    }
+    return rc;
+}
@@ -0,0 +1,203 @@
+/*
+ * Prueba de host de la captura del pulso ECHO del HC-SR04
+ * (components/sensors/ultrasonic_echo.c, compilado tal cual). Alimenta la
+ * máquina de estados con secuencias sintéticas de flancos y consultas de
+ * timeout, como lo harían la ISR de GPIO y sensor_ultrasonic_wait(), y
+ * verifica:
+ *
+ *   - pulso normal: DONE solo con el flanco de bajada y ancho exacto;
+ *   - flancos fuera de secuencia (bajada antes del eco, subidas repetidas,
+ *     ecos tardíos, sin armar) ignorados sin tocar la medición;
+ *   - timeouts de subida y de ancho en el límite exacto (estrictamente
+ *     mayor), una sola vez, y sin efecto sobre una medición terminada;
+ *   - rearme tras un timeout o un pulso;
+ *   - conversión ancho -> cm en todo el rango del sensor.
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ultrasonic_echo.h"
+
+#define US_PER_CM    (2.0 / 0.0343)   // Ida y vuelta a 343 m/s: ~58,3 µs por cm
+#define MIN_RANGE_CM 2.0              // Rango del HC-SR04
+#define MAX_RANGE_CM 400.0
+
+static int failures;
+static int checks;
+
+static void check(bool ok, const char *caso, const char *what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        printf("FALLA [%s] %s\n", caso, what);
+    }
+}
+
+/* Disparo en t0, eco de ancho w tras una demora d: devuelve el estado final */
+static echo_capture_t pulse(int64_t t0, int64_t d, uint32_t w)
+{
+    echo_capture_t cap;
+    memset(&cap, 0, sizeof(cap));
+    echo_capture_arm(&cap, t0);
+    bool up = echo_capture_on_edge(&cap, 1, t0 + d);
+    bool down = echo_capture_on_edge(&cap, 0, t0 + d + w);
+    check(!up && down, "pulso", "on_edge() no informó el fin solo en la bajada");
+    return cap;
+}
+
+static void test_normal(void)
+{
+    const char *c = "normal";
+    echo_capture_t cap;
+    memset(&cap, 0, sizeof(cap));
+
+    echo_capture_arm(&cap, 1000);
+    check(cap.state == ECHO_STATE_ARMED && cap.armed_at_us == 1000, c, "arm() no deja ARMED");
+    check(!echo_capture_finished(&cap), c, "terminada recién armada");
+    check(!echo_capture_check_timeout(&cap, 1000 + ECHO_RISE_TIMEOUT_US), c, "timeout antes de tiempo");
+
+    check(!echo_capture_on_edge(&cap, 1, 1450), c, "la subida informó fin");
+    check(cap.state == ECHO_STATE_MEASURING && cap.rise_at_us == 1450, c, "la subida no pasó a MEASURING");
+    check(!echo_capture_finished(&cap), c, "terminada durante el pulso");
+
+    check(echo_capture_on_edge(&cap, 0, 1450 + 5831), c, "la bajada no informó fin");
+    check(cap.state == ECHO_STATE_DONE && cap.width_us == 5831, c, "ancho o estado incorrecto");
+    check(echo_capture_finished(&cap), c, "no terminada tras la bajada");
+    check(fabsf(echo_width_to_cm(cap.width_us) - 100.0f) < 0.01f, c, "5831 µs no son 100 cm");
+
+    // Anchos en todo el rango, con marcas de tiempo grandes (esp_timer tras días)
+    const int64_t t0 = (int64_t)1 << 40;
+    const uint32_t widths[] = { 0, 1, 117, 583, 2915, 11662, 23324, ECHO_PULSE_TIMEOUT_US };
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+        echo_capture_t p = pulse(t0, 430, widths[i]);
+        char msg[64];
+        snprintf(msg, sizeof(msg), "ancho %" PRIu32 " µs medido como %" PRIu32, widths[i], p.width_us);
+        check(p.state == ECHO_STATE_DONE && p.width_us == widths[i], c, msg);
+    }
+}
+
+static void test_out_of_sequence(void)
+{
+    const char *c = "fuera de secuencia";
+    echo_capture_t cap;
+    memset(&cap, 0, sizeof(cap));
+
+    // Sin armar (IDLE): ningún flanco cuenta
+    check(!echo_capture_on_edge(&cap, 1, 10) && !echo_capture_on_edge(&cap, 0, 20), c, "flanco en IDLE informó fin");
+    check(cap.state == ECHO_STATE_IDLE, c, "un flanco sacó de IDLE");
+    check(!echo_capture_check_timeout(&cap, 1000000000), c, "timeout en IDLE");
+
+    // Bajada espuria antes del eco: se sigue esperando la subida
+    echo_capture_arm(&cap, 0);
+    check(!echo_capture_on_edge(&cap, 0, 100), c, "bajada antes del eco informó fin");
+    check(cap.state == ECHO_STATE_ARMED, c, "bajada antes del eco cambió el estado");
+
+    // Subidas repetidas (rebote): cuenta la primera
+    echo_capture_on_edge(&cap, 1, 400);
+    check(!echo_capture_on_edge(&cap, 1, 450), c, "subida repetida informó fin");
+    check(cap.rise_at_us == 400, c, "subida repetida movió el inicio del pulso");
+    check(echo_capture_on_edge(&cap, 0, 1000) && cap.width_us == 600, c, "ancho mal con rebote en la subida");
+
+    // Ecos tardíos tras terminar: ignorados
+    check(!echo_capture_on_edge(&cap, 1, 1200) && !echo_capture_on_edge(&cap, 0, 1800), c, "eco tardío informó fin");
+    check(cap.state == ECHO_STATE_DONE && cap.width_us == 600, c, "eco tardío cambió la medición");
+    check(!echo_capture_check_timeout(&cap, 1000000000), c, "timeout sobre una medición terminada");
+    check(cap.state == ECHO_STATE_DONE, c, "timeout tocó una medición terminada");
+
+    // Rearme tras un pulso: nada de la medición anterior queda
+    echo_capture_arm(&cap, 3000);
+    check(cap.state == ECHO_STATE_ARMED && cap.width_us == 0 && cap.rise_at_us == 0 && cap.armed_at_us == 3000,
+          c, "rearme tras un pulso no limpia");
+}
+
+static void test_timeouts(void)
+{
+    const char *c = "timeout";
+    echo_capture_t cap;
+    memset(&cap, 0, sizeof(cap));
+
+    // Sin eco: vence al superar ECHO_RISE_TIMEOUT_US desde el disparo
+    echo_capture_arm(&cap, 5000);
+    check(!echo_capture_check_timeout(&cap, 5000 + ECHO_RISE_TIMEOUT_US), c, "subida: venció en el límite");
+    check(echo_capture_check_timeout(&cap, 5000 + ECHO_RISE_TIMEOUT_US + 1), c, "subida: no venció pasado el límite");
+    check(cap.state == ECHO_STATE_TIMEOUT && echo_capture_finished(&cap), c, "subida: estado tras vencer");
+    check(!echo_capture_check_timeout(&cap, 5000 + 2 * ECHO_RISE_TIMEOUT_US), c, "subida: venció dos veces");
+    check(!echo_capture_on_edge(&cap, 1, 5000 + ECHO_RISE_TIMEOUT_US + 10) &&
+          !echo_capture_on_edge(&cap, 0, 5000 + ECHO_RISE_TIMEOUT_US + 600), c, "flanco tras vencer informó fin");
+    check(cap.state == ECHO_STATE_TIMEOUT, c, "flanco tras vencer cambió el estado");
+
+    // Rearme tras el timeout: medición limpia
+    echo_capture_arm(&cap, 200000);
+    check(cap.state == ECHO_STATE_ARMED && cap.width_us == 0 && cap.rise_at_us == 0, c, "rearme no limpia");
+    echo_capture_on_edge(&cap, 1, 200300);
+    check(echo_capture_on_edge(&cap, 0, 201466) && cap.width_us == 1166, c, "medición tras rearme");
+
+    // Pulso que no baja: vence por ancho, contado desde la subida y no desde el disparo
+    echo_capture_arm(&cap, 0);
+    echo_capture_on_edge(&cap, 1, 20000);
+    check(!echo_capture_check_timeout(&cap, ECHO_RISE_TIMEOUT_US + 1), c, "ancho: usó el timeout de subida");
+    check(!echo_capture_check_timeout(&cap, 20000 + ECHO_PULSE_TIMEOUT_US), c, "ancho: venció en el límite");
+    check(echo_capture_check_timeout(&cap, 20000 + ECHO_PULSE_TIMEOUT_US + 1), c, "ancho: no venció pasado el límite");
+    check(cap.state == ECHO_STATE_TIMEOUT, c, "ancho: estado tras vencer");
+    check(!echo_capture_on_edge(&cap, 0, 20000 + ECHO_PULSE_TIMEOUT_US + 5), c, "bajada tras vencer informó fin");
+
+    // Consultas de timeout intercaladas con un pulso normal no lo afectan
+    echo_capture_arm(&cap, 0);
+    for (int64_t t = 0; t <= ECHO_RISE_TIMEOUT_US; t += 1000) {
+        check(!echo_capture_check_timeout(&cap, t), c, "venció esperando la subida dentro del plazo");
+    }
+    echo_capture_on_edge(&cap, 1, ECHO_RISE_TIMEOUT_US);
+    check(!echo_capture_check_timeout(&cap, ECHO_RISE_TIMEOUT_US + 5000), c, "venció a mitad del pulso");
+    check(echo_capture_on_edge(&cap, 0, ECHO_RISE_TIMEOUT_US + 5831) && cap.width_us == 5831, c,
+          "pulso con consultas intercaladas");
+}
+
+static void test_distance(void)
+{
+    const char *c = "distancia";
+    check(echo_width_to_cm(0) == 0.0f, c, "0 µs no son 0 cm");
+
+    float prev = -1.0f;
+    double max_err = 0;
+    for (uint32_t w = 0; w <= ECHO_PULSE_TIMEOUT_US; w++) {
+        float cm = echo_width_to_cm(w);
+        double want = w / US_PER_CM;
+        double err = fabs(cm - want);
+        if (err > max_err) {
+            max_err = err;
+        }
+        if (cm < prev) {
+            check(false, c, "la distancia no crece con el ancho");
+            break;
+        }
+        prev = cm;
+    }
+    // float con 24 bits de mantisa: error relativo ~1e-7 sobre hasta 1715 cm
+    check(max_err < 0.001, c, "error de conversión mayor a 0,01 mm");
+
+    uint32_t w_min = (uint32_t)lround(MIN_RANGE_CM * US_PER_CM);
+    uint32_t w_max = (uint32_t)lround(MAX_RANGE_CM * US_PER_CM);
+    check(fabsf(echo_width_to_cm(w_min) - (float)MIN_RANGE_CM) < 0.01f, c, "mínimo del rango");
+    check(fabsf(echo_width_to_cm(w_max) - (float)MAX_RANGE_CM) < 0.01f, c, "máximo del rango");
+    check(w_max < ECHO_PULSE_TIMEOUT_US, c, "el timeout de ancho corta el rango del sensor");
+    printf("conversión: %.1f µs por cm, %" PRIu32 "..%" PRIu32 " µs para %.0f..%.0f cm, error máximo %.2g cm\n",
+           US_PER_CM, w_min, w_max, MIN_RANGE_CM, MAX_RANGE_CM, max_err);
+}
+
+int main(void)
+{
+    test_normal();
+    test_out_of_sequence();
+    test_timeouts();
+    test_distance();
+
+    printf("%s (%d verificaciones, %d fallas)\n", failures ? "FALLA" : "OK", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+/*
+ * Reducción de ráfagas ultrasónicas (components/sensors/ultrasonic_filter) en
+ * el host: corrección frente a un modelo, efecto sobre ráfagas simuladas y
+ * costo por llamada. Compila el código del firmware tal cual (C11 puro).
+ * Verifica:
+ *
+ *   - igual resultado y número de muestras usadas que un modelo directo
+ *     (qsort, filtrado por distancia a la mediana, recorte que deja al menos
+ *     min_valid, media redondeada) en ráfagas aleatorias con ceros,
+ *     duplicados y más de ULTRASONIC_BURST_MAX muestras, con parámetros
+ *     aleatorios;
+ *   - casos de borde: sin ecos, una muestra, mediana par, dos grupos
+ *     separados, recorte con pocas muestras o que dejaría menos de
+ *     min_valid, redondeo y out_us intacto cuando no hay resultado;
+ *   - ultrasonic_filter_mm_to_us() contra 343 m/s ida y vuelta;
+ *   - en ráfagas simuladas con ruido, ecos perdidos y ecos espurios: ningún
+ *     espurio aislado mueve el resultado ni la invalida, y menos lecturas
+ *     fallidas y groseras que con un solo ping.
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "ultrasonic_filter.h"
+
+#define US_PER_CM     (2.0 / 0.0343)   // Ida y vuelta a 343 m/s: ~58,3 µs por cm
+#define MIN_CM        20.0             // Distancias simuladas (rango útil del HC-SR04)
+#define MAX_CM        400.0
+#define NOISE_US      60               // Ruido acotado en ±NOISE_US (~±1 cm)
+#define MISS_PCT      8                // Pings sin eco
+#define SPURIOUS_PCT  4                // Ecos espurios (rebotes) en cualquier punto del rango
+#define GROSS_US      292              // Error grosero: más de 5 cm
+#define WIDTH_MAX_US  100000           // ECHO_PULSE_TIMEOUT_US: acota los anchos reales
+
+#define MODEL_CASES   200000
+#define BENCH_BURSTS  4096
+
+// Valores por defecto del menú "Sensor ultrasónico"
+#define DEFAULT_OUTLIER_MM 50
+#define DEFAULT_TRIM       1
+#define DEFAULT_MIN_VALID  2
+
+static int failures;
+static int checks;
+
+static void check(bool ok, const char *caso, const char *what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA [%s] %s\n", caso, what);
+        }
+    }
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Modelo: la descripción de ultrasonic_filter.h escrita de la forma más directa */
+static size_t model_reduce(const uint32_t *samples, size_t n, const ultrasonic_filter_cfg_t *cfg, uint32_t *out_us)
+{
+    uint32_t v[ULTRASONIC_BURST_MAX], kept[ULTRASONIC_BURST_MAX];
+    size_t count = 0, nk = 0;
+
+    for (size_t i = 0; i < n && i < ULTRASONIC_BURST_MAX; i++) {
+        if (samples[i] != 0) {
+            v[count++] = samples[i];
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    qsort(v, count, sizeof(v[0]), cmp_u32);
+    uint64_t median = count % 2 ? v[count / 2] : ((uint64_t)v[count / 2 - 1] + v[count / 2]) / 2;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t dev = v[i] > median ? v[i] - median : median - v[i];
+        if (cfg->max_dev_us == 0 || dev <= cfg->max_dev_us) {
+            kept[nk++] = v[i];
+        }
+    }
+    size_t lo = 0, hi = nk;
+    size_t keep = cfg->min_valid > 1 ? cfg->min_valid : 1;
+    if (nk >= 2u * cfg->trim + keep) {
+        lo = cfg->trim;
+        hi = nk - cfg->trim;
+    }
+    if (hi == lo) {
+        return 0;
+    }
+    uint64_t sum = 0;
+    for (size_t i = lo; i < hi; i++) {
+        sum += kept[i];
+    }
+    *out_us = (uint32_t)llround((double)sum / (double)(hi - lo));
+    return hi - lo;
+}
+
+/* Ráfagas aleatorias contra el modelo, con parámetros aleatorios */
+static void test_model(void)
+{
+    const char *caso = "modelo";
+    uint32_t samples[ULTRASONIC_BURST_MAX + 5], copy[ULTRASONIC_BURST_MAX + 5];
+    int mismatches = 0;
+
+    for (int k = 0; k < MODEL_CASES; k++) {
+        size_t n = rng() % (ULTRASONIC_BURST_MAX + 6);
+        uint32_t center = 1 + rng() % WIDTH_MAX_US;
+        for (size_t i = 0; i < n; i++) {
+            switch (rng() % 8) {
+            case 0:  samples[i] = 0; break;                                     // sin eco
+            case 1:  samples[i] = 1 + rng() % WIDTH_MAX_US; break;              // espurio
+            case 2:  samples[i] = i > 0 ? samples[i - 1] : center; break;       // duplicado
+            default: samples[i] = center + rng() % 400; break;                  // grupo
+            }
+        }
+        ultrasonic_filter_cfg_t cfg = {
+            .max_dev_us = rng() % 4 == 0 ? 0 : rng() % 2000,
+            .trim = (uint8_t)(rng() % 8),
+            .min_valid = (uint8_t)(rng() % 8),
+        };
+        memcpy(copy, samples, sizeof(samples));
+        uint32_t got_us = 0xDEADBEEF, want_us = 0xDEADBEEF;
+        size_t got = ultrasonic_filter_reduce(samples, n, &cfg, &got_us);
+        size_t want = model_reduce(samples, n, &cfg, &want_us);
+
+        bool ok = got == want && got_us == want_us && memcmp(copy, samples, sizeof(samples)) == 0;
+        if (!ok && mismatches++ < 5) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "n=%zu desvío=%" PRIu32 " recorte=%u mínimo=%u: %zu muestras, %" PRIu32
+                     " µs (esperado %zu, %" PRIu32 " µs)", n, cfg.max_dev_us, cfg.trim, cfg.min_valid, got, got_us,
+                     want, want_us);
+            check(false, caso, msg);
+        }
+    }
+    check(mismatches == 0, caso, "resultados distintos del modelo");
+    printf("modelo: %d ráfagas aleatorias, %d diferencias\n", MODEL_CASES, mismatches);
+}
+
+/* Reduce y compara cantidad y resultado (want_us se ignora si want == 0) */
+static void expect(const char *caso, const uint32_t *s, size_t n, uint32_t max_dev, uint8_t trim,
+                   uint8_t min_valid, size_t want, uint32_t want_us)
+{
+    ultrasonic_filter_cfg_t cfg = { .max_dev_us = max_dev, .trim = trim, .min_valid = min_valid };
+    uint32_t out = 0xDEADBEEF;
+    size_t got = ultrasonic_filter_reduce(s, n, &cfg, &out);
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%zu muestras, %" PRIu32 " µs (esperado %zu, %" PRIu32 " µs)", got, out, want,
+             want ? want_us : 0xDEADBEEF);
+    check(got == want && out == (want ? want_us : 0xDEADBEEF), caso, msg);
+}
+
+static void test_edges(void)
+{
+    const uint32_t none[5] = { 0 };
+    expect("sin ecos", none, 5, 292, 1, 1, 0, 0);
+    expect("ráfaga vacía", none, 0, 292, 1, 1, 0, 0);
+
+    const uint32_t one[3] = { 0, 5831, 0 };
+    expect("una muestra", one, 3, 292, 1, 1, 1, 5831);
+
+    // Mediana par (150): las dos a 50 µs, en el límite, se aceptan
+    const uint32_t pair[2] = { 200, 100 };
+    expect("mediana par", pair, 2, 50, 0, 1, 2, 150);
+    expect("mediana par, límite", pair, 2, 49, 0, 1, 0, 0);
+
+    // Dos grupos separados: ninguna muestra cerca de la mediana
+    const uint32_t split[4] = { 1000, 1010, 9000, 9010 };
+    expect("dos grupos", split, 4, 292, 0, 1, 0, 0);
+    expect("dos grupos sin rechazo", split, 4, 0, 0, 1, 4, 5005);
+
+    // Recorte solo si quedan muestras: 2 con recorte 1 se promedian enteras
+    expect("recorte con pocas", pair, 2, 0, 1, 1, 2, 150);
+    const uint32_t three[3] = { 100, 300, 200 };
+    expect("recorte", three, 3, 0, 1, 1, 1, 200);
+    expect("recorte excesivo", three, 3, 0, 7, 1, 3, 200);
+
+    // Recorte que dejaría menos de min_valid (0 cuenta como 1): se promedia sin recortar
+    expect("recorte y mínimo", three, 3, 0, 1, 2, 3, 200);
+    expect("recorte y mínimo 0", three, 3, 0, 1, 0, 1, 200);
+    const uint32_t four[4] = { 400, 100, 300, 200 };
+    expect("recorte con el mínimo justo", four, 4, 0, 1, 2, 2, 250);
+    expect("recorte por debajo del mínimo", four, 4, 0, 1, 3, 4, 250);
+
+    // Redondeo al entero más cercano
+    const uint32_t round_up[2] = { 1, 2 };
+    expect("redondeo", round_up, 2, 0, 0, 1, 2, 2);
+
+    // Un espurio entre cuatro ecos buenos: descartado por distancia o por recorte
+    const uint32_t spur[5] = { 5831, 5840, 20000, 5825, 5834 };
+    expect("espurio, rechazo", spur, 5, 292, 0, 1, 4, 5833);
+    expect("espurio, recorte", spur, 5, 0, 1, 1, 3, 5835);
+
+    // Solo cuentan las primeras ULTRASONIC_BURST_MAX muestras
+    uint32_t many[ULTRASONIC_BURST_MAX + 5];
+    for (size_t i = 0; i < ULTRASONIC_BURST_MAX + 5; i++) {
+        many[i] = i < ULTRASONIC_BURST_MAX ? 1000 : 90000;
+    }
+    expect("más de ULTRASONIC_BURST_MAX", many, ULTRASONIC_BURST_MAX + 5, 0, 0, 1, ULTRASONIC_BURST_MAX, 1000);
+}
+
+static void test_mm_to_us(void)
+{
+    const char *caso = "mm a µs";
+    check(ultrasonic_filter_mm_to_us(0) == 0, caso, "0 mm");
+    check(ultrasonic_filter_mm_to_us(DEFAULT_OUTLIER_MM) == 292, caso, "50 mm no son 292 µs");
+    check(ultrasonic_filter_mm_to_us(1000) == 5831, caso, "1 m no son 5831 µs");
+    double max_err = 0;
+    for (uint32_t mm = 0; mm <= 2000; mm++) {
+        double err = fabs(ultrasonic_filter_mm_to_us(mm) - mm * US_PER_CM / 10.0);
+        if (err > max_err) {
+            max_err = err;
+        }
+    }
+    // Redondeo (0,5) más la constante truncada a 5,831 µs/mm en todo el rango del menú
+    check(max_err < 0.75, caso, "error mayor a 0,75 µs hasta 2 m");
+}
+
+/* ---- Ráfagas simuladas ---- */
+
+typedef struct {
+    uint32_t reads, failed, gross;
+    double sq_err;              // Sobre las lecturas no groseras
+} read_stats_t;
+
+static void account(read_stats_t *st, bool valid, uint32_t got_us, uint32_t true_us)
+{
+    st->reads++;
+    if (!valid) {
+        st->failed++;
+        return;
+    }
+    double err = (double)got_us - (double)true_us;
+    if (fabs(err) > GROSS_US) {
+        st->gross++;
+    } else {
+        st->sq_err += err * err;
+    }
+}
+
+static uint32_t ping(uint32_t true_us, bool *spurious)
+{
+    uint32_t r = rng() % 100;
+    *spurious = false;
+    if (r < MISS_PCT) {
+        return 0;
+    }
+    if (r < MISS_PCT + SPURIOUS_PCT) {
+        *spurious = true;
+        return (uint32_t)(MIN_CM * US_PER_CM) + rng() % (uint32_t)((MAX_CM - MIN_CM) * US_PER_CM);
+    }
+    return true_us - NOISE_US + rng() % (2 * NOISE_US + 1);
+}
+
+static void print_stats(const char *name, const read_stats_t *st)
+{
+    uint32_t good = st->reads - st->failed - st->gross;
+    printf("  %-12s %6.2f %% fallidas, %6.3f %% groseras, error RMS %.1f µs\n", name,
+           100.0 * st->failed / st->reads, 100.0 * st->gross / st->reads, good ? sqrt(st->sq_err / good) : 0.0);
+}
+
+static void simulate(uint32_t bursts, uint32_t pings)
+{
+    const char *caso = "simulación";
+    ultrasonic_filter_cfg_t cfg = {
+        .max_dev_us = ultrasonic_filter_mm_to_us(DEFAULT_OUTLIER_MM),
+        .trim = DEFAULT_TRIM,
+        .min_valid = pings < DEFAULT_MIN_VALID ? (uint8_t)pings : DEFAULT_MIN_VALID,
+    };
+    read_stats_t single = { 0 }, burst = { 0 };
+    uint32_t isolated = 0, moved = 0;
+
+    for (uint32_t b = 0; b < bursts; b++) {
+        uint32_t true_us = (uint32_t)((MIN_CM + (MAX_CM - MIN_CM) * (rng() / 4294967296.0)) * US_PER_CM);
+        uint32_t w[ULTRASONIC_BURST_MAX];
+        uint32_t spurious = 0, good = 0, far = 0;
+        for (uint32_t i = 0; i < pings; i++) {
+            bool spur;
+            w[i] = ping(true_us, &spur);
+            spurious += spur;
+            good += w[i] != 0 && !spur;
+            far += spur && (w[i] > true_us + NOISE_US + cfg.max_dev_us + 2 * NOISE_US ||
+                            w[i] + NOISE_US + cfg.max_dev_us + 2 * NOISE_US < true_us);
+        }
+        // Sin ráfaga el firmware se queda con el primer ping
+        account(&single, w[0] != 0, w[0], true_us);
+
+        uint32_t out = 0;
+        size_t used = ultrasonic_filter_reduce(w, pings, &cfg, &out);
+        bool valid = used >= cfg.min_valid;
+        account(&burst, valid, out, true_us);
+
+        // Un solo espurio lejos del grupo y al menos dos ecos buenos: la
+        // mediana cae entre los buenos y el resultado queda dentro de su ruido
+        if (spurious == 1 && far == 1 && good >= 2) {
+            isolated++;
+            if (!valid || out + NOISE_US < true_us || out > true_us + NOISE_US) {
+                moved++;
+            }
+        }
+    }
+
+    printf("simulación: %" PRIu32 " ráfagas de %" PRIu32 " pings (desvío %" PRIu32 " µs, recorte %u, mínimo %u)\n",
+           bursts, pings, cfg.max_dev_us, cfg.trim, cfg.min_valid);
+    print_stats("un ping", &single);
+    print_stats("ráfaga", &burst);
+    printf("  %" PRIu32 " ráfagas con un espurio aislado, %" PRIu32 " movidas\n", isolated, moved);
+
+    check(moved == 0, caso, "un eco espurio aislado movió el resultado");
+    if (pings >= 3) {
+        check(isolated > 0, caso, "ninguna ráfaga con un espurio aislado");
+        check(burst.failed < single.failed, caso, "no menos lecturas fallidas que con un ping");
+        check(burst.gross * 4 < single.gross, caso, "no 4 veces menos lecturas groseras que con un ping");
+        check(burst.sq_err / (burst.reads - burst.failed - burst.gross) <
+              single.sq_err / (single.reads - single.failed - single.gross), caso,
+              "error RMS no menor que con un ping");
+    }
+}
+
+/* ---- Costo ---- */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(uint32_t iterations)
+{
+    static uint32_t bursts[BENCH_BURSTS][ULTRASONIC_BURST_MAX];
+    const ultrasonic_filter_cfg_t cfg = {
+        .max_dev_us = ultrasonic_filter_mm_to_us(DEFAULT_OUTLIER_MM),
+        .trim = DEFAULT_TRIM,
+        .min_valid = DEFAULT_MIN_VALID,
+    };
+    const uint32_t sizes[] = { 1, 5, ULTRASONIC_BURST_MAX };
+    uint64_t sink = 0;
+
+    rng_state = 12345;
+    for (int b = 0; b < BENCH_BURSTS; b++) {
+        uint32_t true_us = (uint32_t)(MIN_CM * US_PER_CM) + rng() % (uint32_t)((MAX_CM - MIN_CM) * US_PER_CM);
+        for (int i = 0; i < ULTRASONIC_BURST_MAX; i++) {
+            bool spur;
+            bursts[b][i] = ping(true_us, &spur);
+        }
+    }
+
+    printf("\n%-34s %10s", "operación", "ns");
+#if HAVE_TSC
+    printf(" %10s", "ciclos TSC");
+#endif
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double t0 = now_ns();
+#if HAVE_TSC
+        uint64_t c0 = __rdtsc();
+#endif
+        for (uint32_t i = 0; i < iterations; i++) {
+            uint32_t out = 0;
+            sink += ultrasonic_filter_reduce(bursts[i % BENCH_BURSTS], sizes[s], &cfg, &out);
+            sink += out;
+        }
+#if HAVE_TSC
+        uint64_t c1 = __rdtsc();
+#endif
+        double t1 = now_ns();
+        char name[40];
+        snprintf(name, sizeof(name), "ultrasonic_filter_reduce (%" PRIu32 ")", sizes[s]);
+        printf("\n%-34s %10.1f", name, (t1 - t0) / iterations);
+#if HAVE_TSC
+        printf(" %10.1f", (double)(c1 - c0) / iterations);
+#endif
+    }
+    printf("\n(suma de control %" PRIu64 ")\n", sink);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t pings = 5;
+    uint32_t bursts = 200000;
+    uint32_t iterations = 10000000;
+    int c;
+    while ((c = getopt(argc, argv, "b:n:p:s:")) != -1) {
+        switch (c) {
+        case 'b': bursts = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'n': iterations = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'p': pings = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "uso: %s [-b ráfagas] [-n iteraciones_bench] [-p pings] [-s semilla]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (pings < 1 || pings > ULTRASONIC_BURST_MAX || bursts == 0 || rng_state == 0) {
+        fprintf(stderr, "pings 1..%d, ráfagas > 0, semilla distinta de 0\n", ULTRASONIC_BURST_MAX);
+        return 2;
+    }
+
+    test_model();
+    test_edges();
+    test_mm_to_us();
+    simulate(bursts, pings);
+    if (iterations > 0) {
+        bench(iterations);
+    }
+
+    printf("%s (%d verificaciones, %d fallas)\n", failures ? "FALLA" : "OK", checks, failures);
+    return failures ? 1 : 0;
+}
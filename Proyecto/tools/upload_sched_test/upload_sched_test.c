@@ -0,0 +1,407 @@
+/*
+ * Prueba de host del planificador de subidas del modo deep sleep
+ * (components/power/upload_sched.c, compilado tal cual). Verifica:
+ *
+ *   - cada disparo: primera muestra tras el arranque en frío (también con
+ *     lectura fallida), lote de every_n muestras (0 cuenta como 1), nivel
+ *     a level_delta_cm o más de la referencia en ambos sentidos, cambio de
+ *     estado del agua y buffer lleno; y su precedencia;
+ *   - la referencia: solo una subida exitosa la fija, una lectura fallida no
+ *     reemplaza el nivel y sin nivel de referencia no hay disparo por nivel;
+ *   - espera exponencial tras fallos: 1, 2, 4... muestras sin intentar,
+ *     acotada a max_backoff (0 cuenta como 1) y a 2^15, y reinicio tras una
+ *     subida exitosa;
+ *   - una semana de despertares como los de duty_cycle.c con un corte de
+ *     red: ninguna muestra perdida salvo por buffer lleno, antigüedad de lo
+ *     subido acotada por every_n, disparo por nivel y estado en el mismo
+ *     despertar, pocos intentos durante el corte y recuperación rápida.
+ *
+ * Termina con código 1 si alguna verificación falla.
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "upload_sched.h"
+
+// Valores por defecto del menú de deep sleep
+#define DS_BUFFER        32
+#define DS_UPLOAD_EVERY  10
+#define DS_LEVEL_DELTA   10.0f
+
+static int failures;
+static int checks;
+
+static void check(bool ok, const char *caso, const char *what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        if (failures <= 20) {
+            printf("FALLA [%s] %s\n", caso, what);
+        }
+    }
+}
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void expect(const char *caso, upload_reason_t got, upload_reason_t want)
+{
+    char msg[96];
+    snprintf(msg, sizeof(msg), "motivo \"%s\" (esperado \"%s\")", upload_reason_str(got), upload_reason_str(want));
+    check(got == want, caso, msg);
+}
+
+/* Planificador con una subida exitosa de referencia (nivel 100 cm, estado 1) */
+static void with_ref(upload_sched_t *s, const upload_policy_t *p)
+{
+    upload_sched_init(s);
+    upload_sched_on_sample(s, p, 1, 100.0f, 1);
+    upload_sched_done(s, p, true, 100.0f, 1);
+}
+
+static void test_first(void)
+{
+    const char *c = "primera";
+    const upload_policy_t p = { .every_n = 10, .capacity = 32, .level_delta_cm = 10.0f, .max_backoff = 10 };
+    upload_sched_t s;
+
+    upload_sched_init(&s);
+    check(!s.have_ref && s.ref_level_cm == -1.0f && s.fail_streak == 0 && s.retry_in == 0, c, "estado inicial");
+    expect(c, upload_sched_on_sample(&s, &p, 1, 100.0f, 1), UPLOAD_FIRST);
+    // Sin subida exitosa sigue siendo la primera
+    expect(c, upload_sched_on_sample(&s, &p, 2, 100.0f, 1), UPLOAD_FIRST);
+    upload_sched_done(&s, &p, true, 100.0f, 1);
+    check(s.have_ref && s.ref_level_cm == 100.0f && s.ref_state == 1, c, "la subida no fijó la referencia");
+    expect(c, upload_sched_on_sample(&s, &p, 1, 100.0f, 1), UPLOAD_NONE);
+
+    // Lectura fallida en el arranque: se sube igual, sin referencia de nivel
+    upload_sched_init(&s);
+    expect(c, upload_sched_on_sample(&s, &p, 1, -1.0f, 0), UPLOAD_FIRST);
+    upload_sched_done(&s, &p, true, -1.0f, 0);
+    check(s.have_ref && s.ref_level_cm == -1.0f, c, "una lectura fallida fijó el nivel de referencia");
+    expect(c, upload_sched_on_sample(&s, &p, 1, 300.0f, 0), UPLOAD_NONE);
+    upload_sched_done(&s, &p, true, 300.0f, 0);
+    check(s.ref_level_cm == 300.0f, c, "la primera lectura válida no fijó el nivel");
+    upload_sched_done(&s, &p, true, -1.0f, 0);
+    check(s.ref_level_cm == 300.0f, c, "una lectura fallida reemplazó el nivel de referencia");
+
+    // Primera subida fallida: no se repite como primera, sigue por cantidad
+    upload_sched_init(&s);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 100.0f, 1), UPLOAD_FIRST);
+    upload_sched_done(&s, &p, false, 100.0f, 1);
+    check(!s.have_ref, c, "una subida fallida fijó la referencia");
+    expect(c, upload_sched_on_sample(&s, &p, 2, 100.0f, 1), UPLOAD_NONE);   // espera 1
+    expect(c, upload_sched_on_sample(&s, &p, 3, 100.0f, 1), UPLOAD_NONE);
+    expect(c, upload_sched_on_sample(&s, &p, 10, 100.0f, 1), UPLOAD_COUNT);
+}
+
+static void test_count_full(void)
+{
+    const char *c = "cantidad";
+    upload_policy_t p = { .every_n = 6, .capacity = 12, .level_delta_cm = 0.0f, .max_backoff = 6 };
+    upload_sched_t s;
+
+    with_ref(&s, &p);
+    for (uint32_t n = 1; n < 6; n++) {
+        expect(c, upload_sched_on_sample(&s, &p, n, 100.0f, 1), UPLOAD_NONE);
+    }
+    expect(c, upload_sched_on_sample(&s, &p, 6, 100.0f, 1), UPLOAD_COUNT);
+    expect(c, upload_sched_on_sample(&s, &p, 7, 100.0f, 1), UPLOAD_COUNT);
+
+    p.every_n = 0;
+    expect("cada 0", upload_sched_on_sample(&s, &p, 1, 100.0f, 1), UPLOAD_COUNT);
+
+    // Capacidad menor que el lote: se sube lleno antes de perder muestras
+    c = "lleno";
+    p.every_n = 20;
+    p.capacity = 4;
+    expect(c, upload_sched_on_sample(&s, &p, 3, 100.0f, 1), UPLOAD_NONE);
+    expect(c, upload_sched_on_sample(&s, &p, 4, 100.0f, 1), UPLOAD_FULL);
+    expect(c, upload_sched_on_sample(&s, &p, 5, 100.0f, 1), UPLOAD_FULL);
+    // Lleno y lote a la vez: se informa lleno
+    p.every_n = 4;
+    expect(c, upload_sched_on_sample(&s, &p, 4, 100.0f, 1), UPLOAD_FULL);
+    p.capacity = 0;
+    p.every_n = 20;
+    expect("sin capacidad", upload_sched_on_sample(&s, &p, 19, 100.0f, 1), UPLOAD_NONE);
+}
+
+static void test_threshold_state(void)
+{
+    const char *c = "nivel";
+    upload_policy_t p = { .every_n = 10, .capacity = 32, .level_delta_cm = 10.0f, .max_backoff = 10 };
+    upload_sched_t s;
+
+    with_ref(&s, &p);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 109.9f, 1), UPLOAD_NONE);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 110.0f, 1), UPLOAD_THRESHOLD);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 90.1f, 1), UPLOAD_NONE);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 90.0f, 1), UPLOAD_THRESHOLD);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 0.0f, 1), UPLOAD_THRESHOLD);
+    expect(c, upload_sched_on_sample(&s, &p, 1, -1.0f, 1), UPLOAD_NONE);    // lectura fallida
+
+    // La referencia es la última subida, no la última muestra
+    upload_sched_done(&s, &p, true, 106.0f, 1);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 112.0f, 1), UPLOAD_NONE);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 116.0f, 1), UPLOAD_THRESHOLD);
+
+    p.level_delta_cm = 0.0f;
+    expect("nivel desactivado", upload_sched_on_sample(&s, &p, 1, 400.0f, 1), UPLOAD_NONE);
+
+    c = "estado";
+    p.level_delta_cm = 10.0f;
+    with_ref(&s, &p);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 100.0f, 2), UPLOAD_STATE);
+    expect(c, upload_sched_on_sample(&s, &p, 1, -1.0f, 0), UPLOAD_STATE);
+    upload_sched_done(&s, &p, true, 100.0f, 2);
+    expect(c, upload_sched_on_sample(&s, &p, 1, 100.0f, 2), UPLOAD_NONE);
+
+    // Precedencia: nivel, estado, lleno, lote
+    c = "precedencia";
+    p.every_n = 2;
+    p.capacity = 2;
+    expect(c, upload_sched_on_sample(&s, &p, 2, 150.0f, 0), UPLOAD_THRESHOLD);
+    expect(c, upload_sched_on_sample(&s, &p, 2, 100.0f, 0), UPLOAD_STATE);
+    expect(c, upload_sched_on_sample(&s, &p, 2, 100.0f, 2), UPLOAD_FULL);
+}
+
+/* Con un disparo permanente, devuelve cuántas muestras pasan sin intentar tras cada fallo */
+static void backoff_gaps(upload_sched_t *s, const upload_policy_t *p, uint32_t *gaps, int n)
+{
+    for (int k = 0; k < n; k++) {
+        upload_sched_done(s, p, false, 100.0f, 1);
+        uint32_t gap = 0;
+        while (upload_sched_on_sample(s, p, p->every_n, 100.0f, 1) == UPLOAD_NONE && gap < 100000) {
+            gap++;
+        }
+        gaps[k] = gap;
+    }
+}
+
+static void test_backoff(void)
+{
+    const char *c = "espera";
+    upload_policy_t p = { .every_n = 10, .capacity = 32, .level_delta_cm = 10.0f, .max_backoff = 10 };
+    upload_sched_t s;
+    uint32_t gaps[8];
+    char msg[96];
+
+    with_ref(&s, &p);
+    backoff_gaps(&s, &p, gaps, 8);
+    const uint32_t want[8] = { 1, 2, 4, 8, 10, 10, 10, 10 };
+    for (int k = 0; k < 8; k++) {
+        snprintf(msg, sizeof(msg), "fallo %d: %" PRIu32 " muestras sin intentar (esperado %" PRIu32 ")", k + 1,
+                 gaps[k], want[k]);
+        check(gaps[k] == want[k], c, msg);
+    }
+    check(s.fail_streak == 8, c, "fallos seguidos");
+
+    // Una subida exitosa reinicia la espera
+    upload_sched_done(&s, &p, true, 100.0f, 1);
+    check(s.fail_streak == 0 && s.retry_in == 0, c, "la subida exitosa no reinició la espera");
+    backoff_gaps(&s, &p, gaps, 3);
+    check(gaps[0] == 1 && gaps[1] == 2 && gaps[2] == 4, c, "la espera no volvió a 1, 2, 4");
+
+    // Durante la espera no dispara nada, ni nivel ni estado ni lleno
+    with_ref(&s, &p);
+    upload_sched_done(&s, &p, false, 100.0f, 1);
+    upload_sched_done(&s, &p, false, 100.0f, 1);
+    expect(c, upload_sched_on_sample(&s, &p, 32, 300.0f, 7), UPLOAD_NONE);
+    expect(c, upload_sched_on_sample(&s, &p, 32, 300.0f, 7), UPLOAD_NONE);
+    expect(c, upload_sched_on_sample(&s, &p, 32, 300.0f, 7), UPLOAD_THRESHOLD);
+
+    // max_backoff 0 cuenta como 1
+    p.max_backoff = 0;
+    with_ref(&s, &p);
+    backoff_gaps(&s, &p, gaps, 4);
+    check(gaps[0] == 1 && gaps[1] == 1 && gaps[2] == 1 && gaps[3] == 1, "espera máxima 0", "no espera 1 muestra");
+
+    // Muchos fallos: la racha satura y la espera queda en 2^15
+    p.max_backoff = UINT16_MAX;
+    with_ref(&s, &p);
+    for (uint32_t k = 0; k < 70000; k++) {
+        upload_sched_done(&s, &p, false, 100.0f, 1);
+    }
+    check(s.fail_streak == UINT16_MAX && s.retry_in == 32768, "saturación", "racha o espera tras 70000 fallos");
+}
+
+static void test_reason_str(void)
+{
+    const char *c = "motivos";
+    for (int a = UPLOAD_NONE; a <= UPLOAD_FULL; a++) {
+        check(upload_reason_str((upload_reason_t)a)[0] != '\0', c, "nombre vacío");
+        for (int b = a + 1; b <= UPLOAD_FULL; b++) {
+            check(strcmp(upload_reason_str((upload_reason_t)a), upload_reason_str((upload_reason_t)b)) != 0, c,
+                  "dos motivos con el mismo nombre");
+        }
+    }
+    check(strcmp(upload_reason_str((upload_reason_t)99), upload_reason_str(UPLOAD_NONE)) == 0, c,
+          "motivo desconocido");
+}
+
+/* ---- Una semana de despertares ---- */
+
+typedef struct {
+    uint32_t period_s;
+    double days;
+    double outage_h;
+} sim_options_t;
+
+/* Nivel de la cisterna: baja 3 cm/h y la bomba la llena a 30 cm/h de 60 a 180 cm */
+static float tank_level(uint32_t period_s, uint32_t wake)
+{
+    static double level = 120.0;
+    static bool filling;
+    static uint32_t last_wake;
+    for (; last_wake < wake; last_wake++) {
+        level += (filling ? 30.0 : -3.0) * period_s / 3600.0;
+        if (level <= 60.0) {
+            filling = true;
+        } else if (level >= 180.0) {
+            filling = false;
+        }
+    }
+    return (float)(level + ((int32_t)(rng() % 101) - 50) / 100.0);
+}
+
+static void simulate(const sim_options_t *o)
+{
+    const char *c = "semana";
+    const upload_policy_t p = {
+        .every_n = DS_UPLOAD_EVERY,
+        .capacity = DS_BUFFER,
+        .level_delta_cm = DS_LEVEL_DELTA,
+        .max_backoff = DS_UPLOAD_EVERY,
+    };
+    upload_sched_t s;
+    upload_sched_init(&s);
+
+    const uint32_t wakes = (uint32_t)(o->days * 86400.0 / o->period_s);
+    const uint32_t down_from = (uint32_t)(34.0 * 3600.0 / o->period_s);           // día 2, 10:00
+    const uint32_t down_to = down_from + (uint32_t)(o->outage_h * 3600.0 / o->period_s);
+
+    uint32_t buf_wake[DS_BUFFER];               // Despertar de cada muestra del buffer
+    uint32_t count = 0, uploaded = 0, dropped = 0, dropped_settled = 0;
+    uint32_t sessions = 0, outage_attempts = 0, recovered_at = 0, max_age = 0;
+    uint32_t by_reason[UPLOAD_FULL + 1] = { 0 };
+    float my_ref_level = -1.0f;
+    int my_ref_state = -1;
+    uint32_t missed_trigger = 0;
+
+    for (uint32_t w = 1; w <= wakes; w++) {
+        bool net_up = w < down_from || w >= down_to;
+        // Lectura: 2 % fallidas; el estado del agua cambia cada 8 h
+        float level = rng() % 100 < 2 ? -1.0f : tank_level(o->period_s, w);
+        uint8_t state = (uint8_t)((w * o->period_s / (8 * 3600)) % 2);
+
+        // Como buffer_append(): con el buffer lleno se descarta la más vieja
+        if (count == DS_BUFFER) {
+            memmove(&buf_wake[0], &buf_wake[1], (DS_BUFFER - 1) * sizeof(buf_wake[0]));
+            count--;
+            dropped++;
+            // Antes del corte o después de recuperarse: nunca debería llenarse
+            dropped_settled += w < down_from || recovered_at != 0;
+        }
+        buf_wake[count++] = w;
+
+        bool settled = s.fail_streak == 0 && s.have_ref;
+        upload_reason_t reason = upload_sched_on_sample(&s, &p, count, level, state);
+
+        // Con la red estable, un cambio de nivel o de estado se sube en el mismo despertar
+        bool level_moved = level >= 0.0f && my_ref_level >= 0.0f && fabsf(level - my_ref_level) >= p.level_delta_cm;
+        if (settled && (level_moved || state != my_ref_state) && reason == UPLOAD_NONE) {
+            missed_trigger++;
+        }
+        if (reason == UPLOAD_NONE) {
+            continue;
+        }
+
+        sessions++;
+        by_reason[reason]++;
+        outage_attempts += !net_up;
+        upload_sched_done(&s, &p, net_up, level, state);
+        if (!net_up) {
+            continue;
+        }
+        uint32_t age = w - buf_wake[0];
+        if (w >= down_to && recovered_at == 0 && w > down_from && down_to > down_from) {
+            recovered_at = w;
+        } else if (age > max_age) {
+            max_age = age;
+        }
+        uploaded += count;
+        count = 0;
+        if (level >= 0.0f) {
+            my_ref_level = level;
+        }
+        my_ref_state = state;
+    }
+
+    double per_day = sessions / o->days;
+    printf("semana: %" PRIu32 " despertares cada %" PRIu32 " s, corte de %.1f h\n", wakes, o->period_s, o->outage_h);
+    printf("  %" PRIu32 " conexiones (%.1f por día): %" PRIu32 " primera, %" PRIu32 " nivel, %" PRIu32 " estado, %"
+           PRIu32 " lote, %" PRIu32 " lleno\n", sessions, per_day, by_reason[UPLOAD_FIRST], by_reason[UPLOAD_THRESHOLD],
+           by_reason[UPLOAD_STATE], by_reason[UPLOAD_COUNT], by_reason[UPLOAD_FULL]);
+    printf("  subidas %" PRIu32 " muestras, descartadas %" PRIu32 ", en el buffer %" PRIu32 "\n", uploaded, dropped,
+           count);
+    printf("  intentos durante el corte: %" PRIu32 ", recuperación %" PRIu32 " despertares tras el corte, "
+           "antigüedad máxima %" PRIu32 " despertares\n", outage_attempts, recovered_at ? recovered_at - down_to : 0,
+           max_age);
+
+    check(uploaded + dropped + count == wakes, c, "muestras perdidas");
+    check(dropped_settled == 0, c, "se descartaron muestras fuera del corte");
+    check(max_age < DS_UPLOAD_EVERY, c, "una muestra esperó más que un lote con la red disponible");
+    check(missed_trigger == 0, c, "un cambio de nivel o estado no se subió en el mismo despertar");
+    check(by_reason[UPLOAD_FIRST] == 1, c, "más de una subida como primera");
+    if (down_to > down_from && down_to < wakes) {
+        // Espera 1, 2, 4, 8 y luego max_backoff: como mucho una conexión cada max_backoff + 1 despertares
+        uint32_t outage_wakes = down_to - down_from;
+        check(outage_attempts <= outage_wakes / (p.max_backoff + 1) + 5, c, "demasiados intentos durante el corte");
+        check(recovered_at != 0 && recovered_at - down_to <= p.max_backoff, c,
+              "la primera subida tras el corte tardó más que la espera máxima");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    sim_options_t opt = { .period_s = 60, .days = 7.0, .outage_h = 6.0 };
+    int c;
+    while ((c = getopt(argc, argv, "d:o:p:s:")) != -1) {
+        switch (c) {
+        case 'd': opt.days = atof(optarg); break;
+        case 'o': opt.outage_h = atof(optarg); break;
+        case 'p': opt.period_s = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "uso: %s [-d días] [-o horas_de_corte] [-p período_s] [-s semilla]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (opt.period_s < 5 || opt.days < 2.0 || opt.outage_h < 0.0 || rng_state == 0) {
+        fprintf(stderr, "período >= 5 s, días >= 2, corte >= 0 h, semilla distinta de 0\n");
+        return 2;
+    }
+
+    test_first();
+    test_count_full();
+    test_threshold_state();
+    test_backoff();
+    test_reason_str();
+    simulate(&opt);
+
+    printf("%s (%d verificaciones, %d fallas)\n", failures ? "FALLA" : "OK", checks, failures);
+    return failures ? 1 : 0;
+}